@@ -43,6 +43,7 @@ struct _EAddressbookModelPrivate {
 
 	/* Query Results */
 	GPtrArray *contacts;
+	GHashTable *uid_index; /* gchar *uid ~> index into contacts */
 
 	/* Signal Handler IDs */
 	gulong create_contact_id;
@@ -91,6 +92,41 @@ free_data (EAddressbookModel *model)
 	array = model->priv->contacts;
 	g_ptr_array_foreach (array, (GFunc) g_object_unref, NULL);
 	g_ptr_array_set_size (array, 0);
+
+	g_hash_table_remove_all (model->priv->uid_index);
+}
+
+static void
+uid_index_insert (EAddressbookModel *model,
+                  EContact *contact,
+                  gint index)
+{
+	const gchar *uid;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (uid == NULL)
+		return;
+
+	g_hash_table_insert (
+		model->priv->uid_index,
+		g_strdup (uid), GINT_TO_POINTER (index));
+}
+
+/* Returns index of the contact with the given UID, or -1 */
+static gint
+uid_index_lookup (EAddressbookModel *model,
+                  const gchar *uid)
+{
+	gpointer value;
+
+	if (uid == NULL)
+		return -1;
+
+	if (!g_hash_table_lookup_extended (
+		model->priv->uid_index, uid, NULL, &value))
+		return -1;
+
+	return GPOINTER_TO_INT (value);
 }
 
 static void
@@ -186,6 +222,7 @@ view_create_contact_cb (EBookClientView *client_view,
 	while (contact_list != NULL) {
 		EContact *contact = contact_list->data;
 
+		uid_index_insert (model, contact, array->len);
 		g_ptr_array_add (array, g_object_ref (contact));
 		contact_list = contact_list->next;
 	}
@@ -209,53 +246,59 @@ view_remove_contact_cb (EBookClientView *client_view,
                         const GSList *ids,
                         EAddressbookModel *model)
 {
-	/* XXX we should keep a hash around instead of this O(n*m) loop */
 	const GSList *iter;
 	GArray *indices;
 	GPtrArray *array;
-	gint ii;
+	guint ii, jj;
 
 	array = model->priv->contacts;
 	indices = g_array_new (FALSE, FALSE, sizeof (gint));
 
 	for (iter = ids; iter != NULL; iter = iter->next) {
 		const gchar *target_uid = iter->data;
+		gint index;
 
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *contact;
-			const gchar *uid;
+		index = uid_index_lookup (model, target_uid);
 
-			contact = array->pdata[ii];
-			/* check if already removed */
-			if (!contact)
-				continue;
+		/* check if not known or already removed */
+		if (index < 0 || array->pdata[index] == NULL)
+			continue;
 
-			uid = e_contact_get_const (contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
+		g_object_unref (array->pdata[index]);
+		array->pdata[index] = NULL;
+		g_array_append_val (indices, index);
 
-			if (strcmp (uid, target_uid) == 0) {
-				g_object_unref (contact);
-				g_array_append_val (indices, ii);
-				array->pdata[ii] = NULL;
-				break;
-			}
-		}
+		g_hash_table_remove (model->priv->uid_index, target_uid);
 	}
 
-	/* Sort the 'indices' array in descending order, since
-	 * g_ptr_array_remove_index() shifts subsequent elements
-	 * down one position to fill the gap. */
-	g_array_sort (indices, sort_descending);
+	if (indices->len == 0) {
+		g_array_free (indices, TRUE);
+		return;
+	}
 
-	for (ii = 0; ii < indices->len; ii++) {
-		gint index;
+	/* Compact the array in one pass, updating the index
+	 * of each contact which moved down to fill the gaps. */
+	for (ii = 0, jj = 0; ii < array->len; ii++) {
+		EContact *contact = array->pdata[ii];
+
+		if (contact == NULL)
+			continue;
 
-		index = g_array_index (indices, gint, ii);
-		g_ptr_array_remove_index (array, index);
+		if (ii != jj) {
+			array->pdata[jj] = contact;
+			uid_index_insert (model, contact, jj);
+		}
+
+		jj++;
 	}
 
+	g_ptr_array_set_size (array, jj);
+
+	/* Listeners expect the indices in descending order. */
+	g_array_sort (indices, sort_descending);
+
 	g_signal_emit (model, signals[CONTACTS_REMOVED], 0, indices);
-	g_array_free (indices, FALSE);
+	g_array_free (indices, TRUE);
 
 	update_folder_bar_message (model);
 }
@@ -283,25 +326,19 @@ view_modify_contact_cb (EBookClientView *client_view,
 			continue;
 		}
 
-		for (ii = 0; ii < array->len; ii++) {
+		ii = uid_index_lookup (model, target_uid);
+
+		if (ii >= 0) {
 			EContact *old_contact;
-			const gchar *uid;
 
 			old_contact = array->pdata[ii];
 			g_return_if_fail (old_contact != NULL);
 
-			uid = e_contact_get_const (old_contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
-
-			if (strcmp (uid, target_uid) != 0)
-				continue;
-
 			g_object_unref (old_contact);
 			array->pdata[ii] = e_contact_duplicate (new_contact);
 
 			g_signal_emit (
 				model, signals[CONTACT_CHANGED], 0, ii);
-			break;
 		}
 
 		contact_list = contact_list->next;
@@ -577,6 +614,7 @@ addressbook_model_finalize (GObject *object)
 	priv = E_ADDRESSBOOK_MODEL_GET_PRIVATE (object);
 
 	g_ptr_array_free (priv->contacts, TRUE);
+	g_hash_table_destroy (priv->uid_index);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_addressbook_model_parent_class)->finalize (object);
@@ -768,6 +806,10 @@ e_addressbook_model_init (EAddressbookModel *model)
 {
 	model->priv = E_ADDRESSBOOK_MODEL_GET_PRIVATE (model);
 	model->priv->contacts = g_ptr_array_new ();
+	model->priv->uid_index = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
 	model->priv->first_get_view = TRUE;
 }
 
@@ -863,16 +905,21 @@ e_addressbook_model_find (EAddressbookModel *model,
                           EContact *contact)
 {
 	GPtrArray *array;
+	const gchar *uid;
 	gint ii;
 
-	/* XXX This searches for a particular EContact instance,
-	 *     as opposed to an equivalent but possibly different
-	 *     EContact instance.  Might have to revise this in
-	 *     the future. */
+	/* This searches for a contact with the same UID, thus also
+	 * finds an equivalent but possibly different EContact instance,
+	 * like the one returned by e_addressbook_model_get_contact().
+	 * Contacts without UID are searched by the instance. */
 
 	g_return_val_if_fail (E_IS_ADDRESSBOOK_MODEL (model), -1);
 	g_return_val_if_fail (E_IS_CONTACT (contact), -1);
 
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (uid != NULL)
+		return uid_index_lookup (model, uid);
+
 	array = model->priv->contacts;
 	for (ii = 0; ii < array->len; ii++) {
 		EContact *candidate = array->pdata[ii];
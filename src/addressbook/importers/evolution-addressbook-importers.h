@@ -18,6 +18,7 @@
  */
 
 #include <gtk/gtk.h>
+#include <libebook/libebook.h>
 
 struct _EImportImporter *evolution_ldif_importer_peek (void);
 struct _EImportImporter *evolution_vcard_importer_peek (void);
@@ -25,5 +26,37 @@ struct _EImportImporter *evolution_csv_outlook_importer_peek (void);
 struct _EImportImporter *evolution_csv_mozilla_importer_peek (void);
 struct _EImportImporter *evolution_csv_evolution_importer_peek (void);
 
-/* private utility function for importers only */
+/* private utility functions for importers only */
 GtkWidget *evolution_contact_importer_get_preview_widget (const GSList *contacts);
+
+typedef struct _EContactImportBatch EContactImportBatch;
+
+/* Called in a dedicated thread; reads contacts and adds them with
+ * evolution_contact_import_batch_add(). Returns FALSE on error. */
+typedef gboolean (*EContactImportFunc) (EContactImportBatch *batch,
+					gpointer user_data,
+					GCancellable *cancellable,
+					GError **error);
+
+/* Called in the import thread with the contacts just added to the book,
+ * with their UID set. */
+typedef void (*EContactImportFlushedFunc) (const GSList *contacts,
+					   gpointer user_data);
+
+void evolution_contact_importer_run (struct _EImport *import,
+				     struct _EImportTarget *target,
+				     ESource *source,
+				     GCancellable *cancellable,
+				     EContactImportFunc func,
+				     gpointer user_data,
+				     GDestroyNotify user_data_free);
+void evolution_contact_import_batch_set_flushed_func (EContactImportBatch *batch,
+						      EContactImportFlushedFunc func,
+						      gpointer user_data);
+gboolean evolution_contact_import_batch_add (EContactImportBatch *batch,
+					     EContact *contact,
+					     GError **error);
+gboolean evolution_contact_import_batch_flush (EContactImportBatch *batch,
+					       GError **error);
+void evolution_contact_import_batch_set_progress (EContactImportBatch *batch,
+						  gint percent);
@@ -46,12 +46,6 @@
 #define TAB_FILE_DELIMITER '\t'
 
 typedef struct {
-	EImport *import;
-	EImportTarget *target;
-
-	guint idle_id;
-
-	gint state;
 	FILE *file;
 	gulong size;
 	gint count;
@@ -59,16 +53,11 @@ typedef struct {
 	/* gint -> gint -- Column index in the CSV
 	 * file to an index in the known fields array. */
 	GHashTable *fields_map;
-
-	EBookClient *book_client;
-	GSList *contacts;
 } CSVImporter;
 
 static gint importer;
 static gchar delimiter;
 
-static void csv_import_done (CSVImporter *gci);
-
 typedef struct {
 	const gchar *csv_attribute;
 	EContactField contact_field;
@@ -717,35 +706,24 @@ getNextCSVEntry (CSVImporter *gci,
 }
 
 static gboolean
-csv_import_contacts (gpointer d)
+csv_import_thread (EContactImportBatch *batch,
+		   gpointer user_data,
+		   GCancellable *cancellable,
+		   GError **error)
 {
-	CSVImporter *gci = d;
-	EContact *contact = NULL;
+	CSVImporter *gci = user_data;
+	EContact *contact;
+	gboolean success = TRUE;
 
-	while ((contact = getNextCSVEntry (gci, gci->file))) {
-		gchar *uid = NULL;
+	while (success && (contact = getNextCSVEntry (gci, gci->file))) {
+		success = evolution_contact_import_batch_add (batch, contact, error);
+		g_object_unref (contact);
 
-		e_book_client_add_contact_sync (
-			gci->book_client, contact, &uid, NULL, NULL);
-		if (uid != NULL) {
-			e_contact_set (contact, E_CONTACT_UID, uid);
-			g_free (uid);
-		}
-		gci->contacts = g_slist_prepend (gci->contacts, contact);
-	}
-	if (contact == NULL) {
-		gci->state = 1;
-	}
-	if (gci->state == 1) {
-		csv_import_done (gci);
-		return FALSE;
-	}
-	else {
-		e_import_status (
-			gci->import, gci->target, _("Importing..."),
-			ftell (gci->file) * 100 / gci->size);
-		return TRUE;
+		if (gci->size > 0)
+			evolution_contact_import_batch_set_progress (batch, ftell (gci->file) * 100 / gci->size);
 	}
+
+	return success;
 }
 
 static void
@@ -860,44 +838,16 @@ csv_supported (EImport *ei,
 }
 
 static void
-csv_import_done (CSVImporter *gci)
+csv_importer_free (CSVImporter *gci)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
-
 	fclose (gci->file);
-	g_object_unref (gci->book_client);
-	g_slist_foreach (gci->contacts, (GFunc) g_object_unref, NULL);
-	g_slist_free (gci->contacts);
 
 	if (gci->fields_map)
 		g_hash_table_destroy (gci->fields_map);
 
-	e_import_complete (gci->import, gci->target, NULL);
-	g_object_unref (gci->import);
-
 	g_free (gci);
 }
 
-static void
-book_client_connect_cb (GObject *source_object,
-                        GAsyncResult *result,
-                        gpointer user_data)
-{
-	CSVImporter *gci = user_data;
-	EClient *client;
-
-	client = e_book_client_connect_finish (result, NULL);
-
-	if (client == NULL) {
-		csv_import_done (gci);
-		return;
-	}
-
-	gci->book_client = E_BOOK_CLIENT (client);
-	gci->idle_id = g_idle_add (csv_import_contacts, gci);
-}
-
 static void
 csv_import (EImport *ei,
             EImportTarget *target,
@@ -905,6 +855,7 @@ csv_import (EImport *ei,
 {
 	CSVImporter *gci;
 	ESource *source;
+	GCancellable *cancellable;
 	gchar *filename;
 	FILE *file;
 	gint errn;
@@ -932,9 +883,6 @@ csv_import (EImport *ei,
 	}
 
 	gci = g_malloc0 (sizeof (*gci));
-	g_datalist_set_data (&target->data, "csv-data", gci);
-	gci->import = g_object_ref (ei);
-	gci->target = target;
 	gci->file = file;
 	gci->fields_map = NULL;
 	gci->count = 0;
@@ -942,9 +890,18 @@ csv_import (EImport *ei,
 	gci->size = ftell (file);
 	fseek (file, 0, SEEK_SET);
 
+	cancellable = g_cancellable_new ();
+	g_datalist_set_data_full (
+		&target->data, "csv-data", g_object_ref (cancellable),
+		(GDestroyNotify) g_object_unref);
+
 	source = g_datalist_get_data (&target->data, "csv-source");
 
-	e_book_client_connect (source, 30, NULL, book_client_connect_cb, gci);
+	evolution_contact_importer_run (
+		ei, target, source, cancellable, csv_import_thread,
+		gci, (GDestroyNotify) csv_importer_free);
+
+	g_object_unref (cancellable);
 }
 
 static void
@@ -979,10 +936,10 @@ csv_cancel (EImport *ei,
             EImportTarget *target,
             EImportImporter *im)
 {
-	CSVImporter *gci = g_datalist_get_data (&target->data, "csv-data");
+	GCancellable *cancellable = g_datalist_get_data (&target->data, "csv-data");
 
-	if (gci)
-		gci->state = 1;
+	if (cancellable)
+		g_cancellable_cancel (cancellable);
 }
 
 static GtkWidget *
@@ -46,26 +46,14 @@
 #include "evolution-addressbook-importers.h"
 
 typedef struct {
-	EImport *import;
-	EImportTarget *target;
-
-	guint idle_id;
-
 	GHashTable *dn_contact_hash;
 
-	gint state;		/* 0 - initial scan, 1 - list cards, 2 - cancelled/complete */
 	FILE *file;
 	gulong size;
 
-	EBookClient *book_client;
-
-	GSList *contacts;
 	GSList *list_contacts;
-	GSList *list_iterator;
 } LDIFImporter;
 
-static void ldif_import_done (LDIFImporter *gci);
-
 static struct {
 	const gchar *ldif_attribute;
 	EContactField contact_field;
@@ -316,7 +304,8 @@ parseLine (GHashTable *dn_contact_hash,
 			if (!g_ascii_strcasecmp (ptr, "dn"))
 				g_hash_table_insert (
 					dn_contact_hash,
-					g_strdup (ldif_value->str), contact);
+					g_strdup (ldif_value->str),
+					g_object_ref (contact));
 			else if (!g_ascii_strcasecmp (ptr, "objectclass") &&
 				!g_ascii_strcasecmp (ldif_value->str, "groupofnames")) {
 				e_contact_set (
@@ -481,73 +470,83 @@ add_to_notes (EContact *contact,
 	g_free (new_text);
 }
 
-static gboolean
-ldif_import_contacts (gpointer d)
+/* Lists need only the identity of their members, thus the members
+ * are shrunk to it, once they are in the book with their UID set. */
+static void
+ldif_contacts_flushed_cb (const GSList *contacts,
+			  gpointer user_data)
 {
-	LDIFImporter *gci = d;
-	EContact *contact;
-	GSList *iter;
-	gint count = 0;
+	const gchar *keep[] = {
+		EVC_UID, EVC_FN, EVC_N, EVC_EMAIL, EVC_X_FILE_AS, EVC_X_LIST
+	};
+	const GSList *link;
 
-	/* We process all normal cards immediately and keep the list
-	 * ones till the end */
+	for (link = contacts; link; link = g_slist_next (link)) {
+		EVCard *vcard = link->data;
+		GList *attrs, *attr;
 
-	if (gci->state == 0) {
-		while (count < 50 && (contact = getNextLDIFEntry (
-			gci->dn_contact_hash, gci->file))) {
-			if (e_contact_get (contact, E_CONTACT_IS_LIST)) {
-				gci->list_contacts = g_slist_prepend (
-					gci->list_contacts, contact);
-			} else {
-				gchar *uid = NULL;
-
-				add_to_notes (contact, E_CONTACT_OFFICE);
-				add_to_notes (contact, E_CONTACT_SPOUSE);
-				add_to_notes (contact, E_CONTACT_BLOG_URL);
-
-				e_book_client_add_contact_sync (
-					gci->book_client,
-					contact, &uid, NULL, NULL);
-				if (uid != NULL) {
-					e_contact_set (contact, E_CONTACT_UID, uid);
-					g_free (uid);
-				}
-				gci->contacts = g_slist_prepend (gci->contacts, contact);
+		attrs = g_list_copy (e_vcard_get_attributes (vcard));
+
+		for (attr = attrs; attr; attr = attr->next) {
+			const gchar *name = e_vcard_attribute_get_name (attr->data);
+			gint ii;
+
+			for (ii = 0; ii < G_N_ELEMENTS (keep); ii++) {
+				if (g_ascii_strcasecmp (name, keep[ii]) == 0)
+					break;
 			}
-			count++;
-		}
-		if (contact == NULL) {
-			gci->state = 1;
-			gci->list_iterator = gci->list_contacts;
+
+			if (ii == G_N_ELEMENTS (keep))
+				e_vcard_remove_attribute (vcard, attr->data);
 		}
+
+		g_list_free (attrs);
 	}
-	if (gci->state == 1) {
-		for (iter = gci->list_iterator; count < 50 && iter; iter = iter->next) {
-			gchar *uid = NULL;
-
-			contact = iter->data;
-			resolve_list_card (gci, contact);
-			e_book_client_add_contact_sync (
-				gci->book_client, contact, &uid, NULL, NULL);
-			if (uid != NULL) {
-				e_contact_set (contact, E_CONTACT_UID, uid);
-				g_free (uid);
-			}
-			count++;
+}
+
+static gboolean
+ldif_import_thread (EContactImportBatch *batch,
+		    gpointer user_data,
+		    GCancellable *cancellable,
+		    GError **error)
+{
+	LDIFImporter *gci = user_data;
+	EContact *contact;
+	GSList *link;
+	gboolean success = TRUE;
+
+	evolution_contact_import_batch_set_flushed_func (batch, ldif_contacts_flushed_cb, NULL);
+
+	/* We add all normal cards as they are read and keep the list
+	 * ones till the end */
+	while (success && (contact = getNextLDIFEntry (gci->dn_contact_hash, gci->file))) {
+		if (e_contact_get (contact, E_CONTACT_IS_LIST)) {
+			gci->list_contacts = g_slist_prepend (gci->list_contacts, contact);
+		} else {
+			add_to_notes (contact, E_CONTACT_OFFICE);
+			add_to_notes (contact, E_CONTACT_SPOUSE);
+			add_to_notes (contact, E_CONTACT_BLOG_URL);
+
+			success = evolution_contact_import_batch_add (batch, contact, error);
+			g_object_unref (contact);
 		}
-		gci->list_iterator = iter;
-		if (iter == NULL)
-			gci->state = 2;
+
+		if (gci->size > 0)
+			evolution_contact_import_batch_set_progress (batch, ftell (gci->file) * 100 / gci->size);
 	}
-	if (gci->state == 2) {
-		ldif_import_done (gci);
-		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing..."),
-			ftell (gci->file) * 100 / gci->size);
-		return TRUE;
+
+	/* The list members need to have their UID set */
+	if (success)
+		success = evolution_contact_import_batch_flush (batch, error);
+
+	for (link = gci->list_contacts; success && link; link = g_slist_next (link)) {
+		contact = link->data;
+
+		resolve_list_card (gci, contact);
+		success = evolution_contact_import_batch_add (batch, contact, error);
 	}
+
+	return success;
 }
 
 static void
@@ -655,44 +654,15 @@ ldif_supported (EImport *ei,
 }
 
 static void
-ldif_import_done (LDIFImporter *gci)
+ldif_importer_free (LDIFImporter *gci)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
-
 	fclose (gci->file);
-	g_object_unref (gci->book_client);
-	g_slist_foreach (gci->contacts, (GFunc) g_object_unref, NULL);
-	g_slist_foreach (gci->list_contacts, (GFunc) g_object_unref, NULL);
-	g_slist_free (gci->contacts);
-	g_slist_free (gci->list_contacts);
+	g_slist_free_full (gci->list_contacts, g_object_unref);
 	g_hash_table_destroy (gci->dn_contact_hash);
 
-	e_import_complete (gci->import, gci->target, NULL);
-	g_object_unref (gci->import);
-
 	g_free (gci);
 }
 
-static void
-book_client_connect_cb (GObject *source_object,
-                        GAsyncResult *result,
-                        gpointer user_data)
-{
-	LDIFImporter *gci = user_data;
-	EClient *client;
-
-	client = e_book_client_connect_finish (result, NULL);
-
-	if (client == NULL) {
-		ldif_import_done (gci);
-		return;
-	}
-
-	gci->book_client = E_BOOK_CLIENT (client);
-	gci->idle_id = g_idle_add (ldif_import_contacts, gci);
-}
-
 static void
 ldif_import (EImport *ei,
              EImportTarget *target,
@@ -700,6 +670,7 @@ ldif_import (EImport *ei,
 {
 	LDIFImporter *gci;
 	ESource *source;
+	GCancellable *cancellable;
 	FILE *file = NULL;
 	EImportTargetURI *s = (EImportTargetURI *) target;
 	gchar *filename;
@@ -722,9 +693,6 @@ ldif_import (EImport *ei,
 	}
 
 	gci = g_malloc0 (sizeof (*gci));
-	g_datalist_set_data (&target->data, "ldif-data", gci);
-	gci->import = g_object_ref (ei);
-	gci->target = target;
 	gci->file = file;
 	fseek (file, 0, SEEK_END);
 	gci->size = ftell (file);
@@ -732,11 +700,20 @@ ldif_import (EImport *ei,
 	gci->dn_contact_hash = g_hash_table_new_full (
 		g_str_hash, g_str_equal,
 		(GDestroyNotify) g_free,
-		(GDestroyNotify) NULL);
+		(GDestroyNotify) g_object_unref);
+
+	cancellable = g_cancellable_new ();
+	g_datalist_set_data_full (
+		&target->data, "ldif-data", g_object_ref (cancellable),
+		(GDestroyNotify) g_object_unref);
 
 	source = g_datalist_get_data (&target->data, "ldif-source");
 
-	e_book_client_connect (source, 30, NULL, book_client_connect_cb, gci);
+	evolution_contact_importer_run (
+		ei, target, source, cancellable, ldif_import_thread,
+		gci, (GDestroyNotify) ldif_importer_free);
+
+	g_object_unref (cancellable);
 }
 
 static void
@@ -744,10 +721,10 @@ ldif_cancel (EImport *ei,
              EImportTarget *target,
              EImportImporter *im)
 {
-	LDIFImporter *gci = g_datalist_get_data (&target->data, "ldif-data");
+	GCancellable *cancellable = g_datalist_get_data (&target->data, "ldif-data");
 
-	if (gci)
-		gci->state = 2;
+	if (cancellable)
+		g_cancellable_cancel (cancellable);
 }
 
 static GtkWidget *
@@ -780,7 +757,7 @@ ldif_get_preview (EImport *ei,
 	dn_contact_hash = g_hash_table_new_full (
 		g_str_hash, g_str_equal,
 		(GDestroyNotify) g_free,
-		(GDestroyNotify) NULL);
+		(GDestroyNotify) g_object_unref);
 
 	while (contact = getNextLDIFEntry (dn_contact_hash, file), contact != NULL) {
 		if (!e_contact_get (contact, E_CONTACT_IS_LIST)) {
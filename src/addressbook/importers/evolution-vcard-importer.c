@@ -50,35 +50,16 @@ enum _VCardEncoding {
 typedef enum _VCardEncoding VCardEncoding;
 
 typedef struct {
-	EImport *import;
-	EImportTarget *target;
-
-	guint idle_id;
-
-	gint state;		/* 0 - importing, 1 - cancelled/complete */
-	gint total;
-	gint count;
-
-	ESource *primary;
-
-	GSList *contactlist;
-	GSList *iterator;
-	EBookClient *book_client;
-
-	/* when opening book */
-	gchar *contents;
-	VCardEncoding encoding;
+	GFileInputStream *file_stream;
+	GDataInputStream *data_stream;
+	goffset size;
 } VCardImporter;
 
-static void vcard_import_done (VCardImporter *gci);
-
 static void
-vcard_import_contact (VCardImporter *gci,
-                      EContact *contact)
+vcard_fixup_contact (EContact *contact)
 {
 	EContactPhoto *photo;
 	GList *attrs, *attr;
-	gchar *uid = NULL;
 
 	/* Apple's addressbook.app exports PHOTO's without a TYPE
 	 * param, so let's figure out the format here if there's a
@@ -211,43 +192,106 @@ vcard_import_contact (VCardImporter *gci,
 								"OTHER");
 		}
 	}
+}
 
-	/* FIXME Error checking */
-	e_book_client_add_contact_sync (
-		gci->book_client, contact, &uid, NULL, NULL);
-	if (uid != NULL) {
-		e_contact_set (contact, E_CONTACT_UID, uid);
-		g_free (uid);
-	}
+static void
+vcard_importer_free (VCardImporter *gci)
+{
+	g_clear_object (&gci->data_stream);
+	g_clear_object (&gci->file_stream);
+	g_slice_free (VCardImporter, gci);
+}
+
+static gboolean
+vcard_import_card (EContactImportBatch *batch,
+		   const gchar *card,
+		   GError **error)
+{
+	EContact *contact;
+	gboolean success;
+
+	contact = e_contact_new_from_vcard (card);
+	vcard_fixup_contact (contact);
+
+	success = evolution_contact_import_batch_add (batch, contact, error);
+
+	g_object_unref (contact);
+
+	return success;
+}
+
+static gboolean
+vcard_is_end_line (const gchar *line)
+{
+	gsize len;
+
+	while (g_ascii_isspace (*line))
+		line++;
+
+	len = strlen (line);
+	while (len > 0 && g_ascii_isspace (line[len - 1]))
+		len--;
+
+	return len == 9 && g_ascii_strncasecmp (line, "END:VCARD", 9) == 0;
 }
 
+/* Splits the stream into vCards line by line, the same way as
+ * eab_contact_list_from_string() does: an END:VCARD line ends
+ * the card only when followed by BEGIN:VCARD or the end of file,
+ * thus nested (AGENT) vCards are preserved. */
 static gboolean
-vcard_import_contacts (gpointer data)
+vcard_import_thread (EContactImportBatch *batch,
+		     gpointer user_data,
+		     GCancellable *cancellable,
+		     GError **error)
 {
-	VCardImporter *gci = data;
-	gint count = 0;
-	GSList *iterator = gci->iterator;
-
-	if (gci->state == 0) {
-		while (count < 50 && iterator) {
-			vcard_import_contact (gci, iterator->data);
-			count++;
-			iterator = iterator->next;
+	VCardImporter *gci = user_data;
+	GString *card = NULL;
+	gboolean card_ended = FALSE;
+	gboolean success = TRUE;
+	gchar *line;
+	GError *local_error = NULL;
+
+	while (success && (line = g_data_input_stream_read_line (gci->data_stream, NULL, cancellable, &local_error)) != NULL) {
+		gboolean is_begin = g_ascii_strncasecmp (line, "BEGIN:VCARD", 11) == 0;
+
+		if (card && card_ended && is_begin) {
+			success = vcard_import_card (batch, card->str, error);
+			g_string_free (card, TRUE);
+			card = NULL;
+
+			if (gci->size > 0) {
+				evolution_contact_import_batch_set_progress (batch,
+					g_seekable_tell (G_SEEKABLE (gci->file_stream)) * 100 / gci->size);
+			}
+		}
+
+		if (!card) {
+			if (is_begin) {
+				card = g_string_new (line);
+				card_ended = FALSE;
+			}
+		} else if (!card_ended || line[strspn (line, " \t")]) {
+			g_string_append_c (card, '\n');
+			g_string_append (card, line);
+			card_ended = vcard_is_end_line (line);
 		}
-		gci->count += count;
-		gci->iterator = iterator;
-		if (iterator == NULL)
-			gci->state = 1;
+
+		g_free (line);
 	}
-	if (gci->state == 1) {
-		vcard_import_done (gci);
-		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing..."),
-			gci->count * 100 / gci->total);
-		return TRUE;
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		success = FALSE;
 	}
+
+	if (success && card && card_ended)
+		success = vcard_import_card (batch, card->str, error);
+
+	if (card)
+		g_string_free (card, TRUE);
+
+	return success;
 }
 
 #define BOM (gunichar2)0xFEFF
@@ -451,65 +495,6 @@ vcard_supported (EImport *ei,
 	return retval;
 }
 
-static void
-vcard_import_done (VCardImporter *gci)
-{
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
-
-	g_free (gci->contents);
-	g_object_unref (gci->book_client);
-	g_slist_free_full (gci->contactlist, (GDestroyNotify) g_object_unref);
-
-	e_import_complete (gci->import, gci->target, NULL);
-	g_object_unref (gci->import);
-	g_free (gci);
-}
-
-static void
-book_client_connect_cb (GObject *source_object,
-                        GAsyncResult *result,
-                        gpointer user_data)
-{
-	VCardImporter *gci = user_data;
-	EClient *client;
-
-	client = e_book_client_connect_finish (result, NULL);
-
-	if (client == NULL) {
-		vcard_import_done (gci);
-		return;
-	}
-
-	gci->book_client = E_BOOK_CLIENT (client);
-
-	if (gci->encoding == VCARD_ENCODING_UTF16) {
-		gchar *tmp;
-
-		gunichar2 *contents_utf16 = (gunichar2 *) gci->contents;
-		tmp = utf16_to_utf8 (contents_utf16);
-		g_free (gci->contents);
-		gci->contents = tmp;
-
-	} else if (gci->encoding == VCARD_ENCODING_LOCALE) {
-		gchar *tmp;
-		tmp = g_locale_to_utf8 (gci->contents, -1, NULL, NULL, NULL);
-		g_free (gci->contents);
-		gci->contents = tmp;
-	}
-
-	gci->contactlist = eab_contact_list_from_string (gci->contents);
-	g_free (gci->contents);
-	gci->contents = NULL;
-	gci->iterator = gci->contactlist;
-	gci->total = g_slist_length (gci->contactlist);
-
-	if (gci->iterator)
-		gci->idle_id = g_idle_add (vcard_import_contacts, gci);
-	else
-		vcard_import_done (gci);
-}
-
 static void
 vcard_import (EImport *ei,
               EImportTarget *target,
@@ -518,8 +503,12 @@ vcard_import (EImport *ei,
 	VCardImporter *gci;
 	ESource *source;
 	EImportTargetURI *s = (EImportTargetURI *) target;
+	GCancellable *cancellable;
+	GFileInputStream *file_stream;
+	GInputStream *input_stream;
+	GFileInfo *info;
+	GFile *file;
 	gchar *filename;
-	gchar *contents;
 	VCardEncoding encoding;
 	GError *error = NULL;
 
@@ -540,25 +529,67 @@ vcard_import (EImport *ei,
 		return;
 	}
 
-	if (!g_file_get_contents (filename, &contents, NULL, &error)) {
-		g_free (filename);
+	file = g_file_new_for_path (filename);
+	g_free (filename);
+
+	file_stream = g_file_read (file, NULL, &error);
+	g_object_unref (file);
+
+	if (!file_stream) {
 		e_import_complete (ei, target, error);
 		g_clear_error (&error);
 
 		return;
 	}
 
-	g_free (filename);
-	gci = g_malloc0 (sizeof (*gci));
-	g_datalist_set_data (&target->data, "vcard-data", gci);
-	gci->import = g_object_ref (ei);
-	gci->target = target;
-	gci->encoding = encoding;
-	gci->contents = contents;
+	gci = g_slice_new0 (VCardImporter);
+	gci->file_stream = file_stream;
+
+	info = g_file_input_stream_query_info (file_stream, G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+	if (info) {
+		gci->size = g_file_info_get_size (info);
+		g_object_unref (info);
+	}
+
+	/* The contents are converted to UTF-8 on the fly */
+	if (encoding == VCARD_ENCODING_UTF16 || encoding == VCARD_ENCODING_LOCALE) {
+		GCharsetConverter *converter;
+		const gchar *charset = "UTF-16";
+
+		if (encoding == VCARD_ENCODING_LOCALE)
+			g_get_charset (&charset);
+
+		converter = g_charset_converter_new ("UTF-8", charset, &error);
+		if (!converter) {
+			vcard_importer_free (gci);
+			e_import_complete (ei, target, error);
+			g_clear_error (&error);
+
+			return;
+		}
+
+		input_stream = g_converter_input_stream_new (G_INPUT_STREAM (file_stream), G_CONVERTER (converter));
+		g_object_unref (converter);
+	} else {
+		input_stream = g_object_ref (file_stream);
+	}
+
+	gci->data_stream = g_data_input_stream_new (input_stream);
+	g_data_input_stream_set_newline_type (gci->data_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+	g_object_unref (input_stream);
+
+	cancellable = g_cancellable_new ();
+	g_datalist_set_data_full (
+		&target->data, "vcard-data", g_object_ref (cancellable),
+		(GDestroyNotify) g_object_unref);
 
 	source = g_datalist_get_data (&target->data, "vcard-source");
 
-	e_book_client_connect (source, 30, NULL, book_client_connect_cb, gci);
+	evolution_contact_importer_run (
+		ei, target, source, cancellable, vcard_import_thread,
+		gci, (GDestroyNotify) vcard_importer_free);
+
+	g_object_unref (cancellable);
 }
 
 static void
@@ -566,10 +597,10 @@ vcard_cancel (EImport *ei,
               EImportTarget *target,
               EImportImporter *im)
 {
-	VCardImporter *gci = g_datalist_get_data (&target->data, "vcard-data");
+	GCancellable *cancellable = g_datalist_get_data (&target->data, "vcard-data");
 
-	if (gci)
-		gci->state = 1;
+	if (cancellable)
+		g_cancellable_cancel (cancellable);
 }
 
 static GtkWidget *
@@ -648,6 +679,298 @@ evolution_vcard_importer_peek (void)
 }
 
 /* utility functions shared between all contact importers */
+
+/* How many contacts are sent to the book at once. */
+#define CONTACT_IMPORT_BATCH_SIZE 500
+
+struct _EContactImportBatch {
+	EImport *import;
+	EImportTarget *target;
+	ESource *source;
+	GCancellable *cancellable;
+
+	EContactImportFunc func;
+	gpointer user_data;
+	GDestroyNotify user_data_free;
+
+	EContactImportFlushedFunc flushed_func;
+	gpointer flushed_data;
+
+	guint status_id;
+	volatile gint percent;
+
+	/* Used only in the import thread */
+	EBookClient *book_client;
+	GSList *contacts; /* EContact *, in reverse order */
+	guint n_contacts;
+};
+
+static void
+contact_import_batch_free (EContactImportBatch *batch)
+{
+	if (batch->status_id)
+		g_source_remove (batch->status_id);
+
+	if (batch->user_data_free)
+		batch->user_data_free (batch->user_data);
+
+	g_slist_free_full (batch->contacts, g_object_unref);
+	g_clear_object (&batch->book_client);
+	g_clear_object (&batch->cancellable);
+	g_clear_object (&batch->source);
+	g_clear_object (&batch->import);
+	g_slice_free (EContactImportBatch, batch);
+}
+
+static gboolean
+contact_import_status_cb (gpointer user_data)
+{
+	EContactImportBatch *batch = user_data;
+
+	e_import_status (
+		batch->import, batch->target, _("Importing..."),
+		g_atomic_int_get (&batch->percent));
+
+	return TRUE;
+}
+
+static void
+contact_import_thread (GTask *task,
+		       gpointer source_object,
+		       gpointer task_data,
+		       GCancellable *cancellable)
+{
+	EContactImportBatch *batch = task_data;
+	EClient *client;
+	GError *local_error = NULL;
+
+	client = e_book_client_connect_sync (batch->source, 30, cancellable, &local_error);
+
+	if (client) {
+		batch->book_client = E_BOOK_CLIENT (client);
+
+		if (batch->func (batch, batch->user_data, cancellable, &local_error))
+			evolution_contact_import_batch_flush (batch, &local_error);
+	}
+
+	if (local_error)
+		g_task_return_error (task, local_error);
+	else
+		g_task_return_boolean (task, TRUE);
+}
+
+static void
+contact_import_done_cb (GObject *source_object,
+			GAsyncResult *result,
+			gpointer user_data)
+{
+	EContactImportBatch *batch = user_data;
+	GError *local_error = NULL;
+
+	g_task_propagate_boolean (G_TASK (result), &local_error);
+
+	/* Cancelled imports complete silently, as they always did. */
+	if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		g_clear_error (&local_error);
+
+	if (batch->status_id) {
+		g_source_remove (batch->status_id);
+		batch->status_id = 0;
+	}
+
+	e_import_complete (batch->import, batch->target, local_error);
+
+	g_clear_error (&local_error);
+	contact_import_batch_free (batch);
+}
+
+/* Connects to the book of the source and calls the func in a dedicated
+ * thread, which parses contacts from a stream and adds them in batches,
+ * thus neither the whole file, nor all its contacts are held in memory.
+ * Completes the import when done; the user_data_free is then called
+ * in the main thread. */
+void
+evolution_contact_importer_run (EImport *import,
+				EImportTarget *target,
+				ESource *source,
+				GCancellable *cancellable,
+				EContactImportFunc func,
+				gpointer user_data,
+				GDestroyNotify user_data_free)
+{
+	EContactImportBatch *batch;
+	GTask *task;
+
+	g_return_if_fail (E_IS_IMPORT (import));
+	g_return_if_fail (target != NULL);
+	g_return_if_fail (E_IS_SOURCE (source));
+	g_return_if_fail (func != NULL);
+
+	batch = g_slice_new0 (EContactImportBatch);
+	batch->import = g_object_ref (import);
+	batch->target = target;
+	batch->source = g_object_ref (source);
+	batch->cancellable = cancellable ? g_object_ref (cancellable) : g_cancellable_new ();
+	batch->func = func;
+	batch->user_data = user_data;
+	batch->user_data_free = user_data_free;
+
+	batch->status_id = e_named_timeout_add (250, contact_import_status_cb, batch);
+
+	task = g_task_new (NULL, batch->cancellable, contact_import_done_cb, batch);
+	g_task_set_source_tag (task, evolution_contact_importer_run);
+	g_task_set_task_data (task, batch, NULL);
+
+	g_task_run_in_thread (task, contact_import_thread);
+
+	g_object_unref (task);
+}
+
+void
+evolution_contact_import_batch_set_flushed_func (EContactImportBatch *batch,
+						 EContactImportFlushedFunc func,
+						 gpointer user_data)
+{
+	g_return_if_fail (batch != NULL);
+
+	batch->flushed_func = func;
+	batch->flushed_data = user_data;
+}
+
+/* Queues the contact to be added; the pending contacts are sent
+ * to the book once there are CONTACT_IMPORT_BATCH_SIZE of them. */
+gboolean
+evolution_contact_import_batch_add (EContactImportBatch *batch,
+				    EContact *contact,
+				    GError **error)
+{
+	g_return_val_if_fail (batch != NULL, FALSE);
+	g_return_val_if_fail (E_IS_CONTACT (contact), FALSE);
+
+	batch->contacts = g_slist_prepend (batch->contacts, g_object_ref (contact));
+	batch->n_contacts++;
+
+	if (batch->n_contacts < CONTACT_IMPORT_BATCH_SIZE)
+		return !g_cancellable_set_error_if_cancelled (batch->cancellable, error);
+
+	return evolution_contact_import_batch_flush (batch, error);
+}
+
+/* Whether the book refused the contacts because of one of them,
+ * not because it cannot add any contact (read-only, offline, ...). */
+static gboolean
+contact_import_error_is_per_contact (const GError *error)
+{
+	return g_error_matches (error, E_BOOK_CLIENT_ERROR, E_BOOK_CLIENT_ERROR_CONTACT_ID_ALREADY_EXISTS) ||
+	       g_error_matches (error, E_CLIENT_ERROR, E_CLIENT_ERROR_INVALID_ARG) ||
+	       g_error_matches (error, E_CLIENT_ERROR, E_CLIENT_ERROR_INVALID_QUERY);
+}
+
+/* Adds the contacts one by one, skipping those the book refuses, thus
+ * one bad contact does not abort the whole import.  Fails on the first
+ * error which is not about the contact itself; the added contacts are
+ * returned in @out_added either way. */
+static gboolean
+contact_import_batch_add_each (EContactImportBatch *batch,
+			       GSList *contacts,
+			       GSList **out_added,
+			       GError **error)
+{
+	GSList *added = NULL, *link;
+	gboolean success = TRUE;
+
+	for (link = contacts; link && success; link = g_slist_next (link)) {
+		EContact *contact = link->data;
+		gchar *uid = NULL;
+		GError *local_error = NULL;
+
+		if (e_book_client_add_contact_sync (batch->book_client, contact, &uid, batch->cancellable, &local_error)) {
+			if (uid)
+				e_contact_set (contact, E_CONTACT_UID, uid);
+
+			added = g_slist_prepend (added, contact);
+		} else if (contact_import_error_is_per_contact (local_error)) {
+			g_warning ("%s: Skipping contact '%s': %s", G_STRFUNC,
+				(const gchar *) e_contact_get_const (contact, E_CONTACT_FILE_AS),
+				local_error->message);
+			g_clear_error (&local_error);
+		} else {
+			g_propagate_error (error, local_error);
+			success = FALSE;
+		}
+
+		g_free (uid);
+	}
+
+	*out_added = g_slist_reverse (added);
+
+	return success;
+}
+
+gboolean
+evolution_contact_import_batch_flush (EContactImportBatch *batch,
+				      GError **error)
+{
+	GSList *contacts, *added_uids = NULL, *link, *uid_link;
+	GError *local_error = NULL;
+	gboolean success;
+
+	g_return_val_if_fail (batch != NULL, FALSE);
+	g_return_val_if_fail (E_IS_BOOK_CLIENT (batch->book_client), FALSE);
+
+	if (!batch->contacts)
+		return TRUE;
+
+	contacts = g_slist_reverse (batch->contacts);
+	batch->contacts = NULL;
+	batch->n_contacts = 0;
+
+	success = e_book_client_add_contacts_sync (
+		batch->book_client, contacts, &added_uids,
+		batch->cancellable, &local_error);
+
+	if (success) {
+		for (link = contacts, uid_link = added_uids; link && uid_link; link = g_slist_next (link), uid_link = g_slist_next (uid_link)) {
+			if (uid_link->data)
+				e_contact_set (link->data, E_CONTACT_UID, uid_link->data);
+		}
+
+		if (batch->flushed_func)
+			batch->flushed_func (contacts, batch->flushed_data);
+	} else if (!contact_import_error_is_per_contact (local_error)) {
+		/* Cancelled, or the book cannot add any contact */
+		g_propagate_error (error, local_error);
+	} else {
+		GSList *added = NULL;
+
+		/* The book adds all the contacts or none of them; find out
+		 * which are refused (e.g. with an existing UID) and skip only
+		 * those. */
+		g_clear_error (&local_error);
+
+		success = contact_import_batch_add_each (batch, contacts, &added, error);
+
+		if (added && batch->flushed_func)
+			batch->flushed_func (added, batch->flushed_data);
+
+		g_slist_free (added);
+	}
+
+	g_slist_free_full (added_uids, g_free);
+	g_slist_free_full (contacts, g_object_unref);
+
+	return success;
+}
+
+void
+evolution_contact_import_batch_set_progress (EContactImportBatch *batch,
+					     gint percent)
+{
+	g_return_if_fail (batch != NULL);
+
+	g_atomic_int_set (&batch->percent, CLAMP (percent, 0, 100));
+}
+
 static void
 preview_contact (EWebViewPreview *preview,
                  EContact *contact)
@@ -907,6 +907,10 @@ query_objects_changed_async (struct _query_msg *msg)
 
 	day_end = time_day_end_with_zone (time (NULL), zone);
 
+	/* A view reports all the objects of a calendar when it is (re)loaded,
+	 * thus queue their alarms in one go. */
+	alarm_freeze ();
+
 	for (l = objects; l != NULL; l = l->next) {
 		ECalComponentId *id;
 		GSList *sl;
@@ -984,6 +988,9 @@ query_objects_changed_async (struct _query_msg *msg)
 		g_object_unref (comp);
 		comp = NULL;
 	}
+
+	alarm_thaw ();
+
 	g_slist_free (objects);
 
 	g_slice_free (struct _query_msg, msg);
@@ -36,8 +36,22 @@
 /* Our glib timeout */
 static guint timeout_id;
 
-/* The list of pending alarms */
-static GList *alarms = NULL;
+/* The pending alarms, as a binary min-heap ordered by the trigger time */
+static GPtrArray *alarms = NULL;
+
+/* All queued AlarmRecord-s, to recognize removed alarms */
+static GHashTable *alarm_records = NULL;
+
+/* Used to keep alarms with the same trigger time in the order of adding */
+static guint64 alarm_sequence = 0;
+
+/* Count of alarm_freeze() calls and whether the heap needs to be rebuilt */
+static guint freeze_count = 0;
+static gboolean heap_dirty = FALSE;
+
+/* Guards all the above; the alarms are added also from other threads than
+ * the main thread.  The alarm callbacks are called without holding it. */
+static GRecMutex alarms_lock;
 
 /* A queued alarm structure */
 typedef struct {
@@ -45,26 +59,151 @@ typedef struct {
 	AlarmFunction      alarm_fn;
 	gpointer           data;
 	AlarmDestroyNotify destroy_notify_fn;
+
+	guint64            sequence;
+	guint              index; /* position in the alarms array */
 } AlarmRecord;
 
 static void setup_timeout (void);
 
+#define ALARM_AT(_index) ((AlarmRecord *) g_ptr_array_index (alarms, (_index)))
+
+/* Compares the trigger times of two AlarmRecord structures */
+static gint
+compare_alarm_by_time (const AlarmRecord *ara,
+                       const AlarmRecord *arb)
+{
+	if (ara->trigger != arb->trigger)
+		return ara->trigger < arb->trigger ? -1 : 1;
+
+	if (ara->sequence != arb->sequence)
+		return ara->sequence < arb->sequence ? -1 : 1;
+
+	return 0;
+}
+
+static void
+heap_set (guint index,
+          AlarmRecord *ar)
+{
+	alarms->pdata[index] = ar;
+	ar->index = index;
+}
+
+static void
+heap_sift_up (guint index)
+{
+	AlarmRecord *ar = ALARM_AT (index);
+
+	while (index > 0) {
+		guint parent = (index - 1) / 2;
+
+		if (compare_alarm_by_time (ALARM_AT (parent), ar) <= 0)
+			break;
+
+		heap_set (index, ALARM_AT (parent));
+		index = parent;
+	}
+
+	heap_set (index, ar);
+}
+
+static void
+heap_sift_down (guint index)
+{
+	AlarmRecord *ar = ALARM_AT (index);
+
+	while (TRUE) {
+		guint child = 2 * index + 1;
+
+		if (child >= alarms->len)
+			break;
+
+		if (child + 1 < alarms->len &&
+		    compare_alarm_by_time (ALARM_AT (child + 1), ALARM_AT (child)) < 0)
+			child++;
+
+		if (compare_alarm_by_time (ar, ALARM_AT (child)) <= 0)
+			break;
+
+		heap_set (index, ALARM_AT (child));
+		index = child;
+	}
+
+	heap_set (index, ar);
+}
+
+/* Restores the heap order after adding alarms while frozen */
+static void
+heap_ensure_order (void)
+{
+	guint ii;
+
+	if (!heap_dirty)
+		return;
+
+	heap_dirty = FALSE;
+
+	if (!alarms)
+		return;
+
+	for (ii = alarms->len / 2; ii > 0; ii--)
+		heap_sift_down (ii - 1);
+}
+
+/* Returns the alarm to trigger first, or NULL when there is none */
+static AlarmRecord *
+peek_alarm (void)
+{
+	if (!alarms)
+		return NULL;
+
+	heap_ensure_order ();
+
+	if (!alarms->len)
+		return NULL;
+
+	return ALARM_AT (0);
+}
+
+/* Removes an alarm from the queue.  Does not free it
+ * nor does it touch the timeout_id. */
+static void
+unqueue_alarm (AlarmRecord *ar)
+{
+	AlarmRecord *last;
+	guint index = ar->index;
+
+	g_hash_table_remove (alarm_records, ar);
+
+	last = g_ptr_array_remove_index (alarms, alarms->len - 1);
+	if (last == ar)
+		return;
+
+	heap_set (index, last);
+
+	if (heap_dirty)
+		return;
+
+	if (index > 0 && compare_alarm_by_time (last, ALARM_AT ((index - 1) / 2)) < 0)
+		heap_sift_up (index);
+	else
+		heap_sift_down (index);
+}
+
 /* Removes the head alarm from the queue.  Does not touch the timeout_id. */
 static void
 pop_alarm (void)
 {
 	AlarmRecord *ar;
-	GList *l;
 
-	if (!alarms) {
+	ar = peek_alarm ();
+	if (!ar) {
 		g_warning ("Nothing to pop from the alarm queue");
 		return;
 	}
 
-	ar = alarms->data;
-
-	l = alarms;
-	alarms = g_list_delete_link (alarms, l);
+	unqueue_alarm (ar);
 
 	g_free (ar);
 }
@@ -75,7 +214,10 @@ alarm_ready_cb (gpointer data)
 {
 	time_t now;
 
-	if (!alarms) {
+	g_rec_mutex_lock (&alarms_lock);
+
+	if (!peek_alarm ()) {
+		g_rec_mutex_unlock (&alarms_lock);
 		g_warning ("Alarm triggered, but no alarm present\n");
 		return FALSE;
 	}
@@ -85,11 +227,11 @@ alarm_ready_cb (gpointer data)
 	now = time (NULL);
 
 	debug (("Alarm callback!"));
-	while (alarms) {
+	while (peek_alarm ()) {
 		AlarmRecord *notify_id, *ar;
 		AlarmRecord ar_copy;
 
-		ar = alarms->data;
+		ar = peek_alarm ();
 
 		if (ar->trigger > now)
 			break;
@@ -104,19 +246,25 @@ alarm_ready_cb (gpointer data)
 		 * that's why we copy it. */
 		pop_alarm ();
 
+		g_rec_mutex_unlock (&alarms_lock);
+
 		(* ar->alarm_fn) (notify_id, ar->trigger, ar->data);
 
 		if (ar->destroy_notify_fn)
 			(* ar->destroy_notify_fn) (notify_id, ar->data);
+
+		g_rec_mutex_lock (&alarms_lock);
 	}
 
 	/* We need this check because one of the alarm_fn above may have
 	 * re-entered and added an alarm of its own, so the timer will
 	 * already be set up.
 	 */
-	if (alarms)
+	if (peek_alarm () && !freeze_count)
 		setup_timeout ();
 
+	g_rec_mutex_unlock (&alarms_lock);
+
 	return FALSE;
 }
 
@@ -130,13 +278,12 @@ setup_timeout (void)
 	guint diff;
 	time_t now;
 
-	if (!alarms) {
+	ar = peek_alarm ();
+	if (!ar) {
 		g_warning ("No alarm to setup\n");
 		return;
 	}
 
-	ar = alarms->data;
-
 	/* Remove the existing time out */
 	if (timeout_id != 0) {
 		g_source_remove (timeout_id);
@@ -157,35 +304,32 @@ setup_timeout (void)
 	timeout_id = e_named_timeout_add_seconds (diff, alarm_ready_cb, NULL);
 }
 
-/* Used from g_list_insert_sorted(); compares the
- * trigger times of two AlarmRecord structures. */
-static gint
-compare_alarm_by_time (gconstpointer a,
-                       gconstpointer b)
-{
-	const AlarmRecord *ara = a;
-	const AlarmRecord *arb = b;
-	time_t diff;
-
-	diff = ara->trigger - arb->trigger;
-	return (diff < 0) ? -1 : (diff > 0) ? 1 : 0;
-}
-
 /* Adds an alarm to the queue and sets up the timer */
 static void
 queue_alarm (AlarmRecord *ar)
 {
-	GList *old_head;
+	if (!alarms) {
+		alarms = g_ptr_array_new ();
+		alarm_records = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+
+	ar->sequence = alarm_sequence++;
+
+	g_ptr_array_add (alarms, ar);
+	ar->index = alarms->len - 1;
 
-	/* Track the current head of the list in case there are changes */
-	old_head = alarms;
+	g_hash_table_add (alarm_records, ar);
 
-	/* Insert the new alarm in order if the alarm's trigger time is
-	 * after the current time */
-	alarms = g_list_insert_sorted (alarms, ar, compare_alarm_by_time);
+	/* The heap is rebuilt at once in alarm_thaw() */
+	if (freeze_count) {
+		heap_dirty = TRUE;
+		return;
+	}
 
-	/* If there first item on the list didn't change, the time out is fine */
-	if (old_head == alarms)
+	heap_sift_up (ar->index);
+
+	/* If the first item in the queue didn't change, the time out is fine */
+	if (ar->index != 0)
 		return;
 
 	/* Set the timer for removal upon activation */
@@ -223,7 +367,9 @@ alarm_add (time_t trigger,
 	ar->data = data;
 	ar->destroy_notify_fn = destroy_notify_fn;
 
+	g_rec_mutex_lock (&alarms_lock);
 	queue_alarm (ar);
+	g_rec_mutex_unlock (&alarms_lock);
 
 	return ar;
 }
@@ -239,40 +385,37 @@ alarm_remove (gpointer alarm)
 {
 	AlarmRecord *notify_id, *ar;
 	AlarmRecord ar_copy;
-	AlarmRecord *old_head;
-	GList *l;
 
 	g_return_if_fail (alarm != NULL);
 
 	ar = alarm;
 
-	l = g_list_find (alarms, ar);
-	if (!l) {
+	g_rec_mutex_lock (&alarms_lock);
+
+	if (!alarm_records || !g_hash_table_contains (alarm_records, ar)) {
+		g_rec_mutex_unlock (&alarms_lock);
 		g_warning (G_STRLOC ": Requested removal of nonexistent alarm!");
 		return;
 	}
 
-	old_head = alarms->data;
-
 	notify_id = ar;
 
-	if (old_head == ar) {
-		ar_copy = *ar;
-		ar = &ar_copy;
+	ar_copy = *ar;
+	ar = &ar_copy;
 
-		/* This will free the original AlarmRecord;
-		 * that's why we copy it. */
-		pop_alarm ();
-	} else {
-		alarms = g_list_delete_link (alarms, l);
-	}
+	/* This will free the original AlarmRecord;
+	 * that's why we copy it. */
+	unqueue_alarm (notify_id);
+	g_free (notify_id);
 
 	/* Reset the timeout */
-	if (!alarms) {
+	if (!alarms->len && timeout_id != 0) {
 		g_source_remove (timeout_id);
 		timeout_id = 0;
 	}
 
+	g_rec_mutex_unlock (&alarms_lock);
+
 	/* Notify about destructiono of the alarm */
 
 	if (ar->destroy_notify_fn)
@@ -280,6 +423,47 @@ alarm_remove (gpointer alarm)
 
 }
 
+/**
+ * alarm_freeze:
+ *
+ * Starts a bulk update of the alarm queue, like when all the alarms
+ * of a calendar are being reloaded.  The alarms added until the matching
+ * alarm_thaw() are only appended to the queue, which is then reordered
+ * at once, and the timer is not touched in the meantime.  Calls can be
+ * nested.
+ **/
+void
+alarm_freeze (void)
+{
+	g_rec_mutex_lock (&alarms_lock);
+	freeze_count++;
+	g_rec_mutex_unlock (&alarms_lock);
+}
+
+/**
+ * alarm_thaw:
+ *
+ * Finishes a bulk update of the alarm queue started with alarm_freeze()
+ * and sets up the timer for the first alarm.
+ **/
+void
+alarm_thaw (void)
+{
+	g_rec_mutex_lock (&alarms_lock);
+
+	if (freeze_count == 0) {
+		g_rec_mutex_unlock (&alarms_lock);
+		g_return_if_reached ();
+	}
+
+	freeze_count--;
+
+	if (!freeze_count && peek_alarm ())
+		setup_timeout ();
+
+	g_rec_mutex_unlock (&alarms_lock);
+}
+
 /**
  * alarm_done:
  *
@@ -289,26 +473,41 @@ alarm_remove (gpointer alarm)
 void
 alarm_done (void)
 {
-	GList *l;
+	GPtrArray *done_alarms;
+	guint ii;
+
+	g_rec_mutex_lock (&alarms_lock);
 
 	if (timeout_id == 0) {
-		if (alarms)
+		if (alarms && alarms->len)
 			g_warning ("No timeout, but queue is not NULL\n");
+		g_rec_mutex_unlock (&alarms_lock);
 		return;
 	}
 
 	g_source_remove (timeout_id);
 	timeout_id = 0;
 
-	if (!alarms) {
+	if (!alarms || !alarms->len) {
 		g_warning ("timeout present, freed, but no alarms active\n");
+		g_rec_mutex_unlock (&alarms_lock);
 		return;
 	}
 
-	for (l = alarms; l; l = l->next) {
+	done_alarms = alarms;
+	alarms = NULL;
+
+	g_hash_table_destroy (alarm_records);
+	alarm_records = NULL;
+
+	heap_dirty = FALSE;
+
+	g_rec_mutex_unlock (&alarms_lock);
+
+	for (ii = 0; ii < done_alarms->len; ii++) {
 		AlarmRecord *ar;
 
-		ar = l->data;
+		ar = g_ptr_array_index (done_alarms, ii);
 
 		if (ar->destroy_notify_fn)
 			(* ar->destroy_notify_fn) (ar, ar->data);
@@ -316,8 +515,7 @@ alarm_done (void)
 		g_free (ar);
 	}
 
-	g_list_free (alarms);
-	alarms = NULL;
+	g_ptr_array_free (done_alarms, TRUE);
 }
 
 /**
@@ -328,6 +526,10 @@ alarm_done (void)
 void
 alarm_reschedule_timeout (void)
 {
-	if (alarms)
+	g_rec_mutex_lock (&alarms_lock);
+
+	if (peek_alarm () && !freeze_count)
 		setup_timeout ();
+
+	g_rec_mutex_unlock (&alarms_lock);
 }
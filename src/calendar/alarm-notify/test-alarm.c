@@ -0,0 +1,155 @@
+/*
+ * Evolution calendar - Stress test of the alarm timer mechanism
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+
+#include "alarm.h"
+
+#define N_ALARMS 100000
+
+typedef struct _TestData {
+	time_t *triggers;
+	gboolean *removed;
+	gint n_fired;
+	gint last_fired;
+	gint n_destroyed;
+} TestData;
+
+static TestData test_data;
+
+static void
+alarm_fired_cb (gpointer alarm_id,
+                time_t trigger,
+                gpointer data)
+{
+	gint index = GPOINTER_TO_INT (data);
+
+	g_assert (!test_data.removed[index]);
+	g_assert_cmpint (test_data.triggers[index], ==, trigger);
+
+	/* Alarms fire by their trigger time, those with the same
+	 * trigger time in the order they had been added. */
+	if (test_data.last_fired != -1) {
+		time_t last_trigger = test_data.triggers[test_data.last_fired];
+
+		g_assert (last_trigger <= trigger);
+		if (last_trigger == trigger)
+			g_assert_cmpint (test_data.last_fired, <, index);
+	}
+
+	test_data.last_fired = index;
+	test_data.n_fired++;
+}
+
+static void
+alarm_destroyed_cb (gpointer alarm_id,
+                    gpointer data)
+{
+	test_data.n_destroyed++;
+}
+
+static void
+run_alarms (gboolean use_freeze)
+{
+	gpointer *ids;
+	GTimer *timer;
+	time_t now;
+	gint ii, n_removed = 0;
+
+	now = time (NULL);
+
+	test_data.triggers = g_new (time_t, N_ALARMS);
+	test_data.removed = g_new0 (gboolean, N_ALARMS);
+	test_data.n_fired = 0;
+	test_data.last_fired = -1;
+	test_data.n_destroyed = 0;
+
+	ids = g_new (gpointer, N_ALARMS);
+
+	timer = g_timer_new ();
+
+	if (use_freeze)
+		alarm_freeze ();
+
+	/* Already due, with plenty of equal trigger times */
+	for (ii = 0; ii < N_ALARMS; ii++) {
+		test_data.triggers[ii] = now - g_test_rand_int_range (0, 1000);
+		ids[ii] = alarm_add (test_data.triggers[ii], alarm_fired_cb, GINT_TO_POINTER (ii), alarm_destroyed_cb);
+		g_assert (ids[ii] != NULL);
+	}
+
+	if (use_freeze)
+		alarm_thaw ();
+
+	for (ii = 0; ii < N_ALARMS; ii++) {
+		if (g_test_rand_int_range (0, 3) == 0) {
+			alarm_remove (ids[ii]);
+			test_data.removed[ii] = TRUE;
+			n_removed++;
+		}
+	}
+
+	g_test_message (
+		"%s %d alarms and removed %d in %f seconds",
+		use_freeze ? "Bulk-added" : "Added",
+		N_ALARMS, n_removed, g_timer_elapsed (timer, NULL));
+
+	g_assert_cmpint (test_data.n_destroyed, ==, n_removed);
+
+	while (test_data.n_fired < N_ALARMS - n_removed)
+		g_main_context_iteration (NULL, TRUE);
+
+	g_test_message (
+		"Fired %d alarms in %f seconds",
+		test_data.n_fired, g_timer_elapsed (timer, NULL));
+
+	g_assert_cmpint (test_data.n_fired, ==, N_ALARMS - n_removed);
+	g_assert_cmpint (test_data.n_destroyed, ==, N_ALARMS);
+
+	g_timer_destroy (timer);
+	g_free (test_data.triggers);
+	g_free (test_data.removed);
+	g_free (ids);
+}
+
+static void
+test_alarm_add_remove (void)
+{
+	run_alarms (FALSE);
+}
+
+static void
+test_alarm_bulk_add_remove (void)
+{
+	run_alarms (TRUE);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/Alarm/AddRemove", test_alarm_add_remove);
+	g_test_add_func ("/Alarm/BulkAddRemove", test_alarm_bulk_add_remove);
+
+	return g_test_run ();
+}
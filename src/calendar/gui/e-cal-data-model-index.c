@@ -0,0 +1,357 @@
+/*
+ * Evolution calendar - Interval index of the components of an ECalDataModel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * SECTION: e-cal-data-model-index
+ * @include: calendar/gui/e-cal-data-model-index.h
+ * @short_description: Find components of an #ECalDataModel by time range
+ *
+ * #ECalDataModelIndex holds (instance start, instance end, data) triples
+ * and finds those which fall into a time range the same way
+ * e_cal_data_model_foreach_component() matches components to a range.
+ *
+ * The entries are kept sorted by their start, which makes the array an
+ * implicit balanced search tree, with the middle of each range being the
+ * root of its subtree.  Each root also remembers the latest end in its
+ * subtree, thus whole subtrees ending before the range are skipped and
+ * the entries starting after the range are cut off by a binary search.
+ *
+ * Entries added after the tree had been built are kept in an unsorted
+ * tail, which is searched linearly and merged into the tree once it
+ * grows too long.  There is no removal, the owner clears the index and
+ * adds the entries again instead.
+ **/
+
+#include "evolution-config.h"
+
+#include "e-cal-data-model-index.h"
+
+/* Merge the unsorted tail into the tree once it is longer than this,
+ * plus a sixteenth of the tree. */
+#define MAX_TAIL_LENGTH 32
+
+typedef struct _IndexEntry IndexEntry;
+
+struct _IndexEntry {
+	time_t start;
+	time_t end;
+	gpointer data;
+};
+
+struct _ECalDataModelIndex {
+	GArray *entries; /* IndexEntry */
+
+	/* How many of the entries are sorted into the tree
+	 * and the latest end in the subtree of each of them. */
+	guint n_sorted;
+	time_t *max_ends;
+
+	/* Searches in progress; the tail is not merged during them,
+	 * which would reorder the entries under their hands. */
+	guint n_walking;
+};
+
+static gint
+cal_data_model_index_compare_entries (gconstpointer ptr1,
+                                      gconstpointer ptr2)
+{
+	const IndexEntry *entry1 = ptr1, *entry2 = ptr2;
+
+	if (entry1->start != entry2->start)
+		return entry1->start < entry2->start ? -1 : 1;
+
+	if (entry1->end != entry2->end)
+		return entry1->end < entry2->end ? -1 : 1;
+
+	return 0;
+}
+
+/* Mirrors the check in e_cal_data_model_foreach_component(). */
+static gboolean
+cal_data_model_index_entry_in_range (const IndexEntry *entry,
+                                     time_t in_range_start,
+                                     time_t in_range_end)
+{
+	return (entry->start < in_range_end && entry->end > in_range_start) ||
+		(entry->start == entry->end && entry->end == in_range_start);
+}
+
+/* Fills max_ends of the subtree in [lo, hi) and returns its latest end. */
+static time_t
+cal_data_model_index_build_subtree (ECalDataModelIndex *index,
+                                    guint lo,
+                                    guint hi)
+{
+	guint mid = lo + (hi - lo) / 2;
+	time_t max_end;
+
+	max_end = g_array_index (index->entries, IndexEntry, mid).end;
+
+	if (lo < mid)
+		max_end = MAX (max_end, cal_data_model_index_build_subtree (index, lo, mid));
+
+	if (mid + 1 < hi)
+		max_end = MAX (max_end, cal_data_model_index_build_subtree (index, mid + 1, hi));
+
+	index->max_ends[mid] = max_end;
+
+	return max_end;
+}
+
+static void
+cal_data_model_index_build (ECalDataModelIndex *index)
+{
+	g_array_sort (index->entries, cal_data_model_index_compare_entries);
+
+	index->n_sorted = index->entries->len;
+	index->max_ends = g_renew (time_t, index->max_ends, MAX (index->n_sorted, 1));
+
+	if (index->n_sorted > 0)
+		cal_data_model_index_build_subtree (index, 0, index->n_sorted);
+}
+
+/* Returns the first sorted entry which starts too late to be in the range;
+ * any entry after it starts too late as well. */
+static guint
+cal_data_model_index_upper_bound (ECalDataModelIndex *index,
+                                  time_t in_range_start,
+                                  time_t in_range_end)
+{
+	guint lo = 0, hi = index->n_sorted;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		const IndexEntry *entry = &g_array_index (index->entries, IndexEntry, mid);
+
+		if (entry->start >= in_range_end && entry->start > in_range_start)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+/* Walks the subtree in [lo, hi), split the same way as when it had been
+ * built, skipping the entries from the @limit on. */
+static gboolean
+cal_data_model_index_walk (ECalDataModelIndex *index,
+                           guint lo,
+                           guint hi,
+                           guint limit,
+                           time_t in_range_start,
+                           time_t in_range_end,
+                           ECalDataModelIndexFunc func,
+                           gpointer user_data)
+{
+	while (lo < hi && lo < limit) {
+		guint mid = lo + (hi - lo) / 2;
+		const IndexEntry *entry;
+
+		/* Nothing in this subtree ends late enough. */
+		if (index->max_ends[mid] < in_range_start)
+			return TRUE;
+
+		if (!cal_data_model_index_walk (index, lo, mid, limit, in_range_start, in_range_end, func, user_data))
+			return FALSE;
+
+		if (mid >= limit)
+			return TRUE;
+
+		entry = &g_array_index (index->entries, IndexEntry, mid);
+
+		if (cal_data_model_index_entry_in_range (entry, in_range_start, in_range_end) &&
+		    !func (entry->data, entry->start, entry->end, user_data))
+			return FALSE;
+
+		lo = mid + 1;
+	}
+
+	return TRUE;
+}
+
+/**
+ * e_cal_data_model_index_new:
+ *
+ * Creates a new, empty #ECalDataModelIndex.
+ *
+ * Returns: (transfer full): a new #ECalDataModelIndex; free it with
+ *    e_cal_data_model_index_free(), when no longer needed
+ *
+ * Since: 3.26
+ **/
+ECalDataModelIndex *
+e_cal_data_model_index_new (void)
+{
+	ECalDataModelIndex *index;
+
+	index = g_slice_new0 (ECalDataModelIndex);
+	index->entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+
+	return index;
+}
+
+/**
+ * e_cal_data_model_index_free:
+ * @index: (nullable): an #ECalDataModelIndex, or %NULL
+ *
+ * Frees @index.  The data of the entries is left untouched.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_data_model_index_free (ECalDataModelIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_array_free (index->entries, TRUE);
+	g_free (index->max_ends);
+
+	g_slice_free (ECalDataModelIndex, index);
+}
+
+/**
+ * e_cal_data_model_index_clear:
+ * @index: an #ECalDataModelIndex
+ *
+ * Removes all entries from @index.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_data_model_index_clear (ECalDataModelIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	g_array_set_size (index->entries, 0);
+	index->n_sorted = 0;
+}
+
+/**
+ * e_cal_data_model_index_add:
+ * @index: an #ECalDataModelIndex
+ * @instance_start: start of the instance
+ * @instance_end: end of the instance
+ * @data: data to pass to the #ECalDataModelIndexFunc for this entry
+ *
+ * Adds a new entry to @index.  The @data is not checked for uniqueness.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_data_model_index_add (ECalDataModelIndex *index,
+                            time_t instance_start,
+                            time_t instance_end,
+                            gpointer data)
+{
+	IndexEntry entry;
+
+	g_return_if_fail (index != NULL);
+
+	entry.start = instance_start;
+	entry.end = instance_end;
+	entry.data = data;
+
+	g_array_append_val (index->entries, entry);
+}
+
+/**
+ * e_cal_data_model_index_get_length:
+ * @index: an #ECalDataModelIndex
+ *
+ * Returns: how many entries @index holds
+ *
+ * Since: 3.26
+ **/
+guint
+e_cal_data_model_index_get_length (ECalDataModelIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return index->entries->len;
+}
+
+/**
+ * e_cal_data_model_index_foreach_in_range:
+ * @index: an #ECalDataModelIndex
+ * @in_range_start: Start of the time range
+ * @in_range_end: End of the time range
+ * @func: an #ECalDataModelIndexFunc to call for each entry in the range
+ * @user_data: user data passed to @func
+ *
+ * Calls @func for each entry of @index which falls into the given time
+ * range, in no particular order, until @func returns %FALSE.  The index
+ * cannot be changed from within @func, though it can be searched.
+ *
+ * Note: A special case when both @in_range_start and @in_range_end are zero
+ *    is treated as a request for all entries.
+ *
+ * Returns: %TRUE when all the entries in the range had been walked,
+ *    %FALSE when @func stopped the walk
+ *
+ * Since: 3.26
+ **/
+gboolean
+e_cal_data_model_index_foreach_in_range (ECalDataModelIndex *index,
+                                         time_t in_range_start,
+                                         time_t in_range_end,
+                                         ECalDataModelIndexFunc func,
+                                         gpointer user_data)
+{
+	gboolean all_range, checked_all = TRUE;
+	guint ii, limit;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+
+	all_range = in_range_start == in_range_end && in_range_start == (time_t) 0;
+
+	if (all_range) {
+		for (ii = 0; ii < index->entries->len; ii++) {
+			const IndexEntry *entry = &g_array_index (index->entries, IndexEntry, ii);
+
+			if (!func (entry->data, entry->start, entry->end, user_data))
+				return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	if (!index->n_walking &&
+	    index->entries->len - index->n_sorted > MAX_TAIL_LENGTH + index->n_sorted / 16)
+		cal_data_model_index_build (index);
+
+	index->n_walking++;
+
+	limit = cal_data_model_index_upper_bound (index, in_range_start, in_range_end);
+
+	checked_all = cal_data_model_index_walk (index, 0, index->n_sorted, limit,
+		in_range_start, in_range_end, func, user_data);
+
+	for (ii = index->n_sorted; checked_all && ii < index->entries->len; ii++) {
+		const IndexEntry *entry = &g_array_index (index->entries, IndexEntry, ii);
+
+		if (cal_data_model_index_entry_in_range (entry, in_range_start, in_range_end) &&
+		    !func (entry->data, entry->start, entry->end, user_data))
+			checked_all = FALSE;
+	}
+
+	index->n_walking--;
+
+	return checked_all;
+}
@@ -0,0 +1,65 @@
+/*
+ * Evolution calendar - Interval index of the components of an ECalDataModel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef E_CAL_DATA_MODEL_INDEX_H
+#define E_CAL_DATA_MODEL_INDEX_H
+
+#include <time.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ECalDataModelIndexFunc:
+ * @data: the data the entry had been added with
+ * @instance_start: start of the instance, as added to the index
+ * @instance_end: end of the instance, as added to the index
+ * @user_data: user data passed to e_cal_data_model_index_foreach_in_range()
+ *
+ * Called for each entry of an #ECalDataModelIndex in the requested range.
+ *
+ * Returns: %TRUE to continue, %FALSE to stop the walk
+ *
+ * Since: 3.26
+ **/
+typedef gboolean (*ECalDataModelIndexFunc)	(gpointer data,
+						 time_t instance_start,
+						 time_t instance_end,
+						 gpointer user_data);
+
+typedef struct _ECalDataModelIndex ECalDataModelIndex;
+
+ECalDataModelIndex *
+		e_cal_data_model_index_new	(void);
+void		e_cal_data_model_index_free	(ECalDataModelIndex *index);
+void		e_cal_data_model_index_clear	(ECalDataModelIndex *index);
+void		e_cal_data_model_index_add	(ECalDataModelIndex *index,
+						 time_t instance_start,
+						 time_t instance_end,
+						 gpointer data);
+guint		e_cal_data_model_index_get_length
+						(ECalDataModelIndex *index);
+gboolean	e_cal_data_model_index_foreach_in_range
+						(ECalDataModelIndex *index,
+						 time_t in_range_start,
+						 time_t in_range_end,
+						 ECalDataModelIndexFunc func,
+						 gpointer user_data);
+
+G_END_DECLS
+
+#endif /* E_CAL_DATA_MODEL_INDEX_H */
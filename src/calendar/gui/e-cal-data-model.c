@@ -23,6 +23,7 @@
 
 #include "comp-util.h"
 #include "e-cal-data-model.h"
+#include "e-cal-data-model-index.h"
 
 #define LOCK_PROPS() g_rec_mutex_lock (&data_model->priv->props_lock)
 #define UNLOCK_PROPS() g_rec_mutex_unlock (&data_model->priv->props_lock)
@@ -87,6 +88,8 @@ typedef struct _ViewData {
 	gulong complete_id;
 
 	GHashTable *components; /* ECalComponentId ~> ComponentData */
+	ECalDataModelIndex *components_index; /* 'components' by their instance time range, with ECalComponentId as data */
+	gboolean components_index_valid;
 	GHashTable *lost_components; /* ECalComponentId ~> ComponentData; when re-running view, valid till 'complete' is received */
 	gboolean received_complete;
 	GSList *to_expand_recurrences; /* icalcomponent */
@@ -201,10 +204,45 @@ view_data_new (ECalClient *client)
 	view_data->components = g_hash_table_new_full (
 		(GHashFunc) e_cal_component_id_hash, (GEqualFunc) e_cal_component_id_equal,
 		(GDestroyNotify) e_cal_component_free_id, component_data_free);
+	view_data->components_index = e_cal_data_model_index_new ();
 
 	return view_data;
 }
 
+/* To be called before any change of the 'components', except of adding
+   a new component; the index is rebuilt on the next search then. The index
+   refers to the keys of the 'components', thus it cannot be used after
+   they are freed. */
+static void
+view_data_components_changed (ViewData *view_data)
+{
+	view_data->components_index_valid = FALSE;
+}
+
+static ECalDataModelIndex *
+view_data_get_components_index (ViewData *view_data)
+{
+	if (!view_data->components_index_valid) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		e_cal_data_model_index_clear (view_data->components_index);
+
+		g_hash_table_iter_init (&iter, view_data->components);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			ComponentData *comp_data = value;
+
+			if (comp_data)
+				e_cal_data_model_index_add (view_data->components_index,
+					comp_data->instance_start, comp_data->instance_end, key);
+		}
+
+		view_data->components_index_valid = TRUE;
+	}
+
+	return view_data->components_index;
+}
+
 static void
 view_data_disconnect_view (ViewData *view_data)
 {
@@ -250,6 +288,7 @@ view_data_unref (gpointer ptr)
 			g_clear_object (&view_data->client);
 			g_clear_object (&view_data->view);
 			g_hash_table_destroy (view_data->components);
+			e_cal_data_model_index_free (view_data->components_index);
 			if (view_data->lost_components)
 				g_hash_table_destroy (view_data->lost_components);
 			g_slist_free_full (view_data->to_expand_recurrences, (GDestroyNotify) icalcomponent_free);
@@ -832,9 +871,16 @@ cal_data_model_process_added_component (ECalDataModel *data_model,
 
 	/* Note: old_comp_data is freed or NULL now */
 
+	if (g_hash_table_contains (view_data->components, id))
+		view_data_components_changed (view_data);
+
 	/* 'id' is stolen by view_data->components */
 	g_hash_table_insert (view_data->components, id, comp_data);
 
+	if (view_data->components_index_valid)
+		e_cal_data_model_index_add (view_data->components_index,
+			comp_data->instance_start, comp_data->instance_end, id);
+
 	if (!comp_data_equal) {
 		if (!old_comp_data)
 			cal_data_model_foreach_subscriber_in_range (data_model, view_data->client,
@@ -971,6 +1017,7 @@ cal_data_model_notify_recurrences_cb (gpointer user_data)
 		}
 
 		if (view_data->is_used && g_hash_table_size (known_instances) > 0) {
+			view_data_components_changed (view_data);
 			cal_data_model_remove_components (data_model, view_data->client, known_instances, view_data->components);
 			g_hash_table_remove_all (known_instances);
 		}
@@ -1347,6 +1394,9 @@ cal_data_model_view_objects_removed (ECalClientView *view,
 					}
 				}
 
+				if (g_hash_table_contains (view_data->components, id))
+					view_data_components_changed (view_data);
+
 				g_hash_table_remove (view_data->components, id);
 				if (view_data->lost_components)
 					g_hash_table_remove (view_data->lost_components, id);
@@ -1584,6 +1634,7 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 		g_hash_table_foreach (view_data->components,
 			cal_data_model_notify_remove_components_cb, &nrc_data);
 
+		view_data_components_changed (view_data);
 		g_hash_table_remove_all (view_data->components);
 		if (view_data->lost_components) {
 			g_hash_table_foreach (view_data->lost_components,
@@ -1610,6 +1661,7 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 			view_data->lost_components = NULL;
 		}
 
+		view_data_components_changed (view_data);
 		view_data->lost_components = view_data->components;
 		view_data->components = g_hash_table_new_full (
 			(GHashFunc) e_cal_component_id_hash, (GEqualFunc) e_cal_component_id_equal,
@@ -1680,6 +1732,7 @@ cal_data_model_remove_client_view (ECalDataModel *data_model,
 
 		g_hash_table_foreach (view_data->components,
 			cal_data_model_notify_remove_components_cb, &nrc_data);
+		view_data_components_changed (view_data);
 		g_hash_table_remove_all (view_data->components);
 
 		if (view_data->lost_components) {
@@ -2488,6 +2541,31 @@ e_cal_data_model_get_components (ECalDataModel *data_model,
 	return g_slist_reverse (components);
 }
 
+typedef struct _ForeachIndexedData {
+	ECalDataModel *data_model;
+	ViewData *view_data;
+	ECalDataModelForeachFunc func;
+	gpointer user_data;
+} ForeachIndexedData;
+
+static gboolean
+cal_data_model_foreach_indexed_cb (gpointer data,
+				   time_t instance_start,
+				   time_t instance_end,
+				   gpointer user_data)
+{
+	ForeachIndexedData *fid = user_data;
+	ECalComponentId *id = data;
+	ComponentData *comp_data;
+
+	comp_data = g_hash_table_lookup (fid->view_data->components, id);
+	if (!comp_data)
+		return TRUE;
+
+	return fid->func (fid->data_model, fid->view_data->client, id, comp_data->component,
+		comp_data->instance_start, comp_data->instance_end, fid->user_data);
+}
+
 static gboolean
 cal_data_model_foreach_component (ECalDataModel *data_model,
 				  time_t in_range_start,
@@ -2516,6 +2594,7 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 	g_hash_table_iter_init (&viter, data_model->priv->views);
 	while (checked_all && g_hash_table_iter_next (&viter, &key, &value)) {
 		ViewData *view_data = value;
+		ForeachIndexedData fid;
 		GHashTableIter citer;
 
 		if (!view_data)
@@ -2523,22 +2602,13 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 
 		view_data_lock (view_data);
 
-		g_hash_table_iter_init (&citer, view_data->components);
-		while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
-			ECalComponentId *id = key;
-			ComponentData *comp_data = value;
+		fid.data_model = data_model;
+		fid.view_data = view_data;
+		fid.func = func;
+		fid.user_data = user_data;
 
-			if (!comp_data)
-				continue;
-
-			if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
-			    (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
-			    (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start)) {
-				if (!func (data_model, view_data->client, id, comp_data->component,
-					   comp_data->instance_start, comp_data->instance_end, user_data))
-					checked_all = FALSE;
-			}
-		}
+		checked_all = e_cal_data_model_index_foreach_in_range (view_data_get_components_index (view_data),
+			in_range_start, in_range_end, cal_data_model_foreach_indexed_cb, &fid);
 
 		if (include_lost_components && view_data->lost_components) {
 			g_hash_table_iter_init (&citer, view_data->lost_components);
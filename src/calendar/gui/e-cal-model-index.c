@@ -0,0 +1,469 @@
+/*
+ * Evolution calendar - Index of the components of an ECalModel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * SECTION: e-cal-model-index
+ * @include: calendar/gui/e-cal-model-index.h
+ * @short_description: Find components of an #ECalModel by their ID
+ *
+ * #ECalModelIndex maps a (client, UID, recurrence ID) triple to the row
+ * of the matching object in a #GPtrArray, which is owned by the caller.
+ * The recurrence ID of each object is computed only once, when the object
+ * is added to the index.
+ *
+ * The owner of the array tells the index about appended and removed
+ * objects.  Each object gets a slot in the order it was appended and
+ * a Fenwick tree counts the objects left in the slots, thus both the
+ * updates and the row of an object cost O(log n), regardless of where
+ * in the array the objects are removed.  Any other change to the array
+ * requires e_cal_model_index_changed(), which rebuilds the index on the
+ * next lookup.
+ **/
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include "e-cal-model-index.h"
+
+typedef struct _IndexEntry IndexEntry;
+
+struct _IndexEntry {
+	gpointer object;
+	gpointer client;
+	gchar *uid;
+	gchar *rid;
+	guint slot;
+};
+
+struct _ECalModelIndex {
+	GPtrArray *objects;
+	ECalModelIndexIdFunc id_func;
+
+	/* object ~> IndexEntry */
+	GHashTable *entries;
+
+	/* UID ~> GPtrArray of IndexEntry */
+	GHashTable *by_uid;
+
+	/* Fenwick tree over the slots, 1-based, and
+	 * whether the slot holds an object, 0-based. */
+	gint *tree;
+	guint8 *occupied;
+	guint n_slots;
+	guint next_slot;
+
+	/* Whether the index reflects the array at all. */
+	gboolean valid;
+};
+
+static void
+index_entry_free (IndexEntry *entry)
+{
+	g_free (entry->uid);
+	g_free (entry->rid);
+
+	g_slice_free (IndexEntry, entry);
+}
+
+static void
+cal_model_index_tree_update (ECalModelIndex *index,
+                             guint slot,
+                             gint delta)
+{
+	guint ii;
+
+	index->occupied[slot] = delta > 0;
+
+	for (ii = slot + 1; ii <= index->n_slots; ii += ii & (-ii))
+		index->tree[ii] += delta;
+}
+
+/* Returns how many slots up to and including @slot are occupied. */
+static gint
+cal_model_index_tree_count (ECalModelIndex *index,
+                            guint slot)
+{
+	gint count = 0;
+	guint ii;
+
+	for (ii = slot + 1; ii > 0; ii -= ii & (-ii))
+		count += index->tree[ii];
+
+	return count;
+}
+
+/* Builds the tree from the occupied slots in linear time. */
+static void
+cal_model_index_tree_build (ECalModelIndex *index)
+{
+	guint ii;
+
+	for (ii = 1; ii <= index->n_slots; ii++)
+		index->tree[ii] = index->occupied[ii - 1];
+
+	for (ii = 1; ii <= index->n_slots; ii++) {
+		guint parent = ii + (ii & (-ii));
+
+		if (parent <= index->n_slots)
+			index->tree[parent] += index->tree[ii];
+	}
+}
+
+static void
+cal_model_index_tree_resize (ECalModelIndex *index,
+                             guint n_slots)
+{
+	index->tree = g_renew (gint, index->tree, n_slots + 1);
+	index->occupied = g_renew (guint8, index->occupied, n_slots);
+
+	if (n_slots > index->n_slots)
+		memset (index->occupied + index->n_slots, 0, n_slots - index->n_slots);
+
+	index->n_slots = n_slots;
+
+	cal_model_index_tree_build (index);
+}
+
+static void
+cal_model_index_add_entry (ECalModelIndex *index,
+                           gpointer object,
+                           guint slot)
+{
+	IndexEntry *entry;
+	GPtrArray *uid_entries;
+	const gchar *uid = NULL;
+
+	entry = g_slice_new0 (IndexEntry);
+	entry->object = object;
+	entry->slot = slot;
+
+	index->id_func (object, &entry->client, &uid, &entry->rid);
+	entry->uid = g_strdup (uid);
+
+	g_hash_table_insert (index->entries, object, entry);
+
+	/* Objects without UID cannot be looked up,
+	 * but their slots are counted all the same. */
+	if (entry->uid == NULL || *entry->uid == '\0')
+		return;
+
+	uid_entries = g_hash_table_lookup (index->by_uid, entry->uid);
+	if (uid_entries == NULL) {
+		uid_entries = g_ptr_array_new ();
+		g_hash_table_insert (
+			index->by_uid,
+			g_strdup (entry->uid), uid_entries);
+	}
+
+	g_ptr_array_add (uid_entries, entry);
+}
+
+static void
+cal_model_index_remove_entry (ECalModelIndex *index,
+                              IndexEntry *entry)
+{
+	if (entry->uid != NULL && *entry->uid != '\0') {
+		GPtrArray *uid_entries;
+
+		uid_entries = g_hash_table_lookup (index->by_uid, entry->uid);
+		if (uid_entries != NULL) {
+			g_ptr_array_remove_fast (uid_entries, entry);
+
+			if (uid_entries->len == 0)
+				g_hash_table_remove (index->by_uid, entry->uid);
+		}
+	}
+
+	/* This frees the entry. */
+	g_hash_table_remove (index->entries, entry->object);
+}
+
+static void
+cal_model_index_rebuild (ECalModelIndex *index)
+{
+	guint ii, n_slots;
+
+	g_hash_table_remove_all (index->by_uid);
+	g_hash_table_remove_all (index->entries);
+
+	/* Leave room for appended objects. */
+	n_slots = MAX (64, index->objects->len * 2);
+
+	g_free (index->occupied);
+	index->occupied = g_new0 (guint8, n_slots);
+	index->n_slots = 0;
+
+	for (ii = 0; ii < index->objects->len; ii++) {
+		cal_model_index_add_entry (index, g_ptr_array_index (index->objects, ii), ii);
+		index->occupied[ii] = 1;
+	}
+
+	index->next_slot = index->objects->len;
+
+	index->tree = g_renew (gint, index->tree, n_slots + 1);
+	index->n_slots = n_slots;
+	cal_model_index_tree_build (index);
+
+	index->valid = TRUE;
+}
+
+/* Returns the row of @entry in the array, or -1 if the array
+ * changed without the index being told about it. */
+static gint
+cal_model_index_get_row (ECalModelIndex *index,
+                         IndexEntry *entry)
+{
+	gint row;
+
+	row = cal_model_index_tree_count (index, entry->slot) - 1;
+
+	if (row < 0 || row >= (gint) index->objects->len ||
+	    g_ptr_array_index (index->objects, row) != entry->object)
+		return -1;
+
+	return row;
+}
+
+/**
+ * e_cal_model_index_new:
+ * @objects: a #GPtrArray to index
+ * @id_func: an #ECalModelIndexIdFunc, to describe the objects in @objects
+ *
+ * Creates a new #ECalModelIndex for @objects.  The array is not referenced,
+ * it should outlive the index.
+ *
+ * Returns: (transfer full): a new #ECalModelIndex; free it with
+ *    e_cal_model_index_free(), when no longer needed
+ *
+ * Since: 3.26
+ **/
+ECalModelIndex *
+e_cal_model_index_new (GPtrArray *objects,
+                       ECalModelIndexIdFunc id_func)
+{
+	ECalModelIndex *index;
+
+	g_return_val_if_fail (objects != NULL, NULL);
+	g_return_val_if_fail (id_func != NULL, NULL);
+
+	index = g_slice_new0 (ECalModelIndex);
+	index->objects = objects;
+	index->id_func = id_func;
+
+	index->entries = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) index_entry_free);
+
+	index->by_uid = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) g_ptr_array_unref);
+
+	return index;
+}
+
+/**
+ * e_cal_model_index_free:
+ * @index: (nullable): an #ECalModelIndex, or %NULL
+ *
+ * Frees @index.  The indexed array is left untouched.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_index_free (ECalModelIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy (index->by_uid);
+	g_hash_table_destroy (index->entries);
+
+	g_free (index->tree);
+	g_free (index->occupied);
+
+	g_slice_free (ECalModelIndex, index);
+}
+
+/**
+ * e_cal_model_index_appended:
+ * @index: an #ECalModelIndex
+ *
+ * Notifies @index that an object had been appended to the end
+ * of the indexed array.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_index_appended (ECalModelIndex *index)
+{
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (index->objects->len > 0);
+
+	if (!index->valid)
+		return;
+
+	if (index->next_slot == index->n_slots) {
+		guint n_objects = g_hash_table_size (index->entries) + 1;
+
+		/* Reclaim the slots of removed objects when they are
+		 * the majority, otherwise make room for more slots. */
+		if (n_objects * 2 < index->n_slots) {
+			cal_model_index_rebuild (index);
+			return;
+		}
+
+		cal_model_index_tree_resize (index, index->n_slots * 2);
+	}
+
+	cal_model_index_add_entry (
+		index, g_ptr_array_index (index->objects, index->objects->len - 1),
+		index->next_slot);
+	cal_model_index_tree_update (index, index->next_slot, 1);
+
+	index->next_slot++;
+}
+
+/**
+ * e_cal_model_index_removed:
+ * @index: an #ECalModelIndex
+ * @object: the removed object
+ * @row: the row @object had in the indexed array
+ *
+ * Notifies @index that @object had been removed from @row
+ * of the indexed array.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_index_removed (ECalModelIndex *index,
+                           gpointer object,
+                           gint row)
+{
+	IndexEntry *entry;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (row >= 0);
+
+	if (!index->valid)
+		return;
+
+	entry = g_hash_table_lookup (index->entries, object);
+	if (entry != NULL) {
+		cal_model_index_tree_update (index, entry->slot, -1);
+		cal_model_index_remove_entry (index, entry);
+	}
+}
+
+/**
+ * e_cal_model_index_changed:
+ * @index: an #ECalModelIndex
+ *
+ * Notifies @index that the indexed array changed other than by appending
+ * or removing single objects.  The index is rebuilt on the next lookup.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_index_changed (ECalModelIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	/* Drop the entries now, the objects might be freed soon. */
+	g_hash_table_remove_all (index->by_uid);
+	g_hash_table_remove_all (index->entries);
+
+	index->valid = FALSE;
+}
+
+/**
+ * e_cal_model_index_lookup:
+ * @index: an #ECalModelIndex
+ * @client: (nullable): a client to match, or %NULL for any client
+ * @uid: a UID to match
+ * @rid: (nullable): a recurrence ID to match, or %NULL or an empty string
+ *    for any recurrence ID
+ *
+ * Finds the first object in the indexed array matching @client, @uid
+ * and @rid.
+ *
+ * Returns: the row of the found object, or -1 when there is none
+ *
+ * Since: 3.26
+ **/
+gint
+e_cal_model_index_lookup (ECalModelIndex *index,
+                          gpointer client,
+                          const gchar *uid,
+                          const gchar *rid)
+{
+	gboolean has_rid;
+	gint attempt;
+
+	g_return_val_if_fail (index != NULL, -1);
+
+	if (uid == NULL || *uid == '\0')
+		return -1;
+
+	/* Objects appended or removed behind the index' back. */
+	if (!index->valid || g_hash_table_size (index->entries) != index->objects->len)
+		cal_model_index_rebuild (index);
+
+	has_rid = rid != NULL && *rid != '\0';
+
+	/* The second attempt is after a rebuild of the index,
+	 * in case the array changed behind its back. */
+	for (attempt = 0; attempt < 2; attempt++) {
+		GPtrArray *uid_entries;
+		gboolean stale = FALSE;
+		gint best_row = -1;
+		guint ii;
+
+		uid_entries = g_hash_table_lookup (index->by_uid, uid);
+
+		for (ii = 0; uid_entries != NULL && ii < uid_entries->len; ii++) {
+			IndexEntry *entry = g_ptr_array_index (uid_entries, ii);
+			gint row;
+
+			if (client != NULL && entry->client != client)
+				continue;
+
+			if (has_rid && g_strcmp0 (entry->rid, rid) != 0)
+				continue;
+
+			row = cal_model_index_get_row (index, entry);
+			if (row < 0) {
+				stale = TRUE;
+				break;
+			}
+
+			if (best_row == -1 || row < best_row)
+				best_row = row;
+		}
+
+		if (!stale)
+			return best_row;
+
+		cal_model_index_rebuild (index);
+	}
+
+	return -1;
+}
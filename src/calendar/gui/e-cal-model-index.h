@@ -0,0 +1,60 @@
+/*
+ * Evolution calendar - Index of the components of an ECalModel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef E_CAL_MODEL_INDEX_H
+#define E_CAL_MODEL_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ECalModelIndexIdFunc:
+ * @object: an object stored in the indexed array
+ * @out_client: (out): return location for the client of @object
+ * @out_uid: (out): return location for the UID of @object, or %NULL
+ * @out_rid: (out) (transfer full): return location for a newly allocated
+ *    recurrence ID of @object, or %NULL when it has none
+ *
+ * Describes @object to an #ECalModelIndex.
+ *
+ * Since: 3.26
+ **/
+typedef void	(*ECalModelIndexIdFunc)		(gpointer object,
+						 gpointer *out_client,
+						 const gchar **out_uid,
+						 gchar **out_rid);
+
+typedef struct _ECalModelIndex ECalModelIndex;
+
+ECalModelIndex *
+		e_cal_model_index_new		(GPtrArray *objects,
+						 ECalModelIndexIdFunc id_func);
+void		e_cal_model_index_free		(ECalModelIndex *index);
+void		e_cal_model_index_appended	(ECalModelIndex *index);
+void		e_cal_model_index_removed	(ECalModelIndex *index,
+						 gpointer object,
+						 gint row);
+void		e_cal_model_index_changed	(ECalModelIndex *index);
+gint		e_cal_model_index_lookup	(ECalModelIndex *index,
+						 gpointer client,
+						 const gchar *uid,
+						 const gchar *rid);
+
+G_END_DECLS
+
+#endif /* E_CAL_MODEL_INDEX_H */
@@ -34,6 +34,7 @@
 #include "comp-util.h"
 #include "e-cal-data-model-subscriber.h"
 #include "e-cal-dialogs.h"
+#include "e-cal-model-index.h"
 #include "e-cal-ops.h"
 #include "itip-utils.h"
 #include "misc.h"
@@ -64,6 +65,9 @@ struct _ECalModelPrivate {
 	/* Array for storing the objects. Each element is of type ECalModelComponent */
 	GPtrArray *objects;
 
+	/* Finds rows in the objects array by client, UID and RID */
+	ECalModelIndex *objects_index;
+
 	icalcomponent_kind kind;
 	icaltimezone *zone;
 
@@ -1221,6 +1225,7 @@ cal_model_finalize (GObject *object)
 		}
 		g_object_unref (comp_data);
 	}
+	e_cal_model_index_free (priv->objects_index);
 	g_ptr_array_free (priv->objects, TRUE);
 
 	/* Chain up to parent's finalize() method. */
@@ -1900,45 +1905,35 @@ cal_model_value_to_string (ETableModel *etm,
 	return g_strdup ("");
 }
 
+static void
+cal_model_component_get_id (gpointer object,
+			    gpointer *out_client,
+			    const gchar **out_uid,
+			    gchar **out_rid)
+{
+	ECalModelComponent *comp_data = object;
+	struct icaltimetype icalrid;
+
+	*out_client = comp_data->client;
+	*out_uid = NULL;
+	*out_rid = NULL;
+
+	if (!comp_data->icalcomp)
+		return;
+
+	*out_uid = icalcomponent_get_uid (comp_data->icalcomp);
+
+	icalrid = icalcomponent_get_recurrenceid (comp_data->icalcomp);
+	if (!icaltime_is_null_time (icalrid))
+		*out_rid = icaltime_as_ical_string_r (icalrid);
+}
+
 static gint
 e_cal_model_get_component_index (ECalModel *model,
 				 ECalClient *client,
 				 const ECalComponentId *id)
 {
-	gint ii;
-
-	for (ii = 0; ii < model->priv->objects->len; ii++) {
-		ECalModelComponent *comp_data = g_ptr_array_index (model->priv->objects, ii);
-
-		if (comp_data) {
-			const gchar *uid;
-			gchar *rid = NULL;
-			struct icaltimetype icalrid;
-			gboolean has_rid = (id->rid && *id->rid);
-
-			uid = icalcomponent_get_uid (comp_data->icalcomp);
-			icalrid = icalcomponent_get_recurrenceid (comp_data->icalcomp);
-			if (!icaltime_is_null_time (icalrid))
-				rid = icaltime_as_ical_string_r (icalrid);
-
-			if (uid && *uid) {
-				if ((!client || comp_data->client == client) && strcmp (id->uid, uid) == 0) {
-					if (has_rid) {
-						if (!(rid && *rid && strcmp (rid, id->rid) == 0)) {
-							g_free (rid);
-							continue;
-						}
-					}
-					g_free (rid);
-					return ii;
-				}
-			}
-
-			g_free (rid);
-		}
-	}
-
-	return -1;
+	return e_cal_model_index_lookup (model->priv->objects_index, client, id->uid, id->rid);
 }
 
 /* We do this check since the calendar items are downloaded from the server
@@ -2004,6 +1999,7 @@ cal_model_data_subscriber_component_added_or_modified (ECalDataModelSubscriber *
 		comp_data->icalcomp = icalcomp;
 		e_cal_model_set_instance_times (comp_data, model->priv->zone);
 		g_ptr_array_add (model->priv->objects, comp_data);
+		e_cal_model_index_appended (model->priv->objects_index);
 
 		e_table_model_row_inserted (table_model, model->priv->objects->len - 1);
 	} else {
@@ -2064,6 +2060,8 @@ e_cal_model_data_subscriber_component_removed (ECalDataModelSubscriber *subscrib
 		return;
 	}
 
+	e_cal_model_index_removed (model->priv->objects_index, comp_data, index);
+
 	link = g_slist_append (NULL, comp_data);
 	g_signal_emit (model, signals[COMPS_DELETED], 0, link);
 
@@ -2633,6 +2631,8 @@ e_cal_model_init (ECalModel *model)
 	model->priv->end = (time_t) -1;
 
 	model->priv->objects = g_ptr_array_new ();
+	model->priv->objects_index = e_cal_model_index_new (
+		model->priv->objects, cal_model_component_get_id);
 	model->priv->kind = ICAL_NO_COMPONENT;
 
 	model->priv->use_24_hour_format = TRUE;
@@ -3624,40 +3624,14 @@ search_by_id_and_client (ECalModelPrivate *priv,
                          ECalClient *client,
                          const ECalComponentId *id)
 {
-	gint i;
+	gint row;
 
-	for (i = 0; i < priv->objects->len; i++) {
-		ECalModelComponent *comp_data = g_ptr_array_index (priv->objects, i);
-
-		if (comp_data) {
-			const gchar *uid;
-			gchar *rid = NULL;
-			struct icaltimetype icalrid;
-			gboolean has_rid = (id->rid && *id->rid);
-
-			uid = icalcomponent_get_uid (comp_data->icalcomp);
-			icalrid = icalcomponent_get_recurrenceid (comp_data->icalcomp);
-			if (!icaltime_is_null_time (icalrid))
-				rid = icaltime_as_ical_string_r (icalrid);
-
-			if (uid && *uid) {
-				if ((!client || comp_data->client == client) && !strcmp (id->uid, uid)) {
-					if (has_rid) {
-						if (!(rid && *rid && !strcmp (rid, id->rid))) {
-							g_free (rid);
-							continue;
-						}
-					}
-					g_free (rid);
-					return comp_data;
-				}
-			}
+	row = e_cal_model_index_lookup (priv->objects_index, client, id->uid, id->rid);
 
-			g_free (rid);
-		}
-	}
+	if (row < 0)
+		return NULL;
 
-	return NULL;
+	return g_ptr_array_index (priv->objects, row);
 }
 
 void
@@ -3678,6 +3652,8 @@ e_cal_model_remove_all_objects (ECalModel *model)
 			continue;
 		}
 
+		e_cal_model_index_removed (model->priv->objects_index, comp_data, index);
+
 		link = g_slist_append (NULL, comp_data);
 		g_signal_emit (model, signals[COMPS_DELETED], 0, link);
 
@@ -4051,6 +4027,11 @@ e_cal_model_generate_instances_sync (ECalModel *model,
 
 /**
  * e_cal_model_get_object_array
+ *
+ * Callers modifying the returned array should call
+ * e_cal_model_object_array_changed(), or for a single added or removed
+ * component e_cal_model_object_array_appended() or
+ * e_cal_model_object_array_removed(), afterwards.
  */
 GPtrArray *
 e_cal_model_get_object_array (ECalModel *model)
@@ -4062,6 +4043,65 @@ e_cal_model_get_object_array (ECalModel *model)
 	return model->priv->objects;
 }
 
+/**
+ * e_cal_model_object_array_changed:
+ * @model: an #ECalModel
+ *
+ * Notifies @model that the array returned by e_cal_model_get_object_array()
+ * had been modified, thus the index used to find components in it needs to
+ * be rebuilt.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_object_array_changed (ECalModel *model)
+{
+	g_return_if_fail (E_IS_CAL_MODEL (model));
+
+	e_cal_model_index_changed (model->priv->objects_index);
+}
+
+/**
+ * e_cal_model_object_array_appended:
+ * @model: an #ECalModel
+ *
+ * Notifies @model that a component had been added at the end of the array
+ * returned by e_cal_model_get_object_array(), thus the index used to find
+ * components in it can add it without being rebuilt.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_object_array_appended (ECalModel *model)
+{
+	g_return_if_fail (E_IS_CAL_MODEL (model));
+
+	e_cal_model_index_appended (model->priv->objects_index);
+}
+
+/**
+ * e_cal_model_object_array_removed:
+ * @model: an #ECalModel
+ * @comp_data: the removed #ECalModelComponent
+ * @pos: the position @comp_data had in the array
+ *
+ * Notifies @model that @comp_data had been removed from @pos of the array
+ * returned by e_cal_model_get_object_array(), thus the index used to find
+ * components in it can drop it without being rebuilt.
+ *
+ * Since: 3.26
+ **/
+void
+e_cal_model_object_array_removed (ECalModel *model,
+                                  ECalModelComponent *comp_data,
+                                  gint pos)
+{
+	g_return_if_fail (E_IS_CAL_MODEL (model));
+	g_return_if_fail (E_IS_CAL_MODEL_COMPONENT (comp_data));
+
+	e_cal_model_index_removed (model->priv->objects_index, comp_data, pos);
+}
+
 void
 e_cal_model_set_instance_times (ECalModelComponent *comp_data,
                                 const icaltimezone *zone)
@@ -373,6 +373,14 @@ void		e_cal_model_generate_instances_sync
 						 ECalRecurInstanceFn cb,
 						 gpointer cb_data);
 GPtrArray *	e_cal_model_get_object_array	(ECalModel *model);
+void		e_cal_model_object_array_changed
+						(ECalModel *model);
+void		e_cal_model_object_array_appended
+						(ECalModel *model);
+void		e_cal_model_object_array_removed
+						(ECalModel *model,
+						 ECalModelComponent *comp_data,
+						 gint pos);
 void		e_cal_model_set_instance_times	(ECalModelComponent *comp_data,
 						 const icaltimezone *zone);
 gboolean	e_cal_model_test_row_editable	(ECalModel *model,
@@ -1666,8 +1666,11 @@ hide_completed_rows_ready (GObject *source_object,
 			e_table_model_pre_change (E_TABLE_MODEL (model));
 			pos = get_position_in_array (
 				comp_objects, comp_data);
-			if (g_ptr_array_remove (comp_objects, comp_data))
+			if (pos >= 0) {
+				g_ptr_array_remove_index (comp_objects, pos);
+				e_cal_model_object_array_removed (model, comp_data, pos);
 				g_object_unref (comp_data);
+			}
 			e_table_model_row_deleted (
 				E_TABLE_MODEL (model), pos);
 			changed = TRUE;
@@ -1749,6 +1752,7 @@ show_completed_rows_ready (GObject *source_object,
 			comp_data->color = NULL;
 
 			g_ptr_array_add (comp_objects, comp_data);
+			e_cal_model_object_array_appended (model);
 			e_table_model_row_inserted (
 				E_TABLE_MODEL (model),
 				comp_objects->len - 1);
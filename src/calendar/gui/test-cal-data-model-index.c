@@ -0,0 +1,350 @@
+/*
+ * Evolution calendar - Tests of ECalDataModelIndex
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+
+#include "e-cal-data-model-index.h"
+
+#define DAY (24 * 60 * 60)
+
+typedef struct _TestInstance {
+	time_t start;
+	time_t end;
+} TestInstance;
+
+/* Mostly short events over a year, some of them all-day, some zero-length
+ * reminders and a few spanning whole months. */
+static void
+random_instance (TestInstance *instance)
+{
+	gint kind = g_test_rand_int_range (0, 10);
+
+	instance->start = (time_t) g_test_rand_int_range (0, 365) * DAY + g_test_rand_int_range (0, 24) * 60 * 60;
+
+	if (kind < 6)
+		instance->end = instance->start + g_test_rand_int_range (1, 8) * 30 * 60;
+	else if (kind < 8)
+		instance->end = instance->start + DAY;
+	else if (kind < 9)
+		instance->end = instance->start;
+	else
+		instance->end = instance->start + g_test_rand_int_range (1, 60) * DAY;
+}
+
+/* How ECalDataModel used to find components, over all of them. */
+static GArray *
+linear_search (GArray *instances,
+               time_t in_range_start,
+               time_t in_range_end)
+{
+	GArray *found;
+	guint ii;
+
+	found = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	for (ii = 0; ii < instances->len; ii++) {
+		TestInstance *instance = &g_array_index (instances, TestInstance, ii);
+
+		if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
+		    (instance->start < in_range_end && instance->end > in_range_start) ||
+		    (instance->start == instance->end && instance->end == in_range_start))
+			g_array_append_val (found, ii);
+	}
+
+	return found;
+}
+
+static gboolean
+gather_found_cb (gpointer data,
+                 time_t instance_start,
+                 time_t instance_end,
+                 gpointer user_data)
+{
+	GArray *found = user_data;
+	guint nth = GPOINTER_TO_UINT (data) - 1;
+
+	g_array_append_val (found, nth);
+
+	return TRUE;
+}
+
+static gint
+compare_uints (gconstpointer ptr1,
+               gconstpointer ptr2)
+{
+	guint val1 = *((const guint *) ptr1), val2 = *((const guint *) ptr2);
+
+	return val1 < val2 ? -1 : val1 > val2 ? 1 : 0;
+}
+
+static GArray *
+index_search (ECalDataModelIndex *index,
+              time_t in_range_start,
+              time_t in_range_end)
+{
+	GArray *found;
+
+	found = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	g_assert (e_cal_data_model_index_foreach_in_range (index, in_range_start, in_range_end, gather_found_cb, found));
+
+	g_array_sort (found, compare_uints);
+
+	return found;
+}
+
+static void
+assert_same_found (GArray *instances,
+                   ECalDataModelIndex *index,
+                   time_t in_range_start,
+                   time_t in_range_end)
+{
+	GArray *expected, *found;
+	guint ii;
+
+	expected = linear_search (instances, in_range_start, in_range_end);
+	found = index_search (index, in_range_start, in_range_end);
+
+	g_assert_cmpuint (found->len, ==, expected->len);
+
+	for (ii = 0; ii < found->len; ii++)
+		g_assert_cmpuint (g_array_index (found, guint, ii), ==, g_array_index (expected, guint, ii));
+
+	g_array_free (expected, TRUE);
+	g_array_free (found, TRUE);
+}
+
+static void
+add_instances (GArray *instances,
+               ECalDataModelIndex *index,
+               guint n_instances)
+{
+	guint ii;
+
+	for (ii = 0; ii < n_instances; ii++) {
+		TestInstance instance;
+
+		random_instance (&instance);
+
+		g_array_append_val (instances, instance);
+		e_cal_data_model_index_add (index, instance.start, instance.end, GUINT_TO_POINTER (instances->len));
+	}
+}
+
+static void
+random_range (time_t *in_range_start,
+              time_t *in_range_end)
+{
+	*in_range_start = (time_t) g_test_rand_int_range (-30, 400) * DAY;
+
+	switch (g_test_rand_int_range (0, 4)) {
+	case 0: /* Day view */
+		*in_range_end = *in_range_start + DAY;
+		break;
+	case 1: /* Week view */
+		*in_range_end = *in_range_start + 7 * DAY;
+		break;
+	case 2: /* Month view */
+		*in_range_end = *in_range_start + 42 * DAY;
+		break;
+	default: /* An instant */
+		*in_range_start += g_test_rand_int_range (0, 24) * 60 * 60;
+		*in_range_end = *in_range_start;
+		break;
+	}
+}
+
+static void
+test_index_matches_linear (void)
+{
+	ECalDataModelIndex *index;
+	GArray *instances;
+	gint round, ii;
+
+	instances = g_array_new (FALSE, FALSE, sizeof (TestInstance));
+	index = e_cal_data_model_index_new ();
+
+	/* Interleave additions with searches, to cover both the tree
+	 * and the unsorted tail, before and after they are merged. */
+	for (round = 0; round < 40; round++) {
+		add_instances (instances, index, g_test_rand_int_range (1, round < 20 ? 20 : 400));
+
+		g_assert_cmpuint (e_cal_data_model_index_get_length (index), ==, instances->len);
+
+		for (ii = 0; ii < 50; ii++) {
+			time_t in_range_start, in_range_end;
+
+			random_range (&in_range_start, &in_range_end);
+			assert_same_found (instances, index, in_range_start, in_range_end);
+		}
+	}
+
+	assert_same_found (instances, index, 0, 0);
+
+	e_cal_data_model_index_clear (index);
+	g_array_set_size (instances, 0);
+
+	g_assert_cmpuint (e_cal_data_model_index_get_length (index), ==, 0);
+	assert_same_found (instances, index, 0, 7 * DAY);
+
+	add_instances (instances, index, 100);
+	assert_same_found (instances, index, 0, 7 * DAY);
+
+	e_cal_data_model_index_free (index);
+	g_array_free (instances, TRUE);
+}
+
+static void
+test_index_bounds (void)
+{
+	ECalDataModelIndex *index;
+	GArray *instances;
+	TestInstance bounds[] = {
+		{ 10, 20 },
+		{ 20, 20 },
+		{ 20, 30 },
+		{ 5, 10 },
+		{ 0, 100 },
+		{ 30, 30 }
+	};
+	guint ii;
+
+	instances = g_array_new (FALSE, FALSE, sizeof (TestInstance));
+	index = e_cal_data_model_index_new ();
+
+	for (ii = 0; ii < G_N_ELEMENTS (bounds); ii++) {
+		g_array_append_val (instances, bounds[ii]);
+		e_cal_data_model_index_add (index, bounds[ii].start, bounds[ii].end, GUINT_TO_POINTER (instances->len));
+	}
+
+	/* Pad the index, so the above do not stay in the unsorted tail. */
+	add_instances (instances, index, 200);
+
+	for (ii = 0; ii < G_N_ELEMENTS (bounds); ii++) {
+		assert_same_found (instances, index, bounds[ii].start, bounds[ii].end);
+		assert_same_found (instances, index, bounds[ii].start, bounds[ii].start);
+		assert_same_found (instances, index, bounds[ii].end, bounds[ii].end);
+		assert_same_found (instances, index, bounds[ii].end, bounds[ii].end + 1);
+		assert_same_found (instances, index, bounds[ii].start - 1, bounds[ii].start);
+	}
+
+	e_cal_data_model_index_free (index);
+	g_array_free (instances, TRUE);
+}
+
+static gboolean
+count_up_to_cb (gpointer data,
+                time_t instance_start,
+                time_t instance_end,
+                gpointer user_data)
+{
+	gint *pcount = user_data;
+
+	(*pcount)--;
+
+	return *pcount > 0;
+}
+
+static void
+test_index_stop (void)
+{
+	ECalDataModelIndex *index;
+	gint ii, count;
+
+	index = e_cal_data_model_index_new ();
+
+	for (ii = 0; ii < 1000; ii++)
+		e_cal_data_model_index_add (index, ii * DAY, ii * DAY + DAY / 2, GINT_TO_POINTER (ii + 1));
+
+	count = 3;
+	g_assert (!e_cal_data_model_index_foreach_in_range (index, 10 * DAY, 20 * DAY, count_up_to_cb, &count));
+	g_assert_cmpint (count, ==, 0);
+
+	count = 11;
+	g_assert (e_cal_data_model_index_foreach_in_range (index, 10 * DAY, 20 * DAY, count_up_to_cb, &count));
+	g_assert_cmpint (count, ==, 1);
+
+	count = 5;
+	g_assert (!e_cal_data_model_index_foreach_in_range (index, 0, 0, count_up_to_cb, &count));
+	g_assert_cmpint (count, ==, 0);
+
+	e_cal_data_model_index_free (index);
+}
+
+static void
+test_index_search (void)
+{
+	ECalDataModelIndex *index;
+	GArray *instances;
+	GTimer *timer;
+	gint n_searches, ii;
+	gdouble linear_elapsed, index_elapsed;
+
+	instances = g_array_new (FALSE, FALSE, sizeof (TestInstance));
+	index = e_cal_data_model_index_new ();
+
+	add_instances (instances, index, g_test_perf () ? 200000 : 20000);
+	n_searches = g_test_perf () ? 2000 : 200;
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < n_searches; ii++) {
+		time_t in_range_start, in_range_end;
+
+		random_range (&in_range_start, &in_range_end);
+		g_array_free (linear_search (instances, in_range_start, in_range_end), TRUE);
+	}
+
+	linear_elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_start (timer);
+
+	for (ii = 0; ii < n_searches; ii++) {
+		time_t in_range_start, in_range_end;
+
+		random_range (&in_range_start, &in_range_end);
+		g_array_free (index_search (index, in_range_start, in_range_end), TRUE);
+	}
+
+	index_elapsed = g_timer_elapsed (timer, NULL);
+
+	g_test_minimized_result (
+		index_elapsed,
+		"Searched %u instances %d times in %f seconds, %f seconds linearly",
+		instances->len, n_searches, index_elapsed, linear_elapsed);
+
+	g_timer_destroy (timer);
+	e_cal_data_model_index_free (index);
+	g_array_free (instances, TRUE);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/ECalDataModelIndex/MatchesLinear", test_index_matches_linear);
+	g_test_add_func ("/ECalDataModelIndex/Bounds", test_index_bounds);
+	g_test_add_func ("/ECalDataModelIndex/Stop", test_index_stop);
+	g_test_add_func ("/ECalDataModelIndex/Search", test_index_search);
+
+	return g_test_run ();
+}
@@ -0,0 +1,279 @@
+/*
+ * Evolution calendar - Replay of ECalDataModel notifications on ECalModelIndex
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+#include <string.h>
+
+#include "e-cal-model-index.h"
+
+#define N_CLIENTS 3
+
+/* Stands for an ECalModelComponent. */
+typedef struct _TestComp {
+	gpointer client;
+	gchar *uid;
+	gchar *rid;
+} TestComp;
+
+typedef enum {
+	NOTIFY_ADDED,
+	NOTIFY_MODIFIED,
+	NOTIFY_REMOVED
+} NotifyKind;
+
+typedef struct _Notification {
+	NotifyKind kind;
+	gpointer client;
+	gchar *uid;
+	gchar *rid;
+} Notification;
+
+static gint clients[N_CLIENTS];
+
+static void
+test_comp_get_id (gpointer object,
+                  gpointer *out_client,
+                  const gchar **out_uid,
+                  gchar **out_rid)
+{
+	TestComp *comp = object;
+
+	*out_client = comp->client;
+	*out_uid = comp->uid;
+	*out_rid = g_strdup (comp->rid);
+}
+
+static void
+test_comp_free (TestComp *comp)
+{
+	g_free (comp->uid);
+	g_free (comp->rid);
+	g_slice_free (TestComp, comp);
+}
+
+/* How ECalModel used to find components, minus the allocations. */
+static gint
+linear_lookup (GPtrArray *objects,
+               gpointer client,
+               const gchar *uid,
+               const gchar *rid)
+{
+	gboolean has_rid = rid && *rid;
+	guint ii;
+
+	for (ii = 0; ii < objects->len; ii++) {
+		TestComp *comp = g_ptr_array_index (objects, ii);
+
+		if (client && comp->client != client)
+			continue;
+
+		if (strcmp (comp->uid, uid) != 0)
+			continue;
+
+		if (has_rid && g_strcmp0 (comp->rid, rid) != 0)
+			continue;
+
+		return ii;
+	}
+
+	return -1;
+}
+
+/* Populates a task list, with a few recurring components, then
+ * modifies and removes random components of it, interleaved with
+ * additions of new components, like a busy shared task list does. */
+static GArray *
+build_notifications (gint n_comps)
+{
+	GArray *notifications;
+	gint ii;
+
+	notifications = g_array_new (FALSE, FALSE, sizeof (Notification));
+
+	for (ii = 0; ii < n_comps + n_comps / 2; ii++) {
+		Notification nt;
+		gint nth;
+
+		nth = ii < n_comps ? ii : g_test_rand_int_range (0, n_comps + n_comps / 2);
+
+		nt.kind = ii < n_comps ? NOTIFY_ADDED : g_test_rand_int_range (NOTIFY_ADDED, NOTIFY_REMOVED + 1);
+		nt.client = &clients[nth % N_CLIENTS];
+		nt.uid = g_strdup_printf ("uid-%d", nth / 4);
+		nt.rid = (nth % 4) == 3 ? g_strdup_printf ("2017%04dT100000Z", nth % 1000) : NULL;
+
+		g_array_append_val (notifications, nt);
+	}
+
+	return notifications;
+}
+
+static void
+free_notifications (GArray *notifications)
+{
+	guint ii;
+
+	for (ii = 0; ii < notifications->len; ii++) {
+		Notification *nt = &g_array_index (notifications, Notification, ii);
+
+		g_free (nt->uid);
+		g_free (nt->rid);
+	}
+
+	g_array_free (notifications, TRUE);
+}
+
+/* Processes the notifications the way ECalModel does. */
+static void
+replay_notifications (GArray *notifications,
+                      gboolean verify)
+{
+	ECalModelIndex *index;
+	GPtrArray *objects;
+	GTimer *timer;
+	guint ii;
+
+	objects = g_ptr_array_new ();
+	index = e_cal_model_index_new (objects, test_comp_get_id);
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < notifications->len; ii++) {
+		Notification *nt = &g_array_index (notifications, Notification, ii);
+		gint row;
+
+		row = e_cal_model_index_lookup (index, nt->client, nt->uid, nt->rid);
+
+		if (verify)
+			g_assert_cmpint (row, ==, linear_lookup (objects, nt->client, nt->uid, nt->rid));
+
+		if (nt->kind == NOTIFY_ADDED && row < 0) {
+			TestComp *comp;
+
+			comp = g_slice_new0 (TestComp);
+			comp->client = nt->client;
+			comp->uid = g_strdup (nt->uid);
+			comp->rid = g_strdup (nt->rid);
+
+			g_ptr_array_add (objects, comp);
+			e_cal_model_index_appended (index);
+
+		} else if (nt->kind == NOTIFY_REMOVED && row >= 0) {
+			TestComp *comp;
+
+			comp = g_ptr_array_remove_index (objects, row);
+			e_cal_model_index_removed (index, comp, row);
+			test_comp_free (comp);
+		}
+	}
+
+	g_timer_stop (timer);
+
+	if (!verify) {
+		g_test_minimized_result (
+			g_timer_elapsed (timer, NULL),
+			"Replayed %u notifications in %f seconds",
+			notifications->len, g_timer_elapsed (timer, NULL));
+	}
+
+	/* Any client, any recurrence. */
+	for (ii = 0; verify && ii < objects->len; ii++) {
+		TestComp *comp = g_ptr_array_index (objects, ii);
+
+		g_assert_cmpint (
+			e_cal_model_index_lookup (index, NULL, comp->uid, NULL), ==,
+			linear_lookup (objects, NULL, comp->uid, NULL));
+	}
+
+	g_timer_destroy (timer);
+	e_cal_model_index_free (index);
+	g_ptr_array_foreach (objects, (GFunc) test_comp_free, NULL);
+	g_ptr_array_unref (objects);
+}
+
+static void
+test_index_matches_linear (void)
+{
+	GArray *notifications;
+
+	notifications = build_notifications (2000);
+	replay_notifications (notifications, TRUE);
+	free_notifications (notifications);
+}
+
+static void
+test_index_changed (void)
+{
+	ECalModelIndex *index;
+	GPtrArray *objects;
+	TestComp *comp;
+	gint ii;
+
+	objects = g_ptr_array_new_with_free_func ((GDestroyNotify) test_comp_free);
+	index = e_cal_model_index_new (objects, test_comp_get_id);
+
+	for (ii = 0; ii < 10; ii++) {
+		comp = g_slice_new0 (TestComp);
+		comp->client = &clients[0];
+		comp->uid = g_strdup_printf ("uid-%d", ii);
+		g_ptr_array_add (objects, comp);
+	}
+
+	/* Appended without telling the index. */
+	g_assert_cmpint (e_cal_model_index_lookup (index, NULL, "uid-9", NULL), ==, 9);
+
+	/* Reordered behind the index' back. */
+	comp = objects->pdata[0];
+	objects->pdata[0] = objects->pdata[9];
+	objects->pdata[9] = comp;
+	e_cal_model_index_changed (index);
+
+	g_assert_cmpint (e_cal_model_index_lookup (index, NULL, "uid-9", NULL), ==, 0);
+	g_assert_cmpint (e_cal_model_index_lookup (index, NULL, "uid-0", NULL), ==, 9);
+	g_assert_cmpint (e_cal_model_index_lookup (index, &clients[1], "uid-0", NULL), ==, -1);
+	g_assert_cmpint (e_cal_model_index_lookup (index, NULL, "uid-0", "20170101T100000Z"), ==, -1);
+	g_assert_cmpint (e_cal_model_index_lookup (index, NULL, "uid-10", NULL), ==, -1);
+
+	e_cal_model_index_free (index);
+	g_ptr_array_unref (objects);
+}
+
+static void
+test_index_replay (void)
+{
+	GArray *notifications;
+
+	notifications = build_notifications (g_test_perf () ? 200000 : 40000);
+	replay_notifications (notifications, FALSE);
+	free_notifications (notifications);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/ECalModelIndex/MatchesLinear", test_index_matches_linear);
+	g_test_add_func ("/ECalModelIndex/Changed", test_index_changed);
+	g_test_add_func ("/ECalModelIndex/Replay", test_index_replay);
+
+	return g_test_run ();
+}
@@ -44,6 +44,10 @@ struct _EContactStorePrivate {
 	gint stamp;
 	EBookQuery *query;
 	GArray *contact_sources;
+
+	/* Offset of the first contact of each source, plus the total count
+	 * of contacts at the end; rebuilt on demand when NULL. */
+	GArray *source_offsets;
 };
 
 /* Signals */
@@ -94,21 +98,37 @@ static gboolean     e_contact_store_iter_parent     (GtkTreeModel       *tree_mo
 						     GtkTreeIter        *iter,
 						     GtkTreeIter        *child);
 
+/* Maps contact UIDs to their index in a contacts array, as it was when
+ * the index was last rebuilt.  Removal shifts the following contacts,
+ * thus the removed indexes are remembered and subtracted on lookup,
+ * until there are enough of them to make a rebuild worth it. */
+typedef struct
+{
+	GHashTable *uids;
+	GArray *removed; /* guint, sorted */
+	gboolean stale;
+}
+ContactIndex;
+
 typedef struct
 {
 	EBookClient *book_client;
 
 	EBookClientView *client_view;
 	GPtrArray *contacts;
+	ContactIndex contacts_index;
 
 	EBookClientView *client_view_pending;
 	GPtrArray *contacts_pending;
+	ContactIndex contacts_pending_index;
 }
 ContactSource;
 
 static void free_contact_ptrarray (GPtrArray *contacts);
 static void clear_contact_source  (EContactStore *contact_store, ContactSource *source);
 static void stop_view             (EContactStore *contact_store, EBookClientView *view);
+static void contact_index_clear   (ContactIndex *index);
+static void invalidate_source_offsets (EContactStore *contact_store);
 
 static void
 contact_store_dispose (GObject *object)
@@ -128,9 +148,11 @@ contact_store_dispose (GObject *object)
 
 		clear_contact_source (E_CONTACT_STORE (object), source);
 		free_contact_ptrarray (source->contacts);
+		contact_index_clear (&source->contacts_index);
 		g_object_unref (source->book_client);
 	}
 	g_array_set_size (priv->contact_sources, 0);
+	invalidate_source_offsets (E_CONTACT_STORE (object));
 
 	if (priv->query != NULL) {
 		e_book_query_unref (priv->query);
@@ -296,10 +318,197 @@ row_changed (EContactStore *contact_store,
 	gtk_tree_path_free (path);
 }
 
+/* -------------------- *
+ * Contact UID indexing *
+ * -------------------- */
+
+static void
+contact_index_init (ContactIndex *index)
+{
+	index->uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	index->removed = g_array_new (FALSE, FALSE, sizeof (guint));
+	index->stale = FALSE;
+}
+
+/* Forgets all the contacts, when the contacts array is being cleared */
+static void
+contact_index_reset (ContactIndex *index)
+{
+	g_hash_table_remove_all (index->uids);
+	g_array_set_size (index->removed, 0);
+	index->stale = FALSE;
+}
+
+static void
+contact_index_clear (ContactIndex *index)
+{
+	if (index->uids) {
+		g_hash_table_destroy (index->uids);
+		index->uids = NULL;
+	}
+
+	if (index->removed) {
+		g_array_free (index->removed, TRUE);
+		index->removed = NULL;
+	}
+
+	index->stale = FALSE;
+}
+
+/* Returns how many of the removed indexes are lower than @value. */
+static guint
+contact_index_count_removed (ContactIndex *index,
+                             guint value)
+{
+	guint lo = 0, hi = index->removed->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (g_array_index (index->removed, guint, mid) < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void
+contact_index_rebuild (ContactIndex *index,
+                       GPtrArray *contacts)
+{
+	guint ii;
+
+	g_hash_table_remove_all (index->uids);
+	g_array_set_size (index->removed, 0);
+	index->stale = FALSE;
+
+	for (ii = 0; ii < contacts->len; ii++) {
+		EContact *contact = g_ptr_array_index (contacts, ii);
+		const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
+
+		if (uid)
+			g_hash_table_insert (index->uids, g_strdup (uid), GUINT_TO_POINTER (ii));
+	}
+}
+
+/* Call after appending the contact at the end of the contacts array */
+static void
+contact_index_add (ContactIndex *index,
+                   GPtrArray *contacts)
+{
+	EContact *contact = g_ptr_array_index (contacts, contacts->len - 1);
+	const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
+
+	/* All the removed indexes precede the new contact. */
+	if (uid)
+		g_hash_table_insert (
+			index->uids, g_strdup (uid),
+			GUINT_TO_POINTER (contacts->len - 1 + index->removed->len));
+}
+
+/* Call before removing the contact at position n from the contacts array */
+static void
+contact_index_remove (ContactIndex *index,
+                      GPtrArray *contacts,
+                      guint n)
+{
+	EContact *contact = g_ptr_array_index (contacts, n);
+	const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
+	gpointer value;
+	guint original;
+
+	if (index->stale)
+		return;
+
+	/* Without the UID the original index is unknown. */
+	if (!uid || !g_hash_table_lookup_extended (index->uids, uid, NULL, &value)) {
+		index->stale = TRUE;
+		return;
+	}
+
+	original = GPOINTER_TO_UINT (value);
+	g_array_insert_val (
+		index->removed,
+		contact_index_count_removed (index, original),
+		original);
+
+	g_hash_table_remove (index->uids, uid);
+}
+
+static gboolean
+contact_index_contains (ContactIndex *index,
+                        GPtrArray *contacts,
+                        const gchar *uid)
+{
+	if (index->stale)
+		contact_index_rebuild (index, contacts);
+
+	return uid && g_hash_table_contains (index->uids, uid);
+}
+
+static gint
+contact_index_lookup (ContactIndex *index,
+                      GPtrArray *contacts,
+                      const gchar *uid)
+{
+	gpointer value;
+	guint original;
+
+	if (index->stale || index->removed->len > 64 + contacts->len / 8)
+		contact_index_rebuild (index, contacts);
+
+	if (!uid || !g_hash_table_lookup_extended (index->uids, uid, NULL, &value))
+		return -1;
+
+	original = GPOINTER_TO_UINT (value);
+
+	return original - contact_index_count_removed (index, original);
+}
+
 /* ---------------------- *
  * Contact source helpers *
  * ---------------------- */
 
+static void
+invalidate_source_offsets (EContactStore *contact_store)
+{
+	if (contact_store->priv->source_offsets) {
+		g_array_free (contact_store->priv->source_offsets, TRUE);
+		contact_store->priv->source_offsets = NULL;
+	}
+}
+
+static GArray *
+get_source_offsets (EContactStore *contact_store)
+{
+	GArray *array;
+	GArray *offsets;
+	gint offset = 0;
+	gint i;
+
+	if (contact_store->priv->source_offsets)
+		return contact_store->priv->source_offsets;
+
+	array = contact_store->priv->contact_sources;
+	offsets = g_array_sized_new (FALSE, FALSE, sizeof (gint), array->len + 1);
+
+	for (i = 0; i < array->len; i++) {
+		ContactSource *source;
+
+		source = &g_array_index (array, ContactSource, i);
+		g_array_append_val (offsets, offset);
+		offset += source->contacts->len;
+	}
+
+	g_array_append_val (offsets, offset);
+
+	contact_store->priv->source_offsets = offsets;
+
+	return offsets;
+}
+
 static gint
 find_contact_source_by_client (EContactStore *contact_store,
                                EBookClient *book_client)
@@ -345,22 +554,29 @@ static gint
 find_contact_source_by_offset (EContactStore *contact_store,
                                gint offset)
 {
-	GArray *array;
-	gint i;
+	GArray *offsets;
+	gint lo, hi;
 
-	array = contact_store->priv->contact_sources;
+	offsets = get_source_offsets (contact_store);
 
-	for (i = 0; i < array->len; i++) {
-		ContactSource *source;
+	if (offset < 0 || offset >= g_array_index (offsets, gint, offsets->len - 1))
+		return -1;
 
-		source = &g_array_index (array, ContactSource, i);
-		if (source->contacts->len > offset)
-			return i;
+	/* Find the last source starting at or before the offset;
+	 * empty sources share their start with the next one. */
+	lo = 0;
+	hi = offsets->len - 2;
+
+	while (lo < hi) {
+		gint mid = lo + (hi - lo + 1) / 2;
 
-		offset -= source->contacts->len;
+		if (g_array_index (offsets, gint, mid) <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
 
-	return -1;
+	return lo;
 }
 
 static gint
@@ -384,113 +600,23 @@ static gint
 get_contact_source_offset (EContactStore *contact_store,
                            gint contact_source_index)
 {
-	GArray *array;
-	gint offset = 0;
-	gint i;
-
-	array = contact_store->priv->contact_sources;
-
-	g_return_val_if_fail (contact_source_index < array->len, 0);
+	GArray *offsets;
 
-	for (i = 0; i < contact_source_index; i++) {
-		ContactSource *source;
+	offsets = get_source_offsets (contact_store);
 
-		source = &g_array_index (array, ContactSource, i);
-		offset += source->contacts->len;
-	}
+	g_return_val_if_fail (contact_source_index < offsets->len - 1, 0);
 
-	return offset;
+	return g_array_index (offsets, gint, contact_source_index);
 }
 
 static gint
 count_contacts (EContactStore *contact_store)
 {
-	GArray *array;
-	gint count = 0;
-	gint i;
-
-	array = contact_store->priv->contact_sources;
+	GArray *offsets;
 
-	for (i = 0; i < array->len; i++) {
-		ContactSource *source;
+	offsets = get_source_offsets (contact_store);
 
-		source = &g_array_index (array, ContactSource, i);
-		count += source->contacts->len;
-	}
-
-	return count;
-}
-
-static gint
-find_contact_by_view_and_uid (EContactStore *contact_store,
-                              EBookClientView *find_view,
-                              const gchar *find_uid)
-{
-	GArray *array;
-	ContactSource *source;
-	GPtrArray *contacts;
-	gint source_index;
-	gint i;
-
-	g_return_val_if_fail (find_uid != NULL, -1);
-
-	source_index = find_contact_source_by_view (contact_store, find_view);
-	if (source_index < 0)
-		return -1;
-
-	array = contact_store->priv->contact_sources;
-	source = &g_array_index (array, ContactSource, source_index);
-
-	if (find_view == source->client_view)
-		contacts = source->contacts;          /* Current view */
-	else
-		contacts = source->contacts_pending;  /* Pending view */
-
-	for (i = 0; i < contacts->len; i++) {
-		EContact    *contact = g_ptr_array_index (contacts, i);
-		const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
-
-		if (uid && !strcmp (find_uid, uid))
-			return i;
-	}
-
-	return -1;
-}
-
-static GHashTable *
-get_contact_hash (EContactStore *contact_store,
-                  EBookClientView *find_view)
-{
-	GArray *array;
-	ContactSource *source;
-	GPtrArray *contacts;
-	gint source_index;
-	gint ii;
-	GHashTable *hash;
-
-	source_index = find_contact_source_by_view (contact_store, find_view);
-	if (source_index < 0)
-		return NULL;
-
-	array = contact_store->priv->contact_sources;
-	source = &g_array_index (array, ContactSource, source_index);
-
-	if (find_view == source->client_view)
-		contacts = source->contacts;          /* Current view */
-	else
-		contacts = source->contacts_pending;  /* Pending view */
-
-	hash = g_hash_table_new (g_str_hash, g_str_equal);
-
-	for (ii = 0; ii < contacts->len; ii++) {
-		EContact *contact = g_ptr_array_index (contacts, ii);
-		const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
-
-		if (uid)
-			g_hash_table_insert (hash, (gpointer) uid, GINT_TO_POINTER (ii));
-	}
-
-	return hash;
+	return g_array_index (offsets, gint, offsets->len - 1);
 }
 
 static gint
@@ -506,13 +632,9 @@ find_contact_by_uid (EContactStore *contact_store,
 		ContactSource *source = &g_array_index (array, ContactSource, i);
 		gint           j;
 
-		for (j = 0; j < source->contacts->len; j++) {
-			EContact    *contact = g_ptr_array_index (source->contacts, j);
-			const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
-
-			if (!strcmp (find_uid, uid))
-				return get_contact_source_offset (contact_store, i) + j;
-		}
+		j = contact_index_lookup (&source->contacts_index, source->contacts, find_uid);
+		if (j >= 0)
+			return get_contact_source_offset (contact_store, i) + j;
 	}
 
 	return -1;
@@ -579,72 +701,76 @@ find_contact_source_details_by_view (EContactStore *contact_store,
 	return TRUE;
 }
 
-/* ------------------------- *
- * EBookView signal handlers *
- * ------------------------- */
+/* ------------------------------ *
+ * Contact source change handling *
+ * ------------------------------ */
+
+/* These apply the changes reported by the current or pending view
+ * of a source to its contacts; the view itself is not used. */
 
 static void
-view_contacts_added (EContactStore *contact_store,
-                     const GSList *contacts,
-                     EBookClientView *client_view)
+contact_source_add_contacts (EContactStore *contact_store,
+                             ContactSource *source,
+                             gint offset,
+                             gboolean pending,
+                             const GSList *contacts)
 {
-	ContactSource *source;
-	gint           offset;
-	const GSList  *l;
-
-	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
-		g_warning ("EContactStore got 'contacts_added' signal from unknown EBookView!");
-		return;
-	}
+	const GSList *l;
 
 	for (l = contacts; l; l = g_slist_next (l)) {
 		EContact *contact = l->data;
 
 		g_object_ref (contact);
 
-		if (client_view == source->client_view) {
+		if (!pending) {
 			/* Current view */
 			g_ptr_array_add (source->contacts, contact);
+			contact_index_add (&source->contacts_index, source->contacts);
+			invalidate_source_offsets (contact_store);
 			row_inserted (contact_store, offset + source->contacts->len - 1);
 		} else {
 			/* Pending view */
 			g_ptr_array_add (source->contacts_pending, contact);
+			contact_index_add (&source->contacts_pending_index, source->contacts_pending);
 		}
 	}
 }
 
 static void
-view_contacts_removed (EContactStore *contact_store,
-                       const GSList *uids,
-                       EBookClientView *client_view)
+contact_source_remove_contacts (EContactStore *contact_store,
+                                ContactSource *source,
+                                gint offset,
+                                gboolean pending,
+                                const GSList *uids)
 {
-	ContactSource *source;
-	gint           offset;
-	const GSList  *l;
-
-	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
-		g_warning ("EContactStore got 'contacts_removed' signal from unknown EBookView!");
-		return;
-	}
+	const GSList *l;
 
 	for (l = uids; l; l = g_slist_next (l)) {
 		const gchar *uid = l->data;
-		gint         n = find_contact_by_view_and_uid (contact_store, client_view, uid);
 		EContact    *contact;
+		gint         n;
+
+		if (!pending)
+			n = contact_index_lookup (&source->contacts_index, source->contacts, uid);
+		else
+			n = contact_index_lookup (&source->contacts_pending_index, source->contacts_pending, uid);
 
 		if (n < 0) {
 			g_warning ("EContactStore got 'contacts_removed' on unknown contact!");
 			continue;
 		}
 
-		if (client_view == source->client_view) {
+		if (!pending) {
 			/* Current view */
+			contact_index_remove (&source->contacts_index, source->contacts, n);
 			contact = g_ptr_array_index (source->contacts, n);
 			g_object_unref (contact);
 			g_ptr_array_remove_index (source->contacts, n);
+			invalidate_source_offsets (contact_store);
 			row_deleted (contact_store, offset + n);
 		} else {
 			/* Pending view */
+			contact_index_remove (&source->contacts_pending_index, source->contacts_pending, n);
 			contact = g_ptr_array_index (source->contacts_pending, n);
 			g_object_unref (contact);
 			g_ptr_array_remove_index (source->contacts_pending, n);
@@ -653,30 +779,29 @@ view_contacts_removed (EContactStore *contact_store,
 }
 
 static void
-view_contacts_modified (EContactStore *contact_store,
-                        const GSList *contacts,
-                        EBookClientView *client_view)
+contact_source_modify_contacts (EContactStore *contact_store,
+                                ContactSource *source,
+                                gint offset,
+                                gboolean pending,
+                                const GSList *contacts)
 {
 	GPtrArray     *cached_contacts;
-	ContactSource *source;
-	gint           offset;
+	ContactIndex  *cached_index;
 	const GSList  *l;
 
-	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
-		g_warning ("EContactStore got 'contacts_changed' signal from unknown EBookView!");
-		return;
-	}
-
-	if (client_view == source->client_view)
+	if (!pending) {
 		cached_contacts = source->contacts;
-	else
+		cached_index = &source->contacts_index;
+	} else {
 		cached_contacts = source->contacts_pending;
+		cached_index = &source->contacts_pending_index;
+	}
 
 	for (l = contacts; l; l = g_slist_next (l)) {
 		EContact    *cached_contact;
 		EContact    *contact = l->data;
 		const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
-		gint         n = find_contact_by_view_and_uid (contact_store, client_view, uid);
+		gint         n = contact_index_lookup (cached_index, cached_contacts, uid);
 
 		if (n < 0) {
 			g_warning ("EContactStore got change notification on unknown contact!");
@@ -692,83 +817,151 @@ view_contacts_modified (EContactStore *contact_store,
 		}
 
 		/* Emit changes for current view only */
-		if (client_view == source->client_view)
+		if (!pending)
 			row_changed (contact_store, offset + n);
 	}
 }
 
+/* Emits the differences between the pending and the current contacts,
+ * moves the pending contacts up to current and frees the pending array. */
 static void
-view_complete (EContactStore *contact_store,
-               const GError *error,
-               EBookClientView *client_view)
+contact_source_promote_pending (EContactStore *contact_store,
+                                ContactSource *source,
+                                gint offset)
 {
-	ContactSource *source;
-	gint           offset;
-	gint           i;
-	GHashTable *hash;
-
-	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
-		g_warning ("EContactStore got 'complete' signal from unknown EBookClientView!");
-		return;
-	}
-
-	/* If current view finished, do nothing */
-	if (client_view == source->client_view) {
-		stop_view (contact_store, source->client_view);
-		return;
-	}
-
-	g_return_if_fail (client_view == source->client_view_pending);
-
-	/* However, if it was a pending view, calculate and emit the differences between that
-	 * and the current view, and move the pending view up to current. */
+	gint i;
 
-	g_signal_emit (contact_store, signals[START_UPDATE], 0, client_view);
+	g_signal_emit (contact_store, signals[START_UPDATE], 0, source->client_view_pending);
 
 	/* Deletions */
-	hash = get_contact_hash (contact_store, source->client_view_pending);
 	for (i = 0; i < source->contacts->len; i++) {
 		EContact    *old_contact = g_ptr_array_index (source->contacts, i);
 		const gchar *old_uid = e_contact_get_const (old_contact, E_CONTACT_UID);
 
-		if (!g_hash_table_contains (hash, old_uid)) {
+		if (!contact_index_contains (&source->contacts_pending_index, source->contacts_pending, old_uid)) {
 			/* Contact is not in new view; removed */
+			contact_index_remove (&source->contacts_index, source->contacts, i);
 			g_object_unref (old_contact);
 			g_ptr_array_remove_index (source->contacts, i);
+			invalidate_source_offsets (contact_store);
 			row_deleted (contact_store, offset + i);
 			i--;  /* Stay in place */
 		}
 	}
-	g_hash_table_unref (hash);
 
 	/* Insertions */
-	hash = get_contact_hash (contact_store, source->client_view);
 	for (i = 0; i < source->contacts_pending->len; i++) {
 		EContact    *new_contact = g_ptr_array_index (source->contacts_pending, i);
 		const gchar *new_uid = e_contact_get_const (new_contact, E_CONTACT_UID);
 
-		if (!g_hash_table_contains (hash, new_uid)) {
+		if (!contact_index_contains (&source->contacts_index, source->contacts, new_uid)) {
 			/* Contact is not in old view; inserted */
 			g_ptr_array_add (source->contacts, new_contact);
+			contact_index_add (&source->contacts_index, source->contacts);
+			invalidate_source_offsets (contact_store);
 			row_inserted (contact_store, offset + source->contacts->len - 1);
 		} else {
 			/* Contact already in old view; drop the new one */
 			g_object_unref (new_contact);
 		}
 	}
-	g_hash_table_unref (hash);
 
-	g_signal_emit (contact_store, signals[STOP_UPDATE], 0, client_view);
+	g_signal_emit (contact_store, signals[STOP_UPDATE], 0, source->client_view_pending);
+
+	/* Free array of pending contacts (members have been either moved or unreffed) */
+	g_ptr_array_free (source->contacts_pending, TRUE);
+	source->contacts_pending = NULL;
+	contact_index_clear (&source->contacts_pending_index);
+}
+
+/* ------------------------- *
+ * EBookView signal handlers *
+ * ------------------------- */
+
+static void
+view_contacts_added (EContactStore *contact_store,
+                     const GSList *contacts,
+                     EBookClientView *client_view)
+{
+	ContactSource *source;
+	gint           offset;
+
+	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
+		g_warning ("EContactStore got 'contacts_added' signal from unknown EBookView!");
+		return;
+	}
+
+	contact_source_add_contacts (
+		contact_store, source, offset,
+		client_view != source->client_view, contacts);
+}
+
+static void
+view_contacts_removed (EContactStore *contact_store,
+                       const GSList *uids,
+                       EBookClientView *client_view)
+{
+	ContactSource *source;
+	gint           offset;
+
+	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
+		g_warning ("EContactStore got 'contacts_removed' signal from unknown EBookView!");
+		return;
+	}
+
+	contact_source_remove_contacts (
+		contact_store, source, offset,
+		client_view != source->client_view, uids);
+}
+
+static void
+view_contacts_modified (EContactStore *contact_store,
+                        const GSList *contacts,
+                        EBookClientView *client_view)
+{
+	ContactSource *source;
+	gint           offset;
+
+	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
+		g_warning ("EContactStore got 'contacts_changed' signal from unknown EBookView!");
+		return;
+	}
+
+	contact_source_modify_contacts (
+		contact_store, source, offset,
+		client_view != source->client_view, contacts);
+}
+
+static void
+view_complete (EContactStore *contact_store,
+               const GError *error,
+               EBookClientView *client_view)
+{
+	ContactSource *source;
+	gint           offset;
+
+	if (!find_contact_source_details_by_view (contact_store, client_view, &source, &offset)) {
+		g_warning ("EContactStore got 'complete' signal from unknown EBookClientView!");
+		return;
+	}
+
+	/* If current view finished, do nothing */
+	if (client_view == source->client_view) {
+		stop_view (contact_store, source->client_view);
+		return;
+	}
+
+	g_return_if_fail (client_view == source->client_view_pending);
+
+	/* However, if it was a pending view, calculate and emit the differences between that
+	 * and the current view, and move the pending view up to current. */
+	contact_source_promote_pending (contact_store, source, offset);
 
 	/* Move pending view up to current */
 	stop_view (contact_store, source->client_view);
 	g_object_unref (source->client_view);
 	source->client_view = source->client_view_pending;
 	source->client_view_pending = NULL;
-
-	/* Free array of pending contacts (members have been either moved or unreffed) */
-	g_ptr_array_free (source->contacts_pending, TRUE);
-	source->contacts_pending = NULL;
 }
 
 /* --------------------- *
@@ -869,11 +1062,17 @@ clear_contact_source (EContactStore *contact_store,
 		g_signal_emit (contact_store, signals[START_UPDATE], 0, source->client_view);
 		gtk_tree_path_append_index (path, source->contacts->len);
 
+		/* All the contacts go away, removing them from the index one
+		 * by one, from the last, would move the whole removed array
+		 * for each of them. */
+		contact_index_reset (&source->contacts_index);
+
 		for (i = source->contacts->len - 1; i >= 0; i--) {
 			EContact *contact = g_ptr_array_index (source->contacts, i);
 
 			g_object_unref (contact);
 			g_ptr_array_remove_index_fast (source->contacts, i);
+			invalidate_source_offsets (contact_store);
 
 			gtk_tree_path_prev (path);
 			gtk_tree_model_row_deleted (GTK_TREE_MODEL (contact_store), path);
@@ -896,6 +1095,7 @@ clear_contact_source (EContactStore *contact_store,
 		stop_view (contact_store, source->client_view_pending);
 		g_object_unref (source->client_view_pending);
 		free_contact_ptrarray (source->contacts_pending);
+		contact_index_clear (&source->contacts_pending_index);
 
 		source->client_view_pending = NULL;
 		source->contacts_pending = NULL;
@@ -932,12 +1132,14 @@ client_view_ready_cb (GObject *source_object,
 				stop_view (contact_store, source->client_view_pending);
 				g_object_unref (source->client_view_pending);
 				free_contact_ptrarray (source->contacts_pending);
+				contact_index_clear (&source->contacts_pending_index);
 			}
 
 			source->client_view_pending = client_view;
 
 			if (source->client_view_pending) {
 				source->contacts_pending = g_ptr_array_new ();
+				contact_index_init (&source->contacts_pending_index);
 				start_view (contact_store, client_view);
 			} else {
 				source->contacts_pending = NULL;
@@ -972,6 +1174,7 @@ query_contact_source (EContactStore *contact_store,
 			stop_view (contact_store, source->client_view_pending);
 			g_object_unref (source->client_view_pending);
 			free_contact_ptrarray (source->contacts_pending);
+			contact_index_clear (&source->contacts_pending_index);
 			source->client_view_pending = NULL;
 			source->contacts_pending = NULL;
 		}
@@ -1125,7 +1328,9 @@ e_contact_store_add_client (EContactStore *contact_store,
 	memset (&source, 0, sizeof (ContactSource));
 	source.book_client = g_object_ref (book_client);
 	source.contacts = g_ptr_array_new ();
+	contact_index_init (&source.contacts_index);
 	g_array_append_val (array, source);
+	invalidate_source_offsets (contact_store);
 
 	indexed_source = &g_array_index (array, ContactSource, array->len - 1);
 
@@ -1164,9 +1369,11 @@ e_contact_store_remove_client (EContactStore *contact_store,
 	source = &g_array_index (array, ContactSource, source_index);
 	clear_contact_source (contact_store, source);
 	free_contact_ptrarray (source->contacts);
+	contact_index_clear (&source->contacts_index);
 	g_object_unref (book_client);
 
 	g_array_remove_index (array, source_index);  /* Preserve order */
+	invalidate_source_offsets (contact_store);
 
 	return TRUE;
 }
@@ -29,7 +29,9 @@
 
 #include "e-photo-cache.h"
 
+#include <errno.h>
 #include <string.h>
+#include <glib/gstdio.h>
 #include <libebackend/libebackend.h>
 
 #include <e-util/e-data-capture.h>
@@ -42,11 +44,23 @@
  * priority photo source, after which we settle for what we have. */
 #define ASYNC_TIMEOUT_SECONDS 3.0
 
-/* How many email addresses we track at once, regardless of whether
- * the email address has a photo.  As new cache entries are added, we
- * discard the least recently accessed entries to keep the cache size
- * within the limit. */
-#define MAX_CACHE_SIZE 20
+/* How many email addresses we track at once by default, regardless of
+ * whether the email address has a photo, and how much photo data those
+ * may hold in total.  As new cache entries are added, we discard the
+ * least recently accessed entries to keep the cache within both limits.
+ * See e_photo_cache_set_limits(). */
+#define DEFAULT_MAX_CACHE_ENTRIES 500
+#define DEFAULT_MAX_CACHE_BYTES (8 * 1024 * 1024)
+
+/* How long (in seconds) to remember that an email address has no photo,
+ * after which the photo sources are asked again.  This way new contacts
+ * and new gravatars show up eventually without a restart. */
+#define NEGATIVE_CACHE_TTL_SECONDS (30 * 60)
+
+/* How old (in days) photos in the on-disk cache may get.  Older files are
+ * pruned when the on-disk cache is enabled, so changed photos are picked
+ * up from the photo sources again. */
+#define DISK_CACHE_MAX_AGE_DAYS 7
 
 #define ERROR_IS_CANCELLED(error) \
 	(g_error_matches ((error), G_IO_ERROR, G_IO_ERROR_CANCELLED))
@@ -60,8 +74,17 @@ struct _EPhotoCachePrivate {
 	EClientCache *client_cache;
 	GMainContext *main_context;
 
+	/* The hash table values are linked into the MRU queue
+	 * through PhotoData.link, so that promoting an entry to
+	 * the head of the queue does not need to search for it. */
 	GHashTable *photo_ht;
-	GQueue photo_ht_keys;
+	GQueue photo_ht_mru;
+	gsize photo_ht_bytes;
+	guint max_entries;
+	gsize max_bytes;
+	guint n_hits;
+	guint n_misses;
+	gchar *disk_cache_dir;
 	GMutex photo_ht_lock;
 
 	GHashTable *sources_ht;
@@ -76,6 +99,8 @@ struct _AsyncContext {
 	GInputStream *stream;
 	GConverter *data_capture;
 
+	gchar *email_address;
+
 	GCancellable *cancellable;
 	gulong cancelled_handler_id;
 };
@@ -99,6 +124,13 @@ struct _PhotoData {
 	volatile gint ref_count;
 	GMutex lock;
 	GBytes *bytes;
+
+	/* The following members are protected
+	 * by EPhotoCachePrivate.photo_ht_lock. */
+	gchar *key;
+	GList link;
+	gsize size;
+	gint64 expires;
 };
 
 enum {
@@ -108,6 +140,9 @@ enum {
 
 /* Forward Declarations */
 static void	async_context_cancel_subtasks	(AsyncContext *async_context);
+static void	photo_ht_insert			(EPhotoCache *photo_cache,
+						 const gchar *email_address,
+						 GBytes *bytes);
 
 G_DEFINE_TYPE_WITH_CODE (
 	EPhotoCache,
@@ -276,6 +311,20 @@ async_subtask_complete (AsyncSubtask *async_subtask)
 		}
 
 		async_subtask_unref (async_subtask);
+	} else {
+		GObject *photo_cache;
+
+		/* All photo sources completed without a match,
+		 * remember that for a while to not ask them again
+		 * each time a message from this sender is shown. */
+		photo_cache = g_async_result_get_source_object (
+			G_ASYNC_RESULT (simple));
+		if (photo_cache != NULL) {
+			photo_ht_insert (
+				E_PHOTO_CACHE (photo_cache),
+				async_context->email_address, NULL);
+			g_object_unref (photo_cache);
+		}
 	}
 
 	g_simple_async_result_complete_in_idle (simple);
@@ -298,6 +347,7 @@ async_context_cancelled_cb (GCancellable *cancellable,
 
 static AsyncContext *
 async_context_new (EDataCapture *data_capture,
+                   const gchar *email_address,
                    GCancellable *cancellable)
 {
 	AsyncContext *async_context;
@@ -305,6 +355,7 @@ async_context_new (EDataCapture *data_capture,
 	async_context = g_slice_new0 (AsyncContext);
 	g_mutex_init (&async_context->lock);
 	async_context->timer = g_timer_new ();
+	async_context->email_address = g_strdup (email_address);
 
 	async_context->subtasks = g_hash_table_new_full (
 		(GHashFunc) g_direct_hash,
@@ -349,6 +400,8 @@ async_context_free (AsyncContext *async_context)
 	g_clear_object (&async_context->data_capture);
 	g_clear_object (&async_context->cancellable);
 
+	g_free (async_context->email_address);
+
 	g_slice_free (AsyncContext, async_context);
 }
 
@@ -413,13 +466,16 @@ data_capture_closure_free (DataCaptureClosure *closure)
 }
 
 static PhotoData *
-photo_data_new (GBytes *bytes)
+photo_data_new (const gchar *key,
+                GBytes *bytes)
 {
 	PhotoData *photo_data;
 
 	photo_data = g_slice_new0 (PhotoData);
 	photo_data->ref_count = 1;
 	g_mutex_init (&photo_data->lock);
+	photo_data->key = g_strdup (key);
+	photo_data->link.data = photo_data;
 
 	if (bytes != NULL)
 		photo_data->bytes = g_bytes_ref (bytes);
@@ -448,6 +504,7 @@ photo_data_unref (PhotoData *photo_data)
 		g_mutex_clear (&photo_data->lock);
 		if (photo_data->bytes != NULL)
 			g_bytes_unref (photo_data->bytes);
+		g_free (photo_data->key);
 		g_slice_free (PhotoData, photo_data);
 	}
 }
@@ -497,20 +554,181 @@ photo_ht_normalize_key (const gchar *email_address)
 	return collation_key;
 }
 
+/* Returns the file of @email_address in the on-disk cache,
+ * or %NULL if the on-disk cache is disabled.  Unlike the keys
+ * of the hash table, the file name must not depend on the locale. */
+static gchar *
+photo_disk_build_filename (EPhotoCache *photo_cache,
+                           const gchar *email_address)
+{
+	gchar *filename = NULL;
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	if (photo_cache->priv->disk_cache_dir != NULL) {
+		gchar *lowercase_email_address;
+		gchar *checksum;
+
+		lowercase_email_address = g_utf8_strdown (email_address, -1);
+		checksum = g_compute_checksum_for_string (
+			G_CHECKSUM_SHA1, lowercase_email_address, -1);
+
+		filename = g_build_filename (
+			photo_cache->priv->disk_cache_dir, checksum, NULL);
+
+		g_free (lowercase_email_address);
+		g_free (checksum);
+	}
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	return filename;
+}
+
+static void
+photo_disk_store_done_cb (GObject *source_object,
+                          GAsyncResult *result,
+                          gpointer user_data)
+{
+	GError *local_error = NULL;
+
+	g_file_replace_contents_finish (
+		G_FILE (source_object), result, NULL, &local_error);
+
+	if (local_error != NULL) {
+		g_warning (
+			"%s: Failed to store photo: %s",
+			G_STRFUNC, local_error->message);
+		g_error_free (local_error);
+	}
+}
+
+static void
+photo_disk_store (EPhotoCache *photo_cache,
+                  const gchar *email_address,
+                  GBytes *bytes)
+{
+	GFile *file;
+	gchar *filename;
+
+	filename = photo_disk_build_filename (photo_cache, email_address);
+	if (filename == NULL)
+		return;
+
+	file = g_file_new_for_path (filename);
+
+	g_file_replace_contents_bytes_async (
+		file, bytes, NULL, FALSE,
+		G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+		NULL, photo_disk_store_done_cb, NULL);
+
+	g_object_unref (file);
+	g_free (filename);
+}
+
+static gboolean
+photo_disk_remove (EPhotoCache *photo_cache,
+                   const gchar *email_address)
+{
+	gchar *filename;
+	gboolean removed;
+
+	filename = photo_disk_build_filename (photo_cache, email_address);
+	if (filename == NULL)
+		return FALSE;
+
+	removed = (g_unlink (filename) == 0);
+
+	g_free (filename);
+
+	return removed;
+}
+
+static gpointer
+photo_disk_prune_thread (gpointer user_data)
+{
+	gchar *disk_cache_dir = user_data;
+	const gchar *name;
+	gint64 min_mtime;
+	GDir *dir;
+
+	dir = g_dir_open (disk_cache_dir, 0, NULL);
+	if (dir == NULL)
+		goto exit;
+
+	min_mtime = g_get_real_time () / G_USEC_PER_SEC -
+		DISK_CACHE_MAX_AGE_DAYS * 24 * 60 * 60;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		GStatBuf st;
+		gchar *filename;
+
+		filename = g_build_filename (disk_cache_dir, name, NULL);
+
+		if (g_stat (filename, &st) == 0 &&
+		    S_ISREG (st.st_mode) && st.st_mtime < min_mtime)
+			g_unlink (filename);
+
+		g_free (filename);
+	}
+
+	g_dir_close (dir);
+
+exit:
+	g_free (disk_cache_dir);
+
+	return NULL;
+}
+
+/* Call with photo_ht_lock held. */
+static void
+photo_ht_unlink (EPhotoCache *photo_cache,
+                 PhotoData *photo_data)
+{
+	g_queue_unlink (&photo_cache->priv->photo_ht_mru, &photo_data->link);
+	photo_cache->priv->photo_ht_bytes -= photo_data->size;
+
+	/* This drops the hash table's reference on the photo data. */
+	g_hash_table_remove (photo_cache->priv->photo_ht, photo_data->key);
+}
+
+/* Call with photo_ht_lock held. */
+static void
+photo_ht_trim (EPhotoCache *photo_cache)
+{
+	EPhotoCachePrivate *priv = photo_cache->priv;
+
+	while (priv->photo_ht_mru.length > priv->max_entries ||
+	       priv->photo_ht_bytes > priv->max_bytes) {
+		PhotoData *oldest;
+
+		oldest = g_queue_peek_tail (&priv->photo_ht_mru);
+		if (oldest == NULL)
+			break;
+
+		photo_ht_unlink (photo_cache, oldest);
+	}
+
+	/* Hash table and queue sizes should be equal at all times. */
+	g_warn_if_fail (
+		g_hash_table_size (priv->photo_ht) ==
+		g_queue_get_length (&priv->photo_ht_mru));
+}
+
 static void
 photo_ht_insert (EPhotoCache *photo_cache,
                  const gchar *email_address,
                  GBytes *bytes)
 {
 	GHashTable *photo_ht;
-	GQueue *photo_ht_keys;
+	GQueue *photo_ht_mru;
 	PhotoData *photo_data;
 	gchar *key;
 
 	g_return_if_fail (email_address != NULL);
 
 	photo_ht = photo_cache->priv->photo_ht;
-	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
+	photo_ht_mru = &photo_cache->priv->photo_ht_mru;
 
 	key = photo_ht_normalize_key (email_address);
 
@@ -519,47 +737,43 @@ photo_ht_insert (EPhotoCache *photo_cache,
 	photo_data = g_hash_table_lookup (photo_ht, key);
 
 	if (photo_data != NULL) {
-		GList *link;
-
 		/* Replace the old photo data if we have new photo
-		 * data, otherwise leave the old photo data alone. */
-		if (bytes != NULL)
+		 * data, otherwise leave the old photo data alone,
+		 * except for refreshing the lifetime of a cached
+		 * "no photo" result. */
+		if (bytes != NULL) {
 			photo_data_set_bytes (photo_data, bytes);
-
-		/* Move the key to the head of the MRU queue. */
-		link = g_queue_find_custom (
-			photo_ht_keys, key,
-			(GCompareFunc) strcmp);
-		if (link != NULL) {
-			g_queue_unlink (photo_ht_keys, link);
-			g_queue_push_head_link (photo_ht_keys, link);
+			photo_cache->priv->photo_ht_bytes -= photo_data->size;
+			photo_data->size = g_bytes_get_size (bytes);
+			photo_cache->priv->photo_ht_bytes += photo_data->size;
+			photo_data->expires = 0;
+		} else if (photo_data->expires != 0) {
+			photo_data->expires = g_get_monotonic_time () +
+				NEGATIVE_CACHE_TTL_SECONDS * G_USEC_PER_SEC;
 		}
-	} else {
-		photo_data = photo_data_new (bytes);
 
-		g_hash_table_insert (
-			photo_ht, g_strdup (key),
-			photo_data_ref (photo_data));
-
-		/* Push the key to the head of the MRU queue. */
-		g_queue_push_head (photo_ht_keys, g_strdup (key));
+		/* Move the entry to the head of the MRU queue. */
+		g_queue_unlink (photo_ht_mru, &photo_data->link);
+		g_queue_push_head_link (photo_ht_mru, &photo_data->link);
+	} else {
+		photo_data = photo_data_new (key, bytes);
 
-		/* Trim the cache if necessary. */
-		while (g_queue_get_length (photo_ht_keys) > MAX_CACHE_SIZE) {
-			gchar *oldest_key;
+		if (bytes != NULL)
+			photo_data->size = g_bytes_get_size (bytes);
+		else
+			photo_data->expires = g_get_monotonic_time () +
+				NEGATIVE_CACHE_TTL_SECONDS * G_USEC_PER_SEC;
 
-			oldest_key = g_queue_pop_tail (photo_ht_keys);
-			g_hash_table_remove (photo_ht, oldest_key);
-			g_free (oldest_key);
-		}
+		/* The hash table takes ownership of the photo data. */
+		g_hash_table_insert (photo_ht, photo_data->key, photo_data);
 
-		photo_data_unref (photo_data);
+		/* Push the entry to the head of the MRU queue. */
+		g_queue_push_head_link (photo_ht_mru, &photo_data->link);
+		photo_cache->priv->photo_ht_bytes += photo_data->size;
 	}
 
-	/* Hash table and queue sizes should be equal at all times. */
-	g_warn_if_fail (
-		g_hash_table_size (photo_ht) ==
-		g_queue_get_length (photo_ht_keys));
+	/* Trim the cache if necessary. */
+	photo_ht_trim (photo_cache);
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
 
@@ -572,6 +786,7 @@ photo_ht_lookup (EPhotoCache *photo_cache,
                  GInputStream **out_stream)
 {
 	GHashTable *photo_ht;
+	GQueue *photo_ht_mru;
 	PhotoData *photo_data;
 	gboolean found = FALSE;
 	gchar *key;
@@ -580,6 +795,7 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 	g_return_val_if_fail (out_stream != NULL, FALSE);
 
 	photo_ht = photo_cache->priv->photo_ht;
+	photo_ht_mru = &photo_cache->priv->photo_ht_mru;
 
 	key = photo_ht_normalize_key (email_address);
 
@@ -587,6 +803,13 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 
 	photo_data = g_hash_table_lookup (photo_ht, key);
 
+	/* Expired "no photo" results count as not found. */
+	if (photo_data != NULL && photo_data->expires != 0 &&
+	    photo_data->expires <= g_get_monotonic_time ()) {
+		photo_ht_unlink (photo_cache, photo_data);
+		photo_data = NULL;
+	}
+
 	if (photo_data != NULL) {
 		GBytes *bytes;
 
@@ -598,6 +821,11 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 		} else {
 			*out_stream = NULL;
 		}
+
+		/* Move the entry to the head of the MRU queue. */
+		g_queue_unlink (photo_ht_mru, &photo_data->link);
+		g_queue_push_head_link (photo_ht_mru, &photo_data->link);
+
 		found = TRUE;
 	}
 
@@ -612,38 +840,23 @@ static gboolean
 photo_ht_remove (EPhotoCache *photo_cache,
                  const gchar *email_address)
 {
-	GHashTable *photo_ht;
-	GQueue *photo_ht_keys;
+	PhotoData *photo_data;
 	gchar *key;
 	gboolean removed = FALSE;
 
 	g_return_val_if_fail (email_address != NULL, FALSE);
 
-	photo_ht = photo_cache->priv->photo_ht;
-	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
-
 	key = photo_ht_normalize_key (email_address);
 
 	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
-	if (g_hash_table_remove (photo_ht, key)) {
-		GList *link;
+	photo_data = g_hash_table_lookup (photo_cache->priv->photo_ht, key);
 
-		link = g_queue_find_custom (
-			photo_ht_keys, key,
-			(GCompareFunc) strcmp);
-		if (link != NULL) {
-			g_free (link->data);
-			g_queue_delete_link (photo_ht_keys, link);
-			removed = TRUE;
-		}
+	if (photo_data != NULL) {
+		photo_ht_unlink (photo_cache, photo_data);
+		removed = TRUE;
 	}
 
-	/* Hash table and queue sizes should be equal at all times. */
-	g_warn_if_fail (
-		g_hash_table_size (photo_ht) ==
-		g_queue_get_length (photo_ht_keys));
-
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
 
 	g_free (key);
@@ -654,18 +867,27 @@ photo_ht_remove (EPhotoCache *photo_cache,
 static void
 photo_ht_remove_all (EPhotoCache *photo_cache)
 {
-	GHashTable *photo_ht;
-	GQueue *photo_ht_keys;
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
-	photo_ht = photo_cache->priv->photo_ht;
-	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
+	/* The queue links are embedded in the photo data,
+	 * so there is nothing to free for the queue itself. */
+	g_queue_init (&photo_cache->priv->photo_ht_mru);
+	g_hash_table_remove_all (photo_cache->priv->photo_ht);
+	photo_cache->priv->photo_ht_bytes = 0;
 
-	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+}
 
-	g_hash_table_remove_all (photo_ht);
+static void
+photo_ht_count (EPhotoCache *photo_cache,
+                gboolean hit)
+{
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
-	while (!g_queue_is_empty (photo_ht_keys))
-		g_free (g_queue_pop_head (photo_ht_keys));
+	if (hit)
+		photo_cache->priv->n_hits++;
+	else
+		photo_cache->priv->n_misses++;
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
 }
@@ -704,6 +926,109 @@ photo_cache_async_subtask_done_cb (GObject *source_object,
 	async_subtask_unref (async_subtask);
 }
 
+static void
+photo_cache_dispatch_subtasks (EPhotoCache *photo_cache,
+                               GSimpleAsyncResult *simple)
+{
+	AsyncContext *async_context;
+	GList *list, *link;
+
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	photo_ht_count (photo_cache, FALSE);
+
+	list = e_photo_cache_list_photo_sources (photo_cache);
+
+	if (list == NULL) {
+		g_simple_async_result_complete_in_idle (simple);
+		return;
+	}
+
+	g_mutex_lock (&async_context->lock);
+
+	/* Dispatch a subtask for each photo source. */
+	for (link = list; link != NULL; link = g_list_next (link)) {
+		EPhotoSource *photo_source;
+		AsyncSubtask *async_subtask;
+
+		photo_source = E_PHOTO_SOURCE (link->data);
+		async_subtask = async_subtask_new (photo_source, simple);
+
+		g_hash_table_add (
+			async_context->subtasks,
+			async_subtask_ref (async_subtask));
+
+		e_photo_source_get_photo (
+			photo_source, async_context->email_address,
+			async_subtask->cancellable,
+			photo_cache_async_subtask_done_cb,
+			async_subtask_ref (async_subtask));
+
+		async_subtask_unref (async_subtask);
+	}
+
+	g_mutex_unlock (&async_context->lock);
+
+	g_list_free_full (list, (GDestroyNotify) g_object_unref);
+
+	/* Check if we were cancelled while dispatching subtasks. */
+	if (g_cancellable_is_cancelled (async_context->cancellable))
+		async_context_cancel_subtasks (async_context);
+}
+
+static void
+photo_cache_disk_loaded_cb (GObject *source_object,
+                            GAsyncResult *result,
+                            gpointer user_data)
+{
+	GSimpleAsyncResult *simple;
+	AsyncContext *async_context;
+	GObject *photo_cache;
+	gchar *contents = NULL;
+	gsize length = 0;
+	GError *local_error = NULL;
+
+	simple = G_SIMPLE_ASYNC_RESULT (user_data);
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+	photo_cache = g_async_result_get_source_object (G_ASYNC_RESULT (simple));
+
+	g_file_load_contents_finish (
+		G_FILE (source_object), result,
+		&contents, &length, NULL, &local_error);
+
+	if (photo_cache == NULL || ERROR_IS_CANCELLED (local_error)) {
+		g_free (contents);
+		g_simple_async_result_complete_in_idle (simple);
+
+	} else if (local_error == NULL) {
+		GBytes *bytes;
+
+		bytes = g_bytes_new_take (contents, length);
+
+		/* Bypass e_photo_cache_add_photo(),
+		 * the photo is on the disk already. */
+		photo_ht_insert (
+			E_PHOTO_CACHE (photo_cache),
+			async_context->email_address, bytes);
+		photo_ht_count (E_PHOTO_CACHE (photo_cache), TRUE);
+
+		async_context->stream =
+			g_memory_input_stream_new_from_bytes (bytes);
+
+		g_bytes_unref (bytes);
+
+		g_simple_async_result_complete_in_idle (simple);
+
+	} else {
+		photo_cache_dispatch_subtasks (
+			E_PHOTO_CACHE (photo_cache), simple);
+	}
+
+	g_clear_error (&local_error);
+	g_clear_object (&photo_cache);
+	g_object_unref (simple);
+}
+
 static void
 photo_cache_set_client_cache (EPhotoCache *photo_cache,
                               EClientCache *client_cache)
@@ -779,6 +1104,8 @@ photo_cache_finalize (GObject *object)
 	g_mutex_clear (&priv->photo_ht_lock);
 	g_mutex_clear (&priv->sources_ht_lock);
 
+	g_free (priv->disk_cache_dir);
+
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_photo_cache_parent_class)->finalize (object);
 }
@@ -830,10 +1157,11 @@ e_photo_cache_init (EPhotoCache *photo_cache)
 	GHashTable *photo_ht;
 	GHashTable *sources_ht;
 
+	/* The keys are owned by the values. */
 	photo_ht = g_hash_table_new_full (
 		(GHashFunc) g_str_hash,
 		(GEqualFunc) g_str_equal,
-		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL,
 		(GDestroyNotify) photo_data_unref);
 
 	sources_ht = g_hash_table_new_full (
@@ -846,6 +1174,8 @@ e_photo_cache_init (EPhotoCache *photo_cache)
 	photo_cache->priv->main_context = g_main_context_ref_thread_default ();
 	photo_cache->priv->photo_ht = photo_ht;
 	photo_cache->priv->sources_ht = sources_ht;
+	photo_cache->priv->max_entries = DEFAULT_MAX_CACHE_ENTRIES;
+	photo_cache->priv->max_bytes = DEFAULT_MAX_CACHE_BYTES;
 
 	g_mutex_init (&photo_cache->priv->photo_ht_lock);
 	g_mutex_init (&photo_cache->priv->sources_ht_lock);
@@ -996,7 +1326,8 @@ e_photo_cache_remove_photo_source (EPhotoCache *photo_cache,
  * input stream.
  *
  * The entry may be removed without notice however, subject to @photo_cache's
- * internal caching policy.
+ * internal caching policy.  If the on-disk cache is enabled, @bytes are also
+ * stored there, see e_photo_cache_set_disk_cache_dir().
  **/
 void
 e_photo_cache_add_photo (EPhotoCache *photo_cache,
@@ -1007,6 +1338,9 @@ e_photo_cache_add_photo (EPhotoCache *photo_cache,
 	g_return_if_fail (email_address != NULL);
 
 	photo_ht_insert (photo_cache, email_address, bytes);
+
+	if (bytes != NULL)
+		photo_disk_store (photo_cache, email_address, bytes);
 }
 
 /**
@@ -1014,7 +1348,8 @@ e_photo_cache_add_photo (EPhotoCache *photo_cache,
  * @photo_cache: an #EPhotoCache
  * @email_address: an email address
  *
- * Removes the cache entry for @email_address, if such an entry exists.
+ * Removes the cache entry for @email_address, if such an entry exists,
+ * both from memory and from the on-disk cache.
  *
  * Returns: %TRUE if a cache entry was found and removed
  **/
@@ -1022,10 +1357,182 @@ gboolean
 e_photo_cache_remove_photo (EPhotoCache *photo_cache,
                             const gchar *email_address)
 {
+	gboolean removed;
+
 	g_return_val_if_fail (E_IS_PHOTO_CACHE (photo_cache), FALSE);
 	g_return_val_if_fail (email_address != NULL, FALSE);
 
-	return photo_ht_remove (photo_cache, email_address);
+	removed = photo_ht_remove (photo_cache, email_address);
+
+	if (photo_disk_remove (photo_cache, email_address))
+		removed = TRUE;
+
+	return removed;
+}
+
+/**
+ * e_photo_cache_set_limits:
+ * @photo_cache: an #EPhotoCache
+ * @max_entries: how many email addresses to remember at most
+ * @max_bytes: how many bytes of photo data to hold in memory at most
+ *
+ * Sets the limits of the in-memory cache.  When either of them is exceeded,
+ * the least recently used entries are discarded.  Cached "no photo" results
+ * count against @max_entries only.
+ *
+ * Since: 3.26
+ **/
+void
+e_photo_cache_set_limits (EPhotoCache *photo_cache,
+                          guint max_entries,
+                          gsize max_bytes)
+{
+	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	photo_cache->priv->max_entries = max_entries;
+	photo_cache->priv->max_bytes = max_bytes;
+
+	photo_ht_trim (photo_cache);
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+}
+
+/**
+ * e_photo_cache_get_limits:
+ * @photo_cache: an #EPhotoCache
+ * @out_max_entries: (out) (allow-none): return location for the entry limit,
+ *    or %NULL
+ * @out_max_bytes: (out) (allow-none): return location for the byte limit,
+ *    or %NULL
+ *
+ * Returns the limits of the in-memory cache, as set by
+ * e_photo_cache_set_limits().
+ *
+ * Since: 3.26
+ **/
+void
+e_photo_cache_get_limits (EPhotoCache *photo_cache,
+                          guint *out_max_entries,
+                          gsize *out_max_bytes)
+{
+	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	if (out_max_entries != NULL)
+		*out_max_entries = photo_cache->priv->max_entries;
+
+	if (out_max_bytes != NULL)
+		*out_max_bytes = photo_cache->priv->max_bytes;
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+}
+
+/**
+ * e_photo_cache_get_stats:
+ * @photo_cache: an #EPhotoCache
+ * @out_hits: (out) (allow-none): return location for the count of photo
+ *    requests answered from the cache, or %NULL
+ * @out_misses: (out) (allow-none): return location for the count of photo
+ *    requests which had to consult the photo sources, or %NULL
+ *
+ * Returns how well the cache performs.  Requests answered from the on-disk
+ * cache count as hits.
+ *
+ * Since: 3.26
+ **/
+void
+e_photo_cache_get_stats (EPhotoCache *photo_cache,
+                         guint *out_hits,
+                         guint *out_misses)
+{
+	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	if (out_hits != NULL)
+		*out_hits = photo_cache->priv->n_hits;
+
+	if (out_misses != NULL)
+		*out_misses = photo_cache->priv->n_misses;
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+}
+
+/**
+ * e_photo_cache_set_disk_cache_dir:
+ * @photo_cache: an #EPhotoCache
+ * @disk_cache_dir: (allow-none): a directory path, or %NULL
+ *
+ * Enables a second, on-disk cache tier in @disk_cache_dir, which is
+ * consulted before the photo sources and which survives restarts.
+ * Photos older than a few days are pruned from it, so that changed
+ * photos are eventually picked up again.  Pass %NULL to disable the
+ * on-disk cache, which is also the default.
+ *
+ * Since: 3.26
+ **/
+void
+e_photo_cache_set_disk_cache_dir (EPhotoCache *photo_cache,
+                                  const gchar *disk_cache_dir)
+{
+	GThread *thread;
+
+	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
+
+	if (disk_cache_dir != NULL &&
+	    g_mkdir_with_parents (disk_cache_dir, 0700) == -1) {
+		g_warning (
+			"%s: Failed to create '%s': %s",
+			G_STRFUNC, disk_cache_dir, g_strerror (errno));
+		disk_cache_dir = NULL;
+	}
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	g_free (photo_cache->priv->disk_cache_dir);
+	photo_cache->priv->disk_cache_dir = g_strdup (disk_cache_dir);
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	if (disk_cache_dir != NULL) {
+		thread = g_thread_new (
+			NULL, photo_disk_prune_thread,
+			g_strdup (disk_cache_dir));
+		g_thread_unref (thread);
+	}
+}
+
+/**
+ * e_photo_cache_dup_disk_cache_dir:
+ * @photo_cache: an #EPhotoCache
+ *
+ * Returns the directory of the on-disk cache tier, as set by
+ * e_photo_cache_set_disk_cache_dir(), or %NULL if it is disabled.
+ *
+ * Free the returned string with g_free() when finished with it.
+ *
+ * Returns: (transfer full) (nullable): a newly-allocated directory path,
+ *    or %NULL
+ *
+ * Since: 3.26
+ **/
+gchar *
+e_photo_cache_dup_disk_cache_dir (EPhotoCache *photo_cache)
+{
+	gchar *disk_cache_dir;
+
+	g_return_val_if_fail (E_IS_PHOTO_CACHE (photo_cache), NULL);
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	disk_cache_dir = g_strdup (photo_cache->priv->disk_cache_dir);
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	return disk_cache_dir;
 }
 
 /**
@@ -1101,7 +1608,7 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 	AsyncContext *async_context;
 	EDataCapture *data_capture;
 	GInputStream *stream = NULL;
-	GList *list, *link;
+	gchar *filename;
 
 	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
 	g_return_if_fail (email_address != NULL);
@@ -1116,7 +1623,8 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 		data_capture_closure_new (photo_cache, email_address),
 		(GClosureNotify) data_capture_closure_free, 0);
 
-	async_context = async_context_new (data_capture, cancellable);
+	async_context = async_context_new (
+		data_capture, email_address, cancellable);
 
 	simple = g_simple_async_result_new (
 		G_OBJECT (photo_cache), callback,
@@ -1129,48 +1637,30 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 
 	/* Check if we have this email address already cached. */
 	if (photo_ht_lookup (photo_cache, email_address, &stream)) {
+		photo_ht_count (photo_cache, TRUE);
 		async_context->stream = stream;  /* takes ownership */
 		g_simple_async_result_complete_in_idle (simple);
 		goto exit;
 	}
 
-	list = e_photo_cache_list_photo_sources (photo_cache);
-
-	if (list == NULL) {
-		g_simple_async_result_complete_in_idle (simple);
-		goto exit;
-	}
-
-	g_mutex_lock (&async_context->lock);
-
-	/* Dispatch a subtask for each photo source. */
-	for (link = list; link != NULL; link = g_list_next (link)) {
-		EPhotoSource *photo_source;
-		AsyncSubtask *async_subtask;
-
-		photo_source = E_PHOTO_SOURCE (link->data);
-		async_subtask = async_subtask_new (photo_source, simple);
+	/* Check if we have this email address cached on disk. */
+	filename = photo_disk_build_filename (photo_cache, email_address);
+	if (filename != NULL) {
+		GFile *file;
 
-		g_hash_table_add (
-			async_context->subtasks,
-			async_subtask_ref (async_subtask));
+		file = g_file_new_for_path (filename);
 
-		e_photo_source_get_photo (
-			photo_source, email_address,
-			async_subtask->cancellable,
-			photo_cache_async_subtask_done_cb,
-			async_subtask_ref (async_subtask));
+		g_file_load_contents_async (
+			file, cancellable,
+			photo_cache_disk_loaded_cb,
+			g_object_ref (simple));
 
-		async_subtask_unref (async_subtask);
+		g_object_unref (file);
+		g_free (filename);
+		goto exit;
 	}
 
-	g_mutex_unlock (&async_context->lock);
-
-	g_list_free_full (list, (GDestroyNotify) g_object_unref);
-
-	/* Check if we were cancelled while dispatching subtasks. */
-	if (g_cancellable_is_cancelled (cancellable))
-		async_context_cancel_subtasks (async_context);
+	photo_cache_dispatch_subtasks (photo_cache, simple);
 
 exit:
 	g_object_unref (simple);
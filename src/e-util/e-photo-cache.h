@@ -81,6 +81,20 @@ void		e_photo_cache_add_photo		(EPhotoCache *photo_cache,
 						 GBytes *bytes);
 gboolean	e_photo_cache_remove_photo	(EPhotoCache *photo_cache,
 						 const gchar *email_address);
+void		e_photo_cache_set_limits	(EPhotoCache *photo_cache,
+						 guint max_entries,
+						 gsize max_bytes);
+void		e_photo_cache_get_limits	(EPhotoCache *photo_cache,
+						 guint *out_max_entries,
+						 gsize *out_max_bytes);
+void		e_photo_cache_get_stats		(EPhotoCache *photo_cache,
+						 guint *out_hits,
+						 guint *out_misses);
+void		e_photo_cache_set_disk_cache_dir
+						(EPhotoCache *photo_cache,
+						 const gchar *disk_cache_dir);
+gchar *		e_photo_cache_dup_disk_cache_dir
+						(EPhotoCache *photo_cache);
 gboolean	e_photo_cache_get_photo_sync	(EPhotoCache *photo_cache,
 						 const gchar *email_address,
 						 GCancellable *cancellable,
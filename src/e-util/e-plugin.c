@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include <libebackend/libebackend.h>
 
@@ -61,6 +62,13 @@
 
 /* EPlugin stuff */
 
+/* The plugin definitions of the plugin directory, to not read and parse
+ * every .eplug file on each start; the variant holds the version, the
+ * directory with its modification time, and the <e-plugin> elements
+ * with their file name and load level. */
+#define EP_MANIFEST_FILE "plugins.manifest"
+#define EP_MANIFEST_TYPE "(ssxa(sis))"
+
 /* global table of plugin types by pluginclass.type */
 static GHashTable *ep_types;
 /* global table of plugins by plugin.id */
@@ -358,14 +366,55 @@ ep_load_plugin (xmlNodePtr root,
 	return ep;
 }
 
+static void
+ep_load_element (xmlNodePtr root,
+                 struct _plugin_doc *pdoc,
+                 gint load_level)
+{
+	EPlugin *ep;
+	gchar *is_system_plugin;
+
+	ep = ep_load_plugin (root, pdoc);
+	if (!ep)
+		return;
+
+	if (load_level == 1)
+		e_plugin_invoke (ep, "load_plugin_type_register_function", NULL);
+
+	/* README: Maybe we can use load_levels to
+	 * achieve the same thing.  But it may be
+	 * confusing for a plugin writer. */
+	is_system_plugin = e_plugin_xml_prop (root, "system_plugin");
+	if (g_strcmp0 (is_system_plugin, "true") == 0) {
+		e_plugin_enable (ep, TRUE);
+		ep->flags |= E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
+	} else
+		ep->flags &= ~E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
+	g_free (is_system_plugin);
+}
+
+/* Plugins without a load level are loaded at the last one. */
 static gint
-ep_load (const gchar *filename,
-         gint load_level)
+ep_get_load_level (xmlNodePtr root)
+{
+	gchar *plugin_load_level;
+	gint load_level = 2;
+
+	plugin_load_level = e_plugin_xml_prop (root, "load_level");
+	if (plugin_load_level)
+		load_level = atoi (plugin_load_level);
+	g_free (plugin_load_level);
+
+	return load_level;
+}
+
+/* Adds the <e-plugin> elements of the file to the manifest builder. */
+static gint
+ep_scan (const gchar *filename,
+         GVariantBuilder *builder)
 {
 	xmlDocPtr doc;
 	xmlNodePtr root;
-	EPlugin *ep = NULL;
-	struct _plugin_doc *pdoc;
 
 	doc = e_xml_parse_file (filename);
 	if (doc == NULL)
@@ -378,51 +427,151 @@ ep_load (const gchar *filename,
 		return -1;
 	}
 
-	pdoc = g_malloc0 (sizeof (*pdoc));
-	pdoc->doc = doc;
-	pdoc->filename = g_strdup (filename);
-
 	for (root = root->children; root; root = root->next) {
-		if (strcmp ((gchar *) root->name, "e-plugin") == 0) {
-			gchar *plugin_load_level, *is_system_plugin;
-
-			plugin_load_level = NULL;
-			plugin_load_level = e_plugin_xml_prop (root, "load_level");
-			if (plugin_load_level) {
-				if ((atoi (plugin_load_level) == load_level)) {
-					ep = ep_load_plugin (root, pdoc);
-
-					if (ep && load_level == 1)
-						e_plugin_invoke (
-							ep, "load_plugin_type_register_function", NULL);
-				}
-			} else if (load_level == 2) {
-				ep = ep_load_plugin (root, pdoc);
-			}
+		xmlBufferPtr buffer;
+
+		if (strcmp ((gchar *) root->name, "e-plugin") != 0)
+			continue;
+
+		buffer = xmlBufferCreate ();
+		xmlNodeDump (buffer, doc, root, 0, 0);
+
+		g_variant_builder_add (
+			builder, "(sis)", filename,
+			ep_get_load_level (root),
+			(const gchar *) xmlBufferContent (buffer));
+
+		xmlBufferFree (buffer);
+	}
+
+	xmlFreeDoc (doc);
+
+	return 0;
+}
+
+static gchar *
+ep_get_manifest_filename (void)
+{
+	return g_build_filename (e_get_user_cache_dir (), EP_MANIFEST_FILE, NULL);
+}
+
+static gint64
+ep_get_directory_mtime (const gchar *path)
+{
+	GStatBuf st;
+
+	if (g_stat (path, &st) != 0)
+		return -1;
+
+	return st.st_mtime;
+}
+
+/* Returns the manifest of the plugin directory, read from the cache
+ * when the directory did not change since it had been written. */
+static GVariant *
+ep_ref_manifest (const gchar *path)
+{
+	GVariantBuilder builder;
+	GVariant *manifest;
+	GDir *dir;
+	gchar *filename, *dirname, *contents = NULL;
+	gsize length = 0;
+	gint64 mtime;
+	GError *error = NULL;
+
+	mtime = ep_get_directory_mtime (path);
+	filename = ep_get_manifest_filename ();
+
+	if (g_file_get_contents (filename, &contents, &length, NULL)) {
+		const gchar *version, *directory;
+		gint64 manifest_mtime;
+
+		manifest = g_variant_new_from_data (
+			G_VARIANT_TYPE (EP_MANIFEST_TYPE),
+			contents, length, FALSE, g_free, contents);
+		g_variant_ref_sink (manifest);
+
+		g_variant_get (manifest, "(&s&sxa(sis))", &version, &directory, &manifest_mtime, NULL);
+
+		if (g_strcmp0 (version, VERSION) == 0 &&
+		    g_strcmp0 (directory, path) == 0 &&
+		    manifest_mtime == mtime) {
+			g_free (filename);
+			return manifest;
+		}
+
+		g_variant_unref (manifest);
+	}
+
+	pd (printf ("scanning plugin dir '%s'\n", path));
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sis)"));
 
-			if (ep) {
-				/* README: Maybe we can use load_levels to
-				 * achieve the same thing.  But it may be
-				 * confusing for a plugin writer. */
-				is_system_plugin =
-					e_plugin_xml_prop (root, "system_plugin");
-				if (g_strcmp0 (is_system_plugin, "true") == 0) {
-					e_plugin_enable (ep, TRUE);
-					ep->flags |= E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
-				} else
-					ep->flags &= ~E_PLUGIN_FLAGS_SYSTEM_PLUGIN;
-				g_free (is_system_plugin);
-
-				ep = NULL;
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		const gchar *d;
+
+		while ((d = g_dir_read_name (dir))) {
+			if (g_str_has_suffix  (d, ".eplug")) {
+				gchar *name;
+
+				name = g_build_filename (path, d, NULL);
+				ep_scan (name, &builder);
+				g_free (name);
 			}
 		}
+
+		g_dir_close (dir);
 	}
 
-	xmlFreeDoc (pdoc->doc);
-	g_free (pdoc->filename);
-	g_free (pdoc);
+	manifest = g_variant_new ("(ssxa(sis))", VERSION, path, mtime, &builder);
+	g_variant_ref_sink (manifest);
 
-	return 0;
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	if (!g_file_set_contents (filename, g_variant_get_data (manifest), g_variant_get_size (manifest), &error)) {
+		g_warning ("%s: Failed to write '%s': %s", G_STRFUNC, filename, error->message);
+		g_clear_error (&error);
+	}
+
+	g_free (filename);
+
+	return manifest;
+}
+
+static void
+ep_load (GVariant *manifest,
+         gint load_level)
+{
+	GVariantIter *iter;
+	const gchar *filename, *xml;
+	gint plugin_load_level;
+
+	g_variant_get_child (manifest, 3, "a(sis)", &iter);
+
+	while (g_variant_iter_next (iter, "(&si&s)", &filename, &plugin_load_level, &xml)) {
+		struct _plugin_doc pdoc;
+		xmlDocPtr doc;
+
+		if (plugin_load_level != load_level)
+			continue;
+
+		doc = xmlReadMemory (xml, strlen (xml), filename, NULL, 0);
+		if (doc == NULL)
+			continue;
+
+		memset (&pdoc, 0, sizeof (pdoc));
+		pdoc.doc = doc;
+		pdoc.filename = (gchar *) filename;
+
+		ep_load_element (xmlDocGetRootElement (doc), &pdoc, load_level);
+
+		xmlFreeDoc (doc);
+	}
+
+	g_variant_iter_free (iter);
 }
 
 static void
@@ -476,7 +625,8 @@ plugin_hook_load_subclass (GType type,
  * e_plugin_load_plugins:
  *
  * Scan the search path, looking for plugin definitions, and load them
- * into memory.
+ * into memory.  The definitions are cached in the user cache directory
+ * and the search path is scanned again only when it changes.
  *
  * Return value: Returns -1 if an error occurred.
  **/
@@ -484,6 +634,7 @@ gint
 e_plugin_load_plugins (void)
 {
 	GSettings *settings;
+	GVariant *manifest;
 	gchar **strv;
 	gint i;
 
@@ -511,31 +662,12 @@ e_plugin_load_plugins (void)
 	g_strfreev (strv);
 	g_object_unref (settings);
 
-	for (i = 0; i < 3; i++) {
-		GDir *dir;
-		const gchar *d;
-		const gchar *path = EVOLUTION_PLUGINDIR;
-
-		pd (printf ("scanning plugin dir '%s'\n", path));
+	manifest = ep_ref_manifest (EVOLUTION_PLUGINDIR);
 
-		dir = g_dir_open (path, 0, NULL);
-		if (dir == NULL) {
-			/*g_warning("Could not find plugin path: %s", path);*/
-			continue;
-		}
+	for (i = 0; i < 3; i++)
+		ep_load (manifest, i);
 
-		while ((d = g_dir_read_name (dir))) {
-			if (g_str_has_suffix  (d, ".eplug")) {
-				gchar *name;
-
-				name = g_build_filename (path, d, NULL);
-				ep_load (name, i);
-				g_free (name);
-			}
-		}
-
-		g_dir_close (dir);
-	}
+	g_variant_unref (manifest);
 
 	return 0;
 }
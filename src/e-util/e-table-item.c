@@ -703,6 +703,165 @@ eti_row_height_real (ETableItem *eti,
 	return max_h;
 }
 
+/*
+ * The height_tree and the height_unknown_tree are Fenwick trees over the
+ * height_cache, thus the offset of any row and the row at any offset are
+ * found in O(log n) once the heights of the rows before it are known.
+ * Rows with unknown height count as zero pixels in the height_tree.
+ */
+static void
+eti_height_tree_free (ETableItem *eti)
+{
+	g_free (eti->height_tree);
+	g_free (eti->height_unknown_tree);
+	eti->height_tree = NULL;
+	eti->height_unknown_tree = NULL;
+	eti->height_tree_rows = 0;
+}
+
+/* Builds the trees from the height_cache in linear time. */
+static void
+eti_height_tree_build (ETableItem *eti)
+{
+	gint ii, n_rows = eti->rows;
+
+	eti_height_tree_free (eti);
+
+	if (!eti->height_cache)
+		return;
+
+	eti->height_tree = g_new (gint, n_rows + 1);
+	eti->height_unknown_tree = g_new (gint, n_rows + 1);
+	eti->height_tree_rows = n_rows;
+
+	eti->height_tree[0] = 0;
+	eti->height_unknown_tree[0] = 0;
+
+	for (ii = 1; ii <= n_rows; ii++) {
+		gint height = eti->height_cache[ii - 1];
+
+		eti->height_tree[ii] = height == -1 ? 0 : height;
+		eti->height_unknown_tree[ii] = height == -1 ? 1 : 0;
+	}
+
+	for (ii = 1; ii <= n_rows; ii++) {
+		gint parent = ii + (ii & (-ii));
+
+		if (parent <= n_rows) {
+			eti->height_tree[parent] += eti->height_tree[ii];
+			eti->height_unknown_tree[parent] += eti->height_unknown_tree[ii];
+		}
+	}
+}
+
+static gboolean
+eti_height_tree_valid (ETableItem *eti)
+{
+	return eti->height_tree && eti->height_tree_rows == eti->rows;
+}
+
+/* Updates the trees after the height_cache[row] changed
+ * from @old_height to @new_height, either may be -1. */
+static void
+eti_height_tree_update (ETableItem *eti,
+                        gint row,
+                        gint old_height,
+                        gint new_height)
+{
+	gint ii, delta, delta_unknown;
+
+	if (!eti_height_tree_valid (eti) || row < 0 || row >= eti->rows)
+		return;
+
+	delta = (new_height == -1 ? 0 : new_height) - (old_height == -1 ? 0 : old_height);
+	delta_unknown = (new_height == -1 ? 1 : 0) - (old_height == -1 ? 1 : 0);
+
+	for (ii = row + 1; ii <= eti->height_tree_rows; ii += ii & (-ii)) {
+		eti->height_tree[ii] += delta;
+		eti->height_unknown_tree[ii] += delta_unknown;
+	}
+}
+
+/* Returns the sum of the first @n_rows values of @tree. */
+static gint
+eti_height_tree_sum (const gint *tree,
+                     gint n_rows)
+{
+	gint ii, sum = 0;
+
+	for (ii = n_rows; ii > 0; ii -= ii & (-ii))
+		sum += tree[ii];
+
+	return sum;
+}
+
+static gint
+eti_height_tree_top_step (ETableItem *eti)
+{
+	gint step = 1;
+
+	while (step * 2 <= eti->height_tree_rows)
+		step *= 2;
+
+	return step;
+}
+
+/* Returns the first row with unknown height, or eti->rows if none. */
+static gint
+eti_height_tree_first_unknown (ETableItem *eti)
+{
+	gint pos = 0, step;
+
+	if (eti->rows == 0)
+		return 0;
+
+	for (step = eti_height_tree_top_step (eti); step > 0; step /= 2) {
+		if (pos + step <= eti->height_tree_rows &&
+		    eti->height_unknown_tree[pos + step] == 0)
+			pos += step;
+	}
+
+	return pos;
+}
+
+/*
+ * Returns the first row ending at or below @y, counted from the top of
+ * the first row, with each row taking @height_extra more pixels than its
+ * height, or eti->rows if @y lies below the last row.  Returns -1 when it
+ * cannot tell, because the height of some of the rows above is unknown.
+ */
+static gint
+eti_height_tree_find (ETableItem *eti,
+                      gint y,
+                      gint height_extra)
+{
+	gint pos = 0, step;
+
+	if (!eti_height_tree_valid (eti))
+		return -1;
+
+	if (eti->rows == 0)
+		return 0;
+
+	for (step = eti_height_tree_top_step (eti); step > 0; step /= 2) {
+		gint span;
+
+		if (pos + step > eti->height_tree_rows)
+			continue;
+
+		span = eti->height_tree[pos + step] + step * height_extra;
+		if (span < y) {
+			pos += step;
+			y -= span;
+		}
+	}
+
+	if (eti_height_tree_sum (eti->height_unknown_tree, MIN (pos + 1, eti->rows)) != 0)
+		return -1;
+
+	return pos;
+}
+
 static void
 confirm_height_cache (ETableItem *eti)
 {
@@ -714,6 +873,8 @@ confirm_height_cache (ETableItem *eti)
 	for (i = 0; i < eti->rows; i++) {
 		eti->height_cache[i] = -1;
 	}
+
+	eti_height_tree_build (eti);
 }
 
 static gboolean
@@ -749,6 +910,7 @@ free_height_cache (ETableItem *eti)
 		if (eti->height_cache)
 			g_free (eti->height_cache);
 		eti->height_cache = NULL;
+		eti_height_tree_free (eti);
 		eti->height_cache_idle_count = 0;
 		eti->uniform_row_height_cache = -1;
 
@@ -788,6 +950,7 @@ eti_row_height (ETableItem *eti,
 		}
 		if (eti->height_cache[row] == -1) {
 			eti->height_cache[row] = eti_row_height_real (eti, row);
+			eti_height_tree_update (eti, row, -1, eti->height_cache[row]);
 			if (row > 0 &&
 			    eti->length_threshold != -1 &&
 			    eti->rows > eti->length_threshold &&
@@ -830,7 +993,13 @@ eti_get_height (ETableItem *eti)
 		if (eti->length_threshold != -1) {
 			if (rows > eti->length_threshold) {
 				gint row_height = ETI_ROW_HEIGHT (eti, 0);
-				if (eti->height_cache) {
+				if (eti_height_tree_valid (eti)) {
+					/* The known heights up to the first unknown one,
+					 * which is where the idle callback got so far */
+					row = eti_height_tree_first_unknown (eti);
+					height = eti_height_tree_sum (eti->height_tree, row) + row * height_extra;
+					height += (row_height + height_extra) * (rows - row);
+				} else if (eti->height_cache) {
 					height = 0;
 					for (row = 0; row < rows; row++) {
 						if (eti->height_cache[row] == -1) {
@@ -850,11 +1019,7 @@ eti_get_height (ETableItem *eti)
 			}
 		}
 
-		height = height_extra;
-		for (row = 0; row < rows; row++)
-			height += ETI_ROW_HEIGHT (eti, row) + height_extra;
-
-		return height;
+		return height_extra + e_table_item_row_diff (eti, 0, rows);
 	}
 }
 
@@ -899,6 +1064,28 @@ e_table_item_row_diff (ETableItem *eti,
 		return ((end_row - start_row) * (ETI_ROW_HEIGHT (eti, -1) + height_extra));
 	} else {
 		gint row, total;
+
+		if (end_row <= start_row)
+			return 0;
+
+		if (eti_height_tree_valid (eti)) {
+			gint n_unknown;
+
+			n_unknown =
+				eti_height_tree_sum (eti->height_unknown_tree, end_row) -
+				eti_height_tree_sum (eti->height_unknown_tree, start_row);
+
+			if (n_unknown == 0) {
+				total =
+					eti_height_tree_sum (eti->height_tree, end_row) -
+					eti_height_tree_sum (eti->height_tree, start_row);
+
+				return total + (end_row - start_row) * height_extra;
+			}
+		}
+
+		/* This computes the unknown heights on the way,
+		 * thus the next time the trees can answer. */
 		total = 0;
 		for (row = start_row; row < end_row; row++)
 			total += ETI_ROW_HEIGHT (eti, row) + height_extra;
@@ -1238,6 +1425,24 @@ eti_table_model_changed (ETableModel *table_model,
 	eti_idle_maybe_show_cursor (eti);
 }
 
+/* The rows below @row move, but their heights stay,
+ * thus only the trees need to know about the change. */
+static void
+eti_row_height_changed (ETableItem *eti,
+                        gint row,
+                        gint height)
+{
+	eti_height_tree_update (eti, row, eti->height_cache[row], height);
+	eti->height_cache[row] = height;
+
+	eti_unfreeze (eti);
+
+	eti->needs_compute_height = 1;
+	e_canvas_item_request_reflow (GNOME_CANVAS_ITEM (eti));
+	eti->needs_redraw = 1;
+	gnome_canvas_item_request_update (GNOME_CANVAS_ITEM (eti));
+}
+
 static void
 eti_table_model_row_changed (ETableModel *table_model,
                              gint row,
@@ -1250,9 +1455,13 @@ eti_table_model_row_changed (ETableModel *table_model,
 		return;
 	}
 
-	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1 && eti_row_height_real (eti, row) != eti->height_cache[row]) {
-		eti_table_model_changed (table_model, eti);
-		return;
+	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1) {
+		gint height = eti_row_height_real (eti, row);
+
+		if (height != eti->height_cache[row]) {
+			eti_row_height_changed (eti, row, height);
+			return;
+		}
 	}
 
 	eti_unfreeze (eti);
@@ -1273,9 +1482,13 @@ eti_table_model_cell_changed (ETableModel *table_model,
 		return;
 	}
 
-	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1 && eti_row_height_real (eti, row) != eti->height_cache[row]) {
-		eti_table_model_changed (table_model, eti);
-		return;
+	if ((!eti->uniform_row_height) && eti->height_cache && eti->height_cache[row] != -1) {
+		gint height = eti_row_height_real (eti, row);
+
+		if (height != eti->height_cache[row]) {
+			eti_row_height_changed (eti, row, height);
+			return;
+		}
 	}
 
 	eti_unfreeze (eti);
@@ -1303,6 +1516,8 @@ eti_table_model_rows_inserted (ETableModel *table_model,
 		memmove (eti->height_cache + row + count, eti->height_cache + row, (eti->rows - count - row) * sizeof (gint));
 		for (i = row; i < row + count; i++)
 			eti->height_cache[i] = -1;
+
+		eti_height_tree_build (eti);
 	}
 
 	eti_unfreeze (eti);
@@ -1334,6 +1549,9 @@ eti_table_model_rows_deleted (ETableModel *table_model,
 		memmove (eti->height_cache + row, eti->height_cache + row + count, (eti->rows - row) * sizeof (gint));
 	}
 
+	if (eti->height_cache)
+		eti_height_tree_build (eti);
+
 	eti_unfreeze (eti);
 
 	eti_idle_maybe_show_cursor (eti);
@@ -1587,6 +1805,7 @@ eti_dispose (GObject *object)
 	if (eti->height_cache)
 		g_free (eti->height_cache);
 	eti->height_cache = NULL;
+	eti_height_tree_free (eti);
 
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_table_item_parent_class)->dispose (object);
@@ -1742,6 +1961,10 @@ e_table_item_init (ETableItem *eti)
 	eti->height_cache_idle_id = 0;
 	eti->height_cache_idle_count = 0;
 
+	eti->height_tree = NULL;
+	eti->height_unknown_tree = NULL;
+	eti->height_tree_rows = 0;
+
 	eti->length_threshold = -1;
 	eti->uniform_row_height = FALSE;
 
@@ -1863,6 +2086,7 @@ eti_unrealize (GnomeCanvasItem *item)
 	if (eti->height_cache)
 		g_free (eti->height_cache);
 	eti->height_cache = NULL;
+	eti_height_tree_free (eti);
 	eti->height_cache_idle_count = 0;
 
 	eti_unrealize_cell_views (eti);
@@ -1980,7 +2204,16 @@ eti_draw (GnomeCanvasItem *item,
 		first_row = -1;
 
 		y1 = y2 = floor (eti_base_y) + height_extra;
-		for (row = 0; row < rows; row++, y1 = y2) {
+
+		/* Skip the rows above the region */
+		row = eti_height_tree_find (eti, y - y1, height_extra);
+		if (row > 0 && row < rows) {
+			y1 = y2 = y1 + e_table_item_row_diff (eti, 0, row);
+		} else if (row != rows) {
+			row = 0;
+		}
+
+		for (; row < rows; row++, y1 = y2) {
 
 			y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
 
@@ -2234,8 +2467,6 @@ find_cell (ETableItem *eti,
 
 	gint height_extra = eti->horizontal_draw_grid ? 1 : 0;
 
-	/* FIXME: this routine is inneficient, fix later */
-
 	if (eti->grabbed_col >= 0 && eti->grabbed_row >= 0) {
 		*view_col_res = eti->grabbed_col;
 		*view_row_res = eti->grabbed_row;
@@ -2268,18 +2499,27 @@ find_cell (ETableItem *eti,
 		if (row >= eti->rows)
 			return FALSE;
 	} else {
-		y1 = y2 = height_extra;
 		if (y < height_extra)
 			return FALSE;
-		for (row = 0; row < rows; row++, y1 = y2) {
-			y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
 
-			if (y <= y2)
-				break;
-		}
+		row = eti_height_tree_find (eti, ceil (y) - height_extra, height_extra);
+		if (row >= 0) {
+			if (row == rows)
+				return FALSE;
 
-		if (row == rows)
-			return FALSE;
+			y1 = height_extra + e_table_item_row_diff (eti, 0, row);
+		} else {
+			y1 = y2 = height_extra;
+			for (row = 0; row < rows; row++, y1 = y2) {
+				y2 += ETI_ROW_HEIGHT (eti, row) + height_extra;
+
+				if (y <= y2)
+					break;
+			}
+
+			if (row == rows)
+				return FALSE;
+		}
 	}
 	*view_col_res = col;
 	if (x1_res)
@@ -149,6 +149,14 @@ struct _ETableItem {
 	gint height_cache_idle_id;
 	gint height_cache_idle_count;
 
+	/*
+	 * Fenwick trees over the height_cache, with the sum of the
+	 * known row heights and the count of the unknown ones
+	 */
+	gint *height_tree;
+	gint *height_unknown_tree;
+	gint height_tree_rows;
+
 	/*
 	 * Lengh Threshold: above this, we stop computing correctly
 	 * the size
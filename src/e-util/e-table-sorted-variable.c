@@ -156,6 +156,8 @@ etsv_add (ETableSubsetVariable *etssv,
 	etss->map_table[i] = row;
 	etss->n_map++;
 
+	e_table_subset_map_changed_from (etss, i);
+
 	e_table_model_row_inserted (etm, i);
 }
 
@@ -181,6 +183,8 @@ etsv_add_all (ETableSubsetVariable *etssv)
 	for (i = 0; i < rows; i++)
 		etss->map_table[etss->n_map++] = i;
 
+	e_table_subset_map_changed_from (etss, etss->n_map - rows);
+
 	if (etsv->sort_idle_id == 0) {
 		etsv->sort_idle_id = g_idle_add_full (50, (GSourceFunc) etsv_sort_idle, etsv, NULL);
 	}
@@ -235,6 +239,7 @@ etsv_sort (ETableSortedVariable *etsv)
 
 	source_model = e_table_subset_get_source_model (etss);
 	e_table_sorting_utils_sort (source_model, etsv->sort_info, etsv->full_header, etss->map_table, etss->n_map);
+	e_table_subset_map_changed (etss);
 
 	e_table_model_changed (E_TABLE_MODEL (etsv));
 	reentering = 0;
@@ -171,6 +171,8 @@ ets_proxy_model_changed (ETableSubset *subset,
 		subset->map_table[i] = i;
 	}
 
+	e_table_subset_map_changed (subset);
+
 	if (!E_TABLE_SORTED (subset)->sort_idle_id)
 		E_TABLE_SORTED (subset)->sort_idle_id = g_idle_add_full (50, (GSourceFunc) ets_sort_idle, subset, NULL);
 
@@ -228,6 +230,8 @@ ets_proxy_model_rows_inserted (ETableSubset *etss,
 				etss->map_table[i] += count;
 			}
 		}
+
+		e_table_subset_map_changed (etss);
 	}
 
 	etss->map_table = g_realloc (etss->map_table, (etss->n_map + count) * sizeof (gint));
@@ -254,6 +258,7 @@ ets_proxy_model_rows_inserted (ETableSubset *etss,
 		}
 		etss->map_table[i] = row;
 		etss->n_map++;
+		e_table_subset_map_changed_from (etss, i);
 		if (!full_change) {
 			e_table_model_row_inserted (etm, i);
 		}
@@ -282,15 +287,15 @@ ets_proxy_model_rows_deleted (ETableSubset *etss,
 	shift = row == etss->n_map - count;
 
 	for (j = 0; j < count; j++) {
-		for (i = 0; i < etss->n_map; i++) {
-			if (etss->map_table[i] == row + j) {
-				if (shift)
-					e_table_model_pre_change (etm);
-				memmove (etss->map_table + i, etss->map_table + i + 1, (etss->n_map - i - 1) * sizeof (gint));
-				etss->n_map--;
-				if (shift)
-					e_table_model_row_deleted (etm, i);
-			}
+		i = e_table_subset_model_to_view_row (etss, row + j);
+		if (i != -1) {
+			if (shift)
+				e_table_model_pre_change (etm);
+			memmove (etss->map_table + i, etss->map_table + i + 1, (etss->n_map - i - 1) * sizeof (gint));
+			etss->n_map--;
+			e_table_subset_map_changed_from (etss, i);
+			if (shift)
+				e_table_model_row_deleted (etm, i);
 		}
 	}
 	if (!shift) {
@@ -299,6 +304,8 @@ ets_proxy_model_rows_deleted (ETableSubset *etss,
 				etss->map_table[i] -= count;
 		}
 
+		e_table_subset_map_changed (etss);
+
 		e_table_model_changed (etm);
 	} else {
 		e_table_model_no_change (etm);
@@ -327,6 +334,8 @@ ets_sort (ETableSorted *ets)
 		source_model, ets->sort_info,
 		ets->full_header, etss->map_table, etss->n_map);
 
+	e_table_subset_map_changed (etss);
+
 	e_table_model_changed (E_TABLE_MODEL (ets));
 	reentering = 0;
 }
@@ -165,7 +165,7 @@ table_sorter_sort (ETableSorter *table_sorter)
 		qd.ascending[j] = (sort_type == GTK_SORT_ASCENDING);
 	}
 
-	g_qsort_with_data (table_sorter->sorted, rows, sizeof (gint), qsort_callback, &qd);
+	e_table_sorting_utils_sort_rows (table_sorter->sorted, rows, qsort_callback, &qd);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
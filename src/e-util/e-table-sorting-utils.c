@@ -30,6 +30,14 @@
 
 #define d(x)
 
+/* Fewer rows than this are sorted in the calling thread. */
+#define PARALLEL_SORT_MIN_ROWS 10000
+#define PARALLEL_SORT_MAX_THREADS 8
+
+/* The compare cache of the worker thread of the parallel sort,
+ * which replaces the caller's cache, as that is not thread safe. */
+static GPrivate parallel_sort_cmp_cache = G_PRIVATE_INIT ((GDestroyNotify) g_hash_table_destroy);
+
 /* This takes source rows. */
 static gint
 etsu_compare (ETableModel *source,
@@ -180,8 +188,8 @@ e_table_sorting_utils_sort (ETableModel *source,
 		closure.compare[j] = col->compare;
 	}
 
-	g_qsort_with_data (
-		map_table, rows, sizeof (gint), e_sort_callback, &closure);
+	e_table_sorting_utils_sort_rows (
+		map_table, rows, e_sort_callback, &closure);
 
 	for (j = 0; j < cols; j++) {
 		ETableColumnSpecification *spec;
@@ -399,8 +407,8 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 		map[i] = i;
 	}
 
-	g_qsort_with_data (
-		map, count, sizeof (gint), e_sort_callback, &closure);
+	e_table_sorting_utils_sort_rows (
+		map, count, e_sort_callback, &closure);
 
 	map_copy = g_new (ETreePath, count);
 	for (i = 0; i < count; i++) {
@@ -549,6 +557,9 @@ e_table_sorting_utils_add_to_cmp_cache (gpointer cmp_cache,
 	g_return_if_fail (cmp_cache != NULL);
 	g_return_if_fail (key != NULL);
 
+	if (g_private_get (&parallel_sort_cmp_cache) != NULL)
+		cmp_cache = g_private_get (&parallel_sort_cmp_cache);
+
 	g_hash_table_insert (
 		cmp_cache, (gchar *) camel_pstring_strdup (key), value);
 }
@@ -570,5 +581,224 @@ e_table_sorting_utils_lookup_cmp_cache (gpointer cmp_cache,
 	if (cmp_cache == NULL)
 		return NULL;
 
+	if (g_private_get (&parallel_sort_cmp_cache) != NULL)
+		cmp_cache = g_private_get (&parallel_sort_cmp_cache);
+
 	return g_hash_table_lookup (cmp_cache, key);
 }
+
+typedef struct _ParallelSort {
+	gint *rows;
+	gint *tmp;
+	GCompareDataFunc compare;
+	gpointer user_data;
+
+	GMutex lock;
+	GCond cond;
+	gint n_pending;
+} ParallelSort;
+
+typedef struct _ParallelSortTask {
+	ParallelSort *sort;
+	gint start;
+	gint middle;	/* -1 to sort the run, otherwise where the second run starts */
+	gint end;
+} ParallelSortTask;
+
+static void
+parallel_sort_merge (ParallelSort *sort,
+                     gint start,
+                     gint middle,
+                     gint end)
+{
+	gint ii = start, jj = middle, kk = start;
+
+	while (ii < middle && jj < end) {
+		/* Taking from the first run on ties keeps the merge stable. */
+		if (sort->compare (&sort->rows[jj], &sort->rows[ii], sort->user_data) < 0)
+			sort->tmp[kk++] = sort->rows[jj++];
+		else
+			sort->tmp[kk++] = sort->rows[ii++];
+	}
+
+	while (ii < middle)
+		sort->tmp[kk++] = sort->rows[ii++];
+
+	while (jj < end)
+		sort->tmp[kk++] = sort->rows[jj++];
+
+	memcpy (sort->rows + start, sort->tmp + start, sizeof (gint) * (end - start));
+}
+
+static void
+parallel_sort_thread (gpointer task_data,
+                      gpointer user_data)
+{
+	ParallelSortTask *task = task_data;
+	ParallelSort *sort = task->sort;
+
+	g_private_replace (&parallel_sort_cmp_cache, e_table_sorting_utils_create_cmp_cache ());
+
+	if (task->middle == -1)
+		g_qsort_with_data (
+			sort->rows + task->start,
+			task->end - task->start,
+			sizeof (gint),
+			sort->compare,
+			sort->user_data);
+	else
+		parallel_sort_merge (sort, task->start, task->middle, task->end);
+
+	g_private_replace (&parallel_sort_cmp_cache, NULL);
+
+	g_mutex_lock (&sort->lock);
+	sort->n_pending--;
+	if (sort->n_pending == 0)
+		g_cond_signal (&sort->cond);
+	g_mutex_unlock (&sort->lock);
+}
+
+static GThreadPool *
+parallel_sort_ref_thread_pool (guint *n_threads)
+{
+	static GThreadPool *thread_pool = NULL;
+	static guint max_threads = 0;
+	static GMutex thread_pool_mutex;
+
+	g_mutex_lock (&thread_pool_mutex);
+
+	if (!thread_pool) {
+		max_threads = CLAMP (g_get_num_processors (), 1, PARALLEL_SORT_MAX_THREADS);
+
+		/* Single processor machines sort in the calling thread. */
+		if (max_threads > 1)
+			thread_pool = g_thread_pool_new (parallel_sort_thread, NULL, max_threads, FALSE, NULL);
+	}
+
+	g_mutex_unlock (&thread_pool_mutex);
+
+	*n_threads = max_threads;
+
+	return thread_pool;
+}
+
+/* Runs the tasks and waits until all of them are finished. */
+static void
+parallel_sort_run_tasks (ParallelSort *sort,
+                         GThreadPool *thread_pool,
+                         ParallelSortTask *tasks,
+                         gint n_tasks)
+{
+	gint ii;
+
+	sort->n_pending = n_tasks;
+
+	for (ii = 0; ii < n_tasks; ii++)
+		g_thread_pool_push (thread_pool, &tasks[ii], NULL);
+
+	g_mutex_lock (&sort->lock);
+	while (sort->n_pending > 0)
+		g_cond_wait (&sort->cond, &sort->lock);
+	g_mutex_unlock (&sort->lock);
+}
+
+/**
+ * e_table_sorting_utils_sort_rows:
+ * @rows: an array of row indexes to sort
+ * @n_rows: count of items in @rows
+ * @compare: a function to compare two items of @rows
+ * @user_data: user data passed to @compare
+ *
+ * Sorts @rows like g_qsort_with_data() does.  Large arrays are split
+ * into runs, which are sorted and then merged in parallel on a shared,
+ * bounded thread pool; small arrays are sorted in the calling thread.
+ *
+ * The @compare is called from the worker threads, thus it cannot access
+ * anything what is not thread safe, like the table model.  A compare cache
+ * passed to it is used only in the calling thread, the workers use their
+ * own.  The result equals to the serial sort as long as the @compare
+ * defines a total order, like when ties are broken by the row index.
+ *
+ * Since: 3.26
+ **/
+void
+e_table_sorting_utils_sort_rows (gint *rows,
+                                 gint n_rows,
+                                 GCompareDataFunc compare,
+                                 gpointer user_data)
+{
+	GThreadPool *thread_pool;
+	ParallelSort sort;
+	ParallelSortTask *tasks;
+	gint *bounds;
+	guint n_threads = 1;
+	gint n_runs, ii;
+
+	g_return_if_fail (rows != NULL || n_rows == 0);
+	g_return_if_fail (compare != NULL);
+
+	if (n_rows >= PARALLEL_SORT_MIN_ROWS)
+		thread_pool = parallel_sort_ref_thread_pool (&n_threads);
+	else
+		thread_pool = NULL;
+
+	if (!thread_pool) {
+		g_qsort_with_data (rows, n_rows, sizeof (gint), compare, user_data);
+		return;
+	}
+
+	/* Not less than half of the threshold in one run. */
+	n_runs = MIN (n_threads, n_rows / (PARALLEL_SORT_MIN_ROWS / 2));
+	n_runs = MAX (n_runs, 2);
+
+	sort.rows = rows;
+	sort.tmp = g_new (gint, n_rows);
+	sort.compare = compare;
+	sort.user_data = user_data;
+	g_mutex_init (&sort.lock);
+	g_cond_init (&sort.cond);
+
+	tasks = g_new0 (ParallelSortTask, n_runs);
+	bounds = g_new (gint, n_runs + 1);
+
+	for (ii = 0; ii <= n_runs; ii++)
+		bounds[ii] = (gint) (((gint64) n_rows) * ii / n_runs);
+
+	for (ii = 0; ii < n_runs; ii++) {
+		tasks[ii].sort = &sort;
+		tasks[ii].start = bounds[ii];
+		tasks[ii].middle = -1;
+		tasks[ii].end = bounds[ii + 1];
+	}
+
+	parallel_sort_run_tasks (&sort, thread_pool, tasks, n_runs);
+
+	/* Merge neighbouring runs pairwise until only one is left. */
+	while (n_runs > 1) {
+		gint n_merges = n_runs / 2;
+
+		for (ii = 0; ii < n_merges; ii++) {
+			tasks[ii].sort = &sort;
+			tasks[ii].start = bounds[2 * ii];
+			tasks[ii].middle = bounds[2 * ii + 1];
+			tasks[ii].end = bounds[2 * ii + 2];
+		}
+
+		parallel_sort_run_tasks (&sort, thread_pool, tasks, n_merges);
+
+		for (ii = 0; ii <= n_merges; ii++)
+			bounds[ii] = bounds[2 * ii];
+
+		/* An odd run is carried over to the next round as is. */
+		if (n_runs % 2 != 0)
+			bounds[n_merges + 1] = bounds[n_runs];
+
+		n_runs = n_runs - n_merges;
+	}
+
+	g_mutex_clear (&sort.lock);
+	g_cond_clear (&sort.cond);
+	g_free (sort.tmp);
+	g_free (bounds);
+	g_free (tasks);
+}
@@ -88,6 +88,10 @@ void		e_table_sorting_utils_add_to_cmp_cache
 const gchar *	e_table_sorting_utils_lookup_cmp_cache
 						(gpointer cmp_cache,
 						 const gchar *key);
+void		e_table_sorting_utils_sort_rows	(gint *rows,
+						 gint n_rows,
+						 GCompareDataFunc compare,
+						 gpointer user_data);
 
 G_END_DECLS
 
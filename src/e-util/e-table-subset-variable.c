@@ -53,6 +53,8 @@ etssv_add (ETableSubsetVariable *etssv,
 
 	etss->map_table[etss->n_map++] = row;
 
+	e_table_subset_map_changed_from (etss, etss->n_map - 1);
+
 	e_table_model_row_inserted (etm, etss->n_map - 1);
 }
 
@@ -76,6 +78,8 @@ etssv_add_array (ETableSubsetVariable *etssv,
 	for (i = 0; i < count; i++)
 		etss->map_table[etss->n_map++] = array[i];
 
+	e_table_subset_map_changed_from (etss, etss->n_map - count);
+
 	e_table_model_changed (etm);
 }
 
@@ -102,6 +106,8 @@ etssv_add_all (ETableSubsetVariable *etssv)
 	for (i = 0; i < rows; i++)
 		etss->map_table[etss->n_map++] = i;
 
+	e_table_subset_map_changed_from (etss, etss->n_map - rows);
+
 	e_table_model_changed (etm);
 }
 
@@ -113,20 +119,22 @@ etssv_remove (ETableSubsetVariable *etssv,
 	ETableSubset *etss = E_TABLE_SUBSET (etssv);
 	gint i;
 
-	for (i = 0; i < etss->n_map; i++) {
-		if (etss->map_table[i] == row) {
-			e_table_model_pre_change (etm);
-			memmove (
-				etss->map_table + i,
-				etss->map_table + i + 1,
-				(etss->n_map - i - 1) * sizeof (gint));
-			etss->n_map--;
-
-			e_table_model_row_deleted (etm, i);
-			return TRUE;
-		}
-	}
-	return FALSE;
+	i = e_table_subset_model_to_view_row (etss, row);
+	if (i == -1)
+		return FALSE;
+
+	e_table_model_pre_change (etm);
+	memmove (
+		etss->map_table + i,
+		etss->map_table + i + 1,
+		(etss->n_map - i - 1) * sizeof (gint));
+	etss->n_map--;
+
+	e_table_subset_map_changed_from (etss, i);
+
+	e_table_model_row_deleted (etm, i);
+
+	return TRUE;
 }
 
 static void
@@ -226,6 +234,8 @@ e_table_subset_variable_clear (ETableSubsetVariable *etssv)
 	etss->map_table = (gint *) g_new (guint, 1);
 	etssv->n_vals_allocated = 1;
 
+	e_table_subset_map_changed (etss);
+
 	e_table_model_changed (etm);
 }
 
@@ -240,6 +250,8 @@ e_table_subset_variable_increment (ETableSubsetVariable *etssv,
 		if (etss->map_table[i] >= position)
 			etss->map_table[i] += amount;
 	}
+
+	e_table_subset_map_changed (etss);
 }
 
 void
@@ -253,6 +265,8 @@ e_table_subset_variable_decrement (ETableSubsetVariable *etssv,
 		if (etss->map_table[i] >= position)
 			etss->map_table[i] -= amount;
 	}
+
+	e_table_subset_map_changed (etss);
 }
 
 void
@@ -48,7 +48,11 @@ struct _ETableSubsetPrivate {
 	gulong table_model_rows_inserted_handler_id;
 	gulong table_model_rows_deleted_handler_id;
 
-	gint last_access;
+	/* Inverse of the map_table, model row to view row;
+	 * rebuilt on demand when not valid. */
+	gint *view_rows;
+	gint n_view_rows;
+	gboolean view_rows_valid;
 };
 
 /* Forward Declarations */
@@ -63,41 +67,74 @@ G_DEFINE_TYPE_WITH_CODE (
 		E_TYPE_TABLE_MODEL,
 		e_table_subset_table_model_init))
 
+static void
+table_subset_set_view_row (ETableSubset *table_subset,
+                           gint model_row,
+                           gint view_row)
+{
+	ETableSubsetPrivate *priv = table_subset->priv;
+
+	if (model_row < 0)
+		return;
+
+	if (model_row >= priv->n_view_rows) {
+		gint new_size = MAX (model_row + 1, priv->n_view_rows * 2), i;
+
+		priv->view_rows = g_renew (gint, priv->view_rows, new_size);
+		for (i = priv->n_view_rows; i < new_size; i++)
+			priv->view_rows[i] = -1;
+		priv->n_view_rows = new_size;
+	}
+
+	priv->view_rows[model_row] = view_row;
+}
+
+static void
+table_subset_ensure_view_rows (ETableSubset *table_subset)
+{
+	ETableSubsetPrivate *priv = table_subset->priv;
+	gint i, max_row = -1;
+
+	if (priv->view_rows_valid)
+		return;
+
+	for (i = 0; i < table_subset->n_map; i++)
+		max_row = MAX (max_row, table_subset->map_table[i]);
+
+	g_free (priv->view_rows);
+	priv->n_view_rows = max_row + 1;
+	priv->view_rows = g_new (gint, MAX (priv->n_view_rows, 1));
+
+	for (i = 0; i < priv->n_view_rows; i++)
+		priv->view_rows[i] = -1;
+
+	for (i = 0; i < table_subset->n_map; i++)
+		table_subset_set_view_row (table_subset, table_subset->map_table[i], i);
+
+	priv->view_rows_valid = TRUE;
+}
+
 static gint
 table_subset_get_view_row (ETableSubset *table_subset,
                            gint row)
 {
-	const gint n = table_subset->n_map;
-	const gint * const map_table = table_subset->map_table;
-	gint i;
+	ETableSubsetPrivate *priv = table_subset->priv;
+	gint view_row;
 
-	gint end = MIN (
-		table_subset->n_map,
-		table_subset->priv->last_access + 10);
-	gint start = MAX (0, table_subset->priv->last_access - 10);
-	gint initial = MAX (MIN (table_subset->priv->last_access, end), start);
-
-	for (i = initial; i < end; i++) {
-		if (map_table[i] == row) {
-			table_subset->priv->last_access = i;
-			return i;
-		}
-	}
+	table_subset_ensure_view_rows (table_subset);
 
-	for (i = initial - 1; i >= start; i--) {
-		if (map_table[i] == row) {
-			table_subset->priv->last_access = i;
-			return i;
-		}
-	}
+	if (row < 0 || row >= priv->n_view_rows)
+		return -1;
 
-	for (i = 0; i < n; i++) {
-		if (map_table[i] == row) {
-			table_subset->priv->last_access = i;
-			return i;
-		}
-	}
-	return -1;
+	view_row = priv->view_rows[row];
+
+	/* Rows removed from the map are not cleared from the inverse map,
+	 * thus verify the entry still points to the requested row. */
+	if (view_row < 0 || view_row >= table_subset->n_map ||
+	    table_subset->map_table[view_row] != row)
+		return -1;
+
+	return view_row;
 }
 
 static void
@@ -170,6 +207,7 @@ table_subset_finalize (GObject *object)
 	table_subset = E_TABLE_SUBSET (object);
 
 	g_free (table_subset->map_table);
+	g_free (table_subset->priv->view_rows);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_table_subset_parent_class)->finalize (object);
@@ -268,8 +306,6 @@ table_subset_value_at (ETableModel *table_model,
 
 	g_return_val_if_fail (VALID_ROW (table_subset, row), NULL);
 
-	table_subset->priv->last_access = row;
-
 	return e_table_model_value_at (
 		table_subset->priv->source_model,
 		col, MAP_ROW (table_subset, row));
@@ -285,8 +321,6 @@ table_subset_set_value_at (ETableModel *table_model,
 
 	g_return_if_fail (VALID_ROW (table_subset, row));
 
-	table_subset->priv->last_access = row;
-
 	e_table_model_set_value_at (
 		table_subset->priv->source_model,
 		col, MAP_ROW (table_subset, row), val);
@@ -554,6 +588,8 @@ e_table_subset_construct (ETableSubset *table_subset,
 	for (i = 0; i < nvals; i++)
 		table_subset->map_table[i] = i;
 
+	e_table_subset_map_changed (table_subset);
+
 	handler_id = g_signal_connect (
 		source_model, "model_pre_change",
 		G_CALLBACK (table_subset_proxy_model_pre_change),
@@ -629,15 +665,9 @@ gint
 e_table_subset_model_to_view_row (ETableSubset *table_subset,
                                   gint model_row)
 {
-	gint i;
-
 	g_return_val_if_fail (E_IS_TABLE_SUBSET (table_subset), -1);
 
-	for (i = 0; i < table_subset->n_map; i++) {
-		if (table_subset->map_table[i] == model_row)
-			return i;
-	}
-	return -1;
+	return table_subset_get_view_row (table_subset, model_row);
 }
 
 gint
@@ -652,6 +682,51 @@ e_table_subset_view_to_model_row (ETableSubset *table_subset,
 		return -1;
 }
 
+/**
+ * e_table_subset_map_changed:
+ * @table_subset: an #ETableSubset
+ *
+ * Notifies the @table_subset that its map_table had been rewritten, like
+ * after a sort, or that the model rows stored in it had been renumbered.
+ * The model to view row mapping is rebuilt on the next lookup.
+ *
+ * Since: 3.26
+ **/
+void
+e_table_subset_map_changed (ETableSubset *table_subset)
+{
+	g_return_if_fail (E_IS_TABLE_SUBSET (table_subset));
+
+	table_subset->priv->view_rows_valid = FALSE;
+}
+
+/**
+ * e_table_subset_map_changed_from:
+ * @table_subset: an #ETableSubset
+ * @view_row: the first changed view row
+ *
+ * Notifies the @table_subset that rows had been inserted to or removed
+ * from its map_table at @view_row, thus the rows from @view_row to
+ * the end of the map moved.  The model row numbers are unchanged.
+ * The model to view row mapping is updated only for the moved rows.
+ *
+ * Since: 3.26
+ **/
+void
+e_table_subset_map_changed_from (ETableSubset *table_subset,
+                                 gint view_row)
+{
+	gint i;
+
+	g_return_if_fail (E_IS_TABLE_SUBSET (table_subset));
+
+	if (!table_subset->priv->view_rows_valid)
+		return;
+
+	for (i = MAX (view_row, 0); i < table_subset->n_map; i++)
+		table_subset_set_view_row (table_subset, table_subset->map_table[i], i);
+}
+
 ETableModel *
 e_table_subset_get_toplevel (ETableSubset *table_subset)
 {
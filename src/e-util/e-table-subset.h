@@ -59,7 +59,8 @@ struct _ETableSubset {
 	GObject parent;
 	ETableSubsetPrivate *priv;
 
-	/* protected - subclasses modify this directly */
+	/* protected - subclasses modify this directly and then call
+	 * e_table_subset_map_changed() or e_table_subset_map_changed_from() */
 	gint n_map;
 	gint *map_table;
 };
@@ -109,6 +110,9 @@ gint		e_table_subset_model_to_view_row
 gint		e_table_subset_view_to_model_row
 						(ETableSubset *table_subset,
 						 gint view_row);
+void		e_table_subset_map_changed	(ETableSubset *table_subset);
+void		e_table_subset_map_changed_from	(ETableSubset *table_subset,
+						 gint view_row);
 ETableModel *	e_table_subset_get_toplevel	(ETableSubset *table_subset);
 void		e_table_subset_print_debugging	(ETableSubset *table_subset);
 
@@ -84,6 +84,11 @@ struct _ETreeTableAdapterPrivate {
 	guint resort_idle_id;
 
 	gint force_expanded_state; /* use this instead of model's default if not 0; <0 ... collapse, >0 ... expand */
+
+	/* Batched node changes, see e_tree_table_adapter_begin_update() */
+	gint update_depth;
+	GHashTable *update_resort_nodes; /* GNode * ~> NULL, parents to resort */
+	gboolean update_map_needed;
 };
 
 enum {
@@ -278,6 +283,9 @@ kill_gnode (GNode *node,
 {
 	g_hash_table_remove (etta->priv->nodes, ((node_t *) node->data)->path);
 
+	if (etta->priv->update_depth > 0)
+		g_hash_table_remove (etta->priv->update_resort_nodes, node);
+
 	while (node->children) {
 		GNode *next = node->children->next;
 		kill_gnode (node->children, etta);
@@ -326,11 +334,33 @@ delete_node (ETreeTableAdapter *etta,
              ETreePath path)
 {
 	gint to_remove = 1;
-	gint parent_row = e_tree_table_adapter_row_of_node (etta, parent);
-	gint row = e_tree_table_adapter_row_of_node (etta, path);
+	gint parent_row, row;
 	GNode *gnode = lookup_gnode (etta, path);
 	GNode *parent_gnode = lookup_gnode (etta, parent);
 
+	if (etta->priv->update_depth > 0) {
+		/* The map is rebuilt once the update ends.  Removing
+		 * a node doesn't change the order of its siblings. */
+		if (gnode == NULL)
+			return;
+
+		to_remove += delete_children (etta, gnode);
+		kill_gnode (gnode, etta);
+
+		if (parent_gnode != NULL) {
+			node_t *parent_node = parent_gnode->data;
+
+			update_child_counts (parent_gnode, - to_remove);
+			parent_node->expandable = e_tree_model_node_is_expandable (etta->priv->source_model, parent);
+		}
+
+		etta->priv->update_map_needed = TRUE;
+		return;
+	}
+
+	parent_row = e_tree_table_adapter_row_of_node (etta, parent);
+	row = e_tree_table_adapter_row_of_node (etta, path);
+
 	e_table_model_pre_change (E_TABLE_MODEL (etta));
 
 	if (row == -1) {
@@ -484,6 +514,18 @@ insert_node (ETreeTableAdapter *etta,
 	if (node->expanded)
 		node->num_visible_children = insert_children (etta, gnode);
 
+	if (etta->priv->update_depth > 0) {
+		/* Prepending is O(1); the parent's children get
+		 * their final order when the update ends. */
+		g_node_prepend (parent_gnode, gnode);
+		update_child_counts (parent_gnode, node->num_visible_children + 1);
+		resort_node (etta, gnode, TRUE);
+
+		g_hash_table_add (etta->priv->update_resort_nodes, parent_gnode);
+		etta->priv->update_map_needed = TRUE;
+		return;
+	}
+
 	g_node_append (parent_gnode, gnode);
 	update_child_counts (parent_gnode, node->num_visible_children + 1);
 	resort_node (etta, parent_gnode, FALSE);
@@ -846,6 +888,7 @@ tree_table_adapter_finalize (GObject *object)
 	}
 
 	g_hash_table_destroy (priv->nodes);
+	g_hash_table_destroy (priv->update_resort_nodes);
 
 	g_free (priv->map_table);
 
@@ -1141,6 +1184,7 @@ e_tree_table_adapter_init (ETreeTableAdapter *etta)
 	etta->priv = E_TREE_TABLE_ADAPTER_GET_PRIVATE (etta);
 
 	etta->priv->nodes = g_hash_table_new (NULL, NULL);
+	etta->priv->update_resort_nodes = g_hash_table_new (NULL, NULL);
 
 	etta->priv->root_visible = TRUE;
 	etta->priv->remap_needed = TRUE;
@@ -1581,6 +1625,10 @@ e_tree_table_adapter_node_at_row (ETreeTableAdapter *etta,
 {
 	g_return_val_if_fail (E_IS_TREE_TABLE_ADAPTER (etta), NULL);
 
+	/* The row map is stale while node changes are being collected. */
+	if (etta->priv->update_map_needed)
+		return NULL;
+
 	if (row == -1 && etta->priv->n_map > 0)
 		row = etta->priv->n_map - 1;
 	else if (row < 0 || row >= etta->priv->n_map)
@@ -1598,7 +1646,7 @@ e_tree_table_adapter_row_of_node (ETreeTableAdapter *etta,
 	g_return_val_if_fail (E_IS_TREE_TABLE_ADAPTER (etta), -1);
 
 	node = get_node (etta, path);
-	if (node == NULL)
+	if (node == NULL || etta->priv->update_map_needed)
 		return -1;
 
 	if (etta->priv->remap_needed)
@@ -1671,3 +1719,56 @@ e_tree_table_adapter_clear_nodes_silent (ETreeTableAdapter *etta)
 		kill_gnode (etta->priv->root, etta);
 	resize_map (etta, 0);
 }
+
+/* Node insertions and removals of the source model between these two calls
+ * are collected, instead of resorting the parent node and rebuilding the row
+ * map on each of them.  The views receive one "model_changed" at the end.
+ * Calls can be nested. */
+void
+e_tree_table_adapter_begin_update (ETreeTableAdapter *etta)
+{
+	g_return_if_fail (E_IS_TREE_TABLE_ADAPTER (etta));
+
+	if (etta->priv->update_depth == 0)
+		etta->priv->update_map_needed = FALSE;
+
+	etta->priv->update_depth++;
+
+	e_table_model_freeze (E_TABLE_MODEL (etta));
+}
+
+void
+e_tree_table_adapter_end_update (ETreeTableAdapter *etta)
+{
+	g_return_if_fail (E_IS_TREE_TABLE_ADAPTER (etta));
+	g_return_if_fail (etta->priv->update_depth > 0);
+
+	etta->priv->update_depth--;
+
+	if (etta->priv->update_depth == 0 && etta->priv->update_map_needed) {
+		GHashTableIter iter;
+		gpointer key;
+
+		g_hash_table_iter_init (&iter, etta->priv->update_resort_nodes);
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+			resort_node (etta, key, FALSE);
+
+		g_hash_table_remove_all (etta->priv->update_resort_nodes);
+
+		if (etta->priv->root) {
+			node_t *root = etta->priv->root->data;
+			gint size;
+
+			size = root->num_visible_children;
+			if (etta->priv->root_visible)
+				size++;
+
+			resize_map (etta, size);
+			fill_map (etta, 0, etta->priv->root);
+		}
+
+		etta->priv->update_map_needed = FALSE;
+	}
+
+	e_table_model_thaw (E_TABLE_MODEL (etta));
+}
@@ -135,6 +135,10 @@ void		e_tree_table_adapter_load_expanded_state_xml
 						 xmlDoc *doc);
 void		e_tree_table_adapter_clear_nodes_silent
 						(ETreeTableAdapter *etta);
+void		e_tree_table_adapter_begin_update
+						(ETreeTableAdapter *etta);
+void		e_tree_table_adapter_end_update
+						(ETreeTableAdapter *etta);
 
 G_END_DECLS
 
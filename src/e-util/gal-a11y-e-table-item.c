@@ -187,7 +187,6 @@ inline static gint
 model_to_view_row (ETableItem *eti,
                    gint row)
 {
-	gint i;
 	if (row == -1)
 		return -1;
 	if (eti->uses_source_model) {
@@ -197,11 +196,7 @@ model_to_view_row (ETableItem *eti,
 				return eti->row_guess;
 			}
 		}
-		for (i = 0; i < etss->n_map; i++) {
-			if (etss->map_table[i] == row)
-				return i;
-		}
-		return -1;
+		return e_table_subset_model_to_view_row (etss, row);
 	} else
 		return row;
 }
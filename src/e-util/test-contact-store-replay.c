@@ -0,0 +1,412 @@
+/*
+ * test-contact-store-replay.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Replays the view notifications of a name typed into the name selector
+ * into an EContactStore, without any address book: the store only uses
+ * its views to tell which of its contact arrays a notification is for. */
+
+#include "e-contact-store.c"
+
+#include <locale.h>
+
+static const gchar *given_names[] = {
+	"Anna", "Bob", "Carla", "Dan", "Mara", "Marek", "Maria",
+	"Mark", "Martin", "Marty", "Mary", "Max", "Nina", "Otto"
+};
+
+static const gchar *family_names[] = {
+	"Adams", "Brown", "Clark", "Davis", "Evans", "Moore", "Smith"
+};
+
+/* How many contacts a view reports in one notification. */
+#define REPLAY_CHUNK_SIZE 100
+
+static EContact *
+replay_contact_new (guint id,
+                    GRand *rand)
+{
+	EContact *contact;
+	gchar *value;
+
+	contact = e_contact_new ();
+
+	value = g_strdup_printf ("uid-%u", id);
+	e_contact_set (contact, E_CONTACT_UID, value);
+	g_free (value);
+
+	value = g_strdup_printf (
+		"%s %s",
+		given_names[g_rand_int_range (rand, 0, G_N_ELEMENTS (given_names))],
+		family_names[g_rand_int_range (rand, 0, G_N_ELEMENTS (family_names))]);
+	e_contact_set (contact, E_CONTACT_FULL_NAME, value);
+	g_free (value);
+
+	return contact;
+}
+
+static gboolean
+replay_contact_matches (EContact *contact,
+                        const gchar *typed)
+{
+	return g_str_has_prefix (e_contact_get_const (contact, E_CONTACT_FULL_NAME), typed);
+}
+
+/* A source of the store without a book client, thus without views. */
+static ContactSource *
+replay_add_source (EContactStore *contact_store)
+{
+	GArray *array = contact_store->priv->contact_sources;
+	ContactSource source;
+
+	memset (&source, 0, sizeof (ContactSource));
+	source.contacts = g_ptr_array_new ();
+	contact_index_init (&source.contacts_index);
+	g_array_append_val (array, source);
+	invalidate_source_offsets (contact_store);
+
+	return &g_array_index (array, ContactSource, array->len - 1);
+}
+
+static void
+replay_remove_source (EContactStore *contact_store,
+                      ContactSource *source)
+{
+	gint source_index;
+
+	source_index = find_contact_source_by_pointer (contact_store, source);
+	g_assert_cmpint (source_index, >=, 0);
+
+	clear_contact_source (contact_store, source);
+	free_contact_ptrarray (source->contacts);
+	contact_index_clear (&source->contacts_index);
+
+	g_array_remove_index (contact_store->priv->contact_sources, source_index);
+	invalidate_source_offsets (contact_store);
+}
+
+/* Sends the @book contacts matching @typed to a new pending view,
+ * in chunks, and completes it. */
+static void
+replay_pending_view (EContactStore *contact_store,
+                     ContactSource *source,
+                     GPtrArray *book,
+                     const gchar *typed)
+{
+	GSList *chunk = NULL;
+	guint n_chunk = 0, ii;
+
+	source->contacts_pending = g_ptr_array_new ();
+	contact_index_init (&source->contacts_pending_index);
+
+	for (ii = 0; ii < book->len; ii++) {
+		EContact *contact = g_ptr_array_index (book, ii);
+
+		if (!replay_contact_matches (contact, typed))
+			continue;
+
+		chunk = g_slist_prepend (chunk, contact);
+		n_chunk++;
+
+		if (n_chunk == REPLAY_CHUNK_SIZE) {
+			chunk = g_slist_reverse (chunk);
+			contact_source_add_contacts (contact_store, source, 0, TRUE, chunk);
+			g_slist_free (chunk);
+			chunk = NULL;
+			n_chunk = 0;
+		}
+	}
+
+	chunk = g_slist_reverse (chunk);
+	contact_source_add_contacts (contact_store, source, 0, TRUE, chunk);
+	g_slist_free (chunk);
+
+	contact_source_promote_pending (contact_store, source, 0);
+}
+
+/* Changes of the book while the current view is open: removes every
+ * seventh matching contact, modifies every fifth and adds new ones. */
+static void
+replay_current_view_changes (EContactStore *contact_store,
+                             ContactSource *source,
+                             GPtrArray *book,
+                             const gchar *typed,
+                             guint *next_id,
+                             GRand *rand)
+{
+	GSList *removed = NULL, *modified = NULL, *added = NULL;
+	guint n_matching = 0, ii;
+
+	for (ii = 0; ii < book->len; ii++) {
+		EContact *contact = g_ptr_array_index (book, ii);
+
+		if (!replay_contact_matches (contact, typed))
+			continue;
+
+		n_matching++;
+
+		if (n_matching % 7 == 0) {
+			removed = g_slist_prepend (removed, e_contact_get (contact, E_CONTACT_UID));
+			g_ptr_array_remove_index (book, ii);
+			ii--;
+		} else if (n_matching % 5 == 0) {
+			EContact *changed;
+
+			changed = e_contact_duplicate (contact);
+			e_contact_set (changed, E_CONTACT_NICKNAME, "changed");
+			modified = g_slist_prepend (modified, changed);
+
+			book->pdata[ii] = g_object_ref (changed);
+			g_object_unref (contact);
+		}
+	}
+
+	for (ii = 0; ii < 10; ii++) {
+		EContact *contact = replay_contact_new ((*next_id)++, rand);
+
+		if (!replay_contact_matches (contact, typed)) {
+			gchar *full_name;
+
+			full_name = g_strconcat (typed, " Added", NULL);
+			e_contact_set (contact, E_CONTACT_FULL_NAME, full_name);
+			g_free (full_name);
+		}
+
+		g_ptr_array_add (book, contact);
+		added = g_slist_prepend (added, contact);
+	}
+
+	removed = g_slist_reverse (removed);
+	modified = g_slist_reverse (modified);
+	added = g_slist_reverse (added);
+
+	contact_source_remove_contacts (contact_store, source, 0, FALSE, removed);
+	contact_source_modify_contacts (contact_store, source, 0, FALSE, modified);
+	contact_source_add_contacts (contact_store, source, 0, FALSE, added);
+
+	g_slist_free_full (removed, g_free);
+	g_slist_free_full (modified, g_object_unref);
+	g_slist_free (added);
+}
+
+/* The store shows exactly the @book contacts matching @typed,
+ * each found at its row by its UID. */
+static void
+replay_check_rows (EContactStore *contact_store,
+                   GPtrArray *book,
+                   const gchar *typed)
+{
+	GHashTable *seen;
+	GtkTreeIter iter;
+	gint n_matching = 0;
+	guint ii;
+
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (ii = 0; ii < book->len; ii++) {
+		EContact *contact = g_ptr_array_index (book, ii);
+		EContact *stored;
+		const gchar *uid;
+
+		if (!replay_contact_matches (contact, typed))
+			continue;
+
+		n_matching++;
+		uid = e_contact_get_const (contact, E_CONTACT_UID);
+
+		g_assert_true (e_contact_store_find_contact (contact_store, uid, &iter));
+
+		stored = e_contact_store_get_contact (contact_store, &iter);
+		g_assert_cmpstr (e_contact_get_const (stored, E_CONTACT_UID), ==, uid);
+		g_assert_cmpstr (
+			e_contact_get_const (stored, E_CONTACT_NICKNAME), ==,
+			e_contact_get_const (contact, E_CONTACT_NICKNAME));
+
+		g_assert_true (g_hash_table_add (seen, (gpointer) uid));
+	}
+
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (contact_store), NULL), ==, n_matching);
+
+	g_hash_table_destroy (seen);
+}
+
+static void
+test_contact_store_replay (void)
+{
+	const gchar *text = "Marty";
+	EContactStore *contact_store;
+	ContactSource *source;
+	GPtrArray *book;
+	GTimer *timer;
+	GRand *rand;
+	gdouble elapsed = 0.0;
+	guint n_contacts, next_id;
+	gint typed;
+
+	n_contacts = g_test_perf () ? 60000 : 6000;
+
+	rand = g_rand_new_with_seed (7);
+	book = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (next_id = 0; next_id < n_contacts; next_id++)
+		g_ptr_array_add (book, replay_contact_new (next_id, rand));
+
+	contact_store = e_contact_store_new ();
+	source = replay_add_source (contact_store);
+
+	timer = g_timer_new ();
+
+	for (typed = 1; text[typed - 1]; typed++) {
+		gchar *prefix = g_strndup (text, typed);
+
+		g_timer_start (timer);
+		replay_pending_view (contact_store, source, book, prefix);
+		g_timer_stop (timer);
+		elapsed += g_timer_elapsed (timer, NULL);
+
+		replay_check_rows (contact_store, book, prefix);
+
+		g_timer_start (timer);
+		replay_current_view_changes (contact_store, source, book, prefix, &next_id, rand);
+		g_timer_stop (timer);
+		elapsed += g_timer_elapsed (timer, NULL);
+
+		replay_check_rows (contact_store, book, prefix);
+
+		g_free (prefix);
+	}
+
+	/* Deleting the typed text shows more contacts again. */
+	for (typed = strlen (text) - 1; typed > 0; typed--) {
+		gchar *prefix = g_strndup (text, typed);
+
+		g_timer_start (timer);
+		replay_pending_view (contact_store, source, book, prefix);
+		g_timer_stop (timer);
+		elapsed += g_timer_elapsed (timer, NULL);
+
+		replay_check_rows (contact_store, book, prefix);
+
+		g_free (prefix);
+	}
+
+	g_test_minimized_result (
+		elapsed, "Replayed typing '%s' over %u contacts in %f seconds",
+		text, n_contacts, elapsed);
+
+	/* The pending arrays are all promoted by now. */
+	g_assert_null (source->contacts_pending);
+
+	replay_remove_source (contact_store, source);
+
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (contact_store), NULL), ==, 0);
+
+	g_timer_destroy (timer);
+	g_object_unref (contact_store);
+	g_ptr_array_unref (book);
+	g_rand_free (rand);
+}
+
+static void
+row_deleted_cb (GtkTreeModel *model,
+                GtkTreePath *path,
+                gint *n_deleted)
+{
+	(*n_deleted)++;
+}
+
+static void
+test_contact_store_clear (void)
+{
+	EContactStore *contact_store;
+	ContactSource *source;
+	GSList *contacts = NULL, *link;
+	GTimer *timer;
+	GRand *rand;
+	guint n_contacts, ii;
+	gint n_deleted = 0;
+
+	n_contacts = g_test_perf () ? 600000 : 60000;
+
+	rand = g_rand_new_with_seed (11);
+
+	for (ii = 0; ii < n_contacts; ii++)
+		contacts = g_slist_prepend (contacts, replay_contact_new (ii, rand));
+
+	contact_store = e_contact_store_new ();
+	source = replay_add_source (contact_store);
+
+	contact_source_add_contacts (contact_store, source, 0, FALSE, contacts);
+
+	/* Some removals, which the index remembers until a rebuild. */
+	for (link = contacts, ii = 0; link && ii < 50; link = g_slist_next (link), ii++) {
+		GSList uids = { NULL, NULL };
+
+		uids.data = (gpointer) e_contact_get_const (link->data, E_CONTACT_UID);
+		contact_source_remove_contacts (contact_store, source, 0, FALSE, &uids);
+	}
+
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (contact_store), NULL), ==, n_contacts - 50);
+
+	g_signal_connect (
+		contact_store, "row-deleted",
+		G_CALLBACK (row_deleted_cb), &n_deleted);
+
+	timer = g_timer_new ();
+	clear_contact_source (contact_store, source);
+	g_timer_stop (timer);
+
+	g_assert_cmpint (n_deleted, ==, n_contacts - 50);
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (contact_store), NULL), ==, 0);
+	g_assert_cmpint (
+		contact_index_lookup (
+			&source->contacts_index, source->contacts,
+			e_contact_get_const (g_slist_last (contacts)->data, E_CONTACT_UID)), ==, -1);
+
+	g_test_minimized_result (
+		g_timer_elapsed (timer, NULL),
+		"Cleared %u contacts in %f seconds",
+		n_contacts - 50, g_timer_elapsed (timer, NULL));
+
+	/* The source can be filled again. */
+	contact_source_add_contacts (contact_store, source, 0, FALSE, contacts);
+	g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (contact_store), NULL), ==, n_contacts);
+	g_assert_cmpint (
+		contact_index_lookup (
+			&source->contacts_index, source->contacts,
+			e_contact_get_const (g_slist_last (contacts)->data, E_CONTACT_UID)), ==, n_contacts - 1);
+
+	replay_remove_source (contact_store, source);
+
+	g_timer_destroy (timer);
+	g_object_unref (contact_store);
+	g_slist_free_full (contacts, g_object_unref);
+	g_rand_free (rand);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/EContactStore/Replay", test_contact_store_replay);
+	g_test_add_func ("/EContactStore/Clear", test_contact_store_clear);
+
+	return g_test_run ();
+}
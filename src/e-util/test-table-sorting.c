@@ -0,0 +1,124 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-config.h"
+
+#include <string.h>
+#include <locale.h>
+
+#include <e-util/e-util.h>
+
+typedef struct _SortData {
+	gint *keys;
+	gchar **strings;
+	gpointer cmp_cache;
+} SortData;
+
+/* Compares like the table sorters do, ties are broken by the row index. */
+static gint
+compare_rows_cb (gconstpointer data1,
+                 gconstpointer data2,
+                 gpointer user_data)
+{
+	SortData *sd = user_data;
+	gint row1 = *(gint *) data1;
+	gint row2 = *(gint *) data2;
+	const gchar *key1, *key2;
+	gint comp_val;
+
+	comp_val = sd->keys[row1] - sd->keys[row2];
+	if (comp_val != 0)
+		return comp_val;
+
+	key1 = e_table_sorting_utils_lookup_cmp_cache (sd->cmp_cache, sd->strings[row1]);
+	if (!key1) {
+		gchar *ckey = g_utf8_collate_key (sd->strings[row1], -1);
+		e_table_sorting_utils_add_to_cmp_cache (sd->cmp_cache, sd->strings[row1], ckey);
+		key1 = ckey;
+	}
+
+	key2 = e_table_sorting_utils_lookup_cmp_cache (sd->cmp_cache, sd->strings[row2]);
+	if (!key2) {
+		gchar *ckey = g_utf8_collate_key (sd->strings[row2], -1);
+		e_table_sorting_utils_add_to_cmp_cache (sd->cmp_cache, sd->strings[row2], ckey);
+		key2 = ckey;
+	}
+
+	comp_val = strcmp (key1, key2);
+	if (comp_val != 0)
+		return comp_val;
+
+	return row1 < row2 ? -1 : row1 > row2 ? 1 : 0;
+}
+
+static void
+test_sort_rows_matches_serial (gconstpointer user_data)
+{
+	gint n_rows = GPOINTER_TO_INT (user_data);
+	SortData sd;
+	gint *serial, *parallel;
+	gint ii;
+
+	sd.keys = g_new (gint, n_rows + 1);
+	sd.strings = g_new0 (gchar *, n_rows + 1);
+
+	/* Few distinct values, to have plenty of ties. */
+	for (ii = 0; ii < n_rows; ii++) {
+		sd.keys[ii] = g_test_rand_int_range (0, 16);
+		sd.strings[ii] = g_strdup_printf ("value %d", g_test_rand_int_range (0, 64));
+	}
+
+	serial = g_new (gint, n_rows + 1);
+	parallel = g_new (gint, n_rows + 1);
+
+	for (ii = 0; ii < n_rows; ii++) {
+		serial[ii] = ii;
+		parallel[ii] = ii;
+	}
+
+	sd.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	g_qsort_with_data (serial, n_rows, sizeof (gint), compare_rows_cb, &sd);
+	e_table_sorting_utils_free_cmp_cache (sd.cmp_cache);
+
+	sd.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	e_table_sorting_utils_sort_rows (parallel, n_rows, compare_rows_cb, &sd);
+	e_table_sorting_utils_free_cmp_cache (sd.cmp_cache);
+
+	for (ii = 0; ii < n_rows; ii++)
+		g_assert_cmpint (serial[ii], ==, parallel[ii]);
+
+	g_strfreev (sd.strings);
+	g_free (sd.keys);
+	g_free (serial);
+	g_free (parallel);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	/* Below, at and above the threshold of the parallel sort, including
+	 * counts which do not split evenly between the worker threads. */
+	g_test_add_data_func ("/ETableSortingUtils/SortRows/Empty", GINT_TO_POINTER (0), test_sort_rows_matches_serial);
+	g_test_add_data_func ("/ETableSortingUtils/SortRows/Small", GINT_TO_POINTER (1000), test_sort_rows_matches_serial);
+	g_test_add_data_func ("/ETableSortingUtils/SortRows/Threshold", GINT_TO_POINTER (10000), test_sort_rows_matches_serial);
+	g_test_add_data_func ("/ETableSortingUtils/SortRows/Odd", GINT_TO_POINTER (77777), test_sort_rows_matches_serial);
+	g_test_add_data_func ("/ETableSortingUtils/SortRows/Large", GINT_TO_POINTER (250000), test_sort_rows_matches_serial);
+
+	return g_test_run ();
+}
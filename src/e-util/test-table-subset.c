@@ -0,0 +1,199 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+
+#include <e-util/e-util.h>
+
+/* A source model with a given count of rows and a single column. */
+
+typedef struct _TestModel {
+	GObject parent;
+	gint n_rows;
+} TestModel;
+
+typedef struct _TestModelClass {
+	GObjectClass parent_class;
+} TestModelClass;
+
+static GType test_model_get_type (void);
+static void test_model_table_model_init (ETableModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestModel, test_model, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE (E_TYPE_TABLE_MODEL, test_model_table_model_init))
+
+static gint
+test_model_column_count (ETableModel *table_model)
+{
+	return 1;
+}
+
+static gint
+test_model_row_count (ETableModel *table_model)
+{
+	return ((TestModel *) table_model)->n_rows;
+}
+
+static gpointer
+test_model_value_at (ETableModel *table_model,
+                     gint col,
+                     gint row)
+{
+	return GINT_TO_POINTER (row);
+}
+
+static void
+test_model_class_init (TestModelClass *class)
+{
+}
+
+static void
+test_model_table_model_init (ETableModelInterface *iface)
+{
+	iface->column_count = test_model_column_count;
+	iface->row_count = test_model_row_count;
+	iface->value_at = test_model_value_at;
+}
+
+static void
+test_model_init (TestModel *model)
+{
+}
+
+static void
+row_changed_cb (ETableModel *table_model,
+                gint view_row,
+                gpointer user_data)
+{
+	gint *n_changed = user_data;
+
+	(*n_changed)++;
+}
+
+static ETableModel *
+create_reversed_subset (TestModel **out_model,
+                        gint n_rows)
+{
+	ETableModel *subset;
+	gint *rows, ii;
+
+	*out_model = g_object_new (test_model_get_type (), NULL);
+	(*out_model)->n_rows = n_rows;
+
+	subset = e_table_subset_variable_new (E_TABLE_MODEL (*out_model));
+
+	rows = g_new (gint, n_rows);
+	for (ii = 0; ii < n_rows; ii++)
+		rows[ii] = n_rows - ii - 1;
+
+	e_table_subset_variable_add_array (E_TABLE_SUBSET_VARIABLE (subset), rows, n_rows);
+
+	g_free (rows);
+
+	return subset;
+}
+
+static void
+test_subset_model_to_view (void)
+{
+	ETableModel *subset;
+	ETableSubset *table_subset;
+	TestModel *model;
+	gint ii;
+
+	subset = create_reversed_subset (&model, 1000);
+	table_subset = E_TABLE_SUBSET (subset);
+
+	for (ii = 0; ii < 1000; ii++)
+		g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, ii), ==, 1000 - ii - 1);
+
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 1000), ==, -1);
+
+	/* Removal moves the following view rows one up. */
+	g_assert (e_table_subset_variable_remove (E_TABLE_SUBSET_VARIABLE (subset), 900));
+	g_assert (!e_table_subset_variable_remove (E_TABLE_SUBSET_VARIABLE (subset), 900));
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 900), ==, -1);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 901), ==, 98);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 899), ==, 99);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 0), ==, 998);
+
+	/* Renumbering of the model rows. */
+	e_table_subset_variable_increment (E_TABLE_SUBSET_VARIABLE (subset), 500, 10);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 505), ==, -1);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 510), ==, 498);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 499), ==, 499);
+
+	e_table_subset_variable_add (E_TABLE_SUBSET_VARIABLE (subset), 2000);
+	g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, 2000), ==, 998);
+
+	for (ii = 0; ii < table_subset->n_map; ii++)
+		g_assert_cmpint (e_table_subset_model_to_view_row (table_subset, table_subset->map_table[ii]), ==, ii);
+
+	g_object_unref (subset);
+	g_object_unref (model);
+}
+
+/* Emits a change notification for each row of the source model,
+ * like a bulk update of a large task list does. */
+static void
+test_subset_bulk_row_changed (void)
+{
+	ETableModel *subset;
+	TestModel *model;
+	GTimer *timer;
+	gint n_rows, n_changed = 0, ii;
+
+	n_rows = g_test_perf () ? 500000 : 50000;
+
+	subset = create_reversed_subset (&model, n_rows);
+
+	g_signal_connect (
+		subset, "model_row_changed",
+		G_CALLBACK (row_changed_cb), &n_changed);
+
+	timer = g_timer_new ();
+
+	/* Not in the order of the view, to defeat any locality. */
+	for (ii = 0; ii < n_rows; ii++)
+		e_table_model_row_changed (E_TABLE_MODEL (model), (gint) (((gint64) ii * 7919) % n_rows));
+
+	g_timer_stop (timer);
+
+	g_assert_cmpint (n_changed, ==, n_rows);
+
+	g_test_minimized_result (
+		g_timer_elapsed (timer, NULL),
+		"%d row changes of %d rows in %f seconds",
+		n_rows, n_rows, g_timer_elapsed (timer, NULL));
+
+	g_timer_destroy (timer);
+	g_object_unref (subset);
+	g_object_unref (model);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/ETableSubset/ModelToView", test_subset_model_to_view);
+	g_test_add_func ("/ETableSubset/BulkRowChanged", test_subset_bulk_row_changed);
+
+	return g_test_run ();
+}
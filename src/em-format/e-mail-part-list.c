@@ -29,7 +29,12 @@ struct _EMailPartListPrivate {
 	gchar *message_uid;
 
 	GQueue queue;
-	GMutex queue_lock;
+	GRWLock queue_lock;
+
+	/* Part ID and Content ID -> GList link in the queue,
+	 * for the first part in the queue with such an ID. */
+	GHashTable *id_index;
+	GHashTable *cid_index;
 };
 
 enum {
@@ -44,6 +49,53 @@ G_DEFINE_TYPE (EMailPartList, e_mail_part_list, G_TYPE_OBJECT)
 static CamelObjectBag *registry = NULL;
 G_LOCK_DEFINE_STATIC (registry);
 
+/* Call with queue_lock held for writing. */
+static void
+mail_part_list_index_part (EMailPartList *part_list,
+                           GList *link)
+{
+	EMailPart *part = link->data;
+	const gchar *id;
+
+	/* Earlier parts win, like with a linear search. */
+
+	id = e_mail_part_get_id (part);
+	if (id != NULL && !g_hash_table_contains (part_list->priv->id_index, id))
+		g_hash_table_insert (part_list->priv->id_index, g_strdup (id), link);
+
+	id = e_mail_part_get_cid (part);
+	if (id != NULL && !g_hash_table_contains (part_list->priv->cid_index, id))
+		g_hash_table_insert (part_list->priv->cid_index, g_strdup (id), link);
+}
+
+static void
+mail_part_list_part_cid_notify_cb (EMailPart *part,
+                                   GParamSpec *param,
+                                   EMailPartList *part_list)
+{
+	GList *link;
+
+	/* Content IDs change rarely and only while parsing,
+	 * thus simply rebuild the whole index when one does. */
+
+	g_rw_lock_writer_lock (&part_list->priv->queue_lock);
+
+	g_hash_table_remove_all (part_list->priv->cid_index);
+
+	link = g_queue_peek_head_link (&part_list->priv->queue);
+
+	for (; link != NULL; link = g_list_next (link)) {
+		const gchar *cid;
+
+		cid = e_mail_part_get_cid (E_MAIL_PART (link->data));
+
+		if (cid != NULL && !g_hash_table_contains (part_list->priv->cid_index, cid))
+			g_hash_table_insert (part_list->priv->cid_index, g_strdup (cid), link);
+	}
+
+	g_rw_lock_writer_unlock (&part_list->priv->queue_lock);
+}
+
 static void
 mail_part_list_set_folder (EMailPartList *part_list,
                            CamelFolder *folder)
@@ -158,10 +210,17 @@ mail_part_list_dispose (GObject *object)
 		priv->message = NULL;
 	}
 
-	g_mutex_lock (&priv->queue_lock);
-	while (!g_queue_is_empty (&priv->queue))
-		g_object_unref (g_queue_pop_head (&priv->queue));
-	g_mutex_unlock (&priv->queue_lock);
+	g_rw_lock_writer_lock (&priv->queue_lock);
+	g_hash_table_remove_all (priv->id_index);
+	g_hash_table_remove_all (priv->cid_index);
+	while (!g_queue_is_empty (&priv->queue)) {
+		EMailPart *part = g_queue_pop_head (&priv->queue);
+
+		g_signal_handlers_disconnect_by_func (
+			part, mail_part_list_part_cid_notify_cb, object);
+		g_object_unref (part);
+	}
+	g_rw_lock_writer_unlock (&priv->queue_lock);
 
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_mail_part_list_parent_class)->dispose (object);
@@ -177,7 +236,10 @@ mail_part_list_finalize (GObject *object)
 	g_free (priv->message_uid);
 
 	g_warn_if_fail (g_queue_is_empty (&priv->queue));
-	g_mutex_clear (&priv->queue_lock);
+	g_rw_lock_clear (&priv->queue_lock);
+
+	g_hash_table_destroy (priv->id_index);
+	g_hash_table_destroy (priv->cid_index);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_mail_part_list_parent_class)->finalize (object);
@@ -238,7 +300,19 @@ e_mail_part_list_init (EMailPartList *part_list)
 {
 	part_list->priv = E_MAIL_PART_LIST_GET_PRIVATE (part_list);
 
-	g_mutex_init (&part_list->priv->queue_lock);
+	g_rw_lock_init (&part_list->priv->queue_lock);
+
+	part_list->priv->id_index = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
+
+	part_list->priv->cid_index = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
 }
 
 EMailPartList *
@@ -290,13 +364,20 @@ e_mail_part_list_add_part (EMailPartList *part_list,
 	g_return_if_fail (E_IS_MAIL_PART_LIST (part_list));
 	g_return_if_fail (E_IS_MAIL_PART (part));
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_writer_lock (&part_list->priv->queue_lock);
 
 	g_queue_push_tail (
 		&part_list->priv->queue,
 		g_object_ref (part));
 
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	mail_part_list_index_part (
+		part_list, g_queue_peek_tail_link (&part_list->priv->queue));
+
+	g_rw_lock_writer_unlock (&part_list->priv->queue_lock);
+
+	g_signal_connect (
+		part, "notify::cid",
+		G_CALLBACK (mail_part_list_part_cid_notify_cb), part_list);
 
 	e_mail_part_set_part_list (part, part_list);
 }
@@ -306,34 +387,25 @@ e_mail_part_list_ref_part (EMailPartList *part_list,
                            const gchar *part_id)
 {
 	EMailPart *match = NULL;
-	GList *head, *link;
-	gboolean by_cid;
+	GHashTable *index;
+	GList *link;
 
 	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), NULL);
 	g_return_val_if_fail (part_id != NULL, NULL);
 
-	by_cid = (g_ascii_strncasecmp (part_id, "cid:", 4) == 0);
-
-	g_mutex_lock (&part_list->priv->queue_lock);
+	if (g_ascii_strncasecmp (part_id, "cid:", 4) == 0)
+		index = part_list->priv->cid_index;
+	else
+		index = part_list->priv->id_index;
 
-	head = g_queue_peek_head_link (&part_list->priv->queue);
+	g_rw_lock_reader_lock (&part_list->priv->queue_lock);
 
-	for (link = head; link != NULL; link = g_list_next (link)) {
-		EMailPart *candidate = E_MAIL_PART (link->data);
-		const gchar *candidate_id;
+	link = g_hash_table_lookup (index, part_id);
 
-		if (by_cid)
-			candidate_id = e_mail_part_get_cid (candidate);
-		else
-			candidate_id = e_mail_part_get_id (candidate);
-
-		if (g_strcmp0 (candidate_id, part_id) == 0) {
-			match = g_object_ref (candidate);
-			break;
-		}
-	}
+	if (link != NULL)
+		match = g_object_ref (link->data);
 
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_unlock (&part_list->priv->queue_lock);
 
 	return match;
 }
@@ -364,21 +436,12 @@ e_mail_part_list_queue_parts (EMailPartList *part_list,
 	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), FALSE);
 	g_return_val_if_fail (result_queue != NULL, FALSE);
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_lock (&part_list->priv->queue_lock);
 
-	link = g_queue_peek_head_link (&part_list->priv->queue);
-
-	if (part_id != NULL) {
-		for (; link != NULL; link = g_list_next (link)) {
-			EMailPart *candidate = E_MAIL_PART (link->data);
-			const gchar *candidate_id;
-
-			candidate_id = e_mail_part_get_id (candidate);
-
-			if (g_strcmp0 (candidate_id, part_id) == 0)
-				break;
-		}
-	}
+	if (part_id != NULL)
+		link = g_hash_table_lookup (part_list->priv->id_index, part_id);
+	else
+		link = g_queue_peek_head_link (&part_list->priv->queue);
 
 	/* We skip the loop entirely if link is NULL. */
 	for (; link != NULL; link = g_list_next (link)) {
@@ -391,7 +454,7 @@ e_mail_part_list_queue_parts (EMailPartList *part_list,
 		parts_queued++;
 	}
 
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_unlock (&part_list->priv->queue_lock);
 
 	return parts_queued;
 }
@@ -409,9 +472,9 @@ e_mail_part_list_is_empty (EMailPartList *part_list)
 
 	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), TRUE);
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_lock (&part_list->priv->queue_lock);
 	is_empty = g_queue_is_empty (&part_list->priv->queue);
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_unlock (&part_list->priv->queue_lock);
 
 	return is_empty;
 }
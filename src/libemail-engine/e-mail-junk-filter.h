@@ -23,6 +23,7 @@
 #define E_MAIL_JUNK_FILTER_H
 
 #include <gtk/gtk.h>
+#include <camel/camel.h>
 #include <libebackend/libebackend.h>
 
 /* Standard GObject macros */
@@ -63,6 +64,12 @@ struct _EMailJunkFilterClass {
 
 	gboolean	(*available)		(EMailJunkFilter *junk_filter);
 	GtkWidget *	(*new_config_widget)	(EMailJunkFilter *junk_filter);
+	gboolean	(*classify_messages_sync)
+						(EMailJunkFilter *junk_filter,
+						 GPtrArray *messages,
+						 CamelJunkStatus *statuses,
+						 GCancellable *cancellable,
+						 GError **error);
 };
 
 GType		e_mail_junk_filter_get_type	(void) G_GNUC_CONST;
@@ -71,6 +78,12 @@ GtkWidget *	e_mail_junk_filter_new_config_widget
 						(EMailJunkFilter *junk_filter);
 gint		e_mail_junk_filter_compare	(EMailJunkFilter *junk_filter_a,
 						 EMailJunkFilter *junk_filter_b);
+gboolean	e_mail_junk_filter_classify_messages_sync
+						(EMailJunkFilter *junk_filter,
+						 GPtrArray *messages,
+						 CamelJunkStatus *statuses,
+						 GCancellable *cancellable,
+						 GError **error);
 
 G_END_DECLS
 
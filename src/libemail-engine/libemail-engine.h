@@ -33,6 +33,7 @@
 #include <libemail-engine/em-filter-folder-element.h>
 #include <libemail-engine/em-vfolder-context.h>
 #include <libemail-engine/em-vfolder-rule.h>
+#include <libemail-engine/mail-body-index.h>
 #include <libemail-engine/mail-config.h>
 #include <libemail-engine/mail-folder-cache.h>
 #include <libemail-engine/mail-mt.h>
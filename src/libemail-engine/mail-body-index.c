@@ -0,0 +1,760 @@
+/*
+ * mail-body-index.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* An on-disk index of the text parts of messages, which lets body-contains
+ * searches decode only the messages which can possibly match.
+ *
+ * Each message gets a signature, a bitmap of the hashed trigrams of its
+ * lower-cased text parts, decoded the same way as Camel decodes them for
+ * body-contains.  A message can contain a word only when its signature
+ * has the bits of all the trigrams of the word, thus the index gives
+ * a superset of the matching messages and Camel still does the actual
+ * match, only on the candidates.
+ *
+ * The index of a folder is an append-only journal of added and removed
+ * messages in the mail cache directory, compacted when most of it is
+ * superseded records.  It is used only when it covers all messages of the
+ * folder, otherwise the search scans the folder as before and the missing
+ * messages are indexed in the background, as long as they are available
+ * without downloading them. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <libedataserver/libedataserver.h>
+
+#include "e-mail-folder-utils.h"
+#include "e-mail-session.h"
+#include "mail-body-query.h"
+#include "mail-config.h"
+
+#include "mail-body-index.h"
+
+#define d(x)
+
+#define INDEX_MAGIC "EVOBIDX1"
+#define INDEX_MAGIC_LEN 8
+
+#define RECORD_ADDED '+'
+#define RECORD_REMOVED '-'
+
+/* Restricting the search by the uid function costs a comparison with
+ * each of its arguments per message, thus frequent words are left to
+ * the scan. */
+#define MAX_CANDIDATES 512
+
+/* How many messages are indexed before their records are written. */
+#define WRITE_BATCH 100
+
+typedef struct _BodyIndex {
+	GMappedFile *mapped;
+
+	/* UID ~> signature, both pointing into the mapped file */
+	GHashTable *signatures;
+
+	/* All the records, and those superseded by later records. */
+	guint n_records;
+	guint n_dead;
+} BodyIndex;
+
+/* Guards all the index files.  Held only while reading or writing them,
+ * never while decoding messages. */
+static GMutex index_lock;
+
+/* File name ~> number of records in it, thus the updates can append
+ * to the journal without replaying it.  Counted when the file is loaded
+ * the first time, then updated with the appended records.  Guarded by
+ * the index_lock. */
+static GHashTable *record_counts;
+
+/* Folder URIs with a catch-up in progress. */
+static GHashTable *catching_up;
+G_LOCK_DEFINE_STATIC (catching_up);
+
+static gchar *
+body_index_build_filename (const gchar *folder_uri)
+{
+	gchar *basename, *dirname, *filename;
+
+	dirname = g_build_filename (mail_session_get_cache_dir (), "body-index", NULL);
+	g_mkdir_with_parents (dirname, 0700);
+
+	basename = g_strdup (folder_uri);
+	e_filename_make_safe (basename);
+
+	filename = g_build_filename (dirname, basename, NULL);
+
+	g_free (basename);
+	g_free (dirname);
+
+	return filename;
+}
+
+static gboolean
+body_index_folder_is_indexable (CamelFolder *folder)
+{
+	/* Search folders are searched by Camel, subfolder by subfolder. */
+	return mail_config_get_body_index () && !CAMEL_IS_VEE_FOLDER (folder);
+}
+
+static void
+body_index_set_n_records (const gchar *filename,
+                          guint n_records)
+{
+	if (record_counts == NULL)
+		record_counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_hash_table_insert (record_counts, g_strdup (filename), GUINT_TO_POINTER (n_records));
+}
+
+static void
+body_index_free (BodyIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy (index->signatures);
+
+	if (index->mapped != NULL)
+		g_mapped_file_unref (index->mapped);
+
+	g_slice_free (BodyIndex, index);
+}
+
+/* Replays the journal.  A truncated last record, after a crash,
+ * is ignored and overwritten by the next compaction. */
+static BodyIndex *
+body_index_load (const gchar *filename)
+{
+	BodyIndex *index;
+	const gchar *contents, *end, *ptr;
+
+	index = g_slice_new0 (BodyIndex);
+	index->signatures = g_hash_table_new (g_str_hash, g_str_equal);
+	index->mapped = g_mapped_file_new (filename, FALSE, NULL);
+
+	if (index->mapped == NULL) {
+		body_index_set_n_records (filename, 0);
+		return index;
+	}
+
+	contents = g_mapped_file_get_contents (index->mapped);
+	end = contents + g_mapped_file_get_length (index->mapped);
+
+	if (end - contents < INDEX_MAGIC_LEN ||
+	    memcmp (contents, INDEX_MAGIC, INDEX_MAGIC_LEN) != 0) {
+		g_warning ("%s: Ignoring unknown index file '%s'", G_STRFUNC, filename);
+		g_mapped_file_unref (index->mapped);
+		index->mapped = NULL;
+		g_unlink (filename);
+		body_index_set_n_records (filename, 0);
+		return index;
+	}
+
+	ptr = contents + INDEX_MAGIC_LEN;
+
+	while (ptr < end) {
+		gchar type = *ptr++;
+		const gchar *uid = ptr;
+
+		ptr = memchr (ptr, '\0', end - ptr);
+		if (ptr == NULL)
+			break;
+
+		ptr++;
+
+		if (type == RECORD_ADDED) {
+			if (end - ptr < MAIL_BODY_SIGNATURE_BYTES)
+				break;
+
+			if (g_hash_table_contains (index->signatures, uid))
+				index->n_dead++;
+
+			g_hash_table_insert (index->signatures, (gpointer) uid, (gpointer) ptr);
+			ptr += MAIL_BODY_SIGNATURE_BYTES;
+
+		} else if (type == RECORD_REMOVED) {
+			if (g_hash_table_remove (index->signatures, uid))
+				index->n_dead++;
+			index->n_dead++;
+
+		} else {
+			g_warning ("%s: Corrupted index file '%s'", G_STRFUNC, filename);
+			break;
+		}
+
+		index->n_records++;
+	}
+
+	body_index_set_n_records (filename, index->n_records);
+
+	return index;
+}
+
+/* Returns the number of records in the journal, which is replayed
+ * only when not known yet. */
+static guint
+body_index_get_n_records (const gchar *filename)
+{
+	gpointer value;
+
+	if (record_counts == NULL ||
+	    !g_hash_table_lookup_extended (record_counts, filename, NULL, &value)) {
+		body_index_free (body_index_load (filename));
+		value = g_hash_table_lookup (record_counts, filename);
+	}
+
+	return GPOINTER_TO_UINT (value);
+}
+
+static void
+body_index_append_record (GByteArray *records,
+                          gchar type,
+                          const gchar *uid,
+                          const guint8 *signature)
+{
+	g_byte_array_append (records, (const guint8 *) &type, 1);
+	g_byte_array_append (records, (const guint8 *) uid, strlen (uid) + 1);
+
+	if (signature != NULL)
+		g_byte_array_append (records, signature, MAIL_BODY_SIGNATURE_BYTES);
+}
+
+/* Appends @n_records @records to the journal; the number of records
+ * of the file has to be known already. */
+static gboolean
+body_index_write (const gchar *filename,
+                  GByteArray *records,
+                  guint n_records,
+                  GCancellable *cancellable,
+                  GError **error)
+{
+	GFile *file;
+	GFileOutputStream *stream;
+	gboolean success;
+
+	if (records->len == 0)
+		return TRUE;
+
+	file = g_file_new_for_path (filename);
+
+	if (!g_file_query_exists (file, cancellable))
+		g_byte_array_prepend (records, (const guint8 *) INDEX_MAGIC, INDEX_MAGIC_LEN);
+
+	stream = g_file_append_to (file, G_FILE_CREATE_PRIVATE, cancellable, error);
+	success = stream != NULL;
+
+	if (success) {
+		success = g_output_stream_write_all (
+			G_OUTPUT_STREAM (stream), records->data, records->len,
+			NULL, cancellable, error) &&
+			g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error);
+	}
+
+	g_clear_object (&stream);
+	g_object_unref (file);
+
+	g_byte_array_set_size (records, 0);
+
+	if (success)
+		body_index_set_n_records (filename, body_index_get_n_records (filename) + n_records);
+
+	return success;
+}
+
+/* Rewrites the journal with only the current records of @index. */
+static void
+body_index_compact (BodyIndex *index,
+                    const gchar *filename,
+                    GCancellable *cancellable)
+{
+	GByteArray *records;
+	GHashTableIter iter;
+	gpointer key, value;
+	GError *local_error = NULL;
+
+	records = g_byte_array_sized_new (
+		INDEX_MAGIC_LEN + g_hash_table_size (index->signatures) * (MAIL_BODY_SIGNATURE_BYTES + 16));
+
+	g_byte_array_append (records, (const guint8 *) INDEX_MAGIC, INDEX_MAGIC_LEN);
+
+	g_hash_table_iter_init (&iter, index->signatures);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		body_index_append_record (records, RECORD_ADDED, key, value);
+	}
+
+	if (g_file_set_contents (filename, (const gchar *) records->data, records->len, &local_error)) {
+		body_index_set_n_records (filename, g_hash_table_size (index->signatures));
+	} else {
+		g_warning ("%s: Failed to compact '%s': %s", G_STRFUNC, filename, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	g_byte_array_free (records, TRUE);
+}
+
+/* Walks the message the same way as body-contains in Camel does. */
+static void
+body_index_add_part (guint8 *signature,
+                     CamelDataWrapper *object,
+                     GCancellable *cancellable)
+{
+	CamelDataWrapper *containee;
+	CamelContentType *ct;
+
+	containee = camel_medium_get_content (CAMEL_MEDIUM (object));
+	if (containee == NULL)
+		return;
+
+	if (CAMEL_IS_MULTIPART (containee)) {
+		guint ii, n_parts;
+
+		n_parts = camel_multipart_get_number (CAMEL_MULTIPART (containee));
+		for (ii = 0; ii < n_parts && !g_cancellable_is_cancelled (cancellable); ii++) {
+			CamelMimePart *part;
+
+			part = camel_multipart_get_part (CAMEL_MULTIPART (containee), ii);
+			if (part != NULL)
+				body_index_add_part (signature, CAMEL_DATA_WRAPPER (part), cancellable);
+		}
+
+		return;
+	}
+
+	if (CAMEL_IS_MIME_MESSAGE (containee)) {
+		body_index_add_part (signature, containee, cancellable);
+		return;
+	}
+
+	ct = camel_mime_part_get_content_type (CAMEL_MIME_PART (object));
+
+	if (camel_content_type_is (ct, "text", "*")) {
+		CamelStream *stream;
+		GByteArray *byte_array;
+		const gchar *charset;
+
+		byte_array = g_byte_array_new ();
+		stream = camel_stream_mem_new_with_byte_array (byte_array);
+
+		charset = camel_content_type_param (ct, "charset");
+		if (charset && *charset) {
+			CamelMimeFilter *filter;
+
+			filter = camel_mime_filter_charset_new (charset, "UTF-8");
+			if (filter != NULL) {
+				CamelStream *filtered;
+
+				filtered = camel_stream_filter_new (stream);
+				camel_stream_filter_add (CAMEL_STREAM_FILTER (filtered), filter);
+				g_object_unref (filter);
+
+				g_object_unref (stream);
+				stream = filtered;
+			}
+		}
+
+		camel_data_wrapper_decode_to_stream_sync (containee, stream, cancellable, NULL);
+		camel_stream_flush (stream, cancellable, NULL);
+
+		mail_body_signature_add_text (signature, (const gchar *) byte_array->data, byte_array->len);
+
+		g_object_unref (stream);
+	}
+}
+
+/* Returns the message when it can be read without downloading it. */
+static CamelMimeMessage *
+body_index_get_message (CamelFolder *folder,
+                        const gchar *uid,
+                        GCancellable *cancellable)
+{
+	CamelStore *store;
+
+	store = camel_folder_get_parent_store (folder);
+
+	if (CAMEL_IS_NETWORK_SERVICE (store))
+		return camel_folder_get_message_cached (folder, uid, cancellable);
+
+	return camel_folder_get_message_sync (folder, uid, cancellable, NULL);
+}
+
+/* Appends records for the @removed_uids and the @added_uids, without
+ * replaying the journal; the loader skips the superseded records. */
+static void
+body_index_update (CamelFolder *folder,
+                   const gchar *filename,
+                   GPtrArray *added_uids,
+                   GPtrArray *removed_uids,
+                   GCancellable *cancellable)
+{
+	GByteArray *records;
+	guint8 signature[MAIL_BODY_SIGNATURE_BYTES];
+	guint ii, n_batch = 0, n_records, n_messages, n_dead;
+	GError *local_error = NULL;
+
+	records = g_byte_array_new ();
+
+	g_mutex_lock (&index_lock);
+
+	/* Replays the journal only the first time in the session. */
+	body_index_get_n_records (filename);
+
+	for (ii = 0; removed_uids && ii < removed_uids->len; ii++) {
+		body_index_append_record (records, RECORD_REMOVED, removed_uids->pdata[ii], NULL);
+		n_batch++;
+	}
+
+	body_index_write (filename, records, n_batch, cancellable, &local_error);
+	n_batch = 0;
+
+	g_mutex_unlock (&index_lock);
+
+	/* Decoding the messages takes long, thus without the lock;
+	 * a message indexed twice meanwhile only leaves a dead record. */
+	for (ii = 0; !local_error && added_uids && ii < added_uids->len && !g_cancellable_is_cancelled (cancellable); ii++) {
+		const gchar *uid = added_uids->pdata[ii];
+		CamelMimeMessage *message;
+
+		message = body_index_get_message (folder, uid, cancellable);
+		if (message == NULL)
+			continue;
+
+		memset (signature, 0, MAIL_BODY_SIGNATURE_BYTES);
+		body_index_add_part (signature, CAMEL_DATA_WRAPPER (message), cancellable);
+		g_object_unref (message);
+
+		if (g_cancellable_is_cancelled (cancellable))
+			break;
+
+		body_index_append_record (records, RECORD_ADDED, uid, signature);
+
+		if (++n_batch == WRITE_BATCH) {
+			g_mutex_lock (&index_lock);
+			body_index_write (filename, records, n_batch, cancellable, &local_error);
+			g_mutex_unlock (&index_lock);
+
+			n_batch = 0;
+		}
+	}
+
+	if (local_error == NULL) {
+		g_mutex_lock (&index_lock);
+		body_index_write (filename, records, n_batch, cancellable, &local_error);
+		g_mutex_unlock (&index_lock);
+	}
+
+	if (local_error != NULL) {
+		if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("%s: Failed to write '%s': %s", G_STRFUNC, filename, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	g_byte_array_free (records, TRUE);
+
+	/* Each message has one live record at most, thus at least
+	 * the records over the message count are superseded ones. */
+	n_messages = camel_folder_get_message_count (folder);
+
+	g_mutex_lock (&index_lock);
+
+	n_records = body_index_get_n_records (filename);
+	n_dead = n_records > n_messages ? n_records - n_messages : 0;
+
+	if (n_dead > 1000 && n_dead > n_messages) {
+		BodyIndex *index;
+
+		index = body_index_load (filename);
+		body_index_compact (index, filename, cancellable);
+		body_index_free (index);
+	}
+
+	g_mutex_unlock (&index_lock);
+}
+
+/**
+ * mail_body_index_update_sync:
+ * @folder: a #CamelFolder
+ * @added_uids: (nullable): UIDs of the messages added to @folder, or %NULL
+ * @removed_uids: (nullable): UIDs of the messages removed from @folder, or %NULL
+ * @cancellable: (nullable): optional #GCancellable object, or %NULL
+ *
+ * Indexes text parts of the @added_uids, when they are available without
+ * downloading them, and drops the @removed_uids from the body index of
+ * @folder.  Does nothing, unless the body index is enabled.
+ *
+ * This can block on I/O, thus should not be called from the main thread.
+ **/
+void
+mail_body_index_update_sync (CamelFolder *folder,
+                             GPtrArray *added_uids,
+                             GPtrArray *removed_uids,
+                             GCancellable *cancellable)
+{
+	gchar *folder_uri, *filename;
+
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+
+	if (!body_index_folder_is_indexable (folder))
+		return;
+
+	if ((!added_uids || !added_uids->len) && (!removed_uids || !removed_uids->len))
+		return;
+
+	folder_uri = e_mail_folder_uri_from_folder (folder);
+	filename = body_index_build_filename (folder_uri);
+
+	body_index_update (folder, filename, added_uids, removed_uids, cancellable);
+
+	g_free (filename);
+	g_free (folder_uri);
+}
+
+static void
+body_index_catch_up_thread (GTask *task,
+                            gpointer source_object,
+                            gpointer task_data,
+                            GCancellable *cancellable)
+{
+	CamelFolder *folder = source_object;
+	const gchar *folder_uri = task_data;
+	BodyIndex *index;
+	GPtrArray *uids, *added_uids, *removed_uids;
+	GHashTable *folder_uids;
+	GHashTableIter iter;
+	gpointer key;
+	gchar *filename;
+	guint ii;
+
+	filename = body_index_build_filename (folder_uri);
+
+	uids = camel_folder_get_uids (folder);
+	folder_uids = g_hash_table_new (g_str_hash, g_str_equal);
+	added_uids = g_ptr_array_new ();
+	removed_uids = g_ptr_array_new_with_free_func (g_free);
+
+	g_mutex_lock (&index_lock);
+
+	index = body_index_load (filename);
+
+	for (ii = 0; ii < uids->len; ii++) {
+		g_hash_table_add (folder_uids, uids->pdata[ii]);
+
+		if (!g_hash_table_contains (index->signatures, uids->pdata[ii]))
+			g_ptr_array_add (added_uids, uids->pdata[ii]);
+	}
+
+	g_hash_table_iter_init (&iter, index->signatures);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_contains (folder_uids, key))
+			g_ptr_array_add (removed_uids, g_strdup (key));
+	}
+
+	body_index_free (index);
+
+	g_mutex_unlock (&index_lock);
+
+	d (printf ("%s: indexing %u, dropping %u messages of '%s'\n", G_STRFUNC, added_uids->len, removed_uids->len, folder_uri));
+
+	body_index_update (folder, filename, added_uids, removed_uids, cancellable);
+
+	g_ptr_array_free (removed_uids, TRUE);
+	g_ptr_array_free (added_uids, TRUE);
+	g_hash_table_destroy (folder_uids);
+	camel_folder_free_uids (folder, uids);
+	g_free (filename);
+
+	G_LOCK (catching_up);
+	g_hash_table_remove (catching_up, folder_uri);
+	G_UNLOCK (catching_up);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * mail_body_index_catch_up:
+ * @folder: a #CamelFolder
+ *
+ * Brings the body index of @folder up to date in a dedicated thread,
+ * unless it is already being done.  Does nothing, unless the body index
+ * is enabled.
+ **/
+void
+mail_body_index_catch_up (CamelFolder *folder)
+{
+	GTask *task;
+	gchar *folder_uri;
+	gboolean running;
+
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+
+	if (!body_index_folder_is_indexable (folder))
+		return;
+
+	folder_uri = e_mail_folder_uri_from_folder (folder);
+
+	G_LOCK (catching_up);
+
+	if (catching_up == NULL)
+		catching_up = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	running = g_hash_table_contains (catching_up, folder_uri);
+	if (!running)
+		g_hash_table_add (catching_up, g_strdup (folder_uri));
+
+	G_UNLOCK (catching_up);
+
+	if (running) {
+		g_free (folder_uri);
+		return;
+	}
+
+	task = g_task_new (folder, NULL, NULL, NULL);
+	g_task_set_task_data (task, folder_uri, g_free);
+	g_task_set_priority (task, G_PRIORITY_LOW);
+	g_task_run_in_thread (task, body_index_catch_up_thread);
+	g_object_unref (task);
+}
+
+/**
+ * mail_body_index_remove_folder:
+ * @folder_uri: a folder URI
+ *
+ * Deletes the body index of the folder @folder_uri, if any.
+ **/
+void
+mail_body_index_remove_folder (const gchar *folder_uri)
+{
+	gchar *filename;
+
+	g_return_if_fail (folder_uri != NULL);
+
+	filename = body_index_build_filename (folder_uri);
+
+	g_mutex_lock (&index_lock);
+	g_unlink (filename);
+	if (record_counts != NULL)
+		g_hash_table_remove (record_counts, filename);
+	g_mutex_unlock (&index_lock);
+
+	g_free (filename);
+}
+
+/**
+ * mail_body_index_rewrite_expression:
+ * @folder: a #CamelFolder
+ * @expression: a search expression
+ * @cancellable: (nullable): optional #GCancellable object, or %NULL
+ *
+ * Narrows body-contains terms of @expression to messages which can match
+ * them, according to the body index of @folder.  When the index does not
+ * cover all messages of @folder, it is brought up to date in a dedicated
+ * thread, for the next search.
+ *
+ * Returns: (transfer full) (nullable): a new search expression, which
+ *    gives the same results as @expression, or %NULL when the index
+ *    cannot be used; free it with g_free(), when no longer needed
+ **/
+gchar *
+mail_body_index_rewrite_expression (CamelFolder *folder,
+                                    const gchar *expression,
+                                    GCancellable *cancellable)
+{
+	MailBodyQuery *query;
+	BodyIndex *index;
+	GPtrArray *uids;
+	GPtrArray **candidates;
+	gchar *folder_uri, *filename, *rewritten = NULL;
+	guint ii, jj, n_terms;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
+	g_return_val_if_fail (expression != NULL, NULL);
+
+	if (!body_index_folder_is_indexable (folder))
+		return NULL;
+
+	query = mail_body_query_new (expression);
+	if (query == NULL)
+		return NULL;
+
+	/* Scan rather than wait for the index being written. */
+	if (!g_mutex_trylock (&index_lock)) {
+		mail_body_query_free (query);
+		return NULL;
+	}
+
+	folder_uri = e_mail_folder_uri_from_folder (folder);
+	filename = body_index_build_filename (folder_uri);
+
+	index = body_index_load (filename);
+
+	/* The mapping stays valid, the file is only appended
+	 * to or replaced, never truncated. */
+	g_mutex_unlock (&index_lock);
+
+	n_terms = mail_body_query_get_n_terms (query);
+	uids = camel_folder_get_uids (folder);
+	candidates = g_new0 (GPtrArray *, n_terms);
+
+	for (ii = 0; ii < n_terms; ii++)
+		candidates[ii] = g_ptr_array_new ();
+
+	for (ii = 0; ii < uids->len && !g_cancellable_is_cancelled (cancellable); ii++) {
+		const guint8 *signature;
+
+		signature = g_hash_table_lookup (index->signatures, uids->pdata[ii]);
+
+		/* Not up to date, scan the folder this time. */
+		if (signature == NULL)
+			break;
+
+		for (jj = 0; jj < n_terms; jj++) {
+			if (candidates[jj] != NULL &&
+			    mail_body_query_term_matches (query, jj, signature)) {
+				g_ptr_array_add (candidates[jj], uids->pdata[ii]);
+
+				if (candidates[jj]->len > MAX_CANDIDATES) {
+					g_ptr_array_free (candidates[jj], TRUE);
+					candidates[jj] = NULL;
+				}
+			}
+		}
+	}
+
+	if (ii == uids->len)
+		rewritten = mail_body_query_rewrite (query, candidates);
+	else if (!g_cancellable_is_cancelled (cancellable))
+		mail_body_index_catch_up (folder);
+
+	/* The signatures point into the mapped file. */
+	body_index_free (index);
+
+	for (ii = 0; ii < n_terms; ii++) {
+		if (candidates[ii] != NULL)
+			g_ptr_array_free (candidates[ii], TRUE);
+	}
+
+	g_free (candidates);
+	camel_folder_free_uids (folder, uids);
+	mail_body_query_free (query);
+	g_free (filename);
+	g_free (folder_uri);
+
+	return rewritten;
+}
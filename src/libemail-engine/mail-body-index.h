@@ -0,0 +1,42 @@
+/*
+ * mail-body-index.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#if !defined (__LIBEMAIL_ENGINE_H_INSIDE__) && !defined (LIBEMAIL_ENGINE_COMPILATION)
+#error "Only <libemail-engine/libemail-engine.h> should be included directly."
+#endif
+
+#ifndef MAIL_BODY_INDEX_H
+#define MAIL_BODY_INDEX_H
+
+#include <camel/camel.h>
+
+G_BEGIN_DECLS
+
+void		mail_body_index_update_sync	(CamelFolder *folder,
+						 GPtrArray *added_uids,
+						 GPtrArray *removed_uids,
+						 GCancellable *cancellable);
+void		mail_body_index_catch_up	(CamelFolder *folder);
+void		mail_body_index_remove_folder	(const gchar *folder_uri);
+gchar *		mail_body_index_rewrite_expression
+						(CamelFolder *folder,
+						 const gchar *expression,
+						 GCancellable *cancellable);
+
+G_END_DECLS
+
+#endif /* MAIL_BODY_INDEX_H */
@@ -0,0 +1,399 @@
+/*
+ * mail-body-query.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Signatures of message text and the body-contains terms of a search
+ * expression, matched against them.  A message can contain a word only
+ * when its signature has the bits of all the trigrams of the word. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include <camel/camel.h>
+
+#include "mail-body-query.h"
+
+/* Bits each matching message has for one argument of body-contains. */
+typedef struct _BodyTerm {
+	gsize start, end; /* of the whole term in the expression */
+	GPtrArray *bit_sets; /* GArray of guint, one per argument */
+} BodyTerm;
+
+struct _MailBodyQuery {
+	gchar *expression;
+	GPtrArray *terms; /* BodyTerm, in the order of the expression */
+};
+
+static guint
+body_query_hash_trigram (gunichar c1,
+                         gunichar c2,
+                         gunichar c3)
+{
+	guint32 hash;
+
+	hash = ((c1 * 31) + c2) * 31 + c3;
+	hash *= 2654435761u;
+
+	return hash % MAIL_BODY_SIGNATURE_BITS;
+}
+
+/* Sets the bits of all the trigrams of @text, lower-cased the same way
+ * as camel_ustrstrcase() does.  Invalid text can match in unexpected ways,
+ * thus it sets all the bits. */
+void
+mail_body_signature_add_text (guint8 *signature,
+                              const gchar *text,
+                              gsize text_len)
+{
+	gunichar prev[2] = { 0, 0 };
+	const gchar *ptr, *end;
+	guint n_chars = 0;
+
+	g_return_if_fail (signature != NULL);
+	g_return_if_fail (text != NULL || text_len == 0);
+
+	for (ptr = text, end = text + text_len; ptr < end; ptr = g_utf8_next_char (ptr)) {
+		gunichar c;
+
+		c = g_utf8_get_char_validated (ptr, end - ptr);
+		if (c == (gunichar) -1 || c == (gunichar) -2) {
+			memset (signature, 0xFF, MAIL_BODY_SIGNATURE_BYTES);
+			return;
+		}
+
+		c = g_unichar_tolower (c);
+
+		if (n_chars >= 2) {
+			guint bit = body_query_hash_trigram (prev[0], prev[1], c);
+
+			signature[bit / 8] |= 1 << (bit % 8);
+		}
+
+		prev[0] = prev[1];
+		prev[1] = c;
+		n_chars++;
+	}
+}
+
+static void
+body_term_free (gpointer ptr)
+{
+	BodyTerm *term = ptr;
+
+	g_ptr_array_unref (term->bit_sets);
+	g_slice_free (BodyTerm, term);
+}
+
+/* Collects the bits of the trigrams of all the alphanumeric runs of @word,
+ * which each is a part of a word Camel will look for.  Returns %FALSE,
+ * when nothing in the @word is long enough to narrow the search. */
+static gboolean
+body_term_add_word (BodyTerm *term,
+                    const gchar *word)
+{
+	GArray *bits;
+	gunichar prev[2] = { 0, 0 };
+	guint n_chars = 0;
+	const gchar *ptr;
+
+	if (!g_utf8_validate (word, -1, NULL))
+		return FALSE;
+
+	bits = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	for (ptr = word; *ptr; ptr = g_utf8_next_char (ptr)) {
+		gunichar c = g_utf8_get_char (ptr);
+
+		if (!g_unichar_isalnum (c)) {
+			n_chars = 0;
+			continue;
+		}
+
+		c = g_unichar_tolower (c);
+
+		if (n_chars >= 2) {
+			guint bit = body_query_hash_trigram (prev[0], prev[1], c);
+
+			g_array_append_val (bits, bit);
+		}
+
+		prev[0] = prev[1];
+		prev[1] = c;
+		n_chars++;
+	}
+
+	if (bits->len == 0) {
+		g_array_unref (bits);
+		return FALSE;
+	}
+
+	g_ptr_array_add (term->bit_sets, bits);
+
+	return TRUE;
+}
+
+static const gchar *
+body_query_skip_spaces (const gchar *ptr)
+{
+	while (g_ascii_isspace (*ptr))
+		ptr++;
+
+	return ptr;
+}
+
+/* Reads a string literal as written by camel_sexp_encode_string(),
+ * other escape sequences are refused, to not guess their meaning. */
+static gchar *
+body_query_read_string (const gchar **pptr)
+{
+	GString *str;
+	const gchar *ptr = *pptr;
+
+	if (*ptr != '\"')
+		return NULL;
+
+	str = g_string_new ("");
+
+	for (ptr++; *ptr && *ptr != '\"'; ptr++) {
+		if (*ptr == '\\') {
+			ptr++;
+
+			if (*ptr != '\\' && *ptr != '\"' && *ptr != '\'') {
+				g_string_free (str, TRUE);
+				return NULL;
+			}
+		}
+
+		g_string_append_c (str, *ptr);
+	}
+
+	if (*ptr != '\"') {
+		g_string_free (str, TRUE);
+		return NULL;
+	}
+
+	*pptr = ptr + 1;
+
+	return g_string_free (str, FALSE);
+}
+
+/**
+ * mail_body_query_new:
+ * @expression: a search expression
+ *
+ * Finds (body-contains "..." ...) terms of @expression with only string
+ * arguments, which all can narrow the search.
+ *
+ * Returns: (transfer full) (nullable): a new #MailBodyQuery, or %NULL,
+ *    when no term of @expression can be narrowed by the body index
+ **/
+MailBodyQuery *
+mail_body_query_new (const gchar *expression)
+{
+	MailBodyQuery *query;
+	GPtrArray *terms;
+	const gchar *ptr;
+	gboolean in_string = FALSE;
+
+	g_return_val_if_fail (expression != NULL, NULL);
+
+	if (!strstr (expression, "body-contains"))
+		return NULL;
+
+	terms = g_ptr_array_new_with_free_func (body_term_free);
+
+	for (ptr = expression; *ptr; ptr++) {
+		const gchar *args;
+		BodyTerm *term;
+		gboolean usable = TRUE;
+
+		if (in_string) {
+			if (*ptr == '\\' && ptr[1])
+				ptr++;
+			else if (*ptr == '\"')
+				in_string = FALSE;
+			continue;
+		}
+
+		if (*ptr == '\"') {
+			in_string = TRUE;
+			continue;
+		}
+
+		if (*ptr != '(')
+			continue;
+
+		args = body_query_skip_spaces (ptr + 1);
+		if (!g_str_has_prefix (args, "body-contains") ||
+		    !g_ascii_isspace (args[strlen ("body-contains")]))
+			continue;
+
+		args += strlen ("body-contains");
+
+		term = g_slice_new0 (BodyTerm);
+		term->start = ptr - expression;
+		term->bit_sets = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+
+		for (args = body_query_skip_spaces (args); usable && *args && *args != ')'; args = body_query_skip_spaces (args)) {
+			gchar *word;
+
+			word = body_query_read_string (&args);
+			usable = word != NULL && body_term_add_word (term, word);
+			g_free (word);
+		}
+
+		if (usable && *args == ')' && term->bit_sets->len > 0) {
+			term->end = args + 1 - expression;
+			g_ptr_array_add (terms, term);
+
+			/* The arguments are known to be plain strings. */
+			ptr = args;
+		} else {
+			body_term_free (term);
+		}
+	}
+
+	if (terms->len == 0) {
+		g_ptr_array_unref (terms);
+		return NULL;
+	}
+
+	query = g_slice_new0 (MailBodyQuery);
+	query->expression = g_strdup (expression);
+	query->terms = terms;
+
+	return query;
+}
+
+void
+mail_body_query_free (MailBodyQuery *query)
+{
+	if (query == NULL)
+		return;
+
+	g_ptr_array_unref (query->terms);
+	g_free (query->expression);
+
+	g_slice_free (MailBodyQuery, query);
+}
+
+guint
+mail_body_query_get_n_terms (MailBodyQuery *query)
+{
+	g_return_val_if_fail (query != NULL, 0);
+
+	return query->terms->len;
+}
+
+/**
+ * mail_body_query_term_matches:
+ * @query: a #MailBodyQuery
+ * @term_index: index of the term, less than mail_body_query_get_n_terms()
+ * @signature: a signature of a message, of %MAIL_BODY_SIGNATURE_BYTES
+ *
+ * Returns: whether the message of the @signature can match the term
+ *    at @term_index, that is, whether it can contain any of its words
+ **/
+gboolean
+mail_body_query_term_matches (MailBodyQuery *query,
+                              guint term_index,
+                              const guint8 *signature)
+{
+	BodyTerm *term;
+	guint ii, jj;
+
+	g_return_val_if_fail (query != NULL, FALSE);
+	g_return_val_if_fail (term_index < query->terms->len, FALSE);
+	g_return_val_if_fail (signature != NULL, FALSE);
+
+	term = query->terms->pdata[term_index];
+
+	/* Camel matches any of the arguments. */
+	for (ii = 0; ii < term->bit_sets->len; ii++) {
+		GArray *bits = term->bit_sets->pdata[ii];
+
+		for (jj = 0; jj < bits->len; jj++) {
+			guint bit = g_array_index (bits, guint, jj);
+
+			if ((signature[bit / 8] & (1 << (bit % 8))) == 0)
+				break;
+		}
+
+		if (jj == bits->len)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * mail_body_query_rewrite:
+ * @query: a #MailBodyQuery
+ * @candidates: an array of mail_body_query_get_n_terms() #GPtrArray-s
+ *    of UIDs, or %NULL-s
+ *
+ * Restricts each term of the expression of @query to the UIDs in
+ * the corresponding item of @candidates; terms with a %NULL item
+ * are left as they are.  The term itself is kept, thus the result
+ * is the same as of the original expression, as long as each item
+ * of @candidates contains all the messages matching its term.
+ *
+ * Returns: (transfer full) (nullable): a new search expression,
+ *    or %NULL, when all the @candidates are %NULL
+ **/
+gchar *
+mail_body_query_rewrite (MailBodyQuery *query,
+                         GPtrArray **candidates)
+{
+	GString *rewritten = NULL;
+	gsize last_end = 0;
+	guint ii, jj;
+
+	g_return_val_if_fail (query != NULL, NULL);
+	g_return_val_if_fail (candidates != NULL, NULL);
+
+	for (ii = 0; ii < query->terms->len; ii++) {
+		BodyTerm *term = query->terms->pdata[ii];
+
+		if (candidates[ii] == NULL)
+			continue;
+
+		if (rewritten == NULL)
+			rewritten = g_string_sized_new (strlen (query->expression) + 1024);
+
+		g_string_append_len (rewritten, query->expression + last_end, term->start - last_end);
+		g_string_append (rewritten, "(and (uid");
+
+		for (jj = 0; jj < candidates[ii]->len; jj++) {
+			g_string_append_c (rewritten, ' ');
+			camel_sexp_encode_string (rewritten, candidates[ii]->pdata[jj]);
+		}
+
+		g_string_append (rewritten, ") ");
+		g_string_append_len (rewritten, query->expression + term->start, term->end - term->start);
+		g_string_append_c (rewritten, ')');
+
+		last_end = term->end;
+	}
+
+	if (rewritten == NULL)
+		return NULL;
+
+	g_string_append (rewritten, query->expression + last_end);
+
+	return g_string_free (rewritten, FALSE);
+}
@@ -0,0 +1,47 @@
+/*
+ * mail-body-query.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Private to the body index, not installed. */
+
+#ifndef MAIL_BODY_QUERY_H
+#define MAIL_BODY_QUERY_H
+
+#include <glib.h>
+
+#define MAIL_BODY_SIGNATURE_BITS 4096
+#define MAIL_BODY_SIGNATURE_BYTES (MAIL_BODY_SIGNATURE_BITS / 8)
+
+G_BEGIN_DECLS
+
+typedef struct _MailBodyQuery MailBodyQuery;
+
+void		mail_body_signature_add_text	(guint8 *signature,
+						 const gchar *text,
+						 gsize text_len);
+
+MailBodyQuery *	mail_body_query_new		(const gchar *expression);
+void		mail_body_query_free		(MailBodyQuery *query);
+guint		mail_body_query_get_n_terms	(MailBodyQuery *query);
+gboolean	mail_body_query_term_matches	(MailBodyQuery *query,
+						 guint term_index,
+						 const guint8 *signature);
+gchar *		mail_body_query_rewrite		(MailBodyQuery *query,
+						 GPtrArray **candidates);
+
+G_END_DECLS
+
+#endif /* MAIL_BODY_QUERY_H */
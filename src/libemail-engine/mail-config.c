@@ -43,6 +43,7 @@ typedef struct {
 	gboolean book_lookup;
 	gboolean book_lookup_local_only;
 	gchar *local_archive_folder;
+	gboolean body_index;
 } MailConfig;
 
 extern gint camel_header_param_encode_filenames_in_rfc_2047;
@@ -246,6 +247,14 @@ mail_config_dup_local_archive_folder (void)
 	return g_strdup (config->local_archive_folder);
 }
 
+gboolean
+mail_config_get_body_index (void)
+{
+	g_return_val_if_fail (config != NULL, FALSE);
+
+	return config->body_index;
+}
+
 /* Config struct routines */
 void
 mail_config_init (EMailSession *session)
@@ -315,5 +324,13 @@ mail_config_init (EMailSession *session)
 	config->local_archive_folder = g_settings_get_string (
 		mail_settings, "local-archive-folder");
 
+	/* Search Configuration */
+
+	g_signal_connect (
+		mail_settings, "changed::body-index",
+		G_CALLBACK (settings_bool_value_changed), &config->body_index);
+	config->body_index = g_settings_get_boolean (
+		mail_settings, "body-index");
+
 	settings_jh_check_changed (mail_settings, NULL, session);
 }
@@ -46,6 +46,7 @@ void		mail_config_reload_junk_headers	(EMailSession *session);
 gboolean	mail_config_get_lookup_book	(void);
 gboolean	mail_config_get_lookup_book_local_only (void);
 gchar *		mail_config_dup_local_archive_folder (void);
+gboolean	mail_config_get_body_index	(void);
 
 G_END_DECLS
 
@@ -40,6 +40,7 @@
 
 #include <libemail-engine/mail-mt.h>
 
+#include "mail-body-index.h"
 #include "mail-folder-cache.h"
 #include "mail-ops.h"
 #include "e-mail-utils.h"
@@ -58,6 +59,7 @@ typedef struct _StoreInfo StoreInfo;
 typedef struct _FolderInfo FolderInfo;
 typedef struct _AsyncContext AsyncContext;
 typedef struct _UpdateClosure UpdateClosure;
+typedef struct _IgnoreThreadIndex IgnoreThreadIndex;
 
 struct _MailFolderCachePrivate {
 	GMainContext *main_context;
@@ -131,8 +133,27 @@ struct _FolderInfo {
 
 	GWeakRef folder;
 	gulong folder_changed_handler_id;
+
+	/* Messages with the "ignore-thread" flag, built on demand */
+	GMutex ignore_thread_lock;
+	IgnoreThreadIndex *ignore_thread_index;
+};
+
+/* Count of messages with the "ignore-thread" flag per Message-ID,
+ * kept up to date from the folder changes, thus the new messages
+ * can be checked for an ignored thread without searching the folder. */
+struct _IgnoreThreadIndex {
+	/* UID ~> guint64 Message-ID */
+	GHashTable *msgids_by_uid;
+	/* guint64 Message-ID ~> IgnoreThreadCount */
+	GHashTable *counts;
 };
 
+typedef struct _IgnoreThreadCount {
+	guint64 msgid;
+	gint count;
+} IgnoreThreadCount;
+
 struct _AsyncContext {
 	StoreInfo *store_info;
 	CamelFolderInfo *info;
@@ -183,6 +204,91 @@ static void	store_folder_unsubscribed_cb	(CamelStore *store,
 
 G_DEFINE_TYPE (MailFolderCache, mail_folder_cache, G_TYPE_OBJECT)
 
+static IgnoreThreadIndex *
+ignore_thread_index_new (void)
+{
+	IgnoreThreadIndex *index;
+
+	index = g_slice_new0 (IgnoreThreadIndex);
+	index->msgids_by_uid = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) g_free);
+	index->counts = g_hash_table_new_full (
+		(GHashFunc) g_int64_hash,
+		(GEqualFunc) g_int64_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) g_free);
+
+	return index;
+}
+
+static void
+ignore_thread_index_free (IgnoreThreadIndex *index)
+{
+	if (!index)
+		return;
+
+	g_hash_table_destroy (index->msgids_by_uid);
+	g_hash_table_destroy (index->counts);
+
+	g_slice_free (IgnoreThreadIndex, index);
+}
+
+static void
+ignore_thread_index_count (IgnoreThreadIndex *index,
+                           guint64 msgid,
+                           gint delta)
+{
+	IgnoreThreadCount *itc;
+
+	itc = g_hash_table_lookup (index->counts, &msgid);
+	if (!itc) {
+		if (delta <= 0)
+			return;
+
+		itc = g_new0 (IgnoreThreadCount, 1);
+		itc->msgid = msgid;
+		g_hash_table_insert (index->counts, &itc->msgid, itc);
+	}
+
+	itc->count += delta;
+
+	if (itc->count <= 0)
+		g_hash_table_remove (index->counts, &msgid);
+}
+
+/* Records whether the message @uid with @msgid has the "ignore-thread" flag. */
+static void
+ignore_thread_index_set (IgnoreThreadIndex *index,
+                         const gchar *uid,
+                         guint64 msgid,
+                         gboolean ignore_thread)
+{
+	guint64 *old_msgid;
+
+	old_msgid = g_hash_table_lookup (index->msgids_by_uid, uid);
+
+	if (old_msgid && (!ignore_thread || *old_msgid != msgid)) {
+		ignore_thread_index_count (index, *old_msgid, -1);
+		g_hash_table_remove (index->msgids_by_uid, uid);
+		old_msgid = NULL;
+	}
+
+	if (ignore_thread && msgid && !old_msgid) {
+		g_hash_table_insert (index->msgids_by_uid, g_strdup (uid), g_memdup (&msgid, sizeof (guint64)));
+		ignore_thread_index_count (index, msgid, +1);
+	}
+}
+
+static gboolean
+ignore_thread_index_contains (IgnoreThreadIndex *index,
+                              guint64 msgid)
+{
+	return msgid && g_hash_table_contains (index->counts, &msgid);
+}
+
 static FolderInfo *
 folder_info_new (CamelStore *store,
                  const gchar *full_name,
@@ -197,6 +303,7 @@ folder_info_new (CamelStore *store,
 	folder_info->flags = flags;
 
 	g_mutex_init (&folder_info->lock);
+	g_mutex_init (&folder_info->ignore_thread_lock);
 
 	return folder_info;
 }
@@ -235,6 +342,11 @@ folder_info_clear_folder (FolderInfo *folder_info)
 	}
 
 	g_mutex_unlock (&folder_info->lock);
+
+	/* Any next folder builds its own */
+	g_mutex_lock (&folder_info->ignore_thread_lock);
+	g_clear_pointer (&folder_info->ignore_thread_index, ignore_thread_index_free);
+	g_mutex_unlock (&folder_info->ignore_thread_lock);
 }
 
 static void
@@ -250,6 +362,7 @@ folder_info_unref (FolderInfo *folder_info)
 		g_free (folder_info->full_name);
 
 		g_mutex_clear (&folder_info->lock);
+		g_mutex_clear (&folder_info->ignore_thread_lock);
 
 		g_slice_free (FolderInfo, folder_info);
 	}
@@ -920,83 +1033,262 @@ update_1folder (MailFolderCache *cache,
 	}
 }
 
+/* How many Message-IDs are searched for at once */
+#define IGNORE_THREAD_SEARCH_CHUNK 100
+
+/* Builds the ignore-thread index of @folder_info on its first use.
+ * Expects the ignore_thread_lock being held. */
 static gboolean
-folder_cache_check_ignore_thread (CamelFolder *folder,
-				  CamelMessageInfo *info,
-				  GCancellable *cancellable,
-				  GError **error)
-{
-	GArray *references;
-	gboolean has_ignore_thread = FALSE, first_ignore_thread = FALSE, found_first_msgid = FALSE;
-	guint64 first_msgid;
-	GString *expr = NULL;
+folder_cache_ensure_ignore_thread_index (FolderInfo *folder_info,
+                                         CamelFolder *folder,
+                                         GCancellable *cancellable,
+                                         GError **error)
+{
+	IgnoreThreadIndex *index;
+	GPtrArray *uids;
+	GError *local_error = NULL;
 	guint ii;
 
-	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
-	g_return_val_if_fail (info != NULL, FALSE);
+	if (folder_info->ignore_thread_index)
+		return TRUE;
 
-	references = camel_message_info_dup_references (info);
-	if (!references || references->len <= 0) {
-		if (references)
-			g_array_unref (references);
+	uids = camel_folder_search_by_expression (
+		folder, "(match-all (user-flag \"ignore-thread\"))",
+		cancellable, &local_error);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		if (uids)
+			camel_folder_search_free (folder, uids);
 		return FALSE;
 	}
 
-	first_msgid = g_array_index (references, guint64, 0);
+	index = ignore_thread_index_new ();
 
-	for (ii = 0; ii < references->len; ii++) {
-		CamelSummaryMessageID msgid;
+	for (ii = 0; uids && ii < uids->len; ii++) {
+		CamelMessageInfo *info;
 
-		msgid.id.id = g_array_index (references, guint64, ii);
-		if (!msgid.id.id)
-			continue;
+		info = camel_folder_get_message_info (folder, uids->pdata[ii]);
+		if (info) {
+			ignore_thread_index_set (
+				index, uids->pdata[ii],
+				camel_message_info_get_message_id (info), TRUE);
+			g_clear_object (&info);
+		}
+	}
+
+	if (uids)
+		camel_folder_search_free (folder, uids);
+
+	folder_info->ignore_thread_index = index;
+
+	return TRUE;
+}
+
+/* Expects the ignore_thread_lock being held. */
+static void
+folder_cache_update_ignore_thread_index (FolderInfo *folder_info,
+                                         CamelFolder *folder,
+                                         CamelFolderChangeInfo *changes)
+{
+	IgnoreThreadIndex *index = folder_info->ignore_thread_index;
+	GPtrArray *uids[2];
+	guint ii, jj;
+
+	if (!index)
+		return;
+
+	for (ii = 0; ii < changes->uid_removed->len; ii++)
+		ignore_thread_index_set (index, changes->uid_removed->pdata[ii], 0, FALSE);
+
+	uids[0] = changes->uid_added;
+	uids[1] = changes->uid_changed;
 
-		if (!expr)
-			expr = g_string_new ("(match-all (or ");
+	for (jj = 0; jj < G_N_ELEMENTS (uids); jj++) {
+		for (ii = 0; ii < uids[jj]->len; ii++) {
+			const gchar *uid = uids[jj]->pdata[ii];
+			CamelMessageInfo *info;
 
-		g_string_append_printf (expr, "(= \"msgid\" \"%lu %lu\")",
-			(gulong) msgid.id.part.hi,
-			(gulong) msgid.id.part.lo);
+			info = camel_folder_get_message_info (folder, uid);
+			if (info) {
+				ignore_thread_index_set (
+					index, uid,
+					camel_message_info_get_message_id (info),
+					camel_message_info_get_user_flag (info, "ignore-thread"));
+				g_clear_object (&info);
+			} else {
+				ignore_thread_index_set (index, uid, 0, FALSE);
+			}
+		}
 	}
+}
 
-	if (expr) {
+static void
+folder_cache_set_ignore_thread (IgnoreThreadIndex *index,
+                                CamelMessageInfo *info)
+{
+	camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
+	camel_message_info_set_user_flag (info, "ignore-thread", TRUE);
+
+	/* For the next messages, which can reply to this one */
+	ignore_thread_index_set (
+		index, camel_message_info_get_uid (info),
+		camel_message_info_get_message_id (info), TRUE);
+}
+
+/* Returns a set of those of @msgids, which any message of @folder has. */
+static GHashTable *
+folder_cache_search_msgids (CamelFolder *folder,
+                            GArray *msgids,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	GHashTable *found;
+	guint ii, jj;
+
+	found = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+	for (ii = 0; ii < msgids->len; ii += IGNORE_THREAD_SEARCH_CHUNK) {
+		GString *expr;
 		GPtrArray *uids;
+		GError *local_error = NULL;
+
+		expr = g_string_new ("(match-all (or ");
+
+		for (jj = ii; jj < msgids->len && jj < ii + IGNORE_THREAD_SEARCH_CHUNK; jj++) {
+			CamelSummaryMessageID msgid;
+
+			msgid.id.id = g_array_index (msgids, guint64, jj);
+
+			g_string_append_printf (expr, "(= \"msgid\" \"%lu %lu\")",
+				(gulong) msgid.id.part.hi,
+				(gulong) msgid.id.part.lo);
+		}
 
 		g_string_append (expr, "))");
 
-		uids = camel_folder_search_by_expression (folder, expr->str, cancellable, error);
-		if (uids) {
-			for (ii = 0; ii < uids->len; ii++) {
-				const gchar *refruid = uids->pdata[ii];
-				CamelMessageInfo *refrinfo;
-
-				refrinfo = camel_folder_get_message_info (folder, refruid);
-				if (!refrinfo)
-					continue;
-
-				if (first_msgid && camel_message_info_get_message_id (refrinfo) == first_msgid) {
-					/* The first msgid in the references is In-ReplyTo, which is the master;
-					   the rest is just a guess. */
-					found_first_msgid = TRUE;
-					first_ignore_thread = camel_message_info_get_user_flag (refrinfo, "ignore-thread");
-					g_clear_object (&refrinfo);
-					break;
-				}
+		uids = camel_folder_search_by_expression (folder, expr->str, cancellable, &local_error);
+
+		g_string_free (expr, TRUE);
+
+		for (jj = 0; uids && jj < uids->len; jj++) {
+			CamelMessageInfo *info;
 
-				has_ignore_thread = has_ignore_thread || camel_message_info_get_user_flag (refrinfo, "ignore-thread");
+			info = camel_folder_get_message_info (folder, uids->pdata[jj]);
+			if (info) {
+				guint64 msgid = camel_message_info_get_message_id (info);
 
-				g_clear_object (&refrinfo);
+				g_hash_table_add (found, g_memdup (&msgid, sizeof (guint64)));
+				g_clear_object (&info);
 			}
+		}
 
+		if (uids)
 			camel_folder_search_free (folder, uids);
+
+		if (local_error) {
+			g_propagate_error (error, local_error);
+			g_hash_table_destroy (found);
+			return NULL;
 		}
+	}
 
-		g_string_free (expr, TRUE);
+	return found;
+}
+
+/* Sets the "ignore-thread" flag, and marks as read, those of @infos, new
+ * messages of @folder, which reply to a message with that flag.  When the
+ * message replied to, the first of the References, is in the folder, then
+ * its flag decides, otherwise any of the other References with the flag.
+ * Expects the ignore_thread_lock being held. */
+static gboolean
+folder_cache_check_ignore_threads (FolderInfo *folder_info,
+                                   CamelFolder *folder,
+                                   GPtrArray *infos,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+	IgnoreThreadIndex *index;
+	GPtrArray *undecided;
+	GArray *first_msgids;
+	guint ii;
+
+	if (!folder_cache_ensure_ignore_thread_index (folder_info, folder, cancellable, error))
+		return FALSE;
+
+	index = folder_info->ignore_thread_index;
+
+	/* Nothing in the folder is ignored, which is the usual case */
+	if (g_hash_table_size (index->counts) == 0)
+		return TRUE;
+
+	undecided = g_ptr_array_new ();
+	first_msgids = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+	for (ii = 0; ii < infos->len; ii++) {
+		CamelMessageInfo *info = infos->pdata[ii];
+		GArray *references;
+		guint64 first_msgid;
+		gboolean has_ignore_thread = FALSE;
+		guint jj;
+
+		references = camel_message_info_dup_references (info);
+		if (!references || references->len <= 0) {
+			if (references)
+				g_array_unref (references);
+			continue;
+		}
+
+		first_msgid = g_array_index (references, guint64, 0);
+
+		if (ignore_thread_index_contains (index, first_msgid)) {
+			folder_cache_set_ignore_thread (index, info);
+			g_array_unref (references);
+			continue;
+		}
+
+		for (jj = 1; jj < references->len && !has_ignore_thread; jj++) {
+			has_ignore_thread = ignore_thread_index_contains (
+				index, g_array_index (references, guint64, jj));
+		}
+
+		g_array_unref (references);
+
+		if (!has_ignore_thread)
+			continue;
+
+		if (!first_msgid) {
+			folder_cache_set_ignore_thread (index, info);
+		} else {
+			/* It depends on whether the message replied to,
+			 * without the flag, is in the folder. */
+			g_ptr_array_add (undecided, info);
+			g_array_append_val (first_msgids, first_msgid);
+		}
 	}
 
-	g_array_unref (references);
+	if (undecided->len > 0) {
+		GHashTable *found;
 
-	return (found_first_msgid && first_ignore_thread) || (!found_first_msgid && has_ignore_thread);
+		found = folder_cache_search_msgids (folder, first_msgids, cancellable, error);
+		if (!found) {
+			g_ptr_array_free (undecided, TRUE);
+			g_array_free (first_msgids, TRUE);
+			return FALSE;
+		}
+
+		for (ii = 0; ii < undecided->len; ii++) {
+			if (!g_hash_table_contains (found, &g_array_index (first_msgids, guint64, ii)))
+				folder_cache_set_ignore_thread (index, undecided->pdata[ii]);
+		}
+
+		g_hash_table_destroy (found);
+	}
+
+	g_ptr_array_free (undecided, TRUE);
+	g_array_free (first_msgids, TRUE);
+
+	return TRUE;
 }
 
 static void
@@ -1016,7 +1308,7 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 	CamelSession *session;
 	CamelStore *parent_store;
 	CamelMessageInfo *info;
-	FolderInfo *folder_info;
+	FolderInfo *folder_info, *ignore_info;
 	const gchar *full_name;
 	gint new = 0;
 	gint i;
@@ -1049,58 +1341,89 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 	local_sent = e_mail_session_get_local_folder (
 		E_MAIL_SESSION (session), E_MAIL_LOCAL_FOLDER_SENT);
 
+	folder_info = mail_folder_cache_ref_folder_info (
+		cache, parent_store, full_name);
+
+	/* Folders unknown to the cache are checked for ignored threads
+	 * too, with an index built only for these changes. */
+	if (folder_info != NULL)
+		ignore_info = folder_info_ref (folder_info);
+	else
+		ignore_info = folder_info_new (parent_store, full_name, 0);
+
+	g_mutex_lock (&ignore_info->ignore_thread_lock);
+	folder_cache_update_ignore_thread_index (ignore_info, folder, changes);
+	g_mutex_unlock (&ignore_info->ignore_thread_lock);
+
 	if (!CAMEL_IS_VEE_FOLDER (folder)
 	    && folder != local_drafts
 	    && folder != local_outbox
 	    && folder != local_sent
 	    && changes && (changes->uid_added->len > 0)) {
-		/* for each added message, check to see that it is
-		 * brand new, not junk and not already deleted */
+		GPtrArray *infos, *unread_infos;
+		GError *local_error = NULL;
+
+		infos = g_ptr_array_new_with_free_func (g_object_unref);
+		unread_infos = g_ptr_array_new ();
+
 		for (i = 0; i < changes->uid_added->len && !g_cancellable_is_cancelled (cancellable); i++) {
 			info = camel_folder_get_message_info (
 				folder, changes->uid_added->pdata[i]);
 			if (info) {
-				GError *local_error = NULL;
-
 				flags = camel_message_info_get_flags (info);
 				if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
-				    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
-				    folder_cache_check_ignore_thread (folder, info, cancellable, &local_error)) {
-					camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
-					camel_message_info_set_user_flag (info, "ignore-thread", TRUE);
-					flags = flags | CAMEL_MESSAGE_SEEN;
-				}
+				    ((flags & CAMEL_MESSAGE_DELETED) == 0))
+					g_ptr_array_add (unread_infos, info);
 
-				if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
-				    ((flags & CAMEL_MESSAGE_JUNK) == 0) &&
-				    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
-				    (camel_message_info_get_date_received (info) > latest_received)) {
-					if (camel_message_info_get_date_received (info) > new_latest_received)
-						new_latest_received = camel_message_info_get_date_received (info);
-					new++;
-					if (new == 1) {
-						uid = g_strdup (camel_message_info_get_uid (info));
-						sender = g_strdup (camel_message_info_get_from (info));
-						subject = g_strdup (camel_message_info_get_subject (info));
-					} else {
-						g_free (uid);
-						g_free (sender);
-						g_free (subject);
-
-						uid = NULL;
-						sender = NULL;
-						subject = NULL;
-					}
-				}
+				g_ptr_array_add (infos, info);
+			}
+		}
 
-				g_clear_object (&info);
+		/* All the added messages at once */
+		if (unread_infos->len > 0 &&
+		    !g_cancellable_is_cancelled (cancellable)) {
+			g_mutex_lock (&ignore_info->ignore_thread_lock);
+			folder_cache_check_ignore_threads (
+				ignore_info, folder, unread_infos,
+				cancellable, &local_error);
+			g_mutex_unlock (&ignore_info->ignore_thread_lock);
+		}
 
-				if (local_error) {
-					g_propagate_error (error, local_error);
-					break;
+		/* for each added message, check to see that it is
+		 * brand new, not junk and not already deleted */
+		for (i = 0; i < infos->len; i++) {
+			info = infos->pdata[i];
+
+			flags = camel_message_info_get_flags (info);
+
+			if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
+			    ((flags & CAMEL_MESSAGE_JUNK) == 0) &&
+			    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
+			    (camel_message_info_get_date_received (info) > latest_received)) {
+				if (camel_message_info_get_date_received (info) > new_latest_received)
+					new_latest_received = camel_message_info_get_date_received (info);
+				new++;
+				if (new == 1) {
+					uid = g_strdup (camel_message_info_get_uid (info));
+					sender = g_strdup (camel_message_info_get_from (info));
+					subject = g_strdup (camel_message_info_get_subject (info));
+				} else {
+					g_free (uid);
+					g_free (sender);
+					g_free (subject);
+
+					uid = NULL;
+					sender = NULL;
+					subject = NULL;
 				}
 			}
 		}
+
+		g_ptr_array_free (unread_infos, TRUE);
+		g_ptr_array_free (infos, TRUE);
+
+		if (local_error)
+			g_propagate_error (error, local_error);
 	}
 
 	if (new > 0) {
@@ -1111,8 +1434,6 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 		g_mutex_unlock (&last_newmail_per_folder_mutex);
 	}
 
-	folder_info = mail_folder_cache_ref_folder_info (
-		cache, parent_store, full_name);
 	if (folder_info != NULL) {
 		update_1folder (
 			cache, folder_info, new,
@@ -1120,11 +1441,18 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 		folder_info_unref (folder_info);
 	}
 
+	folder_info_unref (ignore_info);
+
 	g_free (uid);
 	g_free (sender);
 	g_free (subject);
 
 	g_object_unref (session);
+
+	/* Last, it can take long and the counts are updated already. */
+	mail_body_index_update_sync (
+		folder, changes->uid_added,
+		changes->uid_removed, cancellable);
 }
 
 static void
@@ -1155,9 +1483,16 @@ unset_folder_info (MailFolderCache *cache,
 		up = update_closure_new (cache, folder_info->store);
 		up->full_name = g_strdup (folder_info->full_name);
 
-		if (delete)
+		if (delete) {
+			gchar *folder_uri;
+
+			folder_uri = e_mail_folder_uri_build (
+				folder_info->store, folder_info->full_name);
+			mail_body_index_remove_folder (folder_uri);
+			g_free (folder_uri);
+
 			up->signal_id = signals[FOLDER_DELETED];
-		else
+		} else
 			up->signal_id = signals[FOLDER_UNAVAILABLE];
 
 		mail_folder_cache_submit_update (up);
@@ -1318,6 +1653,7 @@ rename_folders (MailFolderCache *cache,
 	/* rename the meta-data we maintain ourselves */
 	config_dir = mail_session_get_config_dir ();
 	olduri = e_mail_folder_uri_build (store_info->store, old);
+	mail_body_index_remove_folder (olduri);
 	e_filename_make_safe (olduri);
 	newuri = e_mail_folder_uri_build (store_info->store, fi->full_name);
 	e_filename_make_safe (newuri);
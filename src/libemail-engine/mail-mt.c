@@ -167,6 +167,9 @@ mail_msg_free (MailMsg *mail_msg)
 	if (mail_msg->cancellable != NULL)
 		g_object_unref (mail_msg->cancellable);
 
+	if (mail_msg->store != NULL)
+		g_object_unref (mail_msg->store);
+
 	if (mail_msg->error != NULL)
 		g_error_free (mail_msg->error);
 
@@ -311,6 +314,27 @@ mail_msg_active (void)
 	return active;
 }
 
+/* Tells the scheduler which store the message works on, which limits
+ * how many messages run on the same store at once and turns the ordered
+ * queues into per-store ones.  Call it before pushing the message. */
+void
+mail_msg_set_store (gpointer msg,
+                    CamelStore *store)
+{
+	MailMsg *mail_msg = msg;
+
+	g_return_if_fail (mail_msg != NULL);
+	g_return_if_fail (store == NULL || CAMEL_IS_STORE (store));
+
+	if (store != NULL)
+		g_object_ref (store);
+
+	if (mail_msg->store != NULL)
+		g_object_unref (mail_msg->store);
+
+	mail_msg->store = store;
+}
+
 /* **************************************** */
 
 static guint idle_source_id = 0;
@@ -420,19 +444,415 @@ mail_msg_compare (const MailMsg *msg1,
 	return (priority1 < priority2) ? 1 : -1;
 }
 
-static gpointer
-create_thread_pool (gpointer data)
+/* Messages pushed to the worker threads are scheduled in three priority
+ * classes, derived from MailMsg::priority.  Background messages can never
+ * take more than a few threads and a couple of threads are kept for
+ * interactive messages only, thus a burst of background work does not
+ * starve the user's requests.
+ *
+ * Ordered messages run one at a time, in the order they were pushed, in
+ * a lane per queue and store; an interactive message waiting in a lane
+ * raises the priority class of the lane's next message. */
+
+#define MAIL_MSG_MAX_THREADS			12
+#define MAIL_MSG_MAX_NON_INTERACTIVE_THREADS	10
+#define MAIL_MSG_MAX_BACKGROUND_THREADS		4
+#define MAIL_MSG_MAX_THREADS_PER_STORE		3
+
+typedef enum {
+	MAIL_MSG_CLASS_INTERACTIVE,
+	MAIL_MSG_CLASS_NORMAL,
+	MAIL_MSG_CLASS_BACKGROUND,
+	MAIL_MSG_N_CLASSES
+} MailMsgClass;
+
+typedef enum {
+	MAIL_MSG_ORDER_NONE,
+	MAIL_MSG_ORDER_FAST,
+	MAIL_MSG_ORDER_SLOW,
+	MAIL_MSG_N_ORDERS
+} MailMsgOrder;
+
+typedef struct _MailMsgLane MailMsgLane;
+typedef struct _MailMsgJob MailMsgJob;
+typedef struct _MailMsgStats MailMsgStats;
+
+struct _MailMsgLane {
+	MailMsgOrder order;
+	CamelStore *store;	/* not referenced, its jobs hold it */
+	MailMsgJob *current;	/* ready or running */
+	GQueue pending;		/* MailMsgJob, in push order */
+};
+
+struct _MailMsgJob {
+	MailMsg *msg;
+	MailMsgInfo *info;
+	CamelStore *store;
+	MailMsgLane *lane;
+	MailMsgClass klass;
+	guint seq;
+	gint64 pushed;
+};
+
+struct _MailMsgStats {
+	gchar *example;		/* description of a message of this kind */
+	guint count;
+	gint64 wait_total, wait_max;
+	gint64 run_total, run_max;
+};
+
+static const gchar *mail_msg_class_names[MAIL_MSG_N_CLASSES] = {
+	"interactive",
+	"normal",
+	"background"
+};
+
+/* Scheduler state.  Must hold mail_msg_sched_lock to access. */
+static GMutex mail_msg_sched_lock;
+static GThreadPool *mail_msg_thread_pool;
+static GQueue mail_msg_ready[MAIL_MSG_N_CLASSES];
+static guint mail_msg_running[MAIL_MSG_N_CLASSES];
+static guint mail_msg_running_total;
+static GHashTable *mail_msg_store_running; /* CamelStore ~> guint */
+static GHashTable *mail_msg_lanes[MAIL_MSG_N_ORDERS]; /* CamelStore ~> MailMsgLane */
+static GHashTable *mail_msg_stats; /* MailMsgInfo ~> MailMsgStats */
+static guint mail_msg_sched_seq;
+
+static void mail_msg_job_run (MailMsgJob *job, gpointer user_data);
+
+static MailMsgClass
+mail_msg_get_class (MailMsg *msg)
+{
+	if (msg->priority > MAIL_MSG_PRIORITY_NORMAL)
+		return MAIL_MSG_CLASS_INTERACTIVE;
+
+	if (msg->priority < MAIL_MSG_PRIORITY_NORMAL)
+		return MAIL_MSG_CLASS_BACKGROUND;
+
+	return MAIL_MSG_CLASS_NORMAL;
+}
+
+static gint
+mail_msg_job_compare (gconstpointer a,
+                      gconstpointer b,
+                      gpointer user_data)
+{
+	const MailMsgJob *job1 = a;
+	const MailMsgJob *job2 = b;
+
+	if (job1->msg->priority != job2->msg->priority)
+		return (job1->msg->priority < job2->msg->priority) ? 1 : -1;
+
+	/* Keep the push order within the same priority. */
+	return (job1->seq < job2->seq) ? -1 : (job1->seq > job2->seq) ? 1 : 0;
+}
+
+static void
+mail_msg_sched_make_ready_locked (MailMsgJob *job)
+{
+	g_queue_insert_sorted (
+		&mail_msg_ready[job->klass], job,
+		mail_msg_job_compare, NULL);
+}
+
+static gboolean
+mail_msg_sched_can_start_locked (MailMsgJob *job)
+{
+	if (mail_msg_running_total >= MAIL_MSG_MAX_THREADS)
+		return FALSE;
+
+	if (job->klass != MAIL_MSG_CLASS_INTERACTIVE &&
+	    mail_msg_running_total >= MAIL_MSG_MAX_NON_INTERACTIVE_THREADS)
+		return FALSE;
+
+	if (job->klass == MAIL_MSG_CLASS_BACKGROUND &&
+	    mail_msg_running[MAIL_MSG_CLASS_BACKGROUND] >= MAIL_MSG_MAX_BACKGROUND_THREADS)
+		return FALSE;
+
+	if (job->store != NULL &&
+	    GPOINTER_TO_UINT (g_hash_table_lookup (mail_msg_store_running, job->store)) >= MAIL_MSG_MAX_THREADS_PER_STORE)
+		return FALSE;
+
+	return TRUE;
+}
+
+static void
+mail_msg_sched_dispatch_locked (void)
+{
+	gint ii;
+
+	for (ii = 0; ii < MAIL_MSG_N_CLASSES; ii++) {
+		GList *link = mail_msg_ready[ii].head;
+
+		while (link != NULL && mail_msg_running_total < MAIL_MSG_MAX_THREADS) {
+			MailMsgJob *job = link->data;
+			GList *next = link->next;
+
+			if (mail_msg_sched_can_start_locked (job)) {
+				g_queue_delete_link (&mail_msg_ready[ii], link);
+
+				mail_msg_running[job->klass]++;
+				mail_msg_running_total++;
+
+				if (job->store != NULL) {
+					guint count;
+
+					count = GPOINTER_TO_UINT (g_hash_table_lookup (mail_msg_store_running, job->store));
+					g_hash_table_insert (mail_msg_store_running, job->store, GUINT_TO_POINTER (count + 1));
+				}
+
+				g_thread_pool_push (mail_msg_thread_pool, job, NULL);
+			}
+
+			link = next;
+		}
+	}
+}
+
+static void
+mail_msg_sched_push (MailMsg *msg,
+                     MailMsgOrder order)
+{
+	MailMsgJob *job;
+
+	job = g_slice_new0 (MailMsgJob);
+	job->msg = msg;
+	job->info = msg->info;
+	job->store = msg->store ? g_object_ref (msg->store) : NULL;
+	job->klass = mail_msg_get_class (msg);
+	job->pushed = g_get_monotonic_time ();
+
+	g_mutex_lock (&mail_msg_sched_lock);
+
+	if (mail_msg_thread_pool == NULL) {
+		gint ii;
+
+		/* once created, run forever */
+		mail_msg_thread_pool = g_thread_pool_new (
+			(GFunc) mail_msg_job_run, NULL,
+			MAIL_MSG_MAX_THREADS, FALSE, NULL);
+
+		mail_msg_store_running = g_hash_table_new (NULL, NULL);
+		mail_msg_stats = g_hash_table_new (NULL, NULL);
+
+		for (ii = MAIL_MSG_ORDER_NONE + 1; ii < MAIL_MSG_N_ORDERS; ii++)
+			mail_msg_lanes[ii] = g_hash_table_new (NULL, NULL);
+	}
+
+	job->seq = mail_msg_sched_seq++;
+
+	if (order != MAIL_MSG_ORDER_NONE) {
+		MailMsgLane *lane;
+
+		lane = g_hash_table_lookup (mail_msg_lanes[order], job->store);
+
+		if (lane == NULL) {
+			lane = g_slice_new0 (MailMsgLane);
+			lane->order = order;
+			lane->store = job->store;
+			g_queue_init (&lane->pending);
+
+			g_hash_table_insert (mail_msg_lanes[order], lane->store, lane);
+		}
+
+		job->lane = lane;
+
+		if (lane->current != NULL) {
+			MailMsgJob *current = lane->current;
+
+			/* Do not let the lane hold back a more urgent message;
+			 * the current job is still waiting, if found. */
+			if (current->klass > job->klass &&
+			    g_queue_remove (&mail_msg_ready[current->klass], current)) {
+				current->klass = job->klass;
+				mail_msg_sched_make_ready_locked (current);
+			}
+
+			g_queue_push_tail (&lane->pending, job);
+			job = NULL;
+		} else {
+			lane->current = job;
+		}
+	}
+
+	if (job != NULL)
+		mail_msg_sched_make_ready_locked (job);
+
+	mail_msg_sched_dispatch_locked ();
+
+	g_mutex_unlock (&mail_msg_sched_lock);
+}
+
+static void
+mail_msg_sched_finish (MailMsgJob *job,
+                       gchar *desc,
+                       gint64 wait_time,
+                       gint64 run_time)
 {
-	GThreadPool *thread_pool;
-	gint max_threads = GPOINTER_TO_INT (data);
+	MailMsgStats *stats;
+
+	g_mutex_lock (&mail_msg_sched_lock);
+
+	mail_msg_running[job->klass]--;
+	mail_msg_running_total--;
+
+	if (job->store != NULL) {
+		guint count;
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (mail_msg_store_running, job->store));
+		if (count > 1)
+			g_hash_table_insert (mail_msg_store_running, job->store, GUINT_TO_POINTER (count - 1));
+		else
+			g_hash_table_remove (mail_msg_store_running, job->store);
+	}
+
+	if (job->lane != NULL) {
+		MailMsgLane *lane = job->lane;
+		MailMsgJob *next;
+
+		next = g_queue_pop_head (&lane->pending);
+		lane->current = next;
+
+		if (next != NULL) {
+			GList *link;
+
+			/* Inherit the most urgent class still waiting. */
+			for (link = lane->pending.head; link; link = g_list_next (link)) {
+				MailMsgJob *waiting = link->data;
+
+				if (waiting->klass < next->klass)
+					next->klass = waiting->klass;
+			}
+
+			mail_msg_sched_make_ready_locked (next);
+		} else {
+			g_hash_table_remove (mail_msg_lanes[lane->order], lane->store);
+			g_slice_free (MailMsgLane, lane);
+		}
+	}
+
+	stats = g_hash_table_lookup (mail_msg_stats, job->info);
+	if (stats == NULL) {
+		stats = g_slice_new0 (MailMsgStats);
+		g_hash_table_insert (mail_msg_stats, job->info, stats);
+	}
+
+	if (stats->example == NULL && desc != NULL) {
+		stats->example = desc;
+		desc = NULL;
+	}
 
-	/* once created, run forever */
-	thread_pool = g_thread_pool_new (
-		(GFunc) mail_msg_proxy, NULL, max_threads, FALSE, NULL);
-	g_thread_pool_set_sort_function (
-		thread_pool, (GCompareDataFunc) mail_msg_compare, NULL);
+	stats->count++;
+	stats->wait_total += wait_time;
+	stats->wait_max = MAX (stats->wait_max, wait_time);
+	stats->run_total += run_time;
+	stats->run_max = MAX (stats->run_max, run_time);
 
-	return thread_pool;
+	mail_msg_sched_dispatch_locked ();
+
+	g_mutex_unlock (&mail_msg_sched_lock);
+
+	g_free (desc);
+}
+
+static gboolean
+mail_msg_sched_has_example (MailMsgInfo *info)
+{
+	MailMsgStats *stats;
+	gboolean has_example;
+
+	g_mutex_lock (&mail_msg_sched_lock);
+	stats = g_hash_table_lookup (mail_msg_stats, info);
+	has_example = stats != NULL && stats->example != NULL;
+	g_mutex_unlock (&mail_msg_sched_lock);
+
+	return has_example;
+}
+
+static void
+mail_msg_job_run (MailMsgJob *job,
+                  gpointer user_data)
+{
+	MailMsg *msg = job->msg;
+	gboolean debug = camel_debug ("mail:mt");
+	gchar *desc = NULL;
+	gint64 started, finished;
+
+	started = g_get_monotonic_time ();
+
+	if (msg->info->desc != NULL &&
+	    (debug || !mail_msg_sched_has_example (msg->info)))
+		desc = msg->info->desc (msg);
+
+	/* The message is gone once passed to the main thread. */
+	mail_msg_proxy (msg);
+
+	finished = g_get_monotonic_time ();
+
+	if (debug && desc != NULL) {
+		printf (
+			"mail-mt: %s message '%s' waited %.1f ms, ran %.1f ms\n",
+			mail_msg_class_names[job->klass], desc,
+			(started - job->pushed) / 1000.0,
+			(finished - started) / 1000.0);
+	}
+
+	mail_msg_sched_finish (job, desc, started - job->pushed, finished - started);
+
+	if (job->store != NULL)
+		g_object_unref (job->store);
+
+	g_slice_free (MailMsgJob, job);
+}
+
+/**
+ * mail_msg_dump_stats:
+ *
+ * Prints how long the messages waited in the queues and how long they
+ * ran, for each kind of message run by the worker threads so far.  The
+ * kinds are named by the description of their first message.  Setting
+ * the "mail:mt" CAMEL_DEBUG option also prints the times of each message
+ * as it finishes.
+ **/
+void
+mail_msg_dump_stats (void)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	gint ii;
+
+	g_mutex_lock (&mail_msg_sched_lock);
+
+	printf ("mail-mt: %u messages running", mail_msg_running_total);
+	for (ii = 0; ii < MAIL_MSG_N_CLASSES; ii++) {
+		printf (
+			", %s: %u running, %u waiting",
+			mail_msg_class_names[ii], mail_msg_running[ii],
+			g_queue_get_length (&mail_msg_ready[ii]));
+	}
+	printf ("\n");
+
+	if (mail_msg_stats == NULL) {
+		g_mutex_unlock (&mail_msg_sched_lock);
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, mail_msg_stats);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		MailMsgStats *stats = value;
+
+		printf (
+			"mail-mt: %6u x %-40s wait avg %8.1f max %8.1f ms, "
+			"run avg %8.1f max %8.1f ms\n",
+			stats->count,
+			stats->example ? stats->example : "(unnamed)",
+			stats->wait_total / 1000.0 / stats->count,
+			stats->wait_max / 1000.0,
+			stats->run_total / 1000.0 / stats->count,
+			stats->run_max / 1000.0);
+	}
+
+	g_mutex_unlock (&mail_msg_sched_lock);
 }
 
 void
@@ -454,31 +874,19 @@ mail_msg_main_loop_push (gpointer msg)
 void
 mail_msg_unordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
-
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (10));
-
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_sched_push (msg, MAIL_MSG_ORDER_NONE);
 }
 
 void
 mail_msg_fast_ordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
-
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
-
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_sched_push (msg, MAIL_MSG_ORDER_FAST);
 }
 
 void
 mail_msg_slow_ordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
-
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
-
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_sched_push (msg, MAIL_MSG_ORDER_SLOW);
 }
 
 gboolean
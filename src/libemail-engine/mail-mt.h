@@ -33,6 +33,15 @@
 typedef struct _MailMsg MailMsg;
 typedef struct _MailMsgInfo MailMsgInfo;
 
+/* Priority classes for MailMsg::priority.  Positive values are scheduled
+ * as interactive, negative as background, zero as normal; within a class
+ * higher values run first. */
+typedef enum {
+	MAIL_MSG_PRIORITY_BACKGROUND = -10,
+	MAIL_MSG_PRIORITY_NORMAL = 0,
+	MAIL_MSG_PRIORITY_INTERACTIVE = 10
+} MailMsgPriority;
+
 typedef gchar *	(*MailMsgDescFunc)		(MailMsg *msg);
 typedef void	(*MailMsgExecFunc)		(MailMsg *msg,
 						 GCancellable *cancellable,
@@ -59,6 +68,7 @@ struct _MailMsg {
 	gint priority;			/* priority (default = 0) */
 	GCancellable *cancellable;
 	GError *error;			/* up to the caller to use this */
+	CamelStore *store;		/* store the message works on, or NULL */
 };
 
 struct _MailMsgInfo {
@@ -93,6 +103,8 @@ void mail_msg_unref (gpointer msg);
 void mail_msg_check_error (gpointer msg);
 void mail_msg_cancel (guint msgid);
 gboolean mail_msg_active (void);
+void mail_msg_set_store (gpointer msg, CamelStore *store);
+void mail_msg_dump_stats (void);
 
 /* dispatch a message */
 void mail_msg_main_loop_push (gpointer msg);
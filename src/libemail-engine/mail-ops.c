@@ -40,12 +40,18 @@
 #include "mail-tools.h"
 
 #include "e-mail-folder-utils.h"
+#include "e-mail-junk-filter.h"
 #include "e-mail-session.h"
 #include "e-mail-session-utils.h"
 
 #define w(x)
 #define d(x)
 
+#define E_FILTER_SOURCE_JUNKTEST "junktest"
+
+/* How many messages are passed to the junk filter at once. */
+#define JUNK_TEST_BATCH_SIZE 50
+
 /* XXX Make this a preprocessor definition. */
 const gchar *x_mailer = "Evolution " VERSION VERSION_SUBSTRING " " VERSION_COMMENT;
 
@@ -63,6 +69,9 @@ struct _filter_mail_msg {
 	gint delete;			/* delete messages after filtering? */
 	CamelFolder *destination;	/* default destination for any
 					 * messages, NULL for none */
+	EMailJunkFilter *junk_filter;	/* to check the messages for junk
+					 * in batches, NULL to leave it
+					 * on the driver */
 };
 
 /* since fetching also filters, we subclass the data here */
@@ -88,6 +97,142 @@ em_filter_folder_element_desc (struct _filter_mail_msg *m)
 	return g_strdup (_("Filtering Selected Messages"));
 }
 
+static void
+em_filter_folder_mark_junk (CamelFolder *folder,
+                            const gchar *uid)
+{
+	/* Same as the "(set-system-flag \"junk\")" action. */
+	camel_folder_set_message_flags (
+		folder, uid, CAMEL_MESSAGE_JUNK, CAMEL_MESSAGE_JUNK);
+}
+
+static gboolean
+em_filter_folder_junk_test_flush (EMailJunkFilter *junk_filter,
+                                  CamelFolder *folder,
+                                  GPtrArray *messages,
+                                  GPtrArray *batch_uids,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	CamelJunkStatus statuses[JUNK_TEST_BATCH_SIZE];
+	gboolean success;
+	guint ii;
+
+	g_return_val_if_fail (messages->len <= JUNK_TEST_BATCH_SIZE, FALSE);
+
+	success = e_mail_junk_filter_classify_messages_sync (
+		junk_filter, messages, statuses, cancellable, error);
+
+	/* Keep the verdicts of a partly classified batch too. */
+	for (ii = 0; ii < messages->len; ii++) {
+		if (statuses[ii] == CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK)
+			em_filter_folder_mark_junk (folder, batch_uids->pdata[ii]);
+	}
+
+	g_ptr_array_set_size (messages, 0);
+	g_ptr_array_set_size (batch_uids, 0);
+
+	return success;
+}
+
+/* Does what the "(junk-test)" rule of the filter driver does, except
+ * that the messages are passed to the junk filter in batches, which
+ * the junk filters can classify faster than one message at a time. */
+static gboolean
+em_filter_folder_junk_test_sync (struct _filter_mail_msg *m,
+                                 CamelFolder *folder,
+                                 GPtrArray *uids,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+	CamelSession *session = CAMEL_SESSION (m->session);
+	GHashTable *junk_headers;
+	GPtrArray *messages, *batch_uids;
+	gboolean success = TRUE;
+	guint ii;
+
+	junk_headers = camel_session_get_junk_headers (session);
+	messages = g_ptr_array_new_with_free_func (g_object_unref);
+	batch_uids = g_ptr_array_new ();
+
+	for (ii = 0; success && ii < uids->len; ii++) {
+		const gchar *uid = uids->pdata[ii];
+		const gchar *from;
+		CamelMessageInfo *info;
+		CamelMimeMessage *message;
+		gboolean is_junk = FALSE;
+
+		camel_operation_progress (cancellable, ii * 100 / uids->len);
+
+		info = camel_folder_get_message_info (folder, uid);
+		if (info == NULL)
+			continue;
+
+		/* Already classified by the user or a junk filter. */
+		if ((camel_message_info_get_flags (info) &
+		    (CAMEL_MESSAGE_JUNK | CAMEL_MESSAGE_NOTJUNK)) != 0) {
+			g_object_unref (info);
+			continue;
+		}
+
+		message = camel_folder_get_message_sync (
+			folder, uid, cancellable, error);
+		if (message == NULL) {
+			g_object_unref (info);
+			success = FALSE;
+			break;
+		}
+
+		if (junk_headers != NULL) {
+			GHashTableIter iter;
+			gpointer key, value;
+
+			g_hash_table_iter_init (&iter, junk_headers);
+			while (!is_junk && g_hash_table_iter_next (&iter, &key, &value)) {
+				const gchar *header;
+
+				header = camel_medium_get_header (
+					CAMEL_MEDIUM (message), key);
+				is_junk = header != NULL && value != NULL &&
+					camel_strstrcase (header, value) != NULL;
+			}
+		}
+
+		from = camel_message_info_get_from (info);
+
+		if (is_junk) {
+			em_filter_folder_mark_junk (folder, uid);
+			g_object_unref (message);
+		} else if (from != NULL && *from &&
+			   camel_session_lookup_addressbook (session, from)) {
+			/* Known senders do not send junk. */
+			g_object_unref (message);
+		} else {
+			g_ptr_array_add (messages, message);
+			g_ptr_array_add (batch_uids, (gpointer) uid);
+		}
+
+		g_object_unref (info);
+
+		if (messages->len == JUNK_TEST_BATCH_SIZE)
+			success = em_filter_folder_junk_test_flush (
+				m->junk_filter, folder, messages,
+				batch_uids, cancellable, error);
+	}
+
+	if (success && messages->len > 0)
+		success = em_filter_folder_junk_test_flush (
+			m->junk_filter, folder, messages,
+			batch_uids, cancellable, error);
+
+	camel_operation_progress (cancellable, 100);
+
+	g_ptr_array_unref (messages);
+	g_ptr_array_unref (batch_uids);
+
+	return success;
+}
+
 /* filter a folder, or a subset thereof, uses source_folder/source_uids */
 /* this is shared with fetch_mail */
 static gboolean
@@ -117,10 +262,16 @@ em_filter_folder_element_exec (struct _filter_mail_msg *m,
 	else
 		folder_uids = uids = camel_folder_get_uids (folder);
 
-	success = camel_filter_driver_filter_folder (
-		m->driver, folder, m->cache, uids, m->delete,
-		cancellable, &local_error) == 0;
-	camel_filter_driver_flush (m->driver, &local_error);
+	if (m->junk_filter)
+		success = em_filter_folder_junk_test_sync (
+			m, folder, uids, cancellable, &local_error);
+
+	if (success) {
+		success = camel_filter_driver_filter_folder (
+			m->driver, folder, m->cache, uids, m->delete,
+			cancellable, &local_error) == 0;
+		camel_filter_driver_flush (m->driver, &local_error);
+	}
 
 	if (folder_uids)
 		camel_folder_free_uids (folder, folder_uids);
@@ -178,6 +329,9 @@ em_filter_folder_element_free (struct _filter_mail_msg *m)
 
 	if (m->driver)
 		g_object_unref (m->driver);
+
+	if (m->junk_filter)
+		g_object_unref (m->junk_filter);
 }
 
 static MailMsgInfo em_filter_folder_element_info = {
@@ -214,6 +368,21 @@ mail_filter_folder (EMailSession *session,
 			m->driver, "new-mail-notification");
 	}
 
+	if (g_strcmp0 (type, E_FILTER_SOURCE_JUNKTEST) == 0) {
+		CamelJunkFilter *junk_filter;
+
+		junk_filter = camel_session_get_junk_filter (
+			CAMEL_SESSION (session));
+
+		/* Check for junk in batches instead of the driver.  The rule
+		 * name has to stay in sync with mail-session::get_filter_driver,
+		 * which adds it only when the folder should be checked. */
+		if (E_IS_MAIL_JUNK_FILTER (junk_filter) &&
+		    camel_filter_driver_remove_rule_by_name (
+		    m->driver, "Junk check") == 0)
+			m->junk_filter = E_MAIL_JUNK_FILTER (g_object_ref (junk_filter));
+	}
+
 	mail_msg_unordered_push (m);
 }
 
@@ -516,6 +685,7 @@ mail_fetch_mail (CamelStore *store,
 	m->provider_lock = lock_func;
 	m->provider_unlock = unlock_func;
 	m->provider_fetch_inbox = fetch_inbox_func;
+	mail_msg_set_store (m, store);
 
 	fm->driver = camel_session_get_filter_driver (session, type, NULL, NULL);
 	camel_filter_driver_set_folder_func (fm->driver, get_folder, get_data);
@@ -567,41 +737,93 @@ static void	report_status		(struct _send_queue_msg *m,
 					 const gchar *desc,
 					 ...);
 
-/* send 1 message to a specific transport */
+/* At most this many messages are between loading from the Outbox
+ * and being post-processed, across all transports. */
+#define SEND_QUEUE_MAX_IN_FLIGHT 8
+
+/* One message of the Outbox, as it goes through the send pipeline */
+typedef struct _SendItem {
+	gchar *uid;
+	CamelMimeMessage *message;
+	CamelService *service;
+	CamelNameValueArray *xev_headers;
+
+	/* Left in the Outbox, as the transport is offline */
+	gboolean skipped;
+	gboolean sent_message_saved;
+
+	GError *error;
+} SendItem;
+
+/* Sends the messages of one transport, in the order of the Outbox */
+typedef struct _SendTransport {
+	struct _send_queue_msg *m;
+	CamelService *service;
+	GCancellable *cancellable;
+
+	/* SendItem *, from the Outbox to the transport */
+	GAsyncQueue *items;
+	/* SendItem *, from the transport to the post-processing */
+	GAsyncQueue *sent;
+
+	gboolean did_connect;
+	GThread *thread;
+} SendTransport;
+
 static void
-mail_send_message (struct _send_queue_msg *m,
-                   CamelFolder *queue,
-                   const gchar *uid,
-                   CamelFilterDriver *driver,
-                   GCancellable *cancellable,
-                   GError **error)
+send_item_free (SendItem *item)
 {
-	CamelService *service;
+	g_free (item->uid);
+	g_clear_object (&item->message);
+	g_clear_object (&item->service);
+	if (item->xev_headers)
+		camel_name_value_array_free (item->xev_headers);
+	g_clear_error (&item->error);
+
+	g_slice_free (SendItem, item);
+}
+
+/* Reads one message from the Outbox and finds its transport */
+static SendItem *
+send_item_load (struct _send_queue_msg *m,
+                CamelFolder *queue,
+                const gchar *uid,
+                GCancellable *cancellable)
+{
+	SendItem *item;
+
+	item = g_slice_new0 (SendItem);
+	item->uid = g_strdup (uid);
+
+	item->message = camel_folder_get_message_sync (
+		queue, uid, cancellable, &item->error);
+	if (!item->message)
+		return item;
+
+	camel_medium_set_header (CAMEL_MEDIUM (item->message), "X-Mailer", x_mailer);
+
+	/* Do this before removing "X-Evolution" headers. */
+	item->service = e_mail_session_ref_transport_for_message (
+		m->session, item->message);
+
+	item->xev_headers = mail_tool_remove_xevolution_headers (item->message);
+
+	return item;
+}
+
+/* The first stage: sends the message through its transport */
+static void
+send_item_transport (SendTransport *st,
+                     SendItem *item)
+{
+	struct _send_queue_msg *m = st->m;
+	CamelService *service = item->service;
 	const CamelInternetAddress *iaddr;
 	CamelAddress *from, *recipients;
-	CamelMessageInfo *info = NULL;
 	CamelProvider *provider = NULL;
 	const gchar *resent_from;
-	CamelFolder *folder = NULL;
-	GString *err = NULL;
-	CamelNameValueArray *xev_headers = NULL;
-	CamelMimeMessage *message;
 	gint i;
-	guint jj, len;
-	GError *local_error = NULL;
-	gboolean did_connect = FALSE;
-	gboolean sent_message_saved = FALSE;
-
-	message = camel_folder_get_message_sync (
-		queue, uid, cancellable, error);
-	if (!message)
-		return;
 
-	camel_medium_set_header (CAMEL_MEDIUM (message), "X-Mailer", x_mailer);
-
-	/* Do this before removing "X-Evolution" headers. */
-	service = e_mail_session_ref_transport_for_message (
-		m->session, message);
 	if (service != NULL)
 		provider = camel_service_get_provider (service);
 
@@ -613,24 +835,14 @@ mail_send_message (struct _send_queue_msg *m,
 		report_status (m, CAMEL_FILTER_STATUS_ACTION, 0, tuid);
 	}
 
-	if (service && !e_mail_session_mark_service_used_sync (m->session, service, cancellable)) {
-		g_warn_if_fail (g_cancellable_set_error_if_cancelled (cancellable, error));
-		g_clear_object (&service);
-		g_clear_object (&message);
-		return;
-	}
-
-	err = g_string_new ("");
-	xev_headers = mail_tool_remove_xevolution_headers (message);
-
 	/* Check for email sending */
 	from = (CamelAddress *) camel_internet_address_new ();
 	resent_from = camel_medium_get_header (
-		CAMEL_MEDIUM (message), "Resent-From");
+		CAMEL_MEDIUM (item->message), "Resent-From");
 	if (resent_from != NULL) {
 		camel_address_decode (from, resent_from);
 	} else {
-		iaddr = camel_mime_message_get_from (message);
+		iaddr = camel_mime_message_get_from (item->message);
 		camel_address_copy (from, CAMEL_ADDRESS (iaddr));
 	}
 
@@ -642,7 +854,7 @@ mail_send_message (struct _send_queue_msg *m,
 			type = resent_recipients[i];
 		else
 			type = normal_recipients[i];
-		iaddr = camel_mime_message_get_recipients (message, type);
+		iaddr = camel_mime_message_get_recipients (item->message, type);
 		camel_address_cat (recipients, CAMEL_ADDRESS (iaddr));
 	}
 
@@ -650,6 +862,7 @@ mail_send_message (struct _send_queue_msg *m,
 		if (provider && (provider->flags & CAMEL_PROVIDER_IS_REMOTE) != 0 &&
 		    !camel_session_get_online (CAMEL_SESSION (m->session))) {
 			/* silently ignore */
+			item->skipped = TRUE;
 			goto exit;
 		}
 		if (camel_service_get_connection_status (service) != CAMEL_SERVICE_CONNECTED) {
@@ -668,33 +881,161 @@ mail_send_message (struct _send_queue_msg *m,
 				g_object_unref (source);
 			}
 
-			if (!camel_service_connect_sync (service, cancellable, error))
+			if (!camel_service_connect_sync (service, st->cancellable, &item->error))
 				goto exit;
 
-			did_connect = TRUE;
+			st->did_connect = TRUE;
 		}
 
 		/* expand, or remove empty, group addresses */
 		em_utils_expand_groups (CAMEL_INTERNET_ADDRESS (recipients));
 
-		if (!camel_transport_send_to_sync (
-			CAMEL_TRANSPORT (service), message,
-			from, recipients, &sent_message_saved, cancellable, error))
-			goto exit;
+		camel_transport_send_to_sync (
+			CAMEL_TRANSPORT (service), item->message,
+			from, recipients, &item->sent_message_saved,
+			st->cancellable, &item->error);
 	}
 
+exit:
+	g_object_unref (recipients);
+	g_object_unref (from);
+}
+
+/* Disconnects the transport, if the pipeline connected it. */
+static void
+send_transport_disconnect (SendTransport *st,
+                           gboolean had_error)
+{
+	GError *local_error = NULL;
+
+	if (!st->did_connect)
+		return;
+
+	/* Disconnect regardless of error or cancellation,
+	 * but be mindful of these conditions when calling
+	 * camel_service_disconnect_sync(). */
+	if (g_cancellable_is_cancelled (st->cancellable)) {
+		camel_service_disconnect_sync (st->service, FALSE, NULL, NULL);
+	} else if (had_error) {
+		camel_service_disconnect_sync (st->service, FALSE, st->cancellable, NULL);
+	} else if (!camel_service_disconnect_sync (st->service, TRUE, st->cancellable, &local_error)) {
+		/* All the messages had been sent already. */
+		g_warning (
+			"%s: Failed to disconnect from '%s': %s", G_STRFUNC,
+			camel_service_get_display_name (st->service),
+			local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+	}
+
+	st->did_connect = FALSE;
+}
+
+/* Sends the messages of one transport, keeping it connected
+ * between them, and hands them over to the post-processing. */
+static gpointer
+send_transport_thread (gpointer user_data)
+{
+	SendTransport *st = user_data;
+	gboolean had_error = FALSE;
+	gboolean service_used;
+	SendItem *item;
+
+	service_used = e_mail_session_mark_service_used_sync (
+		st->m->session, st->service, st->cancellable);
+
+	/* GINT_TO_POINTER (1) marks the end of the messages */
+	while ((item = g_async_queue_pop (st->items)) != GINT_TO_POINTER (1)) {
+		if (!service_used)
+			g_warn_if_fail (g_cancellable_set_error_if_cancelled (st->cancellable, &item->error));
+		else
+			send_item_transport (st, item);
+
+		if (item->error)
+			had_error = TRUE;
+
+		g_async_queue_push (st->sent, item);
+	}
+
+	if (service_used) {
+		send_transport_disconnect (st, had_error);
+		e_mail_session_unmark_service_used (st->m->session, st->service);
+	}
+
+	return NULL;
+}
+
+static SendTransport *
+send_transport_new (struct _send_queue_msg *m,
+                    CamelService *service,
+                    GAsyncQueue *sent,
+                    GCancellable *cancellable)
+{
+	SendTransport *st;
+
+	st = g_slice_new0 (SendTransport);
+	st->m = m;
+	st->service = g_object_ref (service);
+	st->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+	st->items = g_async_queue_new ();
+	st->sent = g_async_queue_ref (sent);
+
+	st->thread = g_thread_new (NULL, send_transport_thread, st);
+
+	return st;
+}
+
+/* Waits for the transport to send all the messages given to it. */
+static void
+send_transport_free (SendTransport *st)
+{
+	g_async_queue_push (st->items, GINT_TO_POINTER (1));
+	g_thread_join (st->thread);
+
+	g_async_queue_unref (st->items);
+	g_async_queue_unref (st->sent);
+	g_clear_object (&st->cancellable);
+	g_object_unref (st->service);
+
+	g_slice_free (SendTransport, st);
+}
+
+/* The second stage: posts, filters and stores the sent message, then
+ * removes it from the Outbox.  The folders it appended the message to
+ * are added to @sent_folders, to be synchronized once at the end. */
+static void
+send_item_post_process (struct _send_queue_msg *m,
+                        CamelFolder *queue,
+                        SendItem *item,
+                        CamelFilterDriver *driver,
+                        GHashTable *sent_folders,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	CamelMimeMessage *message = item->message;
+	CamelMessageInfo *info = NULL;
+	CamelProvider *provider = NULL;
+	CamelFolder *folder = NULL;
+	GString *err = NULL;
+	guint jj, len;
+	GError *local_error = NULL;
+
+	if (item->service != NULL)
+		provider = camel_service_get_provider (item->service);
+
+	err = g_string_new ("");
+
 	/* Now check for posting, failures are ignored */
 	info = camel_message_info_new (NULL);
 	camel_message_info_set_size (info, camel_data_wrapper_calculate_size_sync (CAMEL_DATA_WRAPPER (message), cancellable, NULL));
 	camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN |
 		(camel_mime_message_has_attachment (message) ? CAMEL_MESSAGE_ATTACHMENTS : 0), ~0);
 
-	len = camel_name_value_array_get_length (xev_headers);
+	len = camel_name_value_array_get_length (item->xev_headers);
 	for (jj = 0; jj < len && !local_error; jj++) {
 		const gchar *header_name = NULL, *header_value = NULL;
 		gchar *uri;
 
-		if (!camel_name_value_array_get (xev_headers, jj, &header_name, &header_value) ||
+		if (!camel_name_value_array_get (item->xev_headers, jj, &header_name, &header_value) ||
 		    !header_name ||
 		    g_ascii_strcasecmp (header_name, "X-Evolution-PostTo") != 0)
 			continue;
@@ -717,7 +1058,7 @@ mail_send_message (struct _send_queue_msg *m,
 	}
 
 	/* post process */
-	mail_tool_restore_xevolution_headers (message, xev_headers);
+	mail_tool_restore_xevolution_headers (message, item->xev_headers);
 
 	if (local_error == NULL && driver) {
 		camel_filter_driver_filter_message (
@@ -747,7 +1088,7 @@ mail_send_message (struct _send_queue_msg *m,
 		}
 	}
 
-	if (local_error == NULL && !sent_message_saved && (provider == NULL
+	if (local_error == NULL && !item->sent_message_saved && (provider == NULL
 	    || !(provider->flags & CAMEL_PROVIDER_DISABLE_SENT_FOLDER))) {
 		CamelFolder *local_sent_folder;
 
@@ -758,9 +1099,11 @@ mail_send_message (struct _send_queue_msg *m,
 			m->session, message, cancellable, &local_error);
 
 		/* Sanity check. */
-		g_return_if_fail (
-			((folder == NULL) && (local_error != NULL)) ||
-			((folder != NULL) && (local_error == NULL)));
+		if (!(((folder == NULL) && (local_error != NULL)) ||
+		      ((folder != NULL) && (local_error == NULL)))) {
+			g_warn_if_reached ();
+			goto exit;
+		}
 
 		if (local_error == NULL) {
 			camel_operation_push_message (cancellable, _("Storing sent message to “%s”"), camel_folder_get_full_name (folder));
@@ -849,7 +1192,7 @@ mail_send_message (struct _send_queue_msg *m,
 
 	if (local_error == NULL) {
 		camel_folder_set_message_flags (
-			queue, uid, CAMEL_MESSAGE_DELETED |
+			queue, item->uid, CAMEL_MESSAGE_DELETED |
 			CAMEL_MESSAGE_SEEN, ~0);
 		/* Sync it to disk, since if it crashes in between,
 		 * we keep sending it again on next start. */
@@ -865,43 +1208,32 @@ mail_send_message (struct _send_queue_msg *m,
 	}
 
 exit:
-	if (did_connect) {
-		/* Disconnect regardless of error or cancellation,
-		 * but be mindful of these conditions when calling
-		 * camel_service_disconnect_sync(). */
-		if (g_cancellable_is_cancelled (cancellable)) {
-			camel_service_disconnect_sync (service, FALSE, NULL, NULL);
-		} else if (local_error != NULL) {
-			camel_service_disconnect_sync (service, FALSE, cancellable, NULL);
-		} else {
-			camel_service_disconnect_sync (service, TRUE, cancellable, &local_error);
-		}
-	}
-
-	if (service)
-		e_mail_session_unmark_service_used (m->session, service);
-
 	if (local_error != NULL)
 		g_propagate_error (error, local_error);
 
-	/* FIXME Not passing a GCancellable or GError here. */
-	if (folder != NULL) {
-		camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
-		g_object_unref (folder);
-	}
+	/* Synchronized after the last message */
+	if (folder != NULL && !g_hash_table_contains (sent_folders, folder))
+		g_hash_table_add (sent_folders, folder);
+	else
+		g_clear_object (&folder);
 
 	g_clear_object (&info);
-	g_clear_object (&service);
-
-	g_object_unref (recipients);
-	g_object_unref (from);
-	camel_name_value_array_free (xev_headers);
 	g_string_free (err, TRUE);
-	g_object_unref (message);
 }
 
 /* ** SEND MAIL QUEUE ***************************************************** */
 
+static gpointer
+report_status_main (struct _send_queue_msg *m,
+                    const enum camel_filter_status_t *status,
+                    const gint *pc,
+                    const gchar *desc)
+{
+	m->status (m->driver, *status, *pc, desc, m->status_data);
+
+	return NULL;
+}
+
 static void
 report_status (struct _send_queue_msg *m,
                enum camel_filter_status_t status,
@@ -916,7 +1248,13 @@ report_status (struct _send_queue_msg *m,
 		va_start (ap, desc);
 		str = g_strdup_vprintf (desc, ap);
 		va_end (ap);
-		m->status (m->driver, status, pc, str, m->status_data);
+
+		/* Called also from the transport threads, thus serialize
+		 * the calls by making them in the main thread. */
+		mail_call_main (
+			MAIL_CALL_p_pppp, (MailMainFunc) report_status_main,
+			m, &status, &pc, str);
+
 		g_free (str);
 	}
 }
@@ -928,9 +1266,13 @@ send_queue_exec (struct _send_queue_msg *m,
 {
 	CamelFolder *sent_folder;
 	GPtrArray *uids, *send_uids = NULL;
-	gint i, j;
+	GAsyncQueue *sent;
+	GHashTable *transports, *sent_folders;
+	GHashTableIter iter;
+	gpointer key;
+	gint i, j, n_done, n_in_flight;
+	gboolean stop = FALSE;
 	time_t delay_send = 0;
-	GError *local_error = NULL;
 
 	d (printf ("sending queue\n"));
 
@@ -981,22 +1323,88 @@ send_queue_exec (struct _send_queue_msg *m,
 	 *     fatal problems, it is also used as a mechanism to accumualte
 	 *     warning messages and present them back to the user. */
 
-	for (i = 0, j = 0; i < send_uids->len; i++) {
-		gint pc = (100 * i) / send_uids->len;
+	/* The messages are sent by a thread per transport, while this thread
+	 * reads the next ones from the Outbox and post-processes those sent,
+	 * one by one, as the filter driver and the folders expect. */
+	sent = g_async_queue_new ();
+	transports = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) send_transport_free);
+	sent_folders = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) g_object_unref,
+		(GDestroyNotify) NULL);
+
+	for (i = 0, j = 0, n_done = 0, n_in_flight = 0; n_done < send_uids->len; n_done++) {
+		SendItem *item;
+
+		while (!stop && i < send_uids->len && n_in_flight < SEND_QUEUE_MAX_IN_FLIGHT) {
+			gint pc = (100 * i) / send_uids->len;
+
+			report_status (
+				m, CAMEL_FILTER_STATUS_START, pc,
+				_("Sending message %d of %d"), i + 1,
+				send_uids->len);
+
+			item = send_item_load (m, m->queue, send_uids->pdata[i], cancellable);
+
+			if (!item->error && CAMEL_IS_TRANSPORT (item->service)) {
+				SendTransport *st;
+
+				st = g_hash_table_lookup (transports, item->service);
+				if (!st) {
+					st = send_transport_new (m, item->service, sent, cancellable);
+					g_hash_table_insert (transports, item->service, st);
+				}
 
-		report_status (
-			m, CAMEL_FILTER_STATUS_START, pc,
-			_("Sending message %d of %d"), i + 1,
-			send_uids->len);
+				g_async_queue_push (st->items, item);
+			} else {
+				/* Only posted, or not sent at all */
+				if (!item->error) {
+					SendTransport local_st = { 0 };
+
+					local_st.m = m;
+					local_st.service = item->service;
+					local_st.cancellable = cancellable;
+
+					if (item->service && !e_mail_session_mark_service_used_sync (m->session, item->service, cancellable)) {
+						g_warn_if_fail (g_cancellable_set_error_if_cancelled (cancellable, &item->error));
+					} else {
+						send_item_transport (&local_st, item);
+						send_transport_disconnect (&local_st, item->error != NULL);
+
+						if (item->service)
+							e_mail_session_unmark_service_used (m->session, item->service);
+					}
+				}
+
+				g_async_queue_push (sent, item);
+			}
+
+			i++;
+			n_in_flight++;
+		}
+
+		if (n_in_flight == 0)
+			break;
+
+		item = g_async_queue_pop (sent);
+		n_in_flight--;
 
 		camel_operation_progress (
-			cancellable, (i + 1) * 100 / send_uids->len);
+			cancellable, (n_done + 1) * 100 / send_uids->len);
 
-		mail_send_message (
-			m, m->queue, send_uids->pdata[i],
-			m->driver, cancellable, &local_error);
-		if (local_error != NULL) {
-			if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		if (!item->error && !item->skipped) {
+			send_item_post_process (
+				m, m->queue, item, m->driver, sent_folders,
+				cancellable, &item->error);
+		}
+
+		if (item->error != NULL) {
+			if (!g_error_matches (item->error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
 				/* merge exceptions into one */
 				if (m->base.error != NULL) {
 					gchar *old_message;
@@ -1008,28 +1416,35 @@ send_queue_exec (struct _send_queue_msg *m,
 						&m->base.error, CAMEL_ERROR,
 						CAMEL_ERROR_GENERIC,
 						"%s\n\n%s", old_message,
-						local_error->message);
+						item->error->message);
 					g_free (old_message);
-
-					g_clear_error (&local_error);
 				} else {
-					g_propagate_error (&m->base.error, local_error);
-					local_error = NULL;
+					g_propagate_error (&m->base.error, item->error);
+					item->error = NULL;
 				}
-
-				/* keep track of the number of failures */
-				j++;
 			} else {
 				/* transfer the USER_CANCEL error to the
-				 * async op exception and then break */
-				g_propagate_error (&m->base.error, local_error);
-				local_error = NULL;
-				break;
+				 * async op exception and stop sending */
+				if (m->base.error == NULL) {
+					g_propagate_error (&m->base.error, item->error);
+					item->error = NULL;
+				}
+				stop = TRUE;
 			}
+
+			/* keep track of the number of failures */
+			j++;
 		}
+
+		send_item_free (item);
 	}
 
-	j += (send_uids->len - i);
+	/* Waits for the transports to finish and disconnect */
+	g_hash_table_destroy (transports);
+	g_async_queue_unref (sent);
+
+	/* Those never sent due to cancellation */
+	j += (send_uids->len - n_done);
 
 	if (j > 0)
 		report_status (
@@ -1061,9 +1476,18 @@ send_queue_exec (struct _send_queue_msg *m,
 		camel_folder_synchronize_sync (m->queue, TRUE, NULL, NULL);
 
 	/* FIXME Not passing a GCancellable or GError here. */
-	if (sent_folder)
+	if (sent_folder && !g_hash_table_contains (sent_folders, sent_folder))
 		camel_folder_synchronize_sync (sent_folder, FALSE, NULL, NULL);
 
+	/* Synchronized once, after all the messages are stored */
+	g_hash_table_iter_init (&iter, sent_folders);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		/* FIXME Not passing a GCancellable or GError here. */
+		camel_folder_synchronize_sync (key, FALSE, NULL, NULL);
+	}
+
+	g_hash_table_destroy (sent_folders);
+
 	camel_operation_pop_message (cancellable);
 }
 
@@ -1263,6 +1687,9 @@ mail_transfer_messages (EMailSession *session,
 	m->done = done;
 	m->data = data;
 
+	m->base.priority = MAIL_MSG_PRIORITY_INTERACTIVE;
+	mail_msg_set_store (m, camel_folder_get_parent_store (source));
+
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1383,6 +1810,9 @@ mail_sync_folder (CamelFolder *folder,
 	m->data = data;
 	m->done = done;
 
+	m->base.priority = MAIL_MSG_PRIORITY_BACKGROUND;
+	mail_msg_set_store (m, camel_folder_get_parent_store (folder));
+
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1464,6 +1894,10 @@ mail_sync_store (CamelStore *store,
 	m->data = data;
 	m->done = done;
 
+	if (!expunge)
+		m->base.priority = MAIL_MSG_PRIORITY_BACKGROUND;
+	mail_msg_set_store (m, store);
+
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1539,6 +1973,7 @@ mail_empty_trash (CamelStore *store)
 
 	m = mail_msg_new (&empty_trash_info);
 	m->store = g_object_ref (store);
+	mail_msg_set_store (m, store);
 
 	mail_msg_slow_ordered_push (m);
 }
@@ -1638,5 +2073,8 @@ mail_process_folder_changes (CamelFolder *folder,
 	m->done = done;
 	m->user_data = user_data;
 
+	m->base.priority = MAIL_MSG_PRIORITY_BACKGROUND;
+	mail_msg_set_store (m, camel_folder_get_parent_store (folder));
+
 	mail_msg_unordered_push (m);
 }
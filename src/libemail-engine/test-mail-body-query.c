@@ -0,0 +1,186 @@
+/*
+ * Tests of MailBodyQuery
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+#include <string.h>
+
+#include "mail-body-query.h"
+
+static guint8 *
+signature_new (const gchar *text)
+{
+	guint8 *signature;
+
+	signature = g_new0 (guint8, MAIL_BODY_SIGNATURE_BYTES);
+
+	if (text)
+		mail_body_signature_add_text (signature, text, strlen (text));
+
+	return signature;
+}
+
+static guint
+count_terms (const gchar *expression)
+{
+	MailBodyQuery *query;
+	guint n_terms;
+
+	query = mail_body_query_new (expression);
+	if (!query)
+		return 0;
+
+	n_terms = mail_body_query_get_n_terms (query);
+	mail_body_query_free (query);
+
+	return n_terms;
+}
+
+static void
+test_query_parse (void)
+{
+	g_assert_cmpuint (count_terms (""), ==, 0);
+	g_assert_cmpuint (count_terms ("(match-all (header-contains \"subject\" \"body-contains\"))"), ==, 0);
+
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"evolution\"))"), ==, 1);
+	g_assert_cmpuint (count_terms ("(match-all ( body-contains  \"evolution\" \"camel\" ))"), ==, 1);
+	g_assert_cmpuint (count_terms (
+		"(match-all (and (body-contains \"evolution\") "
+		"(not (body-contains \"camel\"))))"), ==, 2);
+
+	/* Not a term, only a string */
+	g_assert_cmpuint (count_terms ("(match-all (header-contains \"subject\" \"(body-contains \\\"evolution\\\")\"))"), ==, 0);
+
+	/* Nothing long enough to narrow the search */
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"ab\"))"), ==, 0);
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"a-b-c\"))"), ==, 0);
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"evolution\" \"ab\"))"), ==, 0);
+
+	/* Only plain string arguments */
+	g_assert_cmpuint (count_terms ("(match-all (body-contains (get-var \"x\")))"), ==, 0);
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"evo\\nlution\"))"), ==, 0);
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"evo\\\"lution\"))"), ==, 1);
+	g_assert_cmpuint (count_terms ("(match-all (body-contains \"evolution))"), ==, 0);
+
+	/* Other functions with the same prefix */
+	g_assert_cmpuint (count_terms ("(match-all (body-contains-foo \"evolution\"))"), ==, 0);
+}
+
+static void
+test_query_matches (void)
+{
+	MailBodyQuery *query;
+	guint8 *empty, *full, *text, *invalid;
+
+	empty = signature_new (NULL);
+	full = signature_new (NULL);
+	memset (full, 0xFF, MAIL_BODY_SIGNATURE_BYTES);
+	text = signature_new ("The Evolution mail client, with a Camel inside.");
+	invalid = signature_new ("Evolution \xff\xfe");
+
+	query = mail_body_query_new (
+		"(match-all (or (body-contains \"EVOLUTION\") "
+		"(body-contains \"xyzzy\" \"mail client\") "
+		"(body-contains \"camel-inside\")))");
+
+	g_assert_nonnull (query);
+	g_assert_cmpuint (mail_body_query_get_n_terms (query), ==, 3);
+
+	/* Case-insensitive, like Camel */
+	g_assert_true (mail_body_query_term_matches (query, 0, text));
+	/* Any of the arguments */
+	g_assert_true (mail_body_query_term_matches (query, 1, text));
+	/* Each alphanumeric run of the word */
+	g_assert_true (mail_body_query_term_matches (query, 2, text));
+
+	g_assert_false (mail_body_query_term_matches (query, 0, empty));
+	g_assert_false (mail_body_query_term_matches (query, 1, empty));
+	g_assert_false (mail_body_query_term_matches (query, 2, empty));
+
+	g_assert_true (mail_body_query_term_matches (query, 0, full));
+	g_assert_true (mail_body_query_term_matches (query, 1, full));
+	g_assert_true (mail_body_query_term_matches (query, 2, full));
+
+	/* Invalid text can match anything */
+	g_assert_true (mail_body_query_term_matches (query, 2, invalid));
+
+	mail_body_query_free (query);
+
+	g_free (empty);
+	g_free (full);
+	g_free (text);
+	g_free (invalid);
+}
+
+static void
+test_query_rewrite (void)
+{
+	const gchar *expression =
+		"(match-all (and (body-contains \"evolution\") "
+		"(not (body-contains \"camel\"))))";
+	MailBodyQuery *query;
+	GPtrArray *candidates[2];
+	gchar *rewritten;
+
+	query = mail_body_query_new (expression);
+	g_assert_nonnull (query);
+
+	candidates[0] = NULL;
+	candidates[1] = NULL;
+
+	g_assert_null (mail_body_query_rewrite (query, candidates));
+
+	candidates[0] = g_ptr_array_new ();
+	g_ptr_array_add (candidates[0], (gpointer) "1");
+	g_ptr_array_add (candidates[0], (gpointer) "a\"b");
+
+	rewritten = mail_body_query_rewrite (query, candidates);
+	g_assert_cmpstr (rewritten, ==,
+		"(match-all (and (and (uid \"1\" \"a\\\"b\") (body-contains \"evolution\")) "
+		"(not (body-contains \"camel\"))))");
+	g_free (rewritten);
+
+	/* No candidate at all */
+	candidates[1] = g_ptr_array_new ();
+
+	rewritten = mail_body_query_rewrite (query, candidates);
+	g_assert_cmpstr (rewritten, ==,
+		"(match-all (and (and (uid \"1\" \"a\\\"b\") (body-contains \"evolution\")) "
+		"(not (and (uid) (body-contains \"camel\")))))");
+	g_free (rewritten);
+
+	g_ptr_array_free (candidates[0], TRUE);
+	g_ptr_array_free (candidates[1], TRUE);
+
+	mail_body_query_free (query);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/MailBodyQuery/Parse", test_query_parse);
+	g_test_add_func ("/MailBodyQuery/Matches", test_query_matches);
+	g_test_add_func ("/MailBodyQuery/Rewrite", test_query_rewrite);
+
+	return g_test_run ();
+}
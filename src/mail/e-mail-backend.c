@@ -386,6 +386,9 @@ mail_backend_prepare_for_quit_cb (EShell *shell,
 
 	camel_application_is_exiting = TRUE;
 
+	if (camel_debug ("mail:mt"))
+		mail_msg_dump_stats ();
+
 	camel_operation_cancel_all ();
 	mail_vfolder_shutdown ();
 
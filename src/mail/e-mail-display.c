@@ -298,6 +298,15 @@ formatter_image_loading_policy_changed_cb (GObject *object,
 		e_mail_display_reload (display);
 }
 
+static void
+formatter_need_redraw_cb (EMailFormatter *formatter,
+                          EMailDisplay *display)
+{
+	/* Something outside of the formatter settings changed
+	 * the formatted output, thus cached output is stale. */
+	e_mail_request_clear_cache ();
+}
+
 static void
 mail_display_update_formatter_colors (EMailDisplay *display)
 {
@@ -2284,6 +2293,10 @@ e_mail_display_set_mode (EMailDisplay *display,
 		formatter, "notify::header-color",
 		G_CALLBACK (e_mail_display_update_colors), display, G_CONNECT_SWAPPED);
 
+	g_signal_connect (
+		formatter, "need-redraw",
+		G_CALLBACK (formatter_need_redraw_cb), display);
+
 	g_object_connect (formatter,
 		"swapped-object-signal::need-redraw",
 			G_CALLBACK (e_mail_display_reload), display,
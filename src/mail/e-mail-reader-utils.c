@@ -675,6 +675,7 @@ mail_reader_refresh_folder_cb (GObject *source_object,
 
 		m = mail_msg_new (&process_autoarchive_info);
 		m->async_context = async_context;
+		m->base.priority = MAIL_MSG_PRIORITY_BACKGROUND;
 
 		mail_msg_unordered_push (m);
 
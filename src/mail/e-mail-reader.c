@@ -59,8 +59,15 @@
 
 #define d(x)
 
+/* How many messages adjacent to the displayed one are kept parsed
+ * ahead of being selected, and how large they can be in total. */
+#define PREFETCH_MAX_MESSAGES 6
+#define PREFETCH_MAX_BYTES (16 * 1024 * 1024)
+
 typedef struct _EMailReaderClosure EMailReaderClosure;
 typedef struct _EMailReaderPrivate EMailReaderPrivate;
+typedef struct _PrefetchedMessage PrefetchedMessage;
+typedef struct _PrefetchData PrefetchData;
 
 struct _EMailReaderClosure {
 	EMailReader *reader;
@@ -68,6 +75,22 @@ struct _EMailReaderClosure {
 	gchar *message_uid;
 };
 
+struct _PrefetchedMessage {
+	gchar *message_uid;
+	EMailPartList *part_list;
+	gsize size;
+};
+
+struct _PrefetchData {
+	GWeakRef *reader_weakref;
+	EMailSession *session;
+	CamelFolder *folder;
+	GCancellable *cancellable;
+	gchar *message_uid;
+	CamelMimeMessage *message;
+	gsize size;
+};
+
 struct _EMailReaderPrivate {
 
 	EMailForwardStyle forward_style;
@@ -80,6 +103,14 @@ struct _EMailReaderPrivate {
 	 * message is selected before the retrieval has completed. */
 	GCancellable *retrieving_message;
 
+	/* Messages adjacent to the displayed one, parsed in the background
+	 * so that stepping through the folder does not wait for them.  The
+	 * prefetches are cancelled once the selection moves elsewhere, except
+	 * of the newly selected message, which the display then picks up. */
+	GQueue prefetched; /* PrefetchedMessage *, most recently used first */
+	gsize prefetched_size;
+	GHashTable *prefetching_uids; /* gchar *uid ~> GCancellable * */
+
 	/* These flags work to prevent a folder switch from
 	 * automatically marking the message as read. We only want
 	 * that to happen when the -user- selects a message. */
@@ -140,6 +171,58 @@ mail_reader_closure_free (EMailReaderClosure *closure)
 	g_slice_free (EMailReaderClosure, closure);
 }
 
+static void
+prefetched_message_free (PrefetchedMessage *prefetched)
+{
+	g_free (prefetched->message_uid);
+	g_object_unref (prefetched->part_list);
+
+	g_slice_free (PrefetchedMessage, prefetched);
+}
+
+static void
+prefetch_data_free (PrefetchData *data)
+{
+	e_weak_ref_free (data->reader_weakref);
+	g_clear_object (&data->session);
+	g_clear_object (&data->folder);
+	g_clear_object (&data->cancellable);
+	g_clear_object (&data->message);
+	g_free (data->message_uid);
+
+	g_slice_free (PrefetchData, data);
+}
+
+/* Cancels the running prefetches, except of the one of @keep_uid,
+ * which can be NULL to cancel all of them. */
+static void
+mail_reader_cancel_prefetch (EMailReaderPrivate *priv,
+                             const gchar *keep_uid)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (priv->prefetching_uids == NULL)
+		return;
+
+	g_hash_table_iter_init (&iter, priv->prefetching_uids);
+
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (g_strcmp0 (key, keep_uid) != 0) {
+			g_cancellable_cancel (value);
+			g_hash_table_iter_remove (&iter);
+		}
+	}
+}
+
+static void
+mail_reader_clear_prefetched (EMailReaderPrivate *priv)
+{
+	g_queue_foreach (&priv->prefetched, (GFunc) prefetched_message_free, NULL);
+	g_queue_clear (&priv->prefetched);
+	priv->prefetched_size = 0;
+}
+
 static void
 mail_reader_private_free (EMailReaderPrivate *priv)
 {
@@ -152,6 +235,12 @@ mail_reader_private_free (EMailReaderPrivate *priv)
 		priv->retrieving_message = 0;
 	}
 
+	mail_reader_cancel_prefetch (priv, NULL);
+	mail_reader_clear_prefetched (priv);
+
+	if (priv->prefetching_uids != NULL)
+		g_hash_table_destroy (priv->prefetching_uids);
+
 	g_slice_free (EMailReaderPrivate, priv);
 }
 
@@ -3046,6 +3135,295 @@ mail_reader_manage_followup_flag (EMailReader *reader,
 		mail_reader_remove_followup_alert (reader);
 }
 
+/* Returns the prefetched message with the given UID, if any,
+ * and moves it to the head of the most recently used ones. */
+static PrefetchedMessage *
+mail_reader_lookup_prefetched (EMailReaderPrivate *priv,
+                               const gchar *message_uid)
+{
+	GList *link;
+
+	if (message_uid == NULL)
+		return NULL;
+
+	for (link = priv->prefetched.head; link != NULL; link = g_list_next (link)) {
+		PrefetchedMessage *prefetched = link->data;
+
+		if (g_strcmp0 (prefetched->message_uid, message_uid) == 0) {
+			g_queue_unlink (&priv->prefetched, link);
+			g_queue_push_head_link (&priv->prefetched, link);
+
+			return prefetched;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+mail_reader_add_prefetched (EMailReaderPrivate *priv,
+                            const gchar *message_uid,
+                            EMailPartList *part_list,
+                            gsize size)
+{
+	PrefetchedMessage *prefetched;
+
+	if (mail_reader_lookup_prefetched (priv, message_uid) != NULL)
+		return;
+
+	prefetched = g_slice_new0 (PrefetchedMessage);
+	prefetched->message_uid = g_strdup (message_uid);
+	prefetched->part_list = g_object_ref (part_list);
+	prefetched->size = size;
+
+	g_queue_push_head (&priv->prefetched, prefetched);
+	priv->prefetched_size += size;
+
+	/* Drop the least recently used ones over the budget,
+	 * but always keep the one just added. */
+	while (priv->prefetched.length > 1 &&
+	       (priv->prefetched.length > PREFETCH_MAX_MESSAGES ||
+	       priv->prefetched_size > PREFETCH_MAX_BYTES)) {
+		prefetched = g_queue_pop_tail (&priv->prefetched);
+		priv->prefetched_size -= prefetched->size;
+		prefetched_message_free (prefetched);
+	}
+}
+
+static gsize
+mail_reader_get_message_size (CamelFolder *folder,
+                              const gchar *message_uid)
+{
+	CamelMessageInfo *info;
+	gsize size = 0;
+
+	info = camel_folder_get_message_info (folder, message_uid);
+	if (info != NULL) {
+		size = camel_message_info_get_size (info);
+		g_object_unref (info);
+	}
+
+	return size;
+}
+
+static void
+mail_reader_prefetch_parse_thread (GTask *task,
+                                   gpointer source_object,
+                                   gpointer task_data,
+                                   GCancellable *cancellable)
+{
+	PrefetchData *data = task_data;
+	CamelObjectBag *registry;
+	EMailPartList *part_list;
+	gchar *mail_uri;
+	GError *local_error = NULL;
+
+	registry = e_mail_part_list_get_registry ();
+
+	mail_uri = e_mail_part_build_uri (
+		data->folder, data->message_uid, NULL, NULL);
+
+	/* The message can be parsed for the display at the same time,
+	 * when the user selected it before the prefetch finished. */
+	part_list = camel_object_bag_reserve (registry, mail_uri);
+	if (part_list == NULL) {
+		EMailParser *parser;
+
+		parser = e_mail_parser_new (CAMEL_SESSION (data->session));
+
+		part_list = e_mail_parser_parse_sync (
+			parser, data->folder, data->message_uid,
+			data->message, cancellable);
+
+		g_object_unref (parser);
+
+		/* The parser stops early when cancelled, which leaves
+		 * the part list incomplete; let the display parse it. */
+		if (g_cancellable_is_cancelled (cancellable))
+			g_clear_object (&part_list);
+
+		if (part_list == NULL)
+			camel_object_bag_abort (registry, mail_uri);
+		else
+			camel_object_bag_add (registry, mail_uri, part_list);
+	}
+
+	g_free (mail_uri);
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, &local_error)) {
+		g_clear_object (&part_list);
+		g_task_return_error (task, local_error);
+	} else {
+		g_task_return_pointer (task, part_list, g_object_unref);
+	}
+}
+
+static void
+mail_reader_prefetch_parsed_cb (GObject *source_object,
+                                GAsyncResult *result,
+                                gpointer user_data)
+{
+	PrefetchData *data;
+	EMailReader *reader;
+	EMailPartList *part_list;
+
+	data = g_task_get_task_data (G_TASK (result));
+	part_list = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	reader = g_weak_ref_get (data->reader_weakref);
+
+	if (reader != NULL) {
+		EMailReaderPrivate *priv;
+
+		priv = E_MAIL_READER_GET_PRIVATE (reader);
+
+		/* This prefetch had been cancelled, possibly with another
+		 * one started since, when the cancellable does not match. */
+		if (priv != NULL && priv->prefetching_uids != NULL &&
+		    data->cancellable == g_hash_table_lookup (priv->prefetching_uids, data->message_uid)) {
+			g_hash_table_remove (priv->prefetching_uids, data->message_uid);
+
+			if (part_list != NULL)
+				mail_reader_add_prefetched (priv, data->message_uid, part_list, data->size);
+		}
+
+		g_object_unref (reader);
+	}
+
+	g_clear_object (&part_list);
+}
+
+static void
+mail_reader_prefetch_got_message_cb (GObject *source_object,
+                                     GAsyncResult *result,
+                                     gpointer user_data)
+{
+	GTask *task = user_data;
+	PrefetchData *data;
+	GError *local_error = NULL;
+
+	data = g_task_get_task_data (task);
+
+	data->message = camel_folder_get_message_finish (
+		CAMEL_FOLDER (source_object), result, &local_error);
+
+	if (data->message != NULL)
+		g_task_run_in_thread (task, mail_reader_prefetch_parse_thread);
+	else
+		g_task_return_error (task, local_error);
+
+	g_object_unref (task);
+}
+
+static void
+mail_reader_prefetch_message (EMailReader *reader,
+                              CamelFolder *folder,
+                              const gchar *message_uid)
+{
+	EMailReaderPrivate *priv;
+	EMailBackend *backend;
+	PrefetchData *data;
+	GTask *task;
+	gsize size;
+
+	priv = E_MAIL_READER_GET_PRIVATE (reader);
+
+	if (mail_reader_lookup_prefetched (priv, message_uid) != NULL ||
+	    g_hash_table_contains (priv->prefetching_uids, message_uid))
+		return;
+
+	/* Do not download large messages just in case they get selected. */
+	size = mail_reader_get_message_size (folder, message_uid);
+	if (size > PREFETCH_MAX_BYTES / 4)
+		return;
+
+	backend = e_mail_reader_get_backend (reader);
+
+	data = g_slice_new0 (PrefetchData);
+	data->reader_weakref = e_weak_ref_new (reader);
+	data->session = g_object_ref (e_mail_backend_get_session (backend));
+	data->folder = g_object_ref (folder);
+	data->cancellable = g_cancellable_new ();
+	data->message_uid = g_strdup (message_uid);
+	data->size = size;
+
+	g_hash_table_insert (
+		priv->prefetching_uids, g_strdup (message_uid),
+		g_object_ref (data->cancellable));
+
+	task = g_task_new (NULL, data->cancellable, mail_reader_prefetch_parsed_cb, NULL);
+	g_task_set_task_data (task, data, (GDestroyNotify) prefetch_data_free);
+	g_task_set_priority (task, G_PRIORITY_LOW);
+
+	camel_folder_get_message (
+		folder, message_uid, G_PRIORITY_LOW,
+		data->cancellable,
+		mail_reader_prefetch_got_message_cb, task);
+}
+
+/* Prefetches the messages the user is likely to select next, once
+ * the @part_list of the selected message is shown in the display. */
+static void
+mail_reader_prefetch_adjacent (EMailReader *reader,
+                               EMailPartList *part_list)
+{
+	EMailReaderPrivate *priv;
+	MessageList *message_list;
+	CamelFolder *folder;
+	const gchar *message_uid;
+	const struct {
+		MessageListSelectDirection direction;
+		guint32 flags;
+		guint32 mask;
+	} adjacent[] = {
+		/* Next, Next Unread and Previous Message */
+		{ MESSAGE_LIST_SELECT_NEXT, 0, 0 },
+		{ MESSAGE_LIST_SELECT_NEXT | MESSAGE_LIST_SELECT_WRAP, 0, CAMEL_MESSAGE_SEEN },
+		{ MESSAGE_LIST_SELECT_PREVIOUS, 0, 0 }
+	};
+	guint ii;
+
+	priv = E_MAIL_READER_GET_PRIVATE (reader);
+	message_list = MESSAGE_LIST (e_mail_reader_get_message_list (reader));
+	message_uid = e_mail_part_list_get_message_uid (part_list);
+
+	if (priv == NULL || message_list == NULL || message_uid == NULL ||
+	    !message_list->last_sel_single ||
+	    g_strcmp0 (message_list->cursor_uid, message_uid) != 0)
+		return;
+
+	folder = e_mail_reader_ref_folder (reader);
+
+	if (folder == NULL || folder != e_mail_part_list_get_folder (part_list)) {
+		g_clear_object (&folder);
+		return;
+	}
+
+	/* Stepping back to this message should be instant too. */
+	mail_reader_add_prefetched (
+		priv, message_uid, part_list,
+		mail_reader_get_message_size (folder, message_uid));
+
+	if (priv->prefetching_uids == NULL)
+		priv->prefetching_uids = g_hash_table_new_full (
+			g_str_hash, g_str_equal, g_free, g_object_unref);
+
+	for (ii = 0; ii < G_N_ELEMENTS (adjacent); ii++) {
+		gchar *uid;
+
+		uid = message_list_dup_selectable_uid (
+			message_list, adjacent[ii].direction,
+			adjacent[ii].flags, adjacent[ii].mask);
+
+		if (uid != NULL && g_strcmp0 (uid, message_uid) != 0)
+			mail_reader_prefetch_message (reader, folder, uid);
+
+		g_free (uid);
+	}
+
+	g_clear_object (&folder);
+}
+
 static void
 mail_reader_message_loaded_cb (CamelFolder *folder,
                                GAsyncResult *result,
@@ -3136,6 +3514,7 @@ mail_reader_message_selected_timeout_cb (gpointer user_data)
 	const gchar *cursor_uid;
 	const gchar *format_uid;
 	EMailPartList *parts;
+	PrefetchedMessage *prefetched;
 
 	reader = E_MAIL_READER (user_data);
 	priv = E_MAIL_READER_GET_PRIVATE (reader);
@@ -3161,7 +3540,26 @@ mail_reader_message_selected_timeout_cb (gpointer user_data)
 
 		selected_uid_changed = (g_strcmp0 (cursor_uid, format_uid) != 0);
 
-		if (display_visible && selected_uid_changed) {
+		if (display_visible && selected_uid_changed &&
+		    (prefetched = mail_reader_lookup_prefetched (priv, cursor_uid)) != NULL) {
+			CamelMimeMessage *message;
+			CamelFolder *folder;
+
+			/* Parsed in advance, the display picks up the part
+			 * list from the registry, thus show it right away. */
+			message = g_object_ref (e_mail_part_list_get_message (prefetched->part_list));
+			folder = e_mail_reader_ref_folder (reader);
+
+			mail_reader_manage_followup_flag (reader, folder, cursor_uid);
+
+			g_signal_emit (
+				reader, signals[MESSAGE_LOADED], 0,
+				cursor_uid, message);
+
+			g_clear_object (&folder);
+			g_clear_object (&message);
+
+		} else if (display_visible && selected_uid_changed) {
 			EMailReaderClosure *closure;
 			GCancellable *cancellable;
 			CamelFolder *folder;
@@ -3217,6 +3615,14 @@ mail_reader_message_selected_cb (EMailReader *reader,
 	/* Cancel the previous message retrieval activity. */
 	g_cancellable_cancel (priv->retrieving_message);
 
+	message_list = MESSAGE_LIST (e_mail_reader_get_message_list (reader));
+
+	/* Cancel prefetching around the previous selection, but let
+	 * the prefetch of the selected message finish; the display
+	 * waits for its part list in the registry instead of parsing
+	 * the message again. */
+	mail_reader_cancel_prefetch (priv, message_list ? message_list->cursor_uid : NULL);
+
 	/* Cancel the message selected timer. */
 	if (priv->message_selected_timeout_id > 0) {
 		g_source_remove (priv->message_selected_timeout_id);
@@ -3230,7 +3636,6 @@ mail_reader_message_selected_cb (EMailReader *reader,
 			priv->did_try_to_open_message = TRUE;
 	}
 
-	message_list = MESSAGE_LIST (e_mail_reader_get_message_list (reader));
 	if (message_list) {
 		EMailPartList *parts;
 		const gchar *cursor_uid, *format_uid;
@@ -3270,6 +3675,12 @@ mail_reader_message_selected_cb (EMailReader *reader,
 		 * rapidly through the message list. */
 		mail_reader_message_selected_timeout_cb (reader);
 
+	} else if (message_list != NULL &&
+		   mail_reader_lookup_prefetched (priv, message_list->cursor_uid) != NULL) {
+		/* The message is parsed already, thus showing it
+		 * is cheap even when scrolling rapidly. */
+		mail_reader_message_selected_timeout_cb (reader);
+
 	} else {
 		priv->message_selected_timeout_id = e_named_timeout_add (
 			100, mail_reader_message_selected_timeout_cb, reader);
@@ -3404,6 +3815,9 @@ mail_reader_set_folder (EMailReader *reader,
 	if (folder != previous_folder) {
 		e_web_view_clear (E_WEB_VIEW (display));
 
+		mail_reader_cancel_prefetch (priv, NULL);
+		mail_reader_clear_prefetched (priv);
+
 		priv->folder_was_just_selected = (folder != NULL) && !priv->mark_seen_always;
 		priv->did_try_to_open_message = FALSE;
 
@@ -3472,6 +3886,8 @@ set_mail_display_part_list (GObject *object,
 	e_mail_display_set_part_list (display, part_list);
 	e_mail_display_load (display, NULL);
 
+	mail_reader_prefetch_adjacent (reader, part_list);
+
 	/* Remove the reference added when parts list was
 	 * created, so that only owners are EMailDisplays. */
 	g_object_unref (part_list);
@@ -3503,6 +3919,7 @@ mail_reader_set_display_formatter_for_message (EMailReader *reader,
 	} else {
 		e_mail_display_set_part_list (display, parts);
 		e_mail_display_load (display, NULL);
+		mail_reader_prefetch_adjacent (reader, parts);
 		g_object_unref (parts);
 	}
 }
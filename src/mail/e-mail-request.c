@@ -36,10 +36,34 @@
 
 #define d(x)
 
+/* Limits of the cache of formatted message parts.  The least
+ * recently used entries are discarded to keep the cache within
+ * both limits. */
+#define RENDERED_CACHE_MAX_ENTRIES 64
+#define RENDERED_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
 struct _EMailRequestPrivate {
 	gint dummy;
 };
 
+typedef struct _RenderedData {
+	gchar *key;
+	GBytes *bytes;
+	gchar *mime_type;
+	GList link;
+} RenderedData;
+
+/* Formatted message parts, keyed by the request URI, the MIME type
+ * the part was formatted as and the formatter settings, thus flipping
+ * back and forth between messages does not run the formatter over the
+ * same parts again.  The queue is ordered by the most recent access. */
+static GHashTable *rendered_cache = NULL;
+static GQueue rendered_cache_mru = G_QUEUE_INIT;
+static gsize rendered_cache_bytes = 0;
+static guint rendered_cache_hits = 0;
+static guint rendered_cache_misses = 0;
+G_LOCK_DEFINE_STATIC (rendered_cache);
+
 static void e_mail_request_content_request_init (EContentRequestInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (EMailRequest, e_mail_request, G_TYPE_OBJECT,
@@ -84,6 +108,201 @@ save_gicon_to_stream (GIcon *icon,
 	g_object_unref (icon);
 }
 
+static void
+rendered_data_free (RenderedData *rd)
+{
+	g_free (rd->key);
+	g_bytes_unref (rd->bytes);
+	g_free (rd->mime_type);
+
+	g_slice_free (RenderedData, rd);
+}
+
+/* Only parts which are formatted into their own <iframe> and whose
+ * formatting has no side-effects, like claiming attachments, or
+ * interactive content, like meeting invitations, can be cached. */
+static gboolean
+mail_request_can_cache (EMailFormatterMode mode,
+                        const gchar *mime_type)
+{
+	const gchar *uncacheable[] = {
+		"text/html",
+		"text/calendar",
+		"text/x-calendar",
+		"text/x-vcalendar",
+		"text/vcard",
+		"text/x-vcard",
+		"text/directory"
+	};
+	gint ii;
+
+	if (mode != E_MAIL_FORMATTER_MODE_RAW &&
+	    mode != E_MAIL_FORMATTER_MODE_SOURCE)
+		return FALSE;
+
+	if (g_ascii_strcasecmp (mime_type, "application/vnd.evolution.source") == 0)
+		return TRUE;
+
+	if (g_ascii_strncasecmp (mime_type, "text/", 5) != 0)
+		return FALSE;
+
+	for (ii = 0; ii < G_N_ELEMENTS (uncacheable); ii++) {
+		if (g_ascii_strcasecmp (mime_type, uncacheable[ii]) == 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* The request URI covers the folder, the message UID, the part ID,
+ * the mode and the charset, the rest of the key covers the settings
+ * of the formatter, thus changing any of them makes a different key. */
+static gchar *
+mail_request_build_cache_key (EMailFormatter *formatter,
+                              const gchar *uri,
+                              const gchar *mime_type)
+{
+	GSettings *settings;
+	GString *key;
+	gchar *charset, *default_charset;
+	gchar *font, *desktop_font;
+	gint ii;
+
+	key = g_string_new (uri);
+
+	g_string_append_c (key, '\n');
+	g_string_append (key, mime_type);
+	g_string_append_c (key, '\n');
+	g_string_append (key, G_OBJECT_TYPE_NAME (formatter));
+
+	for (ii = 0; ii < E_MAIL_FORMATTER_NUM_COLOR_TYPES; ii++) {
+		gchar *color;
+
+		color = gdk_rgba_to_string (e_mail_formatter_get_color (formatter, ii));
+		g_string_append_c (key, '|');
+		g_string_append (key, color);
+		g_free (color);
+	}
+
+	charset = e_mail_formatter_dup_charset (formatter);
+	default_charset = e_mail_formatter_dup_default_charset (formatter);
+
+	g_string_append_printf (
+		key, "|%u|%d|%d|%d|%d|%d|%s|%s",
+		e_mail_formatter_get_text_format_flags (formatter),
+		e_mail_formatter_get_image_loading_policy (formatter),
+		e_mail_formatter_get_mark_citations (formatter),
+		e_mail_formatter_get_show_sender_photo (formatter),
+		e_mail_formatter_get_show_real_date (formatter),
+		e_mail_formatter_get_animate_images (formatter),
+		charset ? charset : "",
+		default_charset ? default_charset : "");
+
+	g_free (charset);
+	g_free (default_charset);
+
+	/* Formatters of source code read the monospace font on their own. */
+	settings = e_util_ref_settings ("org.gnome.evolution.mail");
+	font = g_settings_get_boolean (settings, "use-custom-font") ?
+		g_settings_get_string (settings, "monospace-font") : NULL;
+	g_object_unref (settings);
+
+	settings = e_util_ref_settings ("org.gnome.desktop.interface");
+	desktop_font = g_settings_get_string (settings, "monospace-font-name");
+	g_object_unref (settings);
+
+	g_string_append_printf (
+		key, "|%s|%s",
+		font ? font : "",
+		desktop_font ? desktop_font : "");
+
+	g_free (font);
+	g_free (desktop_font);
+
+	return g_string_free (key, FALSE);
+}
+
+static gboolean
+rendered_cache_lookup (const gchar *key,
+                       GBytes **out_bytes,
+                       gchar **out_mime_type)
+{
+	RenderedData *rd = NULL;
+
+	G_LOCK (rendered_cache);
+
+	if (rendered_cache != NULL)
+		rd = g_hash_table_lookup (rendered_cache, key);
+
+	if (rd != NULL) {
+		/* Move the entry to the head of the MRU queue. */
+		g_queue_unlink (&rendered_cache_mru, &rd->link);
+		g_queue_push_head_link (&rendered_cache_mru, &rd->link);
+
+		*out_bytes = g_bytes_ref (rd->bytes);
+		*out_mime_type = g_strdup (rd->mime_type);
+
+		rendered_cache_hits++;
+	} else {
+		rendered_cache_misses++;
+	}
+
+	G_UNLOCK (rendered_cache);
+
+	return rd != NULL;
+}
+
+static void
+rendered_cache_insert (const gchar *key,
+                       GBytes *bytes,
+                       const gchar *mime_type)
+{
+	RenderedData *rd;
+
+	/* Do not let a single huge part flush the whole cache. */
+	if (g_bytes_get_size (bytes) > RENDERED_CACHE_MAX_BYTES / 4)
+		return;
+
+	G_LOCK (rendered_cache);
+
+	if (rendered_cache == NULL) {
+		/* The keys are owned by the values. */
+		rendered_cache = g_hash_table_new_full (
+			(GHashFunc) g_str_hash,
+			(GEqualFunc) g_str_equal,
+			(GDestroyNotify) NULL,
+			(GDestroyNotify) rendered_data_free);
+	}
+
+	rd = g_hash_table_lookup (rendered_cache, key);
+	if (rd != NULL) {
+		g_queue_unlink (&rendered_cache_mru, &rd->link);
+		rendered_cache_bytes -= g_bytes_get_size (rd->bytes);
+		g_hash_table_remove (rendered_cache, key);
+	}
+
+	rd = g_slice_new0 (RenderedData);
+	rd->key = g_strdup (key);
+	rd->bytes = g_bytes_ref (bytes);
+	rd->mime_type = g_strdup (mime_type);
+	rd->link.data = rd;
+
+	g_hash_table_insert (rendered_cache, rd->key, rd);
+	g_queue_push_head_link (&rendered_cache_mru, &rd->link);
+	rendered_cache_bytes += g_bytes_get_size (bytes);
+
+	while (rendered_cache_mru.length > RENDERED_CACHE_MAX_ENTRIES ||
+	       rendered_cache_bytes > RENDERED_CACHE_MAX_BYTES) {
+		rd = g_queue_peek_tail (&rendered_cache_mru);
+
+		g_queue_unlink (&rendered_cache_mru, &rd->link);
+		rendered_cache_bytes -= g_bytes_get_size (rd->bytes);
+		g_hash_table_remove (rendered_cache, rd->key);
+	}
+
+	G_UNLOCK (rendered_cache);
+}
+
 static gboolean
 mail_request_process_mail_sync (EContentRequest *request,
 				SoupURI *suri,
@@ -101,6 +320,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 	GOutputStream *output_stream;
 	GBytes *bytes;
 	gchar *tmp, *use_mime_type = NULL;
+	gchar *cache_key = NULL;
 	const gchar *val;
 	const gchar *default_charset, *charset;
 	gboolean part_converted_to_utf8 = FALSE;
@@ -238,6 +458,15 @@ mail_request_process_mail_sync (EContentRequest *request,
 		if (mime_type == NULL)
 			mime_type = e_mail_part_get_mime_type (part);
 
+		if (mime_type != NULL && mail_request_can_cache (context.mode, mime_type)) {
+			cache_key = mail_request_build_cache_key (formatter, context.uri, mime_type);
+
+			if (rendered_cache_lookup (cache_key, &bytes, &use_mime_type)) {
+				g_object_unref (part);
+				goto cached;
+			}
+		}
+
 		e_mail_formatter_format_as (
 			formatter, &context, part,
 			output_stream, mime_type,
@@ -254,8 +483,6 @@ mail_request_process_mail_sync (EContentRequest *request,
 	}
 
  no_part:
-	g_clear_object (&context.part_list);
-
 	g_output_stream_close (output_stream, NULL, NULL);
 
 	bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output_stream));
@@ -282,6 +509,13 @@ mail_request_process_mail_sync (EContentRequest *request,
 		use_mime_type = tmp;
 	}
 
+	/* A cancelled formatter can leave the output incomplete. */
+	if (cache_key != NULL && !g_cancellable_is_cancelled (cancellable))
+		rendered_cache_insert (cache_key, bytes, use_mime_type);
+
+ cached:
+	g_clear_object (&context.part_list);
+
 	*out_stream = g_memory_input_stream_new_from_bytes (bytes);
 	*out_stream_length = g_bytes_get_size (bytes);
 	*out_mime_type = use_mime_type;
@@ -291,6 +525,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 	g_object_unref (formatter);
 	g_bytes_unref (bytes);
 	g_free (context.uri);
+	g_free (cache_key);
 
 	return TRUE;
 }
@@ -504,3 +739,54 @@ e_mail_request_new (void)
 {
 	return g_object_new (E_TYPE_MAIL_REQUEST, NULL);
 }
+
+/**
+ * e_mail_request_clear_cache:
+ *
+ * Discards all cached formatted message parts.  The cache is keyed by
+ * the formatter settings, thus this is needed only when something else
+ * affecting the formatted output changes, like when an #EMailFormatter
+ * emits #EMailFormatter::need-redraw.
+ *
+ * Since: 3.26
+ **/
+void
+e_mail_request_clear_cache (void)
+{
+	G_LOCK (rendered_cache);
+
+	if (rendered_cache != NULL) {
+		/* The queue links are embedded in the values. */
+		g_queue_init (&rendered_cache_mru);
+		g_hash_table_remove_all (rendered_cache);
+		rendered_cache_bytes = 0;
+	}
+
+	G_UNLOCK (rendered_cache);
+}
+
+/**
+ * e_mail_request_get_cache_stats:
+ * @out_hits: (out) (allow-none): return location for the count of requests
+ *    answered from the cache, or %NULL
+ * @out_misses: (out) (allow-none): return location for the count of
+ *    cacheable requests which had to be formatted, or %NULL
+ *
+ * Returns how well the cache of formatted message parts performs.
+ *
+ * Since: 3.26
+ **/
+void
+e_mail_request_get_cache_stats (guint *out_hits,
+                                guint *out_misses)
+{
+	G_LOCK (rendered_cache);
+
+	if (out_hits != NULL)
+		*out_hits = rendered_cache_hits;
+
+	if (out_misses != NULL)
+		*out_misses = rendered_cache_misses;
+
+	G_UNLOCK (rendered_cache);
+}
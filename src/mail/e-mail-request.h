@@ -57,6 +57,9 @@ struct _EMailRequestClass {
 GType		e_mail_request_get_type		(void) G_GNUC_CONST;
 EContentRequest *
 		e_mail_request_new		(void);
+void		e_mail_request_clear_cache	(void);
+void		e_mail_request_get_cache_stats	(guint *out_hits,
+						 guint *out_misses);
 
 G_END_DECLS
 
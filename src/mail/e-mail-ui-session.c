@@ -277,7 +277,8 @@ main_get_filter_driver (CamelSession *session,
 		session_folder_can_filter_junk (for_folder);
 
 	if (add_junk_test) {
-		/* implicit junk check as 1st rule */
+		/* implicit junk check as 1st rule; the name has to stay
+		 * in sync with mail-ops.c:mail_filter_folder() */
 		camel_filter_driver_add_rule (
 			driver, "Junk check", "(junk-test)",
 			"(begin (set-system-flag \"junk\"))");
@@ -459,6 +460,7 @@ mail_ui_session_constructed (GObject *object)
 	EClientCache *client_cache;
 	EMailSession *session;
 	EShell *shell;
+	gchar *photos_dir;
 
 	session = E_MAIL_SESSION (object);
 	shell = e_shell_get_default ();
@@ -480,6 +482,10 @@ mail_ui_session_constructed (GObject *object)
 	client_cache = e_shell_get_client_cache (shell);
 	priv->photo_cache = e_photo_cache_new (client_cache);
 
+	photos_dir = g_build_filename (e_get_user_cache_dir (), "photos", NULL);
+	e_photo_cache_set_disk_cache_dir (priv->photo_cache, photos_dir);
+	g_free (photos_dir);
+
 	/* XXX Make sure the folder tree model is created before we
 	 *     add built-in CamelStores so it gets signals from the
 	 *     EMailAccountStore.
@@ -2379,6 +2379,7 @@ static void
 tree_drag_data_action (struct _DragDataReceivedAsync *m)
 {
 	m->move = m->action == GDK_ACTION_MOVE;
+	m->base.priority = MAIL_MSG_PRIORITY_INTERACTIVE;
 	mail_msg_unordered_push (m);
 }
 
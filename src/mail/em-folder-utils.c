@@ -302,6 +302,8 @@ em_folder_utils_copy_folders (CamelStore *fromstore,
 	m->frombase = g_strdup (frombase);
 	m->tobase = g_strdup (tobase);
 	m->delete = delete;
+	m->base.priority = MAIL_MSG_PRIORITY_INTERACTIVE;
+	mail_msg_set_store (m, fromstore);
 	seq = m->base.seq;
 
 	mail_msg_unordered_push (m);
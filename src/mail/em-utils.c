@@ -1402,145 +1402,527 @@ emu_restore_folder_tree_state (EMFolderTree *folder_tree)
 	g_key_file_free (key_file);
 }
 
-static gboolean
-check_prefix (const gchar *subject,
-	      const gchar *prefix,
-	      const gchar * const *separators,
-              gint *skip_len)
+/* Holds the localized reply prefixes and their separators, compiled
+ * into a trie, so that each subject is scanned only once, regardless
+ * of how many prefixes there are. Immutable once built, thus safe to
+ * be used from any thread without locking. */
+struct _EMUtilsReMatcher {
+	volatile gint ref_count;
+	gchar *key;
+	GArray *nodes; /* ReMatcherNode, the root at index 0 */
+	gunichar **separators; /* lowercased, 0-terminated */
+};
+
+typedef struct _ReMatcherNode {
+	guint first_child; /* 0 means no child */
+	guint next_sibling; /* 0 means no sibling */
+	guchar byte; /* ASCII-lowercased */
+	gboolean terminal;
+} ReMatcherNode;
+
+/* How many nested prefixes of one path are considered, like "R" and "Re". */
+#define RE_MATCHER_MAX_CANDIDATES 8
+
+static void
+re_matcher_add_prefix (EMUtilsReMatcher *matcher,
+		       const gchar *prefix)
 {
-	gboolean res = FALSE;
-	gint plen;
+	guint node_index = 0;
 
-	g_return_val_if_fail (subject != NULL, FALSE);
-	g_return_val_if_fail (prefix != NULL, FALSE);
-	g_return_val_if_fail (*prefix, FALSE);
-	g_return_val_if_fail (skip_len != NULL, FALSE);
+	for (; *prefix; prefix++) {
+		ReMatcherNode *node;
+		guchar byte = g_ascii_tolower (*prefix);
+		guint child;
 
-	plen = strlen (prefix);
-	if (g_ascii_strncasecmp (subject, prefix, plen) != 0)
-		return FALSE;
+		node = &g_array_index (matcher->nodes, ReMatcherNode, node_index);
+		for (child = node->first_child; child; child = g_array_index (matcher->nodes, ReMatcherNode, child).next_sibling) {
+			if (g_array_index (matcher->nodes, ReMatcherNode, child).byte == byte)
+				break;
+		}
+
+		if (!child) {
+			ReMatcherNode new_node = { 0, 0, byte, FALSE };
 
-	if (g_ascii_isspace (subject[plen]))
-		plen++;
+			new_node.next_sibling = node->first_child;
+			g_array_append_val (matcher->nodes, new_node);
 
-	res = e_util_utf8_strstrcase (subject + plen, ":") == subject + plen;
-	if (res)
-		plen += strlen (":");
+			child = matcher->nodes->len - 1;
+			/* The array could be reallocated above */
+			g_array_index (matcher->nodes, ReMatcherNode, node_index).first_child = child;
+		}
 
-	if (!res) {
-		res = e_util_utf8_strstrcase (subject + plen, "︰") == subject + plen;
-		if (res)
-			plen += strlen ("︰");
+		node_index = child;
 	}
 
-	if (!res && separators) {
-		gint ii;
+	if (node_index)
+		g_array_index (matcher->nodes, ReMatcherNode, node_index).terminal = TRUE;
+}
 
-		for (ii = 0; separators[ii]; ii++) {
-			const gchar *separator = separators[ii];
+static gunichar *
+re_matcher_compile_separator (const gchar *separator)
+{
+	gunichar *compiled;
+	glong ii, len;
 
-			res = *separator && e_util_utf8_strstrcase (subject + plen, separator) == subject + plen;
-			if (res) {
-				plen += strlen (separator);
-				break;
-			}
+	if (!separator || !*separator || !g_utf8_validate (separator, -1, NULL))
+		return NULL;
+
+	len = g_utf8_strlen (separator, -1);
+	compiled = g_new0 (gunichar, len + 1);
+
+	for (ii = 0; ii < len; ii++) {
+		compiled[ii] = g_unichar_tolower (g_utf8_get_char (separator));
+		separator = g_utf8_next_char (separator);
+	}
+
+	return compiled;
+}
+
+/**
+ * em_utils_re_matcher_new:
+ * @prefixes: (nullable): localized reply prefixes, like "AW" or "SV"
+ * @separators: (nullable): additional separators between the prefix and the subject
+ *
+ * Compiles the "Re" prefix, the @prefixes and the @separators into
+ * an immutable matcher, which can be used by em_utils_re_matcher_match()
+ * and em_utils_re_matcher_skip() from any thread without locking. The ":"
+ * separator and its presentation form are always recognized.
+ *
+ * Returns: (transfer full): a new #EMUtilsReMatcher. Free it with
+ *    em_utils_re_matcher_unref(), when no longer needed.
+ *
+ * Since: 3.26
+ **/
+EMUtilsReMatcher *
+em_utils_re_matcher_new (const gchar * const *prefixes,
+			 const gchar * const *separators)
+{
+	EMUtilsReMatcher *matcher;
+	ReMatcherNode root = { 0, 0, 0, FALSE };
+	GPtrArray *compiled;
+	GString *key;
+	gint ii;
+
+	matcher = g_slice_new0 (EMUtilsReMatcher);
+	matcher->ref_count = 1;
+	matcher->nodes = g_array_new (FALSE, FALSE, sizeof (ReMatcherNode));
+	g_array_append_val (matcher->nodes, root);
+
+	key = g_string_new ("");
+
+	re_matcher_add_prefix (matcher, "Re");
+
+	for (ii = 0; prefixes && prefixes[ii]; ii++) {
+		const gchar *prefix = prefixes[ii];
+
+		if (*prefix) {
+			re_matcher_add_prefix (matcher, prefix);
+			g_string_append (key, prefix);
+			g_string_append_c (key, ',');
 		}
 	}
 
-	if (res) {
-		if (g_ascii_isspace (subject[plen]))
-			plen++;
+	g_string_append_c (key, '\n');
 
-		*skip_len = plen;
+	compiled = g_ptr_array_new ();
+	g_ptr_array_add (compiled, re_matcher_compile_separator (":"));
+	g_ptr_array_add (compiled, re_matcher_compile_separator ("︰"));
+
+	for (ii = 0; separators && separators[ii]; ii++) {
+		gunichar *separator = re_matcher_compile_separator (separators[ii]);
+
+		if (separator) {
+			g_ptr_array_add (compiled, separator);
+			g_string_append (key, separators[ii]);
+			g_string_append_c (key, '\n');
+		}
 	}
 
-	return res;
+	g_ptr_array_add (compiled, NULL);
+
+	matcher->separators = (gunichar **) g_ptr_array_free (compiled, FALSE);
+	matcher->key = g_string_free (key, FALSE);
+
+	return matcher;
 }
 
-gboolean
-em_utils_is_re_in_subject (const gchar *subject,
-                           gint *skip_len,
-			   const gchar * const *use_prefixes_strv,
-			   const gchar * const *use_separators_strv)
+/**
+ * em_utils_re_matcher_new_from_settings:
+ * @settings: (nullable): a #GSettings for org.gnome.evolution.mail, or %NULL
+ *
+ * Compiles the localized reply prefixes and separators, as set in the @settings,
+ * into a new #EMUtilsReMatcher. When @settings is %NULL, then the default
+ * org.gnome.evolution.mail settings are used.
+ *
+ * Returns: (transfer full): a new #EMUtilsReMatcher. Free it with
+ *    em_utils_re_matcher_unref(), when no longer needed.
+ *
+ * Since: 3.26
+ **/
+EMUtilsReMatcher *
+em_utils_re_matcher_new_from_settings (GSettings *settings)
 {
+	EMUtilsReMatcher *matcher;
 	gchar **prefixes_strv;
 	gchar **separators_strv;
-	gboolean res;
+	gchar *prefixes;
+
+	if (settings)
+		g_object_ref (settings);
+	else
+		settings = e_util_ref_settings ("org.gnome.evolution.mail");
+
+	prefixes = g_settings_get_string (settings, "composer-localized-re");
+	separators_strv = g_settings_get_strv (settings, "composer-localized-re-separators");
+	g_object_unref (settings);
+
+	prefixes_strv = g_strsplit (prefixes ? prefixes : "", ",", -1);
+
+	matcher = em_utils_re_matcher_new ((const gchar * const *) prefixes_strv, (const gchar * const *) separators_strv);
+
+	g_strfreev (separators_strv);
+	g_strfreev (prefixes_strv);
+	g_free (prefixes);
+
+	return matcher;
+}
+
+/**
+ * em_utils_re_matcher_ref:
+ * @matcher: an #EMUtilsReMatcher
+ *
+ * Adds a reference to the @matcher.
+ *
+ * Returns: the @matcher
+ *
+ * Since: 3.26
+ **/
+EMUtilsReMatcher *
+em_utils_re_matcher_ref (EMUtilsReMatcher *matcher)
+{
+	g_return_val_if_fail (matcher != NULL, NULL);
+
+	g_atomic_int_inc (&matcher->ref_count);
+
+	return matcher;
+}
+
+/**
+ * em_utils_re_matcher_unref:
+ * @matcher: an #EMUtilsReMatcher
+ *
+ * Removes a reference from the @matcher. It's freed when the last
+ * reference is removed.
+ *
+ * Since: 3.26
+ **/
+void
+em_utils_re_matcher_unref (EMUtilsReMatcher *matcher)
+{
+	g_return_if_fail (matcher != NULL);
+
+	if (g_atomic_int_dec_and_test (&matcher->ref_count)) {
+		gint ii;
+
+		for (ii = 0; matcher->separators[ii]; ii++)
+			g_free (matcher->separators[ii]);
+
+		g_free (matcher->separators);
+		g_array_free (matcher->nodes, TRUE);
+		g_free (matcher->key);
+		g_slice_free (EMUtilsReMatcher, matcher);
+	}
+}
+
+/**
+ * em_utils_re_matcher_equal:
+ * @matcher1: an #EMUtilsReMatcher
+ * @matcher2: another #EMUtilsReMatcher
+ *
+ * Returns: whether both matchers were compiled from the same prefixes
+ *    and separators, thus recognize the same subjects
+ *
+ * Since: 3.26
+ **/
+gboolean
+em_utils_re_matcher_equal (const EMUtilsReMatcher *matcher1,
+			   const EMUtilsReMatcher *matcher2)
+{
+	g_return_val_if_fail (matcher1 != NULL, FALSE);
+	g_return_val_if_fail (matcher2 != NULL, FALSE);
+
+	return matcher1 == matcher2 || g_strcmp0 (matcher1->key, matcher2->key) == 0;
+}
+
+/* Returns length of the matched separator in bytes, or 0 */
+static gint
+re_matcher_match_separator (const EMUtilsReMatcher *matcher,
+			    const gchar *text)
+{
 	gint ii;
 
+	for (ii = 0; matcher->separators[ii]; ii++) {
+		const gunichar *separator = matcher->separators[ii];
+		const gchar *ptr = text;
+
+		while (*separator && *ptr) {
+			gunichar uc;
+
+			/* Subjects are not guaranteed to be valid UTF-8 */
+			uc = g_utf8_get_char_validated (ptr, -1);
+			if (uc == (gunichar) -1 || uc == (gunichar) -2 ||
+			    g_unichar_tolower (uc) != *separator)
+				break;
+
+			ptr = g_utf8_next_char (ptr);
+			separator++;
+		}
+
+		if (!*separator)
+			return ptr - text;
+	}
+
+	return 0;
+}
+
+/**
+ * em_utils_re_matcher_match:
+ * @matcher: an #EMUtilsReMatcher
+ * @subject: a message subject
+ * @skip_len: (out): where to store how many bytes the reply prefix occupies
+ *
+ * Checks whether the @subject begins with one of the reply prefixes
+ * of the @matcher, followed by one of its separators. When more prefixes
+ * match, like "R" and "Re", then the longest one with a separator wins.
+ * The @skip_len is set to -1, when not found.
+ *
+ * Returns: whether the @subject begins with a reply prefix
+ *
+ * Since: 3.26
+ **/
+gboolean
+em_utils_re_matcher_match (const EMUtilsReMatcher *matcher,
+			   const gchar *subject,
+			   gint *skip_len)
+{
+	const ReMatcherNode *nodes;
+	gint candidates[RE_MATCHER_MAX_CANDIDATES];
+	gint n_candidates = 0, ii;
+	guint node_index = 0;
+	gint depth;
+
+	g_return_val_if_fail (matcher != NULL, FALSE);
 	g_return_val_if_fail (subject != NULL, FALSE);
 	g_return_val_if_fail (skip_len != NULL, FALSE);
 
 	*skip_len = -1;
 
-	if (strlen (subject) < 3)
+	if (!subject[0] || !subject[1] || !subject[2])
 		return FALSE;
 
-	if (use_separators_strv) {
-		separators_strv = (gchar **) use_separators_strv;
-	} else {
-		GSettings *settings;
+	nodes = (const ReMatcherNode *) matcher->nodes->data;
 
-		settings = e_util_ref_settings ("org.gnome.evolution.mail");
-		separators_strv = g_settings_get_strv (settings, "composer-localized-re-separators");
-		g_object_unref (settings);
+	for (depth = 0; subject[depth]; depth++) {
+		guchar byte = g_ascii_tolower (subject[depth]);
+		guint child;
 
-		if (separators_strv && !*separators_strv) {
-			g_strfreev (separators_strv);
-			separators_strv = NULL;
+		for (child = nodes[node_index].first_child; child; child = nodes[child].next_sibling) {
+			if (nodes[child].byte == byte)
+				break;
 		}
+
+		if (!child)
+			break;
+
+		node_index = child;
+
+		if (nodes[node_index].terminal)
+			candidates[(n_candidates++) % RE_MATCHER_MAX_CANDIDATES] = depth + 1;
 	}
 
-	if (check_prefix (subject, "Re", (const gchar * const *) separators_strv, skip_len)) {
-		if (!use_separators_strv)
-			g_strfreev (separators_strv);
+	for (ii = n_candidates - 1; ii >= 0 && ii >= n_candidates - RE_MATCHER_MAX_CANDIDATES; ii--) {
+		gint plen = candidates[ii % RE_MATCHER_MAX_CANDIDATES];
+		gint separator_len;
 
-		return TRUE;
+		if (g_ascii_isspace (subject[plen]))
+			plen++;
+
+		separator_len = re_matcher_match_separator (matcher, subject + plen);
+		if (separator_len > 0) {
+			plen += separator_len;
+
+			if (g_ascii_isspace (subject[plen]))
+				plen++;
+
+			*skip_len = plen;
+
+			return TRUE;
+		}
 	}
 
-	if (use_prefixes_strv) {
-		prefixes_strv = (gchar **) use_prefixes_strv;
-	} else {
-		GSettings *settings;
-		gchar *prefixes;
+	return FALSE;
+}
 
-		settings = e_util_ref_settings ("org.gnome.evolution.mail");
-		prefixes = g_settings_get_string (settings, "composer-localized-re");
-		g_object_unref (settings);
+/**
+ * em_utils_re_matcher_skip:
+ * @matcher: an #EMUtilsReMatcher
+ * @subject: a message subject
+ * @mlist: (nullable): a mailing list name, or %NULL
+ * @mlist_len: how many bytes of the @mlist to use
+ *
+ * Skips all the reply prefixes at the beginning of the @subject,
+ * together with "[@mlist]" tags, when the @mlist is given.
+ *
+ * Returns: (transfer none): a pointer into the @subject, where
+ *    the actual subject begins
+ *
+ * Since: 3.26
+ **/
+const gchar *
+em_utils_re_matcher_skip (const EMUtilsReMatcher *matcher,
+			  const gchar *subject,
+			  const gchar *mlist,
+			  gsize mlist_len)
+{
+	gboolean found_mlist;
 
-		if (!prefixes || !*prefixes) {
-			g_free (prefixes);
+	g_return_val_if_fail (matcher != NULL, subject);
+	g_return_val_if_fail (subject != NULL, subject);
 
-			if (!use_separators_strv)
-				g_strfreev (separators_strv);
+	if (!mlist)
+		mlist_len = 0;
 
-			return FALSE;
+	do {
+		gint skip_len;
+		gboolean found_re = TRUE;
+
+		found_mlist = FALSE;
+
+		while (found_re) {
+			found_re = em_utils_re_matcher_match (matcher, subject, &skip_len) && skip_len > 0;
+			if (found_re)
+				subject += skip_len;
+
+			/* jump over any spaces */
+			while (*subject && g_ascii_isspace (*subject))
+				subject++;
 		}
 
-		prefixes_strv = g_strsplit (prefixes, ",", -1);
-		g_free (prefixes);
+		if (mlist_len &&
+		    *subject == '[' &&
+		    !g_ascii_strncasecmp (subject + 1, mlist, mlist_len) &&
+		    subject[1 + mlist_len] == ']') {
+			subject += 1 + mlist_len + 1;  /* jump over "[mailing-list]" */
+			found_mlist = TRUE;
+
+			/* jump over any spaces */
+			while (*subject && g_ascii_isspace (*subject))
+				subject++;
+		}
+	} while (found_mlist);
+
+	return subject;
+}
+
+static EMUtilsReMatcher *default_re_matcher = NULL;
+static GSettings *default_re_matcher_settings = NULL;
+G_LOCK_DEFINE_STATIC (default_re_matcher);
+
+static void
+default_re_matcher_settings_changed_cb (GSettings *settings,
+					const gchar *key,
+					gpointer user_data)
+{
+	EMUtilsReMatcher *matcher;
+
+	if (g_strcmp0 (key, "composer-localized-re") != 0 &&
+	    g_strcmp0 (key, "composer-localized-re-separators") != 0)
+		return;
+
+	G_LOCK (default_re_matcher);
+	matcher = default_re_matcher;
+	default_re_matcher = NULL;
+	G_UNLOCK (default_re_matcher);
+
+	if (matcher)
+		em_utils_re_matcher_unref (matcher);
+}
+
+static EMUtilsReMatcher *
+ref_default_re_matcher (void)
+{
+	EMUtilsReMatcher *matcher;
+
+	G_LOCK (default_re_matcher);
+
+	if (!default_re_matcher_settings) {
+		default_re_matcher_settings = e_util_ref_settings ("org.gnome.evolution.mail");
+
+		g_signal_connect (
+			default_re_matcher_settings, "changed",
+			G_CALLBACK (default_re_matcher_settings_changed_cb), NULL);
 	}
 
-	if (!prefixes_strv) {
-		if (!use_separators_strv)
-			g_strfreev (separators_strv);
+	if (!default_re_matcher)
+		default_re_matcher = em_utils_re_matcher_new_from_settings (default_re_matcher_settings);
+
+	matcher = em_utils_re_matcher_ref (default_re_matcher);
+
+	G_UNLOCK (default_re_matcher);
+
+	return matcher;
+}
 
+gboolean
+em_utils_is_re_in_subject (const gchar *subject,
+                           gint *skip_len,
+			   const gchar * const *use_prefixes_strv,
+			   const gchar * const *use_separators_strv)
+{
+	EMUtilsReMatcher *matcher;
+	gboolean res;
+
+	g_return_val_if_fail (subject != NULL, FALSE);
+	g_return_val_if_fail (skip_len != NULL, FALSE);
+
+	*skip_len = -1;
+
+	if (strlen (subject) < 3)
 		return FALSE;
-	}
 
-	res = FALSE;
+	if (use_prefixes_strv || use_separators_strv) {
+		GSettings *settings;
+		gchar *prefixes = NULL;
+		gchar **prefixes_strv = NULL;
+		gchar **separators_strv = NULL;
 
-	for (ii = 0; !res && prefixes_strv[ii]; ii++) {
-		const gchar *prefix = prefixes_strv[ii];
+		settings = e_util_ref_settings ("org.gnome.evolution.mail");
 
-		if (*prefix)
-			res = check_prefix (subject, prefix, (const gchar * const *) separators_strv, skip_len);
-	}
+		if (!use_prefixes_strv) {
+			prefixes = g_settings_get_string (settings, "composer-localized-re");
+			prefixes_strv = g_strsplit (prefixes ? prefixes : "", ",", -1);
+			use_prefixes_strv = (const gchar * const *) prefixes_strv;
+		}
+
+		if (!use_separators_strv) {
+			separators_strv = g_settings_get_strv (settings, "composer-localized-re-separators");
+			use_separators_strv = (const gchar * const *) separators_strv;
+		}
+
+		g_object_unref (settings);
+
+		matcher = em_utils_re_matcher_new (use_prefixes_strv, use_separators_strv);
 
-	if (!use_prefixes_strv)
-		g_strfreev (prefixes_strv);
-	if (!use_separators_strv)
 		g_strfreev (separators_strv);
+		g_strfreev (prefixes_strv);
+		g_free (prefixes);
+	} else {
+		matcher = ref_default_re_matcher ();
+	}
+
+	res = em_utils_re_matcher_match (matcher, subject, skip_len);
+
+	em_utils_re_matcher_unref (matcher);
 
 	return res;
 }
@@ -80,6 +80,27 @@ gboolean	em_utils_is_re_in_subject	(const gchar *subject,
 						 const gchar * const *use_prefixes_strv,
 						 const gchar * const *use_separators_strv);
 
+typedef struct _EMUtilsReMatcher EMUtilsReMatcher;
+
+EMUtilsReMatcher *
+		em_utils_re_matcher_new		(const gchar * const *prefixes,
+						 const gchar * const *separators);
+EMUtilsReMatcher *
+		em_utils_re_matcher_new_from_settings
+						(GSettings *settings);
+EMUtilsReMatcher *
+		em_utils_re_matcher_ref		(EMUtilsReMatcher *matcher);
+void		em_utils_re_matcher_unref	(EMUtilsReMatcher *matcher);
+gboolean	em_utils_re_matcher_equal	(const EMUtilsReMatcher *matcher1,
+						 const EMUtilsReMatcher *matcher2);
+gboolean	em_utils_re_matcher_match	(const EMUtilsReMatcher *matcher,
+						 const gchar *subject,
+						 gint *skip_len);
+const gchar *	em_utils_re_matcher_skip	(const EMUtilsReMatcher *matcher,
+						 const gchar *subject,
+						 const gchar *mlist,
+						 gsize mlist_len);
+
 gchar *		em_utils_get_archive_folder_uri_from_folder
 						(CamelFolder *folder,
 						 EMailBackend *mail_backend,
@@ -1184,27 +1184,114 @@ test_should_delete_junk_or_expunge (CamelStore *store,
 	g_object_unref (settings);
 }
 
+/* At most this many folders of one store are refreshed at once,
+ * and never more than the store allows connections. */
+#define REFRESH_MAX_CONCURRENCY 4
+
+/* Refresh priorities, the lower the sooner */
+enum {
+	REFRESH_PRIORITY_INBOX,
+	REFRESH_PRIORITY_OPENED,
+	REFRESH_PRIORITY_UNREAD,
+	REFRESH_PRIORITY_OTHER
+};
+
+typedef struct _RefreshFolder {
+	gchar *folder_uri;
+	gchar *full_name;
+	gint priority;
+	guint order;
+} RefreshFolder;
+
+static void
+refresh_folder_free (RefreshFolder *rf)
+{
+	g_free (rf->folder_uri);
+	g_free (rf->full_name);
+	g_slice_free (RefreshFolder, rf);
+}
+
+static gint
+refresh_folder_compare (gconstpointer ptr1,
+                        gconstpointer ptr2)
+{
+	const RefreshFolder *rf1 = *((const RefreshFolder **) ptr1);
+	const RefreshFolder *rf2 = *((const RefreshFolder **) ptr2);
+
+	if (rf1->priority != rf2->priority)
+		return rf1->priority - rf2->priority;
+
+	/* Keep the folder tree order otherwise */
+	return rf1->order < rf2->order ? -1 : rf1->order > rf2->order ? 1 : 0;
+}
+
 static void
 get_folders (CamelStore *store,
+             MailFolderCache *folder_cache,
              GPtrArray *folders,
              CamelFolderInfo *info)
 {
 	while (info) {
 		if (camel_store_can_refresh_folder (store, info, NULL)) {
 			if ((info->flags & CAMEL_FOLDER_NOSELECT) == 0) {
-				gchar *folder_uri;
+				RefreshFolder *rf;
+				CamelFolder *folder;
 
-				folder_uri = e_mail_folder_uri_build (
+				rf = g_slice_new0 (RefreshFolder);
+				rf->folder_uri = e_mail_folder_uri_build (
 					store, info->full_name);
-				g_ptr_array_add (folders, folder_uri);
+				rf->full_name = g_strdup (info->full_name);
+				rf->order = folders->len;
+
+				folder = folder_cache ? mail_folder_cache_ref_folder (
+					folder_cache, store, info->full_name) : NULL;
+
+				if ((info->flags & CAMEL_FOLDER_TYPE_MASK) == CAMEL_FOLDER_TYPE_INBOX ||
+				    g_ascii_strcasecmp (info->full_name, "INBOX") == 0)
+					rf->priority = REFRESH_PRIORITY_INBOX;
+				else if (folder != NULL)
+					rf->priority = REFRESH_PRIORITY_OPENED;
+				else if (info->unread > 0)
+					rf->priority = REFRESH_PRIORITY_UNREAD;
+				else
+					rf->priority = REFRESH_PRIORITY_OTHER;
+
+				g_clear_object (&folder);
+
+				g_ptr_array_add (folders, rf);
 			}
 		}
 
-		get_folders (store, folders, info->child);
+		get_folders (store, folder_cache, folders, info->child);
 		info = info->next;
 	}
 }
 
+/* How many folders of @store can be refreshed at once. */
+static guint
+get_refresh_concurrency (CamelStore *store)
+{
+	CamelProvider *provider;
+	CamelSettings *settings;
+	guint concurrency = 1;
+
+	provider = camel_service_get_provider (CAMEL_SERVICE (store));
+	if (!provider || (provider->flags & CAMEL_PROVIDER_IS_REMOTE) == 0)
+		return 1;
+
+	settings = camel_service_ref_settings (CAMEL_SERVICE (store));
+
+	/* Only the stores using more connections have this property */
+	if (settings && g_object_class_find_property (
+		G_OBJECT_GET_CLASS (settings), "concurrent-connections")) {
+		g_object_get (settings, "concurrent-connections", &concurrency, NULL);
+	}
+
+	g_clear_object (&settings);
+
+	return CLAMP (concurrency, 1, REFRESH_MAX_CONCURRENCY);
+}
+
 static void
 main_op_cancelled_cb (GCancellable *main_op,
                       GCancellable *refresh_op)
@@ -1216,11 +1303,120 @@ struct _refresh_folders_msg {
 	MailMsg base;
 
 	struct _send_info *info;
-	GPtrArray *folders;
+	GPtrArray *folders; /* RefreshFolder * */
 	CamelStore *store;
 	CamelFolderInfo *finfo;
 };
 
+/* Shared by the threads refreshing the folders of one store */
+typedef struct _RefreshContext {
+	struct _refresh_folders_msg *m;
+	GCancellable *cancellable;
+	EMailBackend *mail_backend;
+	gboolean expunge;
+
+	GMutex lock;
+	guint next_folder;
+	guint n_done;
+	gboolean stop;
+	GHashTable *known_errors;
+} RefreshContext;
+
+static void
+refresh_folder_sync (RefreshContext *rc,
+                     RefreshFolder *rf)
+{
+	struct _refresh_folders_msg *m = rc->m;
+	CamelFolder *folder;
+	GError *local_error = NULL;
+
+	folder = e_mail_session_uri_to_folder_sync (
+		E_MAIL_SESSION (m->info->session),
+		rf->folder_uri, 0,
+		rc->cancellable, &local_error);
+	if (folder && camel_folder_synchronize_sync (folder, rc->expunge, rc->cancellable, &local_error))
+		camel_folder_refresh_info_sync (folder, rc->cancellable, &local_error);
+
+	if (folder && !local_error && rc->mail_backend) {
+		em_utils_process_autoarchive_sync (rc->mail_backend, folder, rf->folder_uri, rc->cancellable, &local_error);
+	}
+
+	if (local_error != NULL) {
+		const gchar *error_message = local_error->message ? local_error->message : _("Unknown error");
+
+		g_mutex_lock (&rc->lock);
+
+		if (g_hash_table_contains (rc->known_errors, error_message)) {
+			/* Received the same error message multiple times; there can be some
+			   connection issue probably, thus skip the rest folder updates for now */
+			rc->stop = TRUE;
+		} else if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			CamelStore *store;
+			const gchar *full_name;
+
+			if (folder) {
+				store = camel_folder_get_parent_store (folder);
+				full_name = camel_folder_get_full_name (folder);
+			} else {
+				store = m->store;
+				full_name = rf->full_name;
+			}
+
+			report_error_to_ui (CAMEL_SERVICE (store), full_name, local_error);
+
+			/* To not report one error for multiple folders multiple times */
+			g_hash_table_insert (rc->known_errors, g_strdup (error_message), GINT_TO_POINTER (1));
+		}
+
+		g_mutex_unlock (&rc->lock);
+
+		g_clear_error (&local_error);
+	}
+
+	g_clear_object (&folder);
+}
+
+/* Refreshes folders in the order of their priority, until there are
+ * none left, the operation is cancelled or a connection issue occurs.
+ * Several threads run this for one store. */
+static gpointer
+refresh_folders_thread (gpointer user_data)
+{
+	RefreshContext *rc = user_data;
+	struct _refresh_folders_msg *m = rc->m;
+
+	while (TRUE) {
+		RefreshFolder *rf = NULL;
+
+		g_mutex_lock (&rc->lock);
+		if (!rc->stop && rc->next_folder < m->folders->len)
+			rf = m->folders->pdata[rc->next_folder++];
+		g_mutex_unlock (&rc->lock);
+
+		if (!rf)
+			break;
+
+		refresh_folder_sync (rc, rf);
+
+		g_mutex_lock (&rc->lock);
+
+		rc->n_done++;
+
+		if (g_cancellable_is_cancelled (m->info->cancellable) ||
+		    g_cancellable_is_cancelled (rc->cancellable))
+			rc->stop = TRUE;
+
+		/* Under the lock, to keep the progress monotonic */
+		if (!rc->stop && m->info->state != SEND_CANCELLED)
+			camel_operation_progress (
+				m->info->cancellable, 100 * rc->n_done / m->folders->len);
+
+		g_mutex_unlock (&rc->lock);
+	}
+
+	return NULL;
+}
+
 static gchar *
 refresh_folders_desc (struct _refresh_folders_msg *m)
 {
@@ -1234,12 +1430,12 @@ refresh_folders_exec (struct _refresh_folders_msg *m,
                       GCancellable *cancellable,
                       GError **error)
 {
-	CamelFolder *folder;
-	gint i;
+	RefreshContext rc;
+	GPtrArray *threads;
+	MailFolderCache *folder_cache;
 	gboolean success;
 	gboolean delete_junk = FALSE, expunge = FALSE;
-	GHashTable *known_errors;
-	EMailBackend *mail_backend;
+	guint concurrency, ii;
 	GError *local_error = NULL;
 	gulong handler_id = 0;
 
@@ -1257,7 +1453,10 @@ refresh_folders_exec (struct _refresh_folders_msg *m,
 		goto exit;
 	}
 
-	get_folders (m->store, m->folders, m->finfo);
+	folder_cache = e_mail_session_get_folder_cache (E_MAIL_SESSION (m->info->session));
+
+	get_folders (m->store, folder_cache, m->folders, m->finfo);
+	g_ptr_array_sort (m->folders, refresh_folder_compare);
 
 	camel_operation_push_message (m->info->cancellable, _("Updating..."));
 
@@ -1268,66 +1467,38 @@ refresh_folders_exec (struct _refresh_folders_msg *m,
 		goto exit;
 	}
 
-	mail_backend = E_MAIL_BACKEND (e_shell_get_backend_by_name (e_shell_get_default (), "mail"));
+	memset (&rc, 0, sizeof (RefreshContext));
+	rc.m = m;
+	rc.cancellable = cancellable;
+	rc.mail_backend = E_MAIL_BACKEND (e_shell_get_backend_by_name (e_shell_get_default (), "mail"));
+	rc.expunge = expunge;
+	rc.known_errors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_mutex_init (&rc.lock);
 
-	known_errors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	concurrency = MIN (get_refresh_concurrency (m->store), m->folders->len);
+	threads = g_ptr_array_new ();
 
-	for (i = 0; i < m->folders->len; i++) {
-		folder = e_mail_session_uri_to_folder_sync (
-			E_MAIL_SESSION (m->info->session),
-			m->folders->pdata[i], 0,
-			cancellable, &local_error);
-		if (folder && camel_folder_synchronize_sync (folder, expunge, cancellable, &local_error))
-			camel_folder_refresh_info_sync (folder, cancellable, &local_error);
+	/* This thread is one of the refreshing threads as well */
+	for (ii = 1; ii < concurrency; ii++) {
+		GThread *thread;
 
-		if (folder && !local_error && mail_backend) {
-			em_utils_process_autoarchive_sync (mail_backend, folder, m->folders->pdata[i], cancellable, &local_error);
-		}
-
-		if (local_error != NULL) {
-			const gchar *error_message = local_error->message ? local_error->message : _("Unknown error");
-
-			if (g_hash_table_contains (known_errors, error_message)) {
-				/* Received the same error message multiple times; there can be some
-				   connection issue probably, thus skip the rest folder updates for now */
-				g_clear_object (&folder);
-				g_clear_error (&local_error);
-				break;
-			} else if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-				CamelStore *store;
-				const gchar *full_name;
-
-				if (folder) {
-					store = camel_folder_get_parent_store (folder);
-					full_name = camel_folder_get_full_name (folder);
-				} else {
-					store = m->store;
-					full_name = (const gchar *) m->folders->pdata[i];
-				}
-
-				report_error_to_ui (CAMEL_SERVICE (store), full_name, local_error);
-
-				/* To not report one error for multiple folders multiple times */
-				g_hash_table_insert (known_errors, g_strdup (error_message), GINT_TO_POINTER (1));
-			}
+		thread = g_thread_try_new (NULL, refresh_folders_thread, &rc, NULL);
+		if (!thread)
+			break;
 
-			g_clear_error (&local_error);
-		}
+		g_ptr_array_add (threads, thread);
+	}
 
-		if (folder)
-			g_object_unref (folder);
+	refresh_folders_thread (&rc);
 
-		if (g_cancellable_is_cancelled (m->info->cancellable) ||
-		    g_cancellable_is_cancelled (cancellable))
-			break;
+	for (ii = 0; ii < threads->len; ii++)
+		g_thread_join (threads->pdata[ii]);
 
-		if (m->info->state != SEND_CANCELLED)
-			camel_operation_progress (
-				m->info->cancellable, 100 * i / m->folders->len);
-	}
+	g_ptr_array_free (threads, TRUE);
 
 	camel_operation_pop_message (m->info->cancellable);
-	g_hash_table_destroy (known_errors);
+	g_hash_table_destroy (rc.known_errors);
+	g_mutex_clear (&rc.lock);
 
 exit:
 	if (handler_id > 0)
@@ -1343,10 +1514,6 @@ refresh_folders_done (struct _refresh_folders_msg *m)
 static void
 refresh_folders_free (struct _refresh_folders_msg *m)
 {
-	gint i;
-
-	for (i = 0; i < m->folders->len; i++)
-		g_free (m->folders->pdata[i]);
 	g_ptr_array_free (m->folders, TRUE);
 
 	camel_folder_info_free (m->finfo);
@@ -1391,15 +1558,21 @@ receive_update_got_folderinfo (GObject *source_object,
 
 	/* CamelFolderInfo may be NULL even if no error occurred. */
 	} else if (info != NULL) {
-		GPtrArray *folders = g_ptr_array_new ();
+		GPtrArray *folders;
 		struct _refresh_folders_msg *m;
 
+		folders = g_ptr_array_new_with_free_func (
+			(GDestroyNotify) refresh_folder_free);
+
 		m = mail_msg_new (&refresh_folders_info);
 		m->store = g_object_ref (send_info->service);
 		m->folders = folders;
 		m->info = send_info;
 		m->finfo = info;  /* takes ownership */
 
+		m->base.priority = MAIL_MSG_PRIORITY_BACKGROUND;
+		mail_msg_set_store (m, m->store);
+
 		mail_msg_unordered_push (m);
 
 	} else {
@@ -1511,6 +1684,9 @@ maybe_delete_junk_or_expunge_local_store (EMailSession *session)
 	m->delete_junk = delete_junk;
 	m->expunge_trash = expunge_trash;
 
+	m->base.priority = MAIL_MSG_PRIORITY_BACKGROUND;
+	mail_msg_set_store (m, store);
+
 	mail_msg_unordered_push (m);
 }
 
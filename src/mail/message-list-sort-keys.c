@@ -0,0 +1,395 @@
+/*
+ * message-list-sort-keys.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Sorting of the UIDs before threading them works on a snapshot of
+ * the sort column values, taken once per message, instead of reading
+ * them from the CamelMessageInfo-s during the comparisons.  The values
+ * are kept as integers or as strings which compare with strcmp() the
+ * same way the column's compare function compares the values; only
+ * the columns with an unknown compare function keep the values. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include "message-list-sort-keys.h"
+
+typedef enum {
+	SORT_KEY_INT,		/* "integer" */
+	SORT_KEY_INT64,		/* "pointer-integer64" */
+	SORT_KEY_STRING,	/* strcmp() of interned keys */
+	SORT_KEY_GENERIC	/* the column's own compare function */
+} SortKeyKind;
+
+typedef struct _SortKeyColumn {
+	gchar *compare;
+	GCompareDataFunc compare_func;
+	gpointer column_data;
+	SortKeyKind kind;
+	gboolean descending;
+
+	/* One item per message, only the one for the 'kind' is set. */
+	gint64 *ints;
+	const gchar **strings;
+	gpointer *values;
+	guint8 *is_set;
+} SortKeyColumn;
+
+struct _MessageListSortKeys {
+	SortKeyColumn *columns;
+	guint n_columns;
+	guint n_messages;
+	GStringChunk *strings;
+	gpointer cmp_cache;
+
+	MessageListSortKeysTieFunc tie_func;
+	gpointer tie_data;
+
+	guint64 n_comparisons;
+};
+
+static SortKeyKind
+sort_key_kind_for_compare (const gchar *compare)
+{
+	if (g_strcmp0 (compare, "integer") == 0)
+		return SORT_KEY_INT;
+
+	if (g_strcmp0 (compare, "pointer-integer64") == 0)
+		return SORT_KEY_INT64;
+
+	if (g_strcmp0 (compare, "string") == 0 ||
+	    g_strcmp0 (compare, "collate") == 0 ||
+	    g_strcmp0 (compare, "stringcase") == 0 ||
+	    g_strcmp0 (compare, "address_compare") == 0)
+		return SORT_KEY_STRING;
+
+	return SORT_KEY_GENERIC;
+}
+
+/* Converts the column value into a key, which compares with strcmp()
+ * the same way the column's compare function compares the values. */
+static const gchar *
+sort_keys_intern_string (MessageListSortKeys *sort_keys,
+                         SortKeyColumn *column,
+                         const gchar *value)
+{
+	const gchar *compare = column->compare;
+	const gchar *interned;
+	gchar *key, *tmp;
+
+	if (g_strcmp0 (compare, "string") == 0)
+		return g_string_chunk_insert_const (sort_keys->strings, value);
+
+	if (g_strcmp0 (compare, "collate") == 0) {
+		key = g_utf8_collate_key (value, -1);
+	} else if (g_strcmp0 (compare, "stringcase") == 0) {
+		tmp = g_utf8_casefold (value, -1);
+		key = g_utf8_collate_key (tmp, -1);
+		g_free (tmp);
+	} else {
+		/* address_compare() is g_ascii_strcasecmp() */
+		key = g_ascii_strdown (value, -1);
+	}
+
+	interned = g_string_chunk_insert_const (sort_keys->strings, key);
+
+	g_free (key);
+
+	return interned;
+}
+
+static gint
+sort_keys_compare_column (MessageListSortKeys *sort_keys,
+                          SortKeyColumn *column,
+                          guint index1,
+                          guint index2)
+{
+	gint res = 0;
+
+	/* Unset values sort first, regardless of the column type. */
+	if (!column->is_set[index1] || !column->is_set[index2]) {
+		res = column->is_set[index1] - column->is_set[index2];
+	} else {
+		switch (column->kind) {
+		case SORT_KEY_INT:
+		case SORT_KEY_INT64:
+			if (column->ints[index1] != column->ints[index2])
+				res = column->ints[index1] < column->ints[index2] ? -1 : 1;
+			break;
+		case SORT_KEY_STRING:
+			/* Interned, thus equal keys share the pointer. */
+			if (column->strings[index1] != column->strings[index2])
+				res = strcmp (column->strings[index1], column->strings[index2]);
+			break;
+		case SORT_KEY_GENERIC:
+			res = column->compare_func (
+				column->values[index1],
+				column->values[index2],
+				sort_keys->cmp_cache);
+			break;
+		}
+	}
+
+	return column->descending ? -res : res;
+}
+
+static gint
+sort_keys_compare (gconstpointer a,
+                   gconstpointer b,
+                   gpointer user_data)
+{
+	MessageListSortKeys *sort_keys = user_data;
+	guint index1 = *((const guint *) a);
+	guint index2 = *((const guint *) b);
+	guint jj;
+	gint res = 0;
+
+	sort_keys->n_comparisons++;
+
+	for (jj = 0; jj < sort_keys->n_columns && res == 0; jj++)
+		res = sort_keys_compare_column (
+			sort_keys, &sort_keys->columns[jj], index1, index2);
+
+	if (res == 0)
+		res = sort_keys->tie_func (index1, index2, sort_keys->tie_data);
+
+	return res;
+}
+
+/* Specialised for the sort by a single date, or other integer, column. */
+static gint
+sort_keys_compare_single_int (gconstpointer a,
+                              gconstpointer b,
+                              gpointer user_data)
+{
+	MessageListSortKeys *sort_keys = user_data;
+	SortKeyColumn *column = sort_keys->columns;
+	guint index1 = *((const guint *) a);
+	guint index2 = *((const guint *) b);
+	gint res;
+
+	sort_keys->n_comparisons++;
+
+	if (column->is_set[index1] && column->is_set[index2]) {
+		gint64 value1 = column->ints[index1];
+		gint64 value2 = column->ints[index2];
+
+		res = (value1 == value2) ? 0 : (value1 < value2) ? -1 : 1;
+	} else {
+		res = column->is_set[index1] - column->is_set[index2];
+	}
+
+	if (column->descending)
+		res = -res;
+
+	if (res == 0)
+		res = sort_keys->tie_func (index1, index2, sort_keys->tie_data);
+
+	return res;
+}
+
+/* Creates sort keys of @n_messages messages by @n_columns columns, each
+ * of which is to be described with message_list_sort_keys_set_column().
+ * The @cmp_cache is passed to the compare functions of the columns. */
+MessageListSortKeys *
+message_list_sort_keys_new (guint n_messages,
+                            guint n_columns,
+                            gpointer cmp_cache)
+{
+	MessageListSortKeys *sort_keys;
+
+	g_return_val_if_fail (n_columns > 0, NULL);
+
+	sort_keys = g_slice_new0 (MessageListSortKeys);
+	sort_keys->columns = g_new0 (SortKeyColumn, n_columns);
+	sort_keys->n_columns = n_columns;
+	sort_keys->n_messages = n_messages;
+	sort_keys->strings = g_string_chunk_new (4096);
+	sort_keys->cmp_cache = cmp_cache;
+
+	return sort_keys;
+}
+
+/* Frees the @sort_keys; the @free_func, if set, is called for each
+ * value kept by message_list_sort_keys_set_value(). */
+void
+message_list_sort_keys_free (MessageListSortKeys *sort_keys,
+                             MessageListSortKeysFreeFunc free_func,
+                             gpointer user_data)
+{
+	guint ii, jj;
+
+	if (sort_keys == NULL)
+		return;
+
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		SortKeyColumn *column = &sort_keys->columns[jj];
+
+		if (column->values != NULL && free_func != NULL) {
+			for (ii = 0; ii < sort_keys->n_messages; ii++) {
+				if (column->values[ii] != NULL)
+					free_func (column->column_data, column->values[ii], user_data);
+			}
+		}
+
+		g_free (column->compare);
+		g_free (column->ints);
+		g_free (column->strings);
+		g_free (column->values);
+		g_free (column->is_set);
+	}
+
+	g_free (sort_keys->columns);
+	g_string_chunk_free (sort_keys->strings);
+
+	g_slice_free (MessageListSortKeys, sort_keys);
+}
+
+/* Describes the @column of the @sort_keys, in the order of sorting.
+ * The @compare is the name of the @compare_func, as in the ETable
+ * specification, which tells how the keys are kept.  The @column_data
+ * is passed to the free function of message_list_sort_keys_free(). */
+void
+message_list_sort_keys_set_column (MessageListSortKeys *sort_keys,
+                                   guint column,
+                                   const gchar *compare,
+                                   GCompareDataFunc compare_func,
+                                   gboolean descending,
+                                   gpointer column_data)
+{
+	SortKeyColumn *col;
+
+	g_return_if_fail (sort_keys != NULL);
+	g_return_if_fail (column < sort_keys->n_columns);
+	g_return_if_fail (compare_func != NULL);
+	g_return_if_fail (sort_keys->columns[column].is_set == NULL);
+
+	col = &sort_keys->columns[column];
+	col->compare = g_strdup (compare);
+	col->compare_func = compare_func;
+	col->column_data = column_data;
+	col->kind = sort_key_kind_for_compare (compare);
+	col->descending = descending;
+	col->is_set = g_new0 (guint8, sort_keys->n_messages);
+
+	switch (col->kind) {
+	case SORT_KEY_INT:
+	case SORT_KEY_INT64:
+		col->ints = g_new0 (gint64, sort_keys->n_messages);
+		break;
+	case SORT_KEY_STRING:
+		col->strings = g_new0 (const gchar *, sort_keys->n_messages);
+		break;
+	case SORT_KEY_GENERIC:
+		col->values = g_new0 (gpointer, sort_keys->n_messages);
+		break;
+	}
+}
+
+/* Sets the @value of the @column for the message at @index, as it
+ * would be passed to the compare function of the column.  Returns
+ * whether the @value is kept, to be freed with the @sort_keys;
+ * otherwise the caller can free it right away. */
+gboolean
+message_list_sort_keys_set_value (MessageListSortKeys *sort_keys,
+                                  guint column,
+                                  guint index,
+                                  gpointer value)
+{
+	SortKeyColumn *col;
+
+	g_return_val_if_fail (sort_keys != NULL, FALSE);
+	g_return_val_if_fail (column < sort_keys->n_columns, FALSE);
+	g_return_val_if_fail (index < sort_keys->n_messages, FALSE);
+
+	col = &sort_keys->columns[column];
+
+	g_return_val_if_fail (col->is_set != NULL, FALSE);
+
+	col->is_set[index] = value != NULL;
+
+	switch (col->kind) {
+	case SORT_KEY_INT:
+		col->ints[index] = GPOINTER_TO_INT (value);
+		break;
+	case SORT_KEY_INT64:
+		col->ints[index] = value ? *((gint64 *) value) : 0;
+		break;
+	case SORT_KEY_STRING:
+		col->strings[index] = value ?
+			sort_keys_intern_string (sort_keys, col, value) : NULL;
+		break;
+	case SORT_KEY_GENERIC:
+		col->values[index] = value;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Sorts the first @n_messages messages by their keys; the @tie_func
+ * orders those with all the keys equal.  Returns a newly allocated
+ * array of the message indexes in the sorted order, free it with
+ * g_free(), when no longer needed. */
+guint *
+message_list_sort_keys_sort (MessageListSortKeys *sort_keys,
+                             guint n_messages,
+                             MessageListSortKeysTieFunc tie_func,
+                             gpointer user_data)
+{
+	GCompareDataFunc compare_func;
+	SortKeyKind kind;
+	guint *indexes;
+	guint ii;
+
+	g_return_val_if_fail (sort_keys != NULL, NULL);
+	g_return_val_if_fail (n_messages <= sort_keys->n_messages, NULL);
+	g_return_val_if_fail (tie_func != NULL, NULL);
+
+	sort_keys->tie_func = tie_func;
+	sort_keys->tie_data = user_data;
+
+	indexes = g_new (guint, MAX (n_messages, 1));
+	for (ii = 0; ii < n_messages; ii++)
+		indexes[ii] = ii;
+
+	kind = sort_keys->columns[0].kind;
+
+	if (sort_keys->n_columns == 1 && (kind == SORT_KEY_INT || kind == SORT_KEY_INT64))
+		compare_func = sort_keys_compare_single_int;
+	else
+		compare_func = sort_keys_compare;
+
+	g_qsort_with_data (
+		indexes,
+		n_messages,
+		sizeof (guint),
+		compare_func,
+		sort_keys);
+
+	return indexes;
+}
+
+/* Returns how many comparisons message_list_sort_keys_sort() did,
+ * in all its calls on the @sort_keys. */
+guint64
+message_list_sort_keys_get_n_comparisons (MessageListSortKeys *sort_keys)
+{
+	g_return_val_if_fail (sort_keys != NULL, 0);
+
+	return sort_keys->n_comparisons;
+}
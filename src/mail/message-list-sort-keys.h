@@ -0,0 +1,68 @@
+/*
+ * message-list-sort-keys.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Private to the message list, not installed. */
+
+#ifndef MESSAGE_LIST_SORT_KEYS_H
+#define MESSAGE_LIST_SORT_KEYS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MessageListSortKeys MessageListSortKeys;
+
+/* Orders the messages at @index1 and @index2 when all their keys
+ * are equal, usually by their UIDs. */
+typedef gint	(*MessageListSortKeysTieFunc)	(guint index1,
+						 guint index2,
+						 gpointer user_data);
+
+/* Frees a @value kept by message_list_sort_keys_set_value(). */
+typedef void	(*MessageListSortKeysFreeFunc)	(gpointer column_data,
+						 gpointer value,
+						 gpointer user_data);
+
+MessageListSortKeys *
+		message_list_sort_keys_new	(guint n_messages,
+						 guint n_columns,
+						 gpointer cmp_cache);
+void		message_list_sort_keys_free	(MessageListSortKeys *sort_keys,
+						 MessageListSortKeysFreeFunc free_func,
+						 gpointer user_data);
+void		message_list_sort_keys_set_column
+						(MessageListSortKeys *sort_keys,
+						 guint column,
+						 const gchar *compare,
+						 GCompareDataFunc compare_func,
+						 gboolean descending,
+						 gpointer column_data);
+gboolean	message_list_sort_keys_set_value
+						(MessageListSortKeys *sort_keys,
+						 guint column,
+						 guint index,
+						 gpointer value);
+guint *		message_list_sort_keys_sort	(MessageListSortKeys *sort_keys,
+						 guint n_messages,
+						 MessageListSortKeysTieFunc tie_func,
+						 gpointer user_data);
+guint64		message_list_sort_keys_get_n_comparisons
+						(MessageListSortKeys *sort_keys);
+
+G_END_DECLS
+
+#endif /* MESSAGE_LIST_SORT_KEYS_H */
@@ -0,0 +1,212 @@
+/*
+ * message-list-tree-diff.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Applies a new thread tree to the existing tree of the message list,
+ * changing only the nodes which changed, thus a few added or removed
+ * messages do not regenerate the whole tree.  The nodes are inserted
+ * and removed by the caller, which keeps its tree model notified. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include "message-list-tree-diff.h"
+
+#define t(x)
+
+/* compares a thread tree node with the etable tree node to see if they point to
+ * the same object */
+static gint
+node_equal (GNode *ap,
+            CamelFolderThreadNode *bp)
+{
+	if (bp->message && strcmp (camel_message_info_get_uid (ap->data), camel_message_info_get_uid (bp->message)) == 0)
+		return 1;
+
+	return 0;
+}
+
+static void	build_subtree_diff		(MessageListTreeDiff *diff,
+						 GNode *parent,
+						 GNode *node,
+						 CamelFolderThreadNode *c);
+
+/* adds a single node before the sibling, or as the last child
+ * when the sibling is NULL, and handles adding children if required */
+static void
+add_node_diff (MessageListTreeDiff *diff,
+               GNode *parent,
+               GNode *sibling,
+               CamelFolderThreadNode *c)
+{
+	CamelMessageInfo *info;
+	GNode *new_node;
+
+	g_return_if_fail (c->message != NULL);
+
+	/* XXX Casting away constness. */
+	info = (CamelMessageInfo *) c->message;
+
+	/* The old node, if any, is removed later in the diff. */
+	if (g_hash_table_contains (diff->uid_nodemap, camel_message_info_get_uid (info)))
+		diff->n_moved++;
+	else
+		diff->n_added++;
+
+	new_node = diff->insert_node (info, parent, sibling, diff->user_data);
+
+	if (c->child) {
+		build_subtree_diff (
+			diff, new_node, NULL, c->child);
+	}
+}
+
+/* removes node, children recursively and all associated data */
+static void
+remove_node_diff (MessageListTreeDiff *diff,
+                  GNode *node,
+                  gint depth)
+{
+	GNode *cp, *cn;
+
+	t (printf ("Removing node: %s\n", (gchar *) node->data));
+
+	/* we depth-first remove all node data's ... */
+	cp = g_node_first_child (node);
+	while (cp) {
+		cn = g_node_next_sibling (cp);
+		remove_node_diff (diff, cp, depth + 1);
+		cp = cn;
+	}
+
+	/* and the rowid entry - if and only if it is referencing this node,
+	 * and only at the toplevel, remove the node (etree should optimise
+	 * this remove somewhat) */
+	g_return_if_fail (node->data != NULL);
+	diff->remove_node (node, depth == 0, diff->user_data);
+	diff->n_removed++;
+}
+
+/* applies a new tree structure to an existing tree, but only by changing things
+ * that have changed */
+static void
+build_subtree_diff (MessageListTreeDiff *diff,
+                    GNode *parent,
+                    GNode *node,
+                    CamelFolderThreadNode *c)
+{
+	GNode *ap, *ai, *at, *tmp;
+	CamelFolderThreadNode *bp, *bi, *bt;
+	gint i, j;
+
+	ap = node;
+	bp = c;
+
+	while (ap || bp) {
+		if (bp != NULL && bp->message == NULL) {
+			/* phantom nodes no longer allowed */
+			g_warning ("bp->message shouldn't be NULL\n");
+			bp = bp->next;
+		} else if (ap == NULL) {
+			t (printf ("out of old nodes\n"));
+			/* ran out of old nodes - remaining nodes are added */
+			add_node_diff (diff, parent, NULL, bp);
+			bp = bp->next;
+		} else if (bp == NULL) {
+			t (printf ("out of new nodes\n"));
+			/* ran out of new nodes - remaining nodes are removed */
+			tmp = g_node_next_sibling (ap);
+			remove_node_diff (diff, ap, 0);
+			ap = tmp;
+		} else if (node_equal (ap, bp)) {
+			tmp = g_node_first_child (ap);
+			/* make child lists match (if either has one) */
+			if (bp->child || tmp) {
+				build_subtree_diff (diff, ap, tmp, bp->child);
+			}
+			ap = g_node_next_sibling (ap);
+			bp = bp->next;
+		} else {
+			t (printf ("searching for matches\n"));
+			/* we have to scan each side for a match */
+			bi = bp->next;
+			ai = g_node_next_sibling (ap);
+			for (i = 1; bi != NULL; i++,bi = bi->next) {
+				if (node_equal (ap, bi))
+					break;
+			}
+			for (j = 1; ai != NULL; j++,ai = g_node_next_sibling (ai)) {
+				if (node_equal (ai, bp))
+					break;
+			}
+			if (i < j) {
+				/* smaller run of new nodes - must be nodes to add */
+				if (bi) {
+					bt = bp;
+					while (bt != bi) {
+						t (printf ("adding new node 0\n"));
+						if (bt->message)
+							add_node_diff (diff, parent, ap, bt);
+						bt = bt->next;
+					}
+					bp = bi;
+				} else {
+					t (printf ("adding new node 1\n"));
+					/* no match in new nodes, add one, try next */
+					add_node_diff (diff, parent, ap, bp);
+					bp = bp->next;
+				}
+			} else {
+				/* bigger run of old nodes - must be nodes to remove */
+				if (ai) {
+					at = ap;
+					while (at != NULL && at != ai) {
+						t (printf ("removing old node 0\n"));
+						tmp = g_node_next_sibling (at);
+						remove_node_diff (diff, at, 0);
+						at = tmp;
+					}
+					ap = ai;
+				} else {
+					t (printf ("adding new node 2\n"));
+					/* didn't find match in old nodes, must be new node? */
+					add_node_diff (diff, parent, ap, bp);
+					bp = bp->next;
+				}
+			}
+		}
+	}
+}
+
+/* Makes the children of @parent, starting with its child @node, match
+ * the thread nodes @c and their siblings, recursively.  Only the changed
+ * nodes are inserted or removed, through the functions of @diff, which
+ * also counts them. */
+void
+message_list_tree_diff_apply (MessageListTreeDiff *diff,
+                              GNode *parent,
+                              GNode *node,
+                              CamelFolderThreadNode *c)
+{
+	g_return_if_fail (diff != NULL);
+	g_return_if_fail (diff->uid_nodemap != NULL);
+	g_return_if_fail (diff->insert_node != NULL);
+	g_return_if_fail (diff->remove_node != NULL);
+	g_return_if_fail (parent != NULL);
+
+	build_subtree_diff (diff, parent, node, c);
+}
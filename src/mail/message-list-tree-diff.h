@@ -0,0 +1,62 @@
+/*
+ * message-list-tree-diff.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Private to the message list, not installed. */
+
+#ifndef MESSAGE_LIST_TREE_DIFF_H
+#define MESSAGE_LIST_TREE_DIFF_H
+
+#include <camel/camel.h>
+
+G_BEGIN_DECLS
+
+/* Inserts a node for @info before @sibling, or as the last child
+ * of @parent when @sibling is NULL, and maps its UID to it. */
+typedef GNode *	(*MessageListTreeDiffInsertFunc)
+						(CamelMessageInfo *info,
+						 GNode *parent,
+						 GNode *sibling,
+						 gpointer user_data);
+
+/* Called for each node of a removed subtree, children first; drops
+ * the UID mapping, if it still references the @node.  The @toplevel
+ * node is also to be removed from the tree, with its children. */
+typedef void	(*MessageListTreeDiffRemoveFunc)
+						(GNode *node,
+						 gboolean toplevel,
+						 gpointer user_data);
+
+typedef struct _MessageListTreeDiff {
+	GHashTable *uid_nodemap;	/* UID ~> GNode *, of the tree */
+	MessageListTreeDiffInsertFunc insert_node;
+	MessageListTreeDiffRemoveFunc remove_node;
+	gpointer user_data;
+
+	/* Counted by message_list_tree_diff_apply() */
+	guint n_added;
+	guint n_removed;
+	guint n_moved;	/* added nodes whose UID was already in the tree */
+} MessageListTreeDiff;
+
+void		message_list_tree_diff_apply	(MessageListTreeDiff *diff,
+						 GNode *parent,
+						 GNode *node,
+						 CamelFolderThreadNode *c);
+
+G_END_DECLS
+
+#endif /* MESSAGE_LIST_TREE_DIFF_H */
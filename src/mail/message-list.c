@@ -58,6 +58,8 @@
 #endif
 
 #include "message-list.h"
+#include "message-list-sort-keys.h"
+#include "message-list-tree-diff.h"
 
 #define d(x)
 #define t(x)
@@ -70,6 +72,10 @@
 #define EXCLUDE_DELETED_MESSAGES_EXPR	"(not (system-flag \"deleted\"))"
 #define EXCLUDE_JUNK_MESSAGES_EXPR	"(not (system-flag \"junk\"))"
 
+/* Folder changes up to this count are applied to the existing
+ * message tree, rather than rebuilding it from scratch. */
+#define MAX_TREE_DIFF_CHANGES 1000
+
 typedef struct _ExtendedGNode ExtendedGNode;
 typedef struct _RegenData RegenData;
 
@@ -93,6 +99,9 @@ struct _MessageListPrivate {
 
 	gboolean thaw_needs_regen;
 
+	/* Guarded by regen_lock. */
+	guint n_pending_folder_changes;
+
 	GMutex thread_tree_lock;
 	CamelFolderThread *thread_tree;
 
@@ -123,9 +132,10 @@ struct _MessageListPrivate {
 	const gchar *oldest_unread_uid;
 
 	GSettings *mail_settings;
-	gchar **re_prefixes;
-	gchar **re_separators;
-	GMutex re_prefixes_lock;
+	/* Read lock-free by the regen thread, thus the replaced
+	 * matchers are kept in re_matchers_retired until finalize. */
+	EMUtilsReMatcher *re_matcher; /* atomic */
+	GSList *re_matchers_retired;
 
 	GdkRGBA *new_mail_bg_color;
 };
@@ -155,6 +165,11 @@ struct _RegenData {
 	 * we received a "folder-changed" signal from our CamelFolder. */
 	gboolean folder_changed;
 
+	/* Number of UIDs added, removed or changed by the "folder-changed"
+	 * signals which requested this regen.  Small numbers let us update
+	 * the existing message tree instead of rebuilding it. */
+	guint n_folder_changes;
+
 	CamelFolder *folder;
 	GPtrArray *summary;
 
@@ -436,27 +451,6 @@ extended_g_node_insert_before (GNode *parent,
 	return node;
 }
 
-static GNode *
-extended_g_node_insert (GNode *parent,
-                        gint position,
-                        GNode *node)
-{
-	GNode *sibling;
-
-	g_return_val_if_fail (parent != NULL, node);
-	g_return_val_if_fail (node != NULL, node);
-	g_return_val_if_fail (G_NODE_IS_ROOT (node), node);
-
-	if (position > 0)
-		sibling = g_node_nth_child (parent, position);
-	else if (position == 0)
-		sibling = parent->children;
-	else /* if (position < 0) */
-		sibling = NULL;
-
-	return extended_g_node_insert_before (parent, sibling, node);
-}
-
 static RegenData *
 regen_data_new (MessageList *message_list,
                 GCancellable *cancellable)
@@ -618,7 +612,7 @@ message_list_tree_model_thaw (MessageList *message_list)
 static GNode *
 message_list_tree_model_insert (MessageList *message_list,
                                 GNode *parent,
-                                gint position,
+                                GNode *sibling,
                                 gpointer data)
 {
 	ETreeModel *tree_model;
@@ -638,7 +632,7 @@ message_list_tree_model_insert (MessageList *message_list,
 	node = extended_g_node_new (data);
 
 	if (parent != NULL) {
-		extended_g_node_insert (parent, position, node);
+		extended_g_node_insert_before (parent, sibling, node);
 		if (!tree_model_frozen)
 			e_tree_model_node_inserted (tree_model, parent, node);
 	} else {
@@ -741,6 +735,34 @@ get_message_info (MessageList *message_list,
 	return node->data;
 }
 
+static const EMUtilsReMatcher *
+message_list_get_re_matcher (MessageList *message_list)
+{
+	return g_atomic_pointer_get (&message_list->priv->re_matcher);
+}
+
+/* Called in the main thread only. */
+static void
+message_list_update_re_matcher (MessageList *message_list)
+{
+	EMUtilsReMatcher *matcher, *old_matcher;
+
+	matcher = em_utils_re_matcher_new_from_settings (message_list->priv->mail_settings);
+	old_matcher = g_atomic_pointer_get (&message_list->priv->re_matcher);
+
+	if (old_matcher && em_utils_re_matcher_equal (old_matcher, matcher)) {
+		em_utils_re_matcher_unref (matcher);
+		return;
+	}
+
+	g_atomic_pointer_set (&message_list->priv->re_matcher, matcher);
+
+	if (old_matcher) {
+		message_list->priv->re_matchers_retired = g_slist_prepend (
+			message_list->priv->re_matchers_retired, old_matcher);
+	}
+}
+
 static const gchar *
 get_normalised_string (MessageList *message_list,
                        CamelMessageInfo *info,
@@ -785,31 +807,7 @@ get_normalised_string (MessageList *message_list,
 	}
 
 	if (col == COL_SUBJECT_NORM) {
-		gint skip_len;
-		const gchar *subject;
-		gboolean found_re = TRUE;
-
-		subject = string;
-		while (found_re) {
-			g_mutex_lock (&message_list->priv->re_prefixes_lock);
-			found_re = em_utils_is_re_in_subject (
-				subject, &skip_len, (const gchar * const *) message_list->priv->re_prefixes,
-				(const gchar * const *) message_list->priv->re_separators) && skip_len > 0;
-			g_mutex_unlock (&message_list->priv->re_prefixes_lock);
-
-			if (found_re)
-				subject += skip_len;
-
-			/* jump over any spaces */
-			while (*subject && isspace ((gint) *subject))
-				subject++;
-		}
-
-		/* jump over any spaces */
-		while (*subject && isspace ((gint) *subject))
-			subject++;
-
-		string = subject;
+		string = em_utils_re_matcher_skip (message_list_get_re_matcher (message_list), string, NULL, 0);
 		normalised = g_utf8_collate_key (string, -1);
 	} else {
 		/* because addresses require strings, not collate keys */
@@ -1157,6 +1155,36 @@ message_list_can_select (MessageList *message_list,
 	return ml_search_path (message_list, direction, flags, mask) != NULL;
 }
 
+/**
+ * message_list_dup_selectable_uid:
+ * @message_list: a MessageList
+ * @direction: the direction to search in
+ * @flags: a set of flag values
+ * @mask: a mask for comparing against @flags
+ *
+ * Finds the message message_list_select() would select with the same
+ * arguments, without changing the selection.
+ *
+ * Returns: (transfer full) (nullable): UID of the found message, or %NULL
+ *    when there is none; free it with g_free(), when no longer needed
+ **/
+gchar *
+message_list_dup_selectable_uid (MessageList *message_list,
+                                 MessageListSelectDirection direction,
+                                 guint32 flags,
+                                 guint32 mask)
+{
+	GNode *node;
+
+	g_return_val_if_fail (IS_MESSAGE_LIST (message_list), NULL);
+
+	node = ml_search_path (message_list, direction, flags, mask);
+	if (node == NULL)
+		return NULL;
+
+	return g_strdup (get_message_uid (message_list, node));
+}
+
 /**
  * message_list_select_uid:
  * @message_list:
@@ -1704,7 +1732,6 @@ get_trimmed_subject (CamelMessageInfo *info,
 	const gchar *subject;
 	const gchar *mlist;
 	gint mlist_len = 0;
-	gboolean found_mlist;
 
 	subject = camel_message_info_get_subject (info);
 	if (!subject || !*subject)
@@ -1722,46 +1749,7 @@ get_trimmed_subject (CamelMessageInfo *info,
 			mlist_len = strlen (mlist);
 	}
 
-	do {
-		gint skip_len;
-		gboolean found_re = TRUE;
-
-		found_mlist = FALSE;
-
-		while (found_re) {
-			found_re = FALSE;
-
-			g_mutex_lock (&message_list->priv->re_prefixes_lock);
-			found_re = em_utils_is_re_in_subject (
-				subject, &skip_len, (const gchar * const *) message_list->priv->re_prefixes,
-				(const gchar * const *) message_list->priv->re_separators) && skip_len > 0;
-			g_mutex_unlock (&message_list->priv->re_prefixes_lock);
-			if (found_re)
-				subject += skip_len;
-
-			/* jump over any spaces */
-			while (*subject && isspace ((gint) *subject))
-				subject++;
-		}
-
-		if (mlist_len &&
-		    *subject == '[' &&
-				!g_ascii_strncasecmp ((gchar *) subject + 1, mlist, mlist_len) &&
-				subject[1 + mlist_len] == ']') {
-			subject += 1 + mlist_len + 1;  /* jump over "[mailing-list]" */
-			found_mlist = TRUE;
-
-			/* jump over any spaces */
-			while (*subject && isspace ((gint) *subject))
-				subject++;
-		}
-	} while (found_mlist);
-
-	/* jump over any spaces */
-	while (*subject && isspace ((gint) *subject))
-		subject++;
-
-	return subject;
+	return em_utils_re_matcher_skip (message_list_get_re_matcher (message_list), subject, mlist, mlist_len);
 }
 
 static gpointer
@@ -2573,6 +2561,7 @@ static void
 ml_drop_action (struct _drop_msg *m)
 {
 	m->move = m->action == GDK_ACTION_MOVE;
+	m->base.priority = MAIL_MSG_PRIORITY_INTERACTIVE;
 	mail_msg_unordered_push (m);
 }
 
@@ -3015,12 +3004,12 @@ message_list_finalize (GObject *object)
 	g_free (message_list->search);
 	g_free (message_list->frozen_search);
 	g_free (message_list->cursor_uid);
-	g_strfreev (message_list->priv->re_prefixes);
-	g_strfreev (message_list->priv->re_separators);
+	g_slist_free_full (message_list->priv->re_matchers_retired, (GDestroyNotify) em_utils_re_matcher_unref);
+	if (message_list->priv->re_matcher)
+		em_utils_re_matcher_unref (message_list->priv->re_matcher);
 
 	g_mutex_clear (&message_list->priv->regen_lock);
 	g_mutex_clear (&message_list->priv->thread_tree_lock);
-	g_mutex_clear (&message_list->priv->re_prefixes_lock);
 
 	clear_selection (message_list, &message_list->priv->clipboard);
 
@@ -3699,7 +3688,6 @@ message_list_init (MessageList *message_list)
 
 	g_mutex_init (&message_list->priv->regen_lock);
 	g_mutex_init (&message_list->priv->thread_tree_lock);
-	g_mutex_init (&message_list->priv->re_prefixes_lock);
 
 	/* TODO: Should this only get the selection if we're realised? */
 	p = message_list->priv;
@@ -3731,8 +3719,8 @@ message_list_init (MessageList *message_list)
 	message_list->priv->paste_target_list = target_list;
 
 	message_list->priv->mail_settings = e_util_ref_settings ("org.gnome.evolution.mail");
-	message_list->priv->re_prefixes = NULL;
-	message_list->priv->re_separators = NULL;
+	message_list->priv->re_matcher = em_utils_re_matcher_new_from_settings (message_list->priv->mail_settings);
+	message_list->priv->re_matchers_retired = NULL;
 	message_list->priv->group_by_threads = TRUE;
 	message_list->priv->new_mail_bg_color = NULL;
 }
@@ -3917,7 +3905,7 @@ clear_tree (MessageList *message_list,
 	e_tree_table_adapter_clear_nodes_silent (e_tree_get_table_adapter (E_TREE (message_list)));
 
 	/* Create a new placeholder root node. */
-	message_list_tree_model_insert (message_list, NULL, 0, NULL);
+	message_list_tree_model_insert (message_list, NULL, NULL, NULL);
 	g_warn_if_fail (message_list->priv->tree_model_root != NULL);
 
 	/* Also reset cursor node, it had been just erased */
@@ -4175,7 +4163,7 @@ static GNode *
 ml_uid_nodemap_insert (MessageList *message_list,
                        CamelMessageInfo *info,
                        GNode *parent,
-                       gint row)
+                       GNode *sibling)
 {
 	CamelFolder *folder;
 	GNode *node;
@@ -4190,14 +4178,18 @@ ml_uid_nodemap_insert (MessageList *message_list,
 		parent = message_list->priv->tree_model_root;
 
 	node = message_list_tree_model_insert (
-		message_list, parent, row, info);
+		message_list, parent, sibling, info);
 
 	uid = camel_message_info_get_uid (info);
 	flags = camel_message_info_get_flags (info);
 	date = camel_message_info_get_date_received (info);
 
 	g_object_ref (info);
-	g_hash_table_insert (message_list->uid_nodemap, (gpointer) uid, node);
+
+	/* Replace, not insert, so that the key is always owned by the
+	 * info of the node it maps to.  A tree diff can map a UID to a
+	 * new node before the old one gets removed. */
+	g_hash_table_replace (message_list->uid_nodemap, (gpointer) uid, node);
 
 	/* Track the latest seen and unseen messages shown, used in
 	 * fallback heuristics for automatic message selection. */
@@ -4223,14 +4215,16 @@ ml_uid_nodemap_insert (MessageList *message_list,
 
 static void
 ml_uid_nodemap_remove (MessageList *message_list,
-                       CamelMessageInfo *info)
+                       GNode *node)
 {
 	CamelFolder *folder;
+	CamelMessageInfo *info;
 	const gchar *uid;
 
 	folder = message_list_ref_folder (message_list);
 	g_return_if_fail (folder != NULL);
 
+	info = node->data;
 	uid = camel_message_info_get_uid (info);
 
 	if (uid == message_list->priv->newest_read_uid) {
@@ -4243,7 +4237,11 @@ ml_uid_nodemap_remove (MessageList *message_list,
 		message_list->priv->oldest_unread_uid = NULL;
 	}
 
-	g_hash_table_remove (message_list->uid_nodemap, uid);
+	/* Drop the mapping only if it still references this node;
+	 * the message may have been moved elsewhere in the tree. */
+	if (g_hash_table_lookup (message_list->uid_nodemap, uid) == node)
+		g_hash_table_remove (message_list->uid_nodemap, uid);
+
 	g_clear_object (&info);
 
 	g_object_unref (folder);
@@ -4254,22 +4252,42 @@ ml_uid_nodemap_remove (MessageList *message_list,
 
 static void	build_subtree			(MessageList *message_list,
 						 GNode *parent,
-						 CamelFolderThreadNode *c,
-						 gint *row);
+						 CamelFolderThreadNode *c);
 
-static void	build_subtree_diff		(MessageList *message_list,
-						 GNode *parent,
-						 GNode *node,
-						 CamelFolderThreadNode *c,
-						 gint *row);
+static GNode *
+ml_tree_diff_insert_node_cb (CamelMessageInfo *info,
+                             GNode *parent,
+                             GNode *sibling,
+                             gpointer user_data)
+{
+	return ml_uid_nodemap_insert (user_data, info, parent, sibling);
+}
 
 static void
+ml_tree_diff_remove_node_cb (GNode *node,
+                             gboolean toplevel,
+                             gpointer user_data)
+{
+	MessageList *message_list = user_data;
+
+	ml_uid_nodemap_remove (message_list, node);
+
+	if (toplevel)
+		message_list_tree_model_remove (message_list, node);
+}
+
+/* Returns whether the existing tree nodes were updated in place,
+ * with no node being re-parented, thus the expanded state of the
+ * ETreeTableAdapter is still valid and doesn't need to be reloaded. */
+static gboolean
 build_tree (MessageList *message_list,
             CamelFolderThread *thread,
-            gboolean folder_changed)
+            gboolean folder_changed,
+            guint n_folder_changes)
 {
-	gint row = 0;
 	ETableItem *table_item = e_tree_get_item (E_TREE (message_list));
+	gboolean update_in_place;
+	guint n_nodes;
 #ifdef TIMEIT
 	struct timeval start, end;
 	gulong diff;
@@ -4278,31 +4296,62 @@ build_tree (MessageList *message_list,
 	gettimeofday (&start, NULL);
 #endif
 
-#ifdef TIMEIT
-	gettimeofday (&end, NULL);
-	diff = end.tv_sec * 1000 + end.tv_usec / 1000;
-	diff -= start.tv_sec * 1000 + start.tv_usec / 1000;
-	printf ("Loading tree state took %ld.%03ld seconds\n", diff / 1000, diff % 1000);
-#endif
-
 	if (message_list->priv->tree_model_root == NULL) {
-		message_list_tree_model_insert (message_list, NULL, 0, NULL);
+		message_list_tree_model_insert (message_list, NULL, NULL, NULL);
 		g_warn_if_fail (message_list->priv->tree_model_root != NULL);
 	}
 
+	n_nodes = g_hash_table_size (message_list->uid_nodemap);
+
+	/* A handful of added or removed messages is cheaper to apply to
+	 * the existing tree than to rebuild it, mainly because the tree
+	 * table adapter then doesn't need to regenerate all its nodes. */
+	update_in_place =
+		folder_changed && thread != NULL && n_nodes > 0 &&
+		n_folder_changes <= MAX_TREE_DIFF_CHANGES &&
+		n_folder_changes <= n_nodes / 2;
+
 	if (table_item)
 		e_table_item_freeze (table_item);
 
-	message_list_tree_model_freeze (message_list);
+	if (update_in_place) {
+		ETreeTableAdapter *adapter;
+		MessageListTreeDiff tree_diff;
 
-	clear_tree (message_list, FALSE);
+		adapter = e_tree_get_table_adapter (E_TREE (message_list));
 
-	build_subtree (
-		message_list,
-		message_list->priv->tree_model_root,
-		thread ? thread->tree : NULL, &row);
+		/* The tree model is not frozen here, each added and removed
+		 * node is notified on its own and the adapter collects them
+		 * into a single update. */
+		e_tree_table_adapter_begin_update (adapter);
 
-	message_list_tree_model_thaw (message_list);
+		memset (&tree_diff, 0, sizeof (MessageListTreeDiff));
+		tree_diff.uid_nodemap = message_list->uid_nodemap;
+		tree_diff.insert_node = ml_tree_diff_insert_node_cb;
+		tree_diff.remove_node = ml_tree_diff_remove_node_cb;
+		tree_diff.user_data = message_list;
+
+		message_list_tree_diff_apply (
+			&tree_diff,
+			message_list->priv->tree_model_root,
+			g_node_first_child (message_list->priv->tree_model_root),
+			thread->tree);
+
+		e_tree_table_adapter_end_update (adapter);
+
+		update_in_place = tree_diff.n_moved == 0;
+	} else {
+		message_list_tree_model_freeze (message_list);
+
+		clear_tree (message_list, FALSE);
+
+		build_subtree (
+			message_list,
+			message_list->priv->tree_model_root,
+			thread ? thread->tree : NULL);
+
+		message_list_tree_model_thaw (message_list);
+	}
 
 	if (table_item) {
 		/* Show the cursor unless we're responding to a
@@ -4318,17 +4367,18 @@ build_tree (MessageList *message_list,
 	diff -= start.tv_sec * 1000 + start.tv_usec / 1000;
 	printf ("Building tree took %ld.%03ld seconds\n", diff / 1000, diff % 1000);
 #endif
+
+	return update_in_place;
 }
 
-/* this is about 20% faster than build_subtree_diff,
+/* this is about 20% faster than message_list_tree_diff_apply(),
  * entirely because e_tree_model_node_insert (xx, -1 xx)
  * is faster than inserting to the right row :( */
 /* Otherwise, this code would probably go as it does the same thing essentially */
 static void
 build_subtree (MessageList *message_list,
                GNode *parent,
-               CamelFolderThreadNode *c,
-               gint *row)
+               CamelFolderThreadNode *c)
 {
 	GNode *node;
 
@@ -4342,188 +4392,15 @@ build_subtree (MessageList *message_list,
 
 		node = ml_uid_nodemap_insert (
 			message_list,
-			(CamelMessageInfo *) c->message, parent, -1);
+			(CamelMessageInfo *) c->message, parent, NULL);
 
 		if (c->child) {
-			build_subtree (message_list, node, c->child, row);
+			build_subtree (message_list, node, c->child);
 		}
 		c = c->next;
 	}
 }
 
-/* compares a thread tree node with the etable tree node to see if they point to
- * the same object */
-static gint
-node_equal (ETreeModel *etm,
-            GNode *ap,
-            CamelFolderThreadNode *bp)
-{
-	if (bp->message && strcmp (camel_message_info_get_uid (ap->data), camel_message_info_get_uid (bp->message)) == 0)
-		return 1;
-
-	return 0;
-}
-
-/* adds a single node, retains save state, and handles adding children if required */
-static void
-add_node_diff (MessageList *message_list,
-               GNode *parent,
-               GNode *node,
-               CamelFolderThreadNode *c,
-               gint *row,
-               gint myrow)
-{
-	CamelMessageInfo *info;
-	GNode *new_node;
-
-	g_return_if_fail (c->message != NULL);
-
-	/* XXX Casting away constness. */
-	info = (CamelMessageInfo *) c->message;
-
-	/* we just update the hashtable key */
-	ml_uid_nodemap_remove (message_list, info);
-	new_node = ml_uid_nodemap_insert (message_list, info, parent, myrow);
-	(*row)++;
-
-	if (c->child) {
-		build_subtree_diff (
-			message_list, new_node, NULL, c->child, row);
-	}
-}
-
-/* removes node, children recursively and all associated data */
-static void
-remove_node_diff (MessageList *message_list,
-                  GNode *node,
-                  gint depth)
-{
-	ETreePath cp, cn;
-	CamelMessageInfo *info;
-
-	t (printf ("Removing node: %s\n", (gchar *) node->data));
-
-	/* we depth-first remove all node data's ... */
-	cp = g_node_first_child (node);
-	while (cp) {
-		cn = g_node_next_sibling (cp);
-		remove_node_diff (message_list, cp, depth + 1);
-		cp = cn;
-	}
-
-	/* and the rowid entry - if and only if it is referencing this node */
-	info = node->data;
-
-	/* and only at the toplevel, remove the node (etree should optimise this remove somewhat) */
-	if (depth == 0)
-		message_list_tree_model_remove (message_list, node);
-
-	g_return_if_fail (info);
-	ml_uid_nodemap_remove (message_list, info);
-}
-
-/* applies a new tree structure to an existing tree, but only by changing things
- * that have changed */
-static void
-build_subtree_diff (MessageList *message_list,
-                    GNode *parent,
-                    GNode *node,
-                    CamelFolderThreadNode *c,
-                    gint *row)
-{
-	ETreeModel *tree_model;
-	GNode *ap, *ai, *at, *tmp;
-	CamelFolderThreadNode *bp, *bi, *bt;
-	gint i, j, myrow = 0;
-
-	tree_model = E_TREE_MODEL (message_list);
-
-	ap = node;
-	bp = c;
-
-	while (ap || bp) {
-		t (printf ("Processing row: %d (subtree row %d)\n", *row, myrow));
-		if (ap == NULL) {
-			t (printf ("out of old nodes\n"));
-			/* ran out of old nodes - remaining nodes are added */
-			add_node_diff (
-				message_list, parent, ap, bp, row, myrow);
-			myrow++;
-			bp = bp->next;
-		} else if (bp == NULL) {
-			t (printf ("out of new nodes\n"));
-			/* ran out of new nodes - remaining nodes are removed */
-			tmp = g_node_next_sibling (ap);
-			remove_node_diff (message_list, ap, 0);
-			ap = tmp;
-		} else if (node_equal (tree_model, ap, bp)) {
-			*row = (*row)+1;
-			myrow++;
-			tmp = g_node_first_child (ap);
-			/* make child lists match (if either has one) */
-			if (bp->child || tmp) {
-				build_subtree_diff (
-					message_list, ap, tmp, bp->child, row);
-			}
-			ap = g_node_next_sibling (ap);
-			bp = bp->next;
-		} else {
-			t (printf ("searching for matches\n"));
-			/* we have to scan each side for a match */
-			bi = bp->next;
-			ai = g_node_next_sibling (ap);
-			for (i = 1; bi != NULL; i++,bi = bi->next) {
-				if (node_equal (tree_model, ap, bi))
-					break;
-			}
-			for (j = 1; ai != NULL; j++,ai = g_node_next_sibling (ai)) {
-				if (node_equal (tree_model, ai, bp))
-					break;
-			}
-			if (i < j) {
-				/* smaller run of new nodes - must be nodes to add */
-				if (bi) {
-					bt = bp;
-					while (bt != bi) {
-						t (printf ("adding new node 0\n"));
-						add_node_diff (
-							message_list, parent, NULL, bt, row, myrow);
-						myrow++;
-						bt = bt->next;
-					}
-					bp = bi;
-				} else {
-					t (printf ("adding new node 1\n"));
-					/* no match in new nodes, add one, try next */
-					add_node_diff (
-						message_list, parent, NULL, bp, row, myrow);
-					myrow++;
-					bp = bp->next;
-				}
-			} else {
-				/* bigger run of old nodes - must be nodes to remove */
-				if (ai) {
-					at = ap;
-					while (at != NULL && at != ai) {
-						t (printf ("removing old node 0\n"));
-						tmp = g_node_next_sibling (at);
-						remove_node_diff (message_list, at, 0);
-						at = tmp;
-					}
-					ap = ai;
-				} else {
-					t (printf ("adding new node 2\n"));
-					/* didn't find match in old nodes, must be new node? */
-					add_node_diff (
-						message_list, parent, NULL, bp, row, myrow);
-					myrow++;
-					bp = bp->next;
-				}
-			}
-		}
-	}
-}
-
 static void
 build_flat (MessageList *message_list,
             GPtrArray *summary,
@@ -4552,7 +4429,7 @@ build_flat (MessageList *message_list,
 	for (i = 0; i < summary->len; i++) {
 		CamelMessageInfo *info = summary->pdata[i];
 
-		ml_uid_nodemap_insert (message_list, info, NULL, -1);
+		ml_uid_nodemap_insert (message_list, info, NULL, NULL);
 	}
 
 	message_list_tree_model_thaw (message_list);
@@ -4730,6 +4607,21 @@ message_list_folder_changed (CamelFolder *folder,
 	}
 
 	if (need_list_regen) {
+		guint n_changes = G_MAXUINT;
+
+		if (altered_changes != NULL)
+			n_changes =
+				altered_changes->uid_added->len +
+				altered_changes->uid_removed->len +
+				altered_changes->uid_changed->len;
+
+		g_mutex_lock (&message_list->priv->regen_lock);
+		if (n_changes > G_MAXUINT - message_list->priv->n_pending_folder_changes)
+			message_list->priv->n_pending_folder_changes = G_MAXUINT;
+		else
+			message_list->priv->n_pending_folder_changes += n_changes;
+		g_mutex_unlock (&message_list->priv->regen_lock);
+
 		/* Use 'folder_changed = TRUE' only if this is not the first change after the folder
 		   had been set. There could happen a race condition on folder enter which prevented
 		   the message list to scroll to the cursor position due to the folder_changed = TRUE,
@@ -5529,119 +5421,62 @@ message_list_set_search (MessageList *message_list,
 	}
 }
 
-struct sort_column_data {
-	ETableCol *col;
-	GtkSortType sort_type;
-};
-
-struct sort_message_info_data {
-	CamelMessageInfo *mi;
-	GPtrArray *values; /* read values so far, in order of sort_array_data::sort_columns */
-};
-
-struct sort_array_data {
-	MessageList *message_list;
+/* Breaks ties of the sort keys by the UIDs of the messages. */
+typedef struct _SortUidsData {
 	CamelFolder *folder;
-	GPtrArray *sort_columns; /* struct sort_column_data in order of sorting */
-	GHashTable *message_infos; /* uid -> struct sort_message_info_data */
-	gpointer cmp_cache;
-	GCancellable *cancellable;
-};
+	GPtrArray *uids;	/* index ~> uid, of the sort keys */
+} SortUidsData;
 
 static gint
-cmp_array_uids (gconstpointer a,
-                gconstpointer b,
-                gpointer user_data)
+ml_sort_uids_tie_cb (guint index1,
+                     guint index2,
+                     gpointer user_data)
 {
-	const gchar *uid1 = *(const gchar **) a;
-	const gchar *uid2 = *(const gchar **) b;
-	struct sort_array_data *sort_data = user_data;
-	gint i, res = 0;
-	struct sort_message_info_data *md1, *md2;
-
-	g_return_val_if_fail (sort_data != NULL, 0);
-
-	md1 = g_hash_table_lookup (sort_data->message_infos, uid1);
-	md2 = g_hash_table_lookup (sort_data->message_infos, uid2);
-
-	g_return_val_if_fail (md1 != NULL, 0);
-	g_return_val_if_fail (md1->mi != NULL, 0);
-	g_return_val_if_fail (md2 != NULL, 0);
-	g_return_val_if_fail (md2->mi != NULL, 0);
-
-	if (g_cancellable_is_cancelled (sort_data->cancellable))
-		return 0;
-
-	for (i = 0;
-	     res == 0
-	     && i < sort_data->sort_columns->len
-	     && !g_cancellable_is_cancelled (sort_data->cancellable);
-	     i++) {
-		gpointer v1, v2;
-		struct sort_column_data *scol = g_ptr_array_index (sort_data->sort_columns, i);
-
-		if (md1->values->len <= i) {
-			camel_message_info_property_lock (md1->mi);
-			v1 = ml_tree_value_at_ex (
-				NULL, NULL,
-				scol->col->spec->compare_col,
-				md1->mi, sort_data->message_list);
-			camel_message_info_property_unlock (md1->mi);
-			g_ptr_array_add (md1->values, v1);
-		} else {
-			v1 = g_ptr_array_index (md1->values, i);
-		}
-
-		if (md2->values->len <= i) {
-			camel_message_info_property_lock (md2->mi);
-			v2 = ml_tree_value_at_ex (
-				NULL, NULL,
-				scol->col->spec->compare_col,
-				md2->mi, sort_data->message_list);
-			camel_message_info_property_unlock (md2->mi);
-
-			g_ptr_array_add (md2->values, v2);
-		} else {
-			v2 = g_ptr_array_index (md2->values, i);
-		}
-
-		if (v1 != NULL && v2 != NULL) {
-			res = (*scol->col->compare) (v1, v2, sort_data->cmp_cache);
-		} else if (v1 != NULL || v2 != NULL) {
-			res = v1 == NULL ? -1 : 1;
-		}
+	SortUidsData *data = user_data;
 
-		if (scol->sort_type == GTK_SORT_DESCENDING)
-			res = res * (-1);
-	}
+	return camel_folder_cmp_uids (
+		data->folder,
+		g_ptr_array_index (data->uids, index1),
+		g_ptr_array_index (data->uids, index2));
+}
 
-	if (res == 0)
-		res = camel_folder_cmp_uids (sort_data->folder, uid1, uid2);
+static void
+ml_sort_uids_free_value_cb (gpointer column_data,
+                            gpointer value,
+                            gpointer user_data)
+{
+	ETableCol *col = column_data;
 
-	return res;
+	message_list_free_value ((ETreeModel *) user_data, col->spec->compare_col, value);
 }
 
+/* Takes the values of the sort columns of one message, at @index. */
 static void
-free_message_info_data (gpointer uid,
-                        struct sort_message_info_data *data,
-                        struct sort_array_data *sort_data)
+ml_sort_uids_snapshot_message (MessageList *message_list,
+                               MessageListSortKeys *sort_keys,
+                               ETableCol **cols,
+                               guint n_cols,
+                               guint index,
+                               CamelMessageInfo *mi)
 {
-	if (data->values) {
-		gint ii;
+	guint jj;
 
-		for (ii = 0; ii < sort_data->sort_columns->len && ii < data->values->len; ii++) {
-			struct sort_column_data *scol = g_ptr_array_index (sort_data->sort_columns, ii);
+	camel_message_info_property_lock (mi);
 
-			message_list_free_value ((ETreeModel *) sort_data->message_list,
-				scol->col->spec->compare_col,
-				g_ptr_array_index (data->values, ii));
-		}
+	for (jj = 0; jj < n_cols; jj++) {
+		gint compare_col = cols[jj]->spec->compare_col;
+		gpointer value;
 
-		g_ptr_array_free (data->values, TRUE);
+		value = ml_tree_value_at_ex (
+			NULL, NULL, compare_col, mi, message_list);
+
+		if (!message_list_sort_keys_set_value (sort_keys, jj, index, value))
+			message_list_free_value (
+				(ETreeModel *) message_list,
+				compare_col, value);
 	}
 
-	g_clear_object (&data->mi);
-	g_free (data);
+	camel_message_info_property_unlock (mi);
 }
 
 static void
@@ -5653,7 +5488,12 @@ ml_sort_uids_by_tree (MessageList *message_list,
 	ETableSortInfo *sort_info;
 	ETableHeader *full_header;
 	CamelFolder *folder;
-	struct sort_array_data sort_data;
+	MessageListSortKeys *sort_keys;
+	SortUidsData tie_data;
+	ETableCol **cols;
+	GPtrArray *valid_uids, *missing_uids;
+	gpointer cmp_cache;
+	guint *indexes;
 	guint i, len;
 
 	if (g_cancellable_is_cancelled (cancellable))
@@ -5678,32 +5518,31 @@ ml_sort_uids_by_tree (MessageList *message_list,
 
 	len = e_table_sort_info_sorting_get_count (sort_info);
 
-	sort_data.message_list = message_list;
-	sort_data.folder = folder;
-	sort_data.sort_columns = g_ptr_array_sized_new (len);
-	sort_data.message_infos = g_hash_table_new (g_str_hash, g_str_equal);
-	sort_data.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
-	sort_data.cancellable = cancellable;
+	cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	sort_keys = message_list_sort_keys_new (uids->len, len, cmp_cache);
+	cols = g_new0 (ETableCol *, len);
+	valid_uids = g_ptr_array_sized_new (uids->len);
+	missing_uids = g_ptr_array_new ();
 
-	for (i = 0;
-	     i < len
-	     && !g_cancellable_is_cancelled (cancellable);
-	     i++) {
+	for (i = 0; i < len; i++) {
 		ETableColumnSpecification *spec;
-		struct sort_column_data *data;
-
-		data = g_new0 (struct sort_column_data, 1);
+		GtkSortType sort_type = GTK_SORT_ASCENDING;
 
 		spec = e_table_sort_info_sorting_get_nth (
-			sort_info, i, &data->sort_type);
+			sort_info, i, &sort_type);
 
-		data->col = e_table_header_get_column_by_spec (full_header, spec);
-		if (data->col == NULL) {
+		cols[i] = e_table_header_get_column_by_spec (full_header, spec);
+		if (cols[i] == NULL) {
 			gint last = e_table_header_count (full_header) - 1;
-			data->col = e_table_header_get_column (full_header, last);
+			cols[i] = e_table_header_get_column (full_header, last);
 		}
 
-		g_ptr_array_add (sort_data.sort_columns, data);
+		message_list_sort_keys_set_column (
+			sort_keys, i,
+			cols[i]->spec->compare,
+			cols[i]->compare,
+			sort_type == GTK_SORT_DESCENDING,
+			cols[i]);
 	}
 
 	camel_folder_summary_prepare_fetch_all (camel_folder_get_folder_summary (folder), NULL);
@@ -5714,7 +5553,6 @@ ml_sort_uids_by_tree (MessageList *message_list,
 	     i++) {
 		gchar *uid;
 		CamelMessageInfo *mi;
-		struct sort_message_info_data *md;
 
 		uid = g_ptr_array_index (uids, i);
 		mi = camel_folder_get_message_info (folder, uid);
@@ -5723,37 +5561,45 @@ ml_sort_uids_by_tree (MessageList *message_list,
 				"%s: Cannot find uid '%s' in folder '%s'",
 				G_STRFUNC, uid,
 				camel_folder_get_full_name (folder));
+			g_ptr_array_add (missing_uids, uid);
 			continue;
 		}
 
-		md = g_new0 (struct sort_message_info_data, 1);
-		md->mi = mi;
-		md->values = g_ptr_array_sized_new (len);
+		ml_sort_uids_snapshot_message (
+			message_list, sort_keys, cols, len,
+			valid_uids->len, mi);
+		g_ptr_array_add (valid_uids, uid);
 
-		g_hash_table_insert (sort_data.message_infos, uid, md);
+		g_object_unref (mi);
 	}
 
-	if (!g_cancellable_is_cancelled (cancellable))
-		g_qsort_with_data (
-			uids->pdata,
-			uids->len,
-			sizeof (gpointer),
-			cmp_array_uids,
-			&sort_data);
-
 	camel_folder_summary_unlock (camel_folder_get_folder_summary (folder));
 
-	/* FIXME Teach the hash table to destroy its own data. */
-	g_hash_table_foreach (
-		sort_data.message_infos,
-		(GHFunc) free_message_info_data,
-		&sort_data);
-	g_hash_table_destroy (sort_data.message_infos);
+	if (!g_cancellable_is_cancelled (cancellable)) {
+		guint n_valid = valid_uids->len;
+
+		tie_data.folder = folder;
+		tie_data.uids = valid_uids;
 
-	g_ptr_array_foreach (sort_data.sort_columns, (GFunc) g_free, NULL);
-	g_ptr_array_free (sort_data.sort_columns, TRUE);
+		indexes = message_list_sort_keys_sort (
+			sort_keys, n_valid,
+			ml_sort_uids_tie_cb, &tie_data);
 
-	e_table_sorting_utils_free_cmp_cache (sort_data.cmp_cache);
+		for (i = 0; i < n_valid; i++)
+			uids->pdata[i] = g_ptr_array_index (valid_uids, indexes[i]);
+
+		/* UIDs without message info are left at the end. */
+		for (i = 0; i < missing_uids->len; i++)
+			uids->pdata[n_valid + i] = g_ptr_array_index (missing_uids, i);
+
+		g_free (indexes);
+	}
+
+	message_list_sort_keys_free (sort_keys, ml_sort_uids_free_value_cb, message_list);
+	e_table_sorting_utils_free_cmp_cache (cmp_cache);
+	g_ptr_array_free (valid_uids, TRUE);
+	g_ptr_array_free (missing_uids, TRUE);
+	g_free (cols);
 
 	g_object_unref (folder);
 }
@@ -5890,8 +5736,17 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 	if (expr->len == 0) {
 		uids = camel_folder_get_uids (folder);
 	} else {
+		gchar *indexed_expr;
+
+		/* Narrow body searches with the local index, if current. */
+		indexed_expr = mail_body_index_rewrite_expression (
+			folder, expr->str, cancellable);
+
 		uids = camel_folder_search_by_expression (
-			folder, expr->str, cancellable, &local_error);
+			folder, indexed_expr ? indexed_expr : expr->str,
+			cancellable, &local_error);
+
+		g_free (indexed_expr);
 
 		/* XXX This indicates we need to use a different
 		 *     "free UID" function for some dumb reason. */
@@ -6048,6 +5903,7 @@ message_list_regen_done_cb (GObject *source_object,
 		GPtrArray *selected;
 		gchar *saveuid = NULL;
 		gboolean forcing_expand_state;
+		gboolean expand_state_valid;
 
 		forcing_expand_state =
 			message_list->expand_all ||
@@ -6082,10 +5938,11 @@ message_list_regen_done_cb (GObject *source_object,
 
 		/* Show the cursor unless we're responding to a
 		 * "folder-changed" signal from our CamelFolder. */
-		build_tree (
+		expand_state_valid = build_tree (
 			message_list,
 			regen_data->thread_tree,
-			regen_data->folder_changed);
+			regen_data->folder_changed,
+			regen_data->n_folder_changes);
 
 		message_list_set_thread_tree (
 			message_list, regen_data->thread_tree);
@@ -6096,6 +5953,9 @@ message_list_regen_done_cb (GObject *source_object,
 
 			/* Disable forced expand/collapse state. */
 			e_tree_table_adapter_force_expanded_state (adapter, 0);
+		} else if (expand_state_valid && was_searching == is_searching) {
+			/* The tree was updated in place, the adapter
+			 * still holds the right expand state. */
 		} else if (was_searching && !is_searching) {
 			/* Load expand state from disk */
 			load_tree_state (
@@ -6307,6 +6167,9 @@ message_list_regen_idle_cb (gpointer user_data)
 		regen_data->expand_state = e_tree_table_adapter_save_expanded_state_xml (adapter);
 	}
 
+	regen_data->n_folder_changes = message_list->priv->n_pending_folder_changes;
+	message_list->priv->n_pending_folder_changes = 0;
+
 	message_list->priv->regen_idle_id = 0;
 
 	g_mutex_unlock (&message_list->priv->regen_lock);
@@ -6357,7 +6220,7 @@ mail_regen_list (MessageList *message_list,
 	GCancellable *cancellable;
 	RegenData *new_regen_data;
 	RegenData *old_regen_data;
-	gchar *prefixes, *tmp_search_copy = NULL;
+	gchar *tmp_search_copy = NULL;
 
 	if (!search) {
 		old_regen_data = message_list_ref_regen_data (message_list);
@@ -6388,22 +6251,7 @@ mail_regen_list (MessageList *message_list,
 		return;
 	}
 
-	g_mutex_lock (&message_list->priv->re_prefixes_lock);
-
-	g_strfreev (message_list->priv->re_prefixes);
-	prefixes = g_settings_get_string (message_list->priv->mail_settings, "composer-localized-re");
-	message_list->priv->re_prefixes = g_strsplit (prefixes ? prefixes : "", ",", -1);
-	g_free (prefixes);
-
-	g_strfreev (message_list->priv->re_separators);
-	message_list->priv->re_separators = g_settings_get_strv (message_list->priv->mail_settings, "composer-localized-re-separators");
-
-	if (message_list->priv->re_separators && !*message_list->priv->re_separators) {
-		g_strfreev (message_list->priv->re_separators);
-		message_list->priv->re_separators = NULL;
-	}
-
-	g_mutex_unlock (&message_list->priv->re_prefixes_lock);
+	message_list_update_re_matcher (message_list);
 
 	g_mutex_lock (&message_list->priv->regen_lock);
 
@@ -196,6 +196,10 @@ gboolean	message_list_can_select		(MessageList *message_list,
 						 MessageListSelectDirection direction,
 						 guint32 flags,
 						 guint32 mask);
+gchar *		message_list_dup_selectable_uid	(MessageList *message_list,
+						 MessageListSelectDirection direction,
+						 guint32 flags,
+						 guint32 mask);
 void		message_list_select_uid		(MessageList *message_list,
 						 const gchar *uid,
 						 gboolean with_fallback);
@@ -0,0 +1,472 @@
+/*
+ * Tests of MessageListSortKeys
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+#include <string.h>
+
+#include "message-list-sort-keys.h"
+
+/* The compare functions of the message list columns, as registered
+ * in the ETableExtras, without their cmp_cache. */
+
+static gint
+test_int_compare (gconstpointer x,
+                  gconstpointer y,
+                  gpointer cmp_cache)
+{
+	gint nx = GPOINTER_TO_INT (x);
+	gint ny = GPOINTER_TO_INT (y);
+
+	return (nx == ny) ? 0 : (nx < ny) ? -1 : 1;
+}
+
+static gint
+test_int64ptr_compare (gconstpointer x,
+                       gconstpointer y,
+                       gpointer cmp_cache)
+{
+	const gint64 *pa = x, *pb = y;
+
+	if (pa && pb)
+		return (*pa == *pb) ? 0 : (*pa < *pb) ? -1 : 1;
+
+	return (!pa && !pb) ? 0 : (pa ? 1 : -1);
+}
+
+static gint
+test_str_compare (gconstpointer x,
+                  gconstpointer y,
+                  gpointer cmp_cache)
+{
+	return strcmp (x, y);
+}
+
+static gint
+test_str_case_compare (gconstpointer x,
+                       gconstpointer y,
+                       gpointer cmp_cache)
+{
+	gchar *cx, *cy;
+	gint res;
+
+	cx = g_utf8_casefold (x, -1);
+	cy = g_utf8_casefold (y, -1);
+
+	res = g_utf8_collate (cx, cy);
+
+	g_free (cx);
+	g_free (cy);
+
+	return res;
+}
+
+static gint
+test_collate_compare (gconstpointer x,
+                      gconstpointer y,
+                      gpointer cmp_cache)
+{
+	return g_utf8_collate (x, y);
+}
+
+static gint
+test_address_compare (gconstpointer x,
+                      gconstpointer y,
+                      gpointer cmp_cache)
+{
+	return g_ascii_strcasecmp (x, y);
+}
+
+/* Not known to the sort keys, thus the values are kept. */
+static gint
+test_length_compare (gconstpointer x,
+                     gconstpointer y,
+                     gpointer cmp_cache)
+{
+	gsize lx = strlen (x), ly = strlen (y);
+
+	return (lx == ly) ? 0 : (lx < ly) ? -1 : 1;
+}
+
+typedef struct _TestMessages {
+	guint n_messages;
+	gint64 *dates;		/* 0 is unset */
+	const gchar **subjects;
+	const gchar **senders;
+	gint *flagged;
+	gint *sizes;
+} TestMessages;
+
+typedef enum {
+	TEST_COLUMN_DATE,
+	TEST_COLUMN_SUBJECT,
+	TEST_COLUMN_SUBJECT_TRIMMED,
+	TEST_COLUMN_FROM,
+	TEST_COLUMN_FLAGGED,
+	TEST_COLUMN_SIZE,
+	TEST_COLUMN_LOCATION,
+	TEST_COLUMN_CUSTOM
+} TestColumn;
+
+static const struct {
+	const gchar *compare;
+	GCompareDataFunc compare_func;
+} test_columns[] = {
+	{ "pointer-integer64", test_int64ptr_compare },
+	{ "string", test_str_compare },
+	{ "stringcase", test_str_case_compare },
+	{ "address_compare", test_address_compare },
+	{ "integer", test_int_compare },
+	{ "integer", test_int_compare },
+	{ "collate", test_collate_compare },
+	{ "custom", test_length_compare }
+};
+
+typedef struct _TestSortColumn {
+	TestColumn column;
+	gboolean descending;
+} TestSortColumn;
+
+typedef struct _TestSort {
+	const gchar *name;
+	TestSortColumn columns[3];
+	guint n_columns;
+} TestSort;
+
+static const TestSort date_sort = {
+	"date", { { TEST_COLUMN_DATE, TRUE } }, 1
+};
+
+static const TestSort subject_date_sort = {
+	"subject and date", { { TEST_COLUMN_SUBJECT_TRIMMED, FALSE }, { TEST_COLUMN_DATE, TRUE } }, 2
+};
+
+static const TestSort flag_date_sort = {
+	"flag and date", { { TEST_COLUMN_FLAGGED, TRUE }, { TEST_COLUMN_DATE, TRUE } }, 2
+};
+
+static const TestSort other_sorts[] = {
+	{ "size", { { TEST_COLUMN_SIZE, FALSE } }, 1 },
+	{ "subject", { { TEST_COLUMN_SUBJECT, TRUE } }, 1 },
+	{ "from and size", { { TEST_COLUMN_FROM, FALSE }, { TEST_COLUMN_SIZE, TRUE } }, 2 },
+	{ "location, custom and date", { { TEST_COLUMN_LOCATION, FALSE }, { TEST_COLUMN_CUSTOM, TRUE }, { TEST_COLUMN_DATE, FALSE } }, 3 }
+};
+
+static const gchar *test_subjects[] = {
+	"Meeting", "meeting", "MEETING", "Re: Meeting", "Évaluation",
+	"evaluation", "Zebra", "apple", "Apple", "Übung", "ubung", ""
+};
+
+static const gchar *test_senders[] = {
+	"Alice <alice@example.com>", "ALICE <alice@example.com>",
+	"bob@example.com", "Bob <bob@example.com>", "carol@example.com",
+	"Zoë <zoe@example.com>"
+};
+
+static TestMessages *
+test_messages_new (guint n_messages)
+{
+	TestMessages *messages;
+	GRand *rand;
+	guint ii;
+
+	rand = g_rand_new_with_seed (17);
+
+	messages = g_new0 (TestMessages, 1);
+	messages->n_messages = n_messages;
+	messages->dates = g_new0 (gint64, n_messages);
+	messages->subjects = g_new0 (const gchar *, n_messages);
+	messages->senders = g_new0 (const gchar *, n_messages);
+	messages->flagged = g_new0 (gint, n_messages);
+	messages->sizes = g_new0 (gint, n_messages);
+
+	for (ii = 0; ii < n_messages; ii++) {
+		/* Plenty of equal dates, and some unset. */
+		if (g_rand_int_range (rand, 0, 20) != 0)
+			messages->dates[ii] = 1500000000 + g_rand_int_range (rand, 0, 1000) * 60;
+
+		if (g_rand_int_range (rand, 0, 20) != 0)
+			messages->subjects[ii] = test_subjects[g_rand_int_range (rand, 0, G_N_ELEMENTS (test_subjects))];
+
+		messages->senders[ii] = test_senders[g_rand_int_range (rand, 0, G_N_ELEMENTS (test_senders))];
+		messages->flagged[ii] = g_rand_int_range (rand, 0, 10) < 3;
+		messages->sizes[ii] = g_rand_int_range (rand, 0, 100) * 1024;
+	}
+
+	g_rand_free (rand);
+
+	return messages;
+}
+
+static void
+test_messages_free (TestMessages *messages)
+{
+	g_free (messages->dates);
+	g_free (messages->subjects);
+	g_free (messages->senders);
+	g_free (messages->flagged);
+	g_free (messages->sizes);
+	g_free (messages);
+}
+
+/* The value the message list gives for the column of the message. */
+static gpointer
+test_messages_get_value (TestMessages *messages,
+                         TestColumn column,
+                         guint index)
+{
+	switch (column) {
+	case TEST_COLUMN_DATE:
+		return messages->dates[index] ? &messages->dates[index] : NULL;
+	case TEST_COLUMN_SUBJECT:
+	case TEST_COLUMN_SUBJECT_TRIMMED:
+	case TEST_COLUMN_CUSTOM:
+		return (gpointer) messages->subjects[index];
+	case TEST_COLUMN_FROM:
+		return (gpointer) messages->senders[index];
+	case TEST_COLUMN_FLAGGED:
+		return GINT_TO_POINTER (messages->flagged[index]);
+	case TEST_COLUMN_SIZE:
+		return GINT_TO_POINTER (messages->sizes[index]);
+	case TEST_COLUMN_LOCATION:
+		return index % 3 ? (gpointer) messages->senders[index] : NULL;
+	}
+
+	g_return_val_if_reached (NULL);
+}
+
+/* The UID order, like camel_folder_cmp_uids() with numeric UIDs. */
+static gint
+test_tie_cb (guint index1,
+             guint index2,
+             gpointer user_data)
+{
+	return (index1 == index2) ? 0 : (index1 < index2) ? -1 : 1;
+}
+
+typedef struct _TestReference {
+	TestMessages *messages;
+	const TestSort *sort;
+} TestReference;
+
+/* The comparison of the former cmp_array_uids(), which read the values
+ * during the sort and compared them with the column compare function. */
+static gint
+test_reference_compare (gconstpointer a,
+                        gconstpointer b,
+                        gpointer user_data)
+{
+	TestReference *reference = user_data;
+	guint index1 = *((const guint *) a);
+	guint index2 = *((const guint *) b);
+	guint ii;
+	gint res = 0;
+
+	for (ii = 0; res == 0 && ii < reference->sort->n_columns; ii++) {
+		const TestSortColumn *scol = &reference->sort->columns[ii];
+		gpointer v1, v2;
+
+		v1 = test_messages_get_value (reference->messages, scol->column, index1);
+		v2 = test_messages_get_value (reference->messages, scol->column, index2);
+
+		if (v1 != NULL && v2 != NULL) {
+			res = test_columns[scol->column].compare_func (v1, v2, NULL);
+		} else if (v1 != NULL || v2 != NULL) {
+			res = v1 == NULL ? -1 : 1;
+		}
+
+		if (scol->descending)
+			res = res * (-1);
+	}
+
+	if (res == 0)
+		res = test_tie_cb (index1, index2, NULL);
+
+	return res;
+}
+
+static MessageListSortKeys *
+test_sort_keys_new (TestMessages *messages,
+                    const TestSort *sort)
+{
+	MessageListSortKeys *sort_keys;
+	guint ii, jj;
+
+	sort_keys = message_list_sort_keys_new (messages->n_messages, sort->n_columns, NULL);
+
+	for (jj = 0; jj < sort->n_columns; jj++) {
+		const TestSortColumn *scol = &sort->columns[jj];
+
+		message_list_sort_keys_set_column (
+			sort_keys, jj,
+			test_columns[scol->column].compare,
+			test_columns[scol->column].compare_func,
+			scol->descending, NULL);
+	}
+
+	for (ii = 0; ii < messages->n_messages; ii++) {
+		for (jj = 0; jj < sort->n_columns; jj++) {
+			message_list_sort_keys_set_value (
+				sort_keys, jj, ii,
+				test_messages_get_value (messages, sort->columns[jj].column, ii));
+		}
+	}
+
+	return sort_keys;
+}
+
+static void
+test_sort_order (TestMessages *messages,
+                 const TestSort *sort)
+{
+	MessageListSortKeys *sort_keys;
+	TestReference reference;
+	guint *indexes, *expected;
+	guint ii;
+
+	reference.messages = messages;
+	reference.sort = sort;
+
+	expected = g_new (guint, messages->n_messages);
+	for (ii = 0; ii < messages->n_messages; ii++)
+		expected[ii] = ii;
+
+	g_qsort_with_data (
+		expected, messages->n_messages, sizeof (guint),
+		test_reference_compare, &reference);
+
+	sort_keys = test_sort_keys_new (messages, sort);
+	indexes = message_list_sort_keys_sort (sort_keys, messages->n_messages, test_tie_cb, NULL);
+
+	for (ii = 0; ii < messages->n_messages; ii++) {
+		if (indexes[ii] != expected[ii])
+			g_error ("Sort by %s differs at %u: %u instead of %u", sort->name, ii, indexes[ii], expected[ii]);
+	}
+
+	message_list_sort_keys_free (sort_keys, NULL, NULL);
+	g_free (indexes);
+	g_free (expected);
+}
+
+static void
+test_sort_keys_order (void)
+{
+	TestMessages *messages;
+	guint ii;
+
+	messages = test_messages_new (5000);
+
+	test_sort_order (messages, &date_sort);
+	test_sort_order (messages, &subject_date_sort);
+	test_sort_order (messages, &flag_date_sort);
+
+	for (ii = 0; ii < G_N_ELEMENTS (other_sorts); ii++)
+		test_sort_order (messages, &other_sorts[ii]);
+
+	test_messages_free (messages);
+}
+
+static void
+test_sort_keys_subset (void)
+{
+	MessageListSortKeys *sort_keys;
+	TestMessages *messages;
+	guint *indexes;
+
+	messages = test_messages_new (10);
+
+	/* Only the first messages are sorted, the UIDs without a message
+	 * info are not snapshot and stay at the end of the keys. */
+	sort_keys = test_sort_keys_new (messages, &date_sort);
+	indexes = message_list_sort_keys_sort (sort_keys, 0, test_tie_cb, NULL);
+	g_assert_nonnull (indexes);
+	g_free (indexes);
+
+	indexes = message_list_sort_keys_sort (sort_keys, 1, test_tie_cb, NULL);
+	g_assert_cmpuint (indexes[0], ==, 0);
+	g_free (indexes);
+
+	message_list_sort_keys_free (sort_keys, NULL, NULL);
+	test_messages_free (messages);
+}
+
+static void
+test_sort_rate (TestMessages *messages,
+                const TestSort *sort)
+{
+	MessageListSortKeys *sort_keys;
+	TestReference reference;
+	GTimer *timer;
+	guint64 n_comparisons;
+	guint *indexes;
+	gdouble elapsed;
+	guint ii;
+
+	sort_keys = test_sort_keys_new (messages, sort);
+
+	timer = g_timer_new ();
+	indexes = message_list_sort_keys_sort (sort_keys, messages->n_messages, test_tie_cb, NULL);
+	g_timer_stop (timer);
+
+	elapsed = MAX (g_timer_elapsed (timer, NULL), 1e-6);
+	n_comparisons = message_list_sort_keys_get_n_comparisons (sort_keys);
+
+	g_test_maximized_result (
+		n_comparisons / elapsed,
+		"Sorting %u messages by %s: %" G_GUINT64_FORMAT " comparisons in %f seconds, %.0f comparisons per second",
+		messages->n_messages, sort->name, n_comparisons, elapsed, n_comparisons / elapsed);
+
+	reference.messages = messages;
+	reference.sort = sort;
+
+	for (ii = 1; ii < messages->n_messages; ii++)
+		g_assert_cmpint (test_reference_compare (&indexes[ii - 1], &indexes[ii], &reference), <, 0);
+
+	message_list_sort_keys_free (sort_keys, NULL, NULL);
+	g_timer_destroy (timer);
+	g_free (indexes);
+}
+
+static void
+test_sort_keys_rate (void)
+{
+	TestMessages *messages;
+
+	messages = test_messages_new (g_test_perf () ? 1000000 : 100000);
+
+	test_sort_rate (messages, &date_sort);
+	test_sort_rate (messages, &subject_date_sort);
+	test_sort_rate (messages, &flag_date_sort);
+
+	test_messages_free (messages);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/MessageListSortKeys/Order", test_sort_keys_order);
+	g_test_add_func ("/MessageListSortKeys/Subset", test_sort_keys_subset);
+	g_test_add_func ("/MessageListSortKeys/Rate", test_sort_keys_rate);
+
+	return g_test_run ();
+}
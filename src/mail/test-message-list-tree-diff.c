@@ -0,0 +1,366 @@
+/*
+ * Tests of MessageListTreeDiff
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <locale.h>
+#include <string.h>
+
+#include "message-list-tree-diff.h"
+
+/* Messages are threaded by groups of this many, the first one being
+ * the parent of the others; the others get to the top level when the
+ * first one is not in the folder. */
+#define THREAD_SIZE 4
+
+typedef struct _TestFolder {
+	CamelMessageInfo **infos;
+	gboolean *present;
+	guint n_messages;
+	guint n_present;
+
+	CamelFolderThreadNode *thread_nodes;
+
+	/* The tree of the message list */
+	GNode *root;
+	GHashTable *uid_nodemap;
+} TestFolder;
+
+static GNode *
+test_insert_node_cb (CamelMessageInfo *info,
+                     GNode *parent,
+                     GNode *sibling,
+                     gpointer user_data)
+{
+	TestFolder *folder = user_data;
+	GNode *node;
+
+	node = g_node_new (info);
+	g_node_insert_before (parent, sibling, node);
+
+	g_hash_table_replace (folder->uid_nodemap, (gpointer) camel_message_info_get_uid (info), node);
+
+	return node;
+}
+
+static void
+test_remove_node_cb (GNode *node,
+                     gboolean toplevel,
+                     gpointer user_data)
+{
+	TestFolder *folder = user_data;
+	const gchar *uid = camel_message_info_get_uid (node->data);
+
+	if (g_hash_table_lookup (folder->uid_nodemap, uid) == node)
+		g_hash_table_remove (folder->uid_nodemap, uid);
+
+	if (toplevel)
+		g_node_destroy (node);
+}
+
+static TestFolder *
+test_folder_new (guint n_messages)
+{
+	TestFolder *folder;
+	guint ii;
+
+	folder = g_new0 (TestFolder, 1);
+	folder->infos = g_new0 (CamelMessageInfo *, n_messages);
+	folder->present = g_new0 (gboolean, n_messages);
+	folder->thread_nodes = g_new0 (CamelFolderThreadNode, n_messages);
+	folder->n_messages = n_messages;
+	folder->root = g_node_new (NULL);
+	folder->uid_nodemap = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (ii = 0; ii < n_messages; ii++) {
+		gchar *uid = g_strdup_printf ("%u", ii);
+
+		folder->infos[ii] = camel_message_info_new (NULL);
+		camel_message_info_set_uid (folder->infos[ii], uid);
+
+		g_free (uid);
+	}
+
+	return folder;
+}
+
+static void
+test_folder_free (TestFolder *folder)
+{
+	guint ii;
+
+	g_node_destroy (folder->root);
+	g_hash_table_destroy (folder->uid_nodemap);
+
+	for (ii = 0; ii < folder->n_messages; ii++)
+		g_object_unref (folder->infos[ii]);
+
+	g_free (folder->infos);
+	g_free (folder->present);
+	g_free (folder->thread_nodes);
+	g_free (folder);
+}
+
+static void
+test_folder_set_present (TestFolder *folder,
+                         guint index,
+                         gboolean present)
+{
+	if (folder->present[index] != present) {
+		folder->present[index] = present;
+
+		if (present)
+			folder->n_present++;
+		else
+			folder->n_present--;
+	}
+}
+
+/* Threads the present messages, like camel_folder_thread_messages_new() */
+static CamelFolderThreadNode *
+test_folder_thread (TestFolder *folder)
+{
+	CamelFolderThreadNode *first = NULL, *last = NULL;
+	guint ii, jj;
+
+	memset (folder->thread_nodes, 0, sizeof (CamelFolderThreadNode) * folder->n_messages);
+
+	for (ii = 0; ii < folder->n_messages; ii += THREAD_SIZE) {
+		CamelFolderThreadNode *last_child = NULL;
+
+		for (jj = ii; jj < ii + THREAD_SIZE && jj < folder->n_messages; jj++) {
+			CamelFolderThreadNode *node = &folder->thread_nodes[jj];
+
+			if (!folder->present[jj])
+				continue;
+
+			node->message = folder->infos[jj];
+
+			if (jj != ii && folder->present[ii]) {
+				CamelFolderThreadNode *parent = &folder->thread_nodes[ii];
+
+				node->parent = parent;
+
+				if (last_child)
+					last_child->next = node;
+				else
+					parent->child = node;
+
+				last_child = node;
+			} else {
+				if (last)
+					last->next = node;
+				else
+					first = node;
+
+				last = node;
+			}
+		}
+	}
+
+	return first;
+}
+
+static void
+test_folder_apply (TestFolder *folder,
+                   MessageListTreeDiff *diff)
+{
+	memset (diff, 0, sizeof (MessageListTreeDiff));
+	diff->uid_nodemap = folder->uid_nodemap;
+	diff->insert_node = test_insert_node_cb;
+	diff->remove_node = test_remove_node_cb;
+	diff->user_data = folder;
+
+	message_list_tree_diff_apply (
+		diff, folder->root,
+		g_node_first_child (folder->root),
+		test_folder_thread (folder));
+}
+
+static guint
+test_check_subtree (TestFolder *folder,
+                    GNode *parent,
+                    CamelFolderThreadNode *c)
+{
+	GNode *node;
+	guint n_nodes = 0;
+
+	for (node = g_node_first_child (parent); c != NULL; c = c->next, node = g_node_next_sibling (node)) {
+		const gchar *uid = camel_message_info_get_uid (c->message);
+
+		g_assert_nonnull (node);
+		g_assert_cmpstr (camel_message_info_get_uid (node->data), ==, uid);
+		g_assert_true (g_hash_table_lookup (folder->uid_nodemap, uid) == node);
+
+		n_nodes += 1 + test_check_subtree (folder, node, c->child);
+	}
+
+	g_assert_null (node);
+
+	return n_nodes;
+}
+
+/* The tree matches the thread of the present messages. */
+static void
+test_folder_check (TestFolder *folder)
+{
+	guint n_nodes;
+
+	n_nodes = test_check_subtree (folder, folder->root, test_folder_thread (folder));
+
+	g_assert_cmpuint (n_nodes, ==, folder->n_present);
+	g_assert_cmpuint (g_hash_table_size (folder->uid_nodemap), ==, folder->n_present);
+}
+
+static void
+test_tree_diff_apply (void)
+{
+	MessageListTreeDiff diff;
+	TestFolder *folder;
+	guint ii;
+
+	folder = test_folder_new (40);
+
+	/* Every other message, thus threads of a parent and one child. */
+	for (ii = 0; ii < folder->n_messages; ii += 2)
+		test_folder_set_present (folder, ii, TRUE);
+
+	test_folder_apply (folder, &diff);
+	test_folder_check (folder);
+
+	g_assert_cmpuint (diff.n_added, ==, 20);
+	g_assert_cmpuint (diff.n_removed, ==, 0);
+	g_assert_cmpuint (diff.n_moved, ==, 0);
+
+	/* Nothing changed. */
+	test_folder_apply (folder, &diff);
+	test_folder_check (folder);
+
+	g_assert_cmpuint (diff.n_added, ==, 0);
+	g_assert_cmpuint (diff.n_removed, ==, 0);
+	g_assert_cmpuint (diff.n_moved, ==, 0);
+
+	/* A new message at the end, a thread child and a whole thread removed. */
+	test_folder_set_present (folder, 39, TRUE);
+	test_folder_set_present (folder, 2, FALSE);
+	test_folder_set_present (folder, 8, FALSE);
+	test_folder_set_present (folder, 10, FALSE);
+
+	test_folder_apply (folder, &diff);
+	test_folder_check (folder);
+
+	g_assert_cmpuint (diff.n_added, ==, 1);
+	g_assert_cmpuint (diff.n_removed, ==, 3);
+	g_assert_cmpuint (diff.n_moved, ==, 0);
+
+	/* The parent of a thread is removed, its child moves to the top level. */
+	test_folder_set_present (folder, 4, FALSE);
+
+	test_folder_apply (folder, &diff);
+	test_folder_check (folder);
+
+	g_assert_cmpuint (diff.n_added, ==, 0);
+	g_assert_cmpuint (diff.n_removed, ==, 2);
+	g_assert_cmpuint (diff.n_moved, ==, 1);
+
+	/* All gone. */
+	for (ii = 0; ii < folder->n_messages; ii++)
+		test_folder_set_present (folder, ii, FALSE);
+
+	test_folder_apply (folder, &diff);
+	test_folder_check (folder);
+
+	g_assert_cmpuint (diff.n_added, ==, 0);
+	g_assert_cmpuint (diff.n_removed, ==, 17);
+
+	test_folder_free (folder);
+}
+
+/* Measures the cost of each added or removed message in a large tree,
+ * the way a folder change applies a few of them at a time. */
+static void
+test_tree_diff_per_change (void)
+{
+	MessageListTreeDiff diff;
+	TestFolder *folder;
+	GTimer *timer;
+	GRand *rand;
+	gdouble elapsed = 0.0;
+	guint n_messages, n_rounds, n_changes = 0;
+	guint ii, jj;
+
+	n_messages = g_test_perf () ? 200000 : 20000;
+	n_rounds = g_test_perf () ? 200 : 20;
+
+	rand = g_rand_new_with_seed (42);
+	folder = test_folder_new (n_messages);
+
+	for (ii = 0; ii < n_messages; ii++)
+		test_folder_set_present (folder, ii, g_rand_int_range (rand, 0, 10) != 0);
+
+	test_folder_apply (folder, &diff);
+	test_folder_check (folder);
+
+	timer = g_timer_new ();
+
+	for (ii = 0; ii < n_rounds; ii++) {
+		/* Leaves the parents alone, a moved child would
+		 * make the message list rebuild the tree. */
+		for (jj = 0; jj < 10; jj++) {
+			guint index = g_rand_int_range (rand, 0, n_messages);
+
+			if (index % THREAD_SIZE != 0)
+				test_folder_set_present (folder, index, !folder->present[index]);
+		}
+
+		g_timer_start (timer);
+		test_folder_apply (folder, &diff);
+		g_timer_stop (timer);
+
+		elapsed += g_timer_elapsed (timer, NULL);
+		n_changes += diff.n_added + diff.n_removed;
+
+		g_assert_cmpuint (diff.n_moved, ==, 0);
+
+		test_folder_check (folder);
+	}
+
+	g_assert_cmpuint (n_changes, >, 0);
+
+	g_test_minimized_result (
+		elapsed * G_USEC_PER_SEC / n_changes,
+		"Tree diff of %u changes over %u nodes took %f us per change",
+		n_changes, folder->n_present, elapsed * G_USEC_PER_SEC / n_changes);
+
+	g_timer_destroy (timer);
+	test_folder_free (folder);
+	g_rand_free (rand);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	setlocale (LC_ALL, "");
+
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/MessageListTreeDiff/Apply", test_tree_diff_apply);
+	g_test_add_func ("/MessageListTreeDiff/PerChange", test_tree_diff_per_change);
+
+	return g_test_run ();
+}
@@ -174,7 +174,7 @@ contacts_removed (EBookShellView *book_shell_view,
 		return;
 
 	/* Is the displayed contact still in the model? */
-	if (e_addressbook_model_find (model, preview_contact) < 0)
+	if (e_addressbook_model_find (model, preview_contact) >= 0)
 		return;
 
 	/* If not, clear the contact display. */
@@ -0,0 +1,1202 @@
+/*
+ * evolution-backup-archive.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Reads and writes the back up archives, which are compressed tar files
+ * in the GNU format, thus the tar command can still list and extract them.
+ *
+ * The gzip compression is done in parallel: the tar stream is cut into
+ * chunks, each compressed into its own gzip member by a thread pool, and
+ * the members are written in order.  A concatenation of gzip members is
+ * a valid gzip file.  The xz compression is left to the xz command, which
+ * can use multiple threads on its own. */
+
+#include "evolution-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "evolution-backup-archive.h"
+
+#define BLOCK_SIZE 512
+#define CHUNK_SIZE (1024 * 1024)
+#define IO_BUFFER_SIZE (64 * 1024)
+
+/* Limit for the size of the GNU long names and the pax headers */
+#define MAX_META_SIZE (1024 * 1024)
+
+#define HEADER_NAME		0
+#define HEADER_MODE		100
+#define HEADER_UID		108
+#define HEADER_GID		116
+#define HEADER_SIZE		124
+#define HEADER_MTIME		136
+#define HEADER_CHECKSUM		148
+#define HEADER_TYPE		156
+#define HEADER_LINK_NAME	157
+#define HEADER_MAGIC		257
+#define HEADER_PREFIX		345
+
+typedef struct _CompressJob {
+	guint index;
+	GByteArray *data;
+	GBytes *compressed;
+	GError *error;
+} CompressJob;
+
+struct _BackupWriter {
+	gchar *filename;
+	GOutputStream *output;
+	GSubprocess *subprocess;
+	GByteArray *chunk;
+	gboolean closed;
+
+	BackupProgressFunc progress_func;
+	gpointer progress_data;
+
+	/* Parallel gzip compression */
+	GThreadPool *pool;
+	GMutex lock;
+	GCond cond;
+	GHashTable *compressed; /* guint index ~> CompressJob * */
+	guint n_chunks;
+	guint n_written;
+	guint max_pending;
+};
+
+struct _BackupReader {
+	GInputStream *input;
+	GSubprocess *subprocess;
+	GConverter *decompressor;
+
+	guint8 *in_buffer;
+	gsize in_start;
+	gsize in_end;
+	gboolean in_eof;
+	gboolean in_member;
+
+	BackupEntry entry;
+	goffset remaining;
+	goffset padding;
+	gboolean finished;
+
+	BackupProgressFunc progress_func;
+	gpointer progress_data;
+};
+
+static void
+compress_job_free (CompressJob *job)
+{
+	if (!job)
+		return;
+
+	if (job->data)
+		g_byte_array_unref (job->data);
+	if (job->compressed)
+		g_bytes_unref (job->compressed);
+	g_clear_error (&job->error);
+	g_slice_free (CompressJob, job);
+}
+
+gboolean
+backup_archive_filename_is_xz (const gchar *filename)
+{
+	gsize len;
+
+	if (!filename)
+		return FALSE;
+
+	len = strlen (filename);
+	if (len < 3)
+		return FALSE;
+
+	return g_ascii_strcasecmp (filename + len - 3, ".xz") == 0;
+}
+
+static void
+backup_header_set_number (gchar *field,
+                          gsize field_len,
+                          guint64 value)
+{
+	/* Too large for the octal digits, use the GNU base-256 encoding */
+	if (value >> (3 * (field_len - 1))) {
+		gsize ii;
+
+		for (ii = field_len - 1; ii > 0; ii--) {
+			field[ii] = value & 0xFF;
+			value >>= 8;
+		}
+
+		field[0] = (gchar) 0x80;
+	} else {
+		g_snprintf (field, field_len, "%0*" G_GINT64_MODIFIER "o", (gint) field_len - 1, value);
+	}
+}
+
+static guint64
+backup_header_get_number (const guint8 *field,
+                          gsize field_len)
+{
+	guint64 value = 0;
+	gsize ii = 0;
+
+	if (field[0] & 0x80) {
+		for (ii = 1; ii < field_len; ii++)
+			value = (value << 8) | field[ii];
+
+		return value;
+	}
+
+	while (ii < field_len && (field[ii] == ' ' || field[ii] == '\0'))
+		ii++;
+
+	for (; ii < field_len && field[ii] >= '0' && field[ii] <= '7'; ii++)
+		value = (value << 3) | (field[ii] - '0');
+
+	return value;
+}
+
+static guint
+backup_header_checksum (const guint8 *header)
+{
+	guint sum = 0, ii;
+
+	/* The checksum field itself counts as spaces */
+	for (ii = 0; ii < BLOCK_SIZE; ii++) {
+		if (ii >= HEADER_CHECKSUM && ii < HEADER_CHECKSUM + 8)
+			sum += ' ';
+		else
+			sum += header[ii];
+	}
+
+	return sum;
+}
+
+static gchar *
+backup_header_dup_string (const guint8 *field,
+                          gsize field_len)
+{
+	gsize len = 0;
+
+	while (len < field_len && field[len])
+		len++;
+
+	return g_strndup ((const gchar *) field, len);
+}
+
+/* Writer */
+
+static void
+compress_chunk_thread (gpointer data,
+                       gpointer user_data)
+{
+	CompressJob *job = data;
+	BackupWriter *writer = user_data;
+	GZlibCompressor *compressor;
+	GOutputStream *memory, *stream;
+
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+	memory = g_memory_output_stream_new_resizable ();
+	stream = g_converter_output_stream_new (memory, G_CONVERTER (compressor));
+
+	if (g_output_stream_write_all (stream, job->data->data, job->data->len, NULL, NULL, &job->error) &&
+	    g_output_stream_close (stream, NULL, &job->error))
+		job->compressed = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory));
+
+	g_object_unref (stream);
+	g_object_unref (memory);
+	g_object_unref (compressor);
+
+	g_byte_array_unref (job->data);
+	job->data = NULL;
+
+	g_mutex_lock (&writer->lock);
+	g_hash_table_insert (writer->compressed, GUINT_TO_POINTER (job->index), job);
+	g_cond_broadcast (&writer->cond);
+	g_mutex_unlock (&writer->lock);
+}
+
+/* Writes the compressed chunks in order, waiting for them
+ * while more than max_pending chunks are being compressed. */
+static gboolean
+backup_writer_write_compressed (BackupWriter *writer,
+                                guint max_pending,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+	gboolean success = TRUE;
+
+	g_mutex_lock (&writer->lock);
+
+	while (success && writer->n_written < writer->n_chunks) {
+		CompressJob *job;
+
+		job = g_hash_table_lookup (writer->compressed, GUINT_TO_POINTER (writer->n_written));
+		if (!job) {
+			if (writer->n_chunks - writer->n_written <= max_pending)
+				break;
+
+			g_cond_wait (&writer->cond, &writer->lock);
+			continue;
+		}
+
+		g_hash_table_steal (writer->compressed, GUINT_TO_POINTER (writer->n_written));
+		writer->n_written++;
+
+		g_mutex_unlock (&writer->lock);
+
+		if (job->error) {
+			g_propagate_error (error, job->error);
+			job->error = NULL;
+			success = FALSE;
+		} else {
+			success = g_output_stream_write_all (
+				writer->output,
+				g_bytes_get_data (job->compressed, NULL),
+				g_bytes_get_size (job->compressed),
+				NULL, cancellable, error);
+		}
+
+		compress_job_free (job);
+
+		g_mutex_lock (&writer->lock);
+	}
+
+	g_mutex_unlock (&writer->lock);
+
+	return success;
+}
+
+static gboolean
+backup_writer_flush_chunk (BackupWriter *writer,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	CompressJob *job;
+
+	if (!writer->chunk->len)
+		return TRUE;
+
+	if (!writer->pool) {
+		gboolean success;
+
+		success = g_output_stream_write_all (
+			writer->output, writer->chunk->data, writer->chunk->len,
+			NULL, cancellable, error);
+
+		g_byte_array_set_size (writer->chunk, 0);
+
+		return success;
+	}
+
+	job = g_slice_new0 (CompressJob);
+	job->index = writer->n_chunks++;
+	job->data = writer->chunk;
+
+	writer->chunk = g_byte_array_sized_new (CHUNK_SIZE);
+
+	g_thread_pool_push (writer->pool, job, NULL);
+
+	return backup_writer_write_compressed (writer, writer->max_pending, cancellable, error);
+}
+
+static gboolean
+backup_writer_write (BackupWriter *writer,
+                     gconstpointer data,
+                     gsize size,
+                     GCancellable *cancellable,
+                     GError **error)
+{
+	const guint8 *bytes = data;
+
+	while (size > 0) {
+		gsize n_bytes;
+
+		n_bytes = MIN (size, CHUNK_SIZE - writer->chunk->len);
+		g_byte_array_append (writer->chunk, bytes, n_bytes);
+
+		bytes += n_bytes;
+		size -= n_bytes;
+
+		if (writer->chunk->len == CHUNK_SIZE &&
+		    !backup_writer_flush_chunk (writer, cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+backup_writer_write_padding (BackupWriter *writer,
+                             goffset size,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	static const guint8 zeros[BLOCK_SIZE] = { 0 };
+	gsize padding;
+
+	padding = (BLOCK_SIZE - (size % BLOCK_SIZE)) % BLOCK_SIZE;
+
+	return backup_writer_write (writer, zeros, padding, cancellable, error);
+}
+
+static gboolean
+backup_writer_write_header (BackupWriter *writer,
+                            const gchar *name,
+                            gchar type,
+                            guint mode,
+                            gint64 mtime,
+                            goffset size,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	gchar header[BLOCK_SIZE];
+	gsize name_len;
+
+	name_len = strlen (name);
+
+	/* The GNU extension for names longer than the header can hold */
+	if (name_len > 100) {
+		if (!backup_writer_write_header (writer, "././@LongLink", 'L', 0644, 0, name_len + 1, cancellable, error) ||
+		    !backup_writer_write (writer, name, name_len + 1, cancellable, error) ||
+		    !backup_writer_write_padding (writer, name_len + 1, cancellable, error))
+			return FALSE;
+	}
+
+	memset (header, 0, sizeof (header));
+	memcpy (header + HEADER_NAME, name, MIN (name_len, 100));
+
+	backup_header_set_number (header + HEADER_MODE, 8, mode & 07777);
+	backup_header_set_number (header + HEADER_UID, 8, 0);
+	backup_header_set_number (header + HEADER_GID, 8, 0);
+	backup_header_set_number (header + HEADER_SIZE, 12, size);
+	backup_header_set_number (header + HEADER_MTIME, 12, MAX (mtime, 0));
+	header[HEADER_TYPE] = type;
+	memcpy (header + HEADER_MAGIC, "ustar  ", 8);
+
+	g_snprintf (header + HEADER_CHECKSUM, 8, "%06o", backup_header_checksum ((const guint8 *) header));
+	header[HEADER_CHECKSUM + 7] = ' ';
+
+	return backup_writer_write (writer, header, BLOCK_SIZE, cancellable, error);
+}
+
+BackupWriter *
+backup_writer_new (const gchar *filename,
+                   BackupProgressFunc progress_func,
+                   gpointer progress_data,
+                   GError **error)
+{
+	BackupWriter *writer;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	writer = g_slice_new0 (BackupWriter);
+	writer->filename = g_strdup (filename);
+	writer->chunk = g_byte_array_sized_new (CHUNK_SIZE);
+	writer->progress_func = progress_func;
+	writer->progress_data = progress_data;
+
+	g_mutex_init (&writer->lock);
+	g_cond_init (&writer->cond);
+
+	writer->compressed = g_hash_table_new_full (
+		g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) compress_job_free);
+
+	if (backup_archive_filename_is_xz (filename)) {
+		GSubprocessLauncher *launcher;
+
+		launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDIN_PIPE);
+		g_subprocess_launcher_set_stdout_file_path (launcher, filename);
+
+		writer->subprocess = g_subprocess_launcher_spawn (
+			launcher, error, "xz", "-z", "-c", "-T0", NULL);
+
+		g_object_unref (launcher);
+
+		if (writer->subprocess)
+			writer->output = g_object_ref (g_subprocess_get_stdin_pipe (writer->subprocess));
+	} else {
+		GFile *file;
+		guint n_threads;
+
+		file = g_file_new_for_path (filename);
+		writer->output = G_OUTPUT_STREAM (g_file_replace (
+			file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, error));
+		g_object_unref (file);
+
+		n_threads = MAX (g_get_num_processors (), 1);
+
+		writer->pool = g_thread_pool_new (compress_chunk_thread, writer, n_threads, FALSE, NULL);
+		writer->max_pending = 2 * n_threads;
+	}
+
+	if (!writer->output) {
+		backup_writer_free (writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+gboolean
+backup_writer_add_directory (BackupWriter *writer,
+                             const gchar *name,
+                             guint mode,
+                             gint64 mtime,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	gchar *dir_name;
+	gboolean success;
+
+	g_return_val_if_fail (writer != NULL, FALSE);
+	g_return_val_if_fail (name != NULL, FALSE);
+
+	if (g_str_has_suffix (name, "/"))
+		dir_name = g_strdup (name);
+	else
+		dir_name = g_strconcat (name, "/", NULL);
+
+	success = backup_writer_write_header (writer, dir_name, '5', mode, mtime, 0, cancellable, error);
+
+	g_free (dir_name);
+
+	return success;
+}
+
+/* The @size is what the header claims, as found when scanning the files
+ * to back up; should the file change since then, its content is cut
+ * or padded with zeros to keep the archive consistent. */
+gboolean
+backup_writer_add_file (BackupWriter *writer,
+                        const gchar *name,
+                        const gchar *filename,
+                        guint mode,
+                        gint64 mtime,
+                        goffset size,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	GFile *file;
+	GFileInputStream *input;
+	guint8 *buffer;
+	goffset remaining = size;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail (writer != NULL, FALSE);
+	g_return_val_if_fail (name != NULL, FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+
+	file = g_file_new_for_path (filename);
+	input = g_file_read (file, cancellable, error);
+	g_object_unref (file);
+
+	if (!input)
+		return FALSE;
+
+	if (!backup_writer_write_header (writer, name, '0', mode, mtime, size, cancellable, error)) {
+		g_object_unref (input);
+		return FALSE;
+	}
+
+	buffer = g_malloc (IO_BUFFER_SIZE);
+
+	while (success && remaining > 0) {
+		gssize n_read;
+
+		n_read = g_input_stream_read (
+			G_INPUT_STREAM (input), buffer,
+			MIN (remaining, IO_BUFFER_SIZE),
+			cancellable, error);
+
+		if (n_read < 0) {
+			success = FALSE;
+		} else if (n_read == 0) {
+			/* Shrunk meanwhile */
+			memset (buffer, 0, IO_BUFFER_SIZE);
+
+			while (success && remaining > 0) {
+				gsize n_zeros = MIN (remaining, IO_BUFFER_SIZE);
+
+				success = backup_writer_write (writer, buffer, n_zeros, cancellable, error);
+				remaining -= n_zeros;
+			}
+		} else {
+			success = backup_writer_write (writer, buffer, n_read, cancellable, error);
+			remaining -= n_read;
+
+			if (success && writer->progress_func)
+				writer->progress_func (n_read, writer->progress_data);
+		}
+	}
+
+	g_free (buffer);
+	g_object_unref (input);
+
+	return success && backup_writer_write_padding (writer, size, cancellable, error);
+}
+
+gboolean
+backup_writer_add_data (BackupWriter *writer,
+                        const gchar *name,
+                        gconstpointer data,
+                        gsize size,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	g_return_val_if_fail (writer != NULL, FALSE);
+	g_return_val_if_fail (name != NULL, FALSE);
+
+	return backup_writer_write_header (writer, name, '0', 0644, g_get_real_time () / G_USEC_PER_SEC, size, cancellable, error) &&
+		backup_writer_write (writer, data, size, cancellable, error) &&
+		backup_writer_write_padding (writer, size, cancellable, error);
+}
+
+gboolean
+backup_writer_close (BackupWriter *writer,
+                     GCancellable *cancellable,
+                     GError **error)
+{
+	static const guint8 zeros[2 * BLOCK_SIZE] = { 0 };
+
+	g_return_val_if_fail (writer != NULL, FALSE);
+	g_return_val_if_fail (!writer->closed, FALSE);
+
+	/* The end of the archive is marked with two zero blocks */
+	if (!backup_writer_write (writer, zeros, sizeof (zeros), cancellable, error) ||
+	    !backup_writer_flush_chunk (writer, cancellable, error) ||
+	    !backup_writer_write_compressed (writer, 0, cancellable, error) ||
+	    !g_output_stream_close (writer->output, cancellable, error))
+		return FALSE;
+
+	if (writer->subprocess &&
+	    !g_subprocess_wait_check (writer->subprocess, cancellable, error))
+		return FALSE;
+
+	writer->closed = TRUE;
+
+	return TRUE;
+}
+
+/* Frees the @writer; when it had not been closed successfully,
+ * the partially written archive is removed. */
+void
+backup_writer_free (BackupWriter *writer)
+{
+	if (!writer)
+		return;
+
+	/* Let the compression threads finish first */
+	if (writer->pool)
+		g_thread_pool_free (writer->pool, FALSE, TRUE);
+
+	if (!writer->closed) {
+		if (writer->output)
+			g_output_stream_close (writer->output, NULL, NULL);
+
+		if (writer->subprocess) {
+			g_subprocess_force_exit (writer->subprocess);
+			g_subprocess_wait (writer->subprocess, NULL, NULL);
+		}
+
+		g_unlink (writer->filename);
+	}
+
+	g_clear_object (&writer->output);
+	g_clear_object (&writer->subprocess);
+	g_hash_table_destroy (writer->compressed);
+	g_byte_array_unref (writer->chunk);
+	g_mutex_clear (&writer->lock);
+	g_cond_clear (&writer->cond);
+	g_free (writer->filename);
+
+	g_slice_free (BackupWriter, writer);
+}
+
+/* Reader */
+
+static void
+backup_entry_clear (BackupEntry *entry)
+{
+	g_free (entry->name);
+	g_free (entry->link_name);
+
+	memset (entry, 0, sizeof (BackupEntry));
+}
+
+static gboolean
+backup_reader_read_input (BackupReader *reader,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	gssize n_read;
+
+	if (reader->in_start > 0) {
+		memmove (reader->in_buffer, reader->in_buffer + reader->in_start, reader->in_end - reader->in_start);
+		reader->in_end -= reader->in_start;
+		reader->in_start = 0;
+	}
+
+	n_read = g_input_stream_read (
+		reader->input,
+		reader->in_buffer + reader->in_end,
+		IO_BUFFER_SIZE - reader->in_end,
+		cancellable, error);
+
+	if (n_read < 0)
+		return FALSE;
+
+	if (n_read == 0)
+		reader->in_eof = TRUE;
+
+	reader->in_end += n_read;
+
+	return TRUE;
+}
+
+/* Reads the decompressed tar stream; returns 0 at its end.  The gzip
+ * archives can consist of several members, each decompressed in turn. */
+static gssize
+backup_reader_decompress (BackupReader *reader,
+                          guint8 *buffer,
+                          gsize size,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	if (!reader->decompressor) {
+		gssize n_read;
+
+		n_read = g_input_stream_read (reader->input, buffer, size, cancellable, error);
+
+		/* Check whether xz could decompress it all */
+		if (n_read == 0 && reader->subprocess &&
+		    !g_subprocess_wait_check (reader->subprocess, cancellable, error))
+			return -1;
+
+		return n_read;
+	}
+
+	while (TRUE) {
+		GConverterResult result;
+		gsize n_read = 0, n_written = 0;
+		GError *local_error = NULL;
+
+		if (reader->in_start == reader->in_end && !reader->in_eof &&
+		    !backup_reader_read_input (reader, cancellable, error))
+			return -1;
+
+		if (reader->in_start == reader->in_end && reader->in_eof && !reader->in_member)
+			return 0;
+
+		result = g_converter_convert (
+			reader->decompressor,
+			reader->in_buffer + reader->in_start,
+			reader->in_end - reader->in_start,
+			buffer, size,
+			reader->in_eof ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+			&n_read, &n_written, &local_error);
+
+		if (result == G_CONVERTER_ERROR) {
+			if (!reader->in_eof && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT)) {
+				g_clear_error (&local_error);
+
+				if (!backup_reader_read_input (reader, cancellable, error))
+					return -1;
+
+				continue;
+			}
+
+			g_propagate_error (error, local_error);
+
+			return -1;
+		}
+
+		reader->in_start += n_read;
+
+		if (n_read > 0)
+			reader->in_member = TRUE;
+
+		if (result == G_CONVERTER_FINISHED) {
+			g_converter_reset (reader->decompressor);
+			reader->in_member = FALSE;
+		}
+
+		if (n_written > 0)
+			return n_written;
+	}
+}
+
+static gboolean
+backup_reader_read_exact (BackupReader *reader,
+                          gpointer buffer,
+                          gsize size,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	guint8 *bytes = buffer;
+
+	while (size > 0) {
+		gssize n_read;
+
+		n_read = backup_reader_decompress (reader, bytes, size, cancellable, error);
+
+		if (n_read < 0)
+			return FALSE;
+
+		if (n_read == 0) {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+				_("Unexpected end of the back up file"));
+			return FALSE;
+		}
+
+		bytes += n_read;
+		size -= n_read;
+	}
+
+	return TRUE;
+}
+
+/* Skips what is left of the current entry, including its padding. */
+static gboolean
+backup_reader_skip (BackupReader *reader,
+                    GCancellable *cancellable,
+                    GError **error)
+{
+	guint8 *buffer;
+	gboolean success = TRUE;
+
+	if (reader->remaining == 0 && reader->padding == 0)
+		return TRUE;
+
+	buffer = g_malloc (IO_BUFFER_SIZE);
+
+	while (success && reader->remaining > 0) {
+		gsize n_bytes = MIN (reader->remaining, IO_BUFFER_SIZE);
+
+		success = backup_reader_read_exact (reader, buffer, n_bytes, cancellable, error);
+		reader->remaining -= n_bytes;
+
+		if (success && reader->progress_func)
+			reader->progress_func (n_bytes, reader->progress_data);
+	}
+
+	if (success)
+		success = backup_reader_read_exact (reader, buffer, reader->padding, cancellable, error);
+
+	reader->padding = 0;
+
+	g_free (buffer);
+
+	return success;
+}
+
+static gchar *
+backup_reader_read_meta (BackupReader *reader,
+                         goffset size,
+                         GCancellable *cancellable,
+                         GError **error)
+{
+	gchar *data;
+
+	if (size > MAX_META_SIZE) {
+		g_set_error_literal (
+			error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			_("The back up file is not a valid archive"));
+		return NULL;
+	}
+
+	data = g_malloc0 (size + 1);
+
+	if (!backup_reader_read_exact (reader, data, size, cancellable, error)) {
+		g_free (data);
+		return NULL;
+	}
+
+	reader->remaining = 0;
+	reader->padding = (BLOCK_SIZE - (size % BLOCK_SIZE)) % BLOCK_SIZE;
+
+	if (!backup_reader_skip (reader, cancellable, error)) {
+		g_free (data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/* Picks the "path" and "linkpath" records of a pax extended header. */
+static void
+backup_reader_parse_pax (const gchar *data,
+                         goffset size,
+                         gchar **inout_name,
+                         gchar **inout_link_name)
+{
+	const gchar *ptr = data, *end = data + size;
+
+	while (ptr < end) {
+		const gchar *record = ptr, *key, *value;
+		guint64 len;
+		gchar *endptr = NULL;
+
+		len = g_ascii_strtoull (record, &endptr, 10);
+		if (!endptr || *endptr != ' ' || len == 0 || len > (guint64) (end - record))
+			break;
+
+		ptr = record + len;
+		key = endptr + 1;
+		value = strchr (key, '=');
+
+		if (!value || value >= ptr)
+			continue;
+
+		value++;
+
+		/* The record ends with a new line */
+		if (strncmp (key, "path=", 5) == 0) {
+			g_free (*inout_name);
+			*inout_name = g_strndup (value, ptr - value - 1);
+		} else if (strncmp (key, "linkpath=", 9) == 0) {
+			g_free (*inout_link_name);
+			*inout_link_name = g_strndup (value, ptr - value - 1);
+		}
+	}
+}
+
+BackupReader *
+backup_reader_new (const gchar *filename,
+                   BackupProgressFunc progress_func,
+                   gpointer progress_data,
+                   GError **error)
+{
+	BackupReader *reader;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	reader = g_slice_new0 (BackupReader);
+	reader->progress_func = progress_func;
+	reader->progress_data = progress_data;
+
+	if (backup_archive_filename_is_xz (filename)) {
+		reader->subprocess = g_subprocess_new (
+			G_SUBPROCESS_FLAGS_STDOUT_PIPE, error,
+			"xz", "-d", "-c", filename, NULL);
+
+		if (reader->subprocess)
+			reader->input = g_object_ref (g_subprocess_get_stdout_pipe (reader->subprocess));
+	} else {
+		GFile *file;
+
+		file = g_file_new_for_path (filename);
+		reader->input = G_INPUT_STREAM (g_file_read (file, NULL, error));
+		g_object_unref (file);
+
+		reader->decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+		reader->in_buffer = g_malloc (IO_BUFFER_SIZE);
+	}
+
+	if (!reader->input) {
+		backup_reader_free (reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+/* Moves to the next entry of the archive, skipping any unread content
+ * of the current one.  Sets @out_entry to %NULL at the end of the
+ * archive.  The entry is valid until the next call. */
+gboolean
+backup_reader_next (BackupReader *reader,
+                    const BackupEntry **out_entry,
+                    GCancellable *cancellable,
+                    GError **error)
+{
+	gchar *long_name = NULL, *long_link_name = NULL;
+
+	g_return_val_if_fail (reader != NULL, FALSE);
+	g_return_val_if_fail (out_entry != NULL, FALSE);
+
+	*out_entry = NULL;
+
+	if (!backup_reader_skip (reader, cancellable, error))
+		return FALSE;
+
+	backup_entry_clear (&reader->entry);
+
+	while (!reader->finished) {
+		guint8 header[BLOCK_SIZE];
+		BackupEntry *entry = &reader->entry;
+		goffset size;
+		gchar type;
+
+		if (!backup_reader_read_exact (reader, header, BLOCK_SIZE, cancellable, error))
+			break;
+
+		if (header[0] == '\0') {
+			reader->finished = TRUE;
+			break;
+		}
+
+		if (backup_header_checksum (header) != backup_header_get_number (header + HEADER_CHECKSUM, 8)) {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				_("The back up file is not a valid archive"));
+			break;
+		}
+
+		size = backup_header_get_number (header + HEADER_SIZE, 12);
+		type = header[HEADER_TYPE];
+
+		if (type == 'L' || type == 'K' || type == 'x') {
+			gchar *data;
+
+			data = backup_reader_read_meta (reader, size, cancellable, error);
+			if (!data)
+				break;
+
+			if (type == 'L') {
+				g_free (long_name);
+				long_name = data;
+			} else if (type == 'K') {
+				g_free (long_link_name);
+				long_link_name = data;
+			} else {
+				backup_reader_parse_pax (data, size, &long_name, &long_link_name);
+				g_free (data);
+			}
+
+			continue;
+		}
+
+		if (type == 'g') {
+			reader->remaining = size;
+			reader->padding = (BLOCK_SIZE - (size % BLOCK_SIZE)) % BLOCK_SIZE;
+
+			if (!backup_reader_skip (reader, cancellable, error))
+				break;
+
+			continue;
+		}
+
+		switch (type) {
+		case '0':
+		case '\0':
+		case '7':
+			entry->type = BACKUP_ENTRY_FILE;
+			break;
+		case '1':
+			entry->type = BACKUP_ENTRY_HARDLINK;
+			break;
+		case '5':
+			entry->type = BACKUP_ENTRY_DIRECTORY;
+			break;
+		default:
+			entry->type = BACKUP_ENTRY_OTHER;
+			break;
+		}
+
+		if (long_name) {
+			entry->name = long_name;
+			long_name = NULL;
+		} else {
+			gchar *name, *prefix = NULL;
+
+			name = backup_header_dup_string (header + HEADER_NAME, 100);
+
+			/* The POSIX ustar format can split long names */
+			if (memcmp (header + HEADER_MAGIC, "ustar\0", 6) == 0)
+				prefix = backup_header_dup_string (header + HEADER_PREFIX, 155);
+
+			if (prefix && *prefix) {
+				entry->name = g_strconcat (prefix, "/", name, NULL);
+				g_free (name);
+			} else {
+				entry->name = name;
+			}
+
+			g_free (prefix);
+		}
+
+		if (long_link_name) {
+			entry->link_name = long_link_name;
+			long_link_name = NULL;
+		} else {
+			entry->link_name = backup_header_dup_string (header + HEADER_LINK_NAME, 100);
+		}
+
+		entry->mode = backup_header_get_number (header + HEADER_MODE, 8);
+		entry->mtime = backup_header_get_number (header + HEADER_MTIME, 12);
+		entry->size = entry->type == BACKUP_ENTRY_DIRECTORY ? 0 : size;
+
+		reader->remaining = entry->size;
+		reader->padding = (BLOCK_SIZE - (entry->size % BLOCK_SIZE)) % BLOCK_SIZE;
+
+		*out_entry = entry;
+
+		break;
+	}
+
+	g_free (long_name);
+	g_free (long_link_name);
+
+	return *out_entry != NULL || reader->finished;
+}
+
+/* Reads the whole content of the current entry, meant for small ones. */
+GBytes *
+backup_reader_read_bytes (BackupReader *reader,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	gchar *data;
+	goffset size;
+
+	g_return_val_if_fail (reader != NULL, NULL);
+
+	size = reader->remaining;
+
+	if (size > MAX_META_SIZE) {
+		g_set_error_literal (
+			error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			_("The back up file is not a valid archive"));
+		return NULL;
+	}
+
+	data = g_malloc (size + 1);
+	data[size] = '\0';
+
+	if (!backup_reader_read_exact (reader, data, size, cancellable, error)) {
+		g_free (data);
+		return NULL;
+	}
+
+	reader->remaining = 0;
+
+	return g_bytes_new_take (data, size);
+}
+
+/* Writes the content of the current file entry to @filename, which
+ * gets the mode and the modification time stored in the archive. */
+gboolean
+backup_reader_extract (BackupReader *reader,
+                       const gchar *filename,
+                       GCancellable *cancellable,
+                       GError **error)
+{
+	struct utimbuf ut;
+	guint8 *buffer;
+	gchar *dirname;
+	FILE *file;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail (reader != NULL, FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (reader->entry.type == BACKUP_ENTRY_FILE, FALSE);
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	file = g_fopen (filename, "wb");
+	if (!file) {
+		gint errsv = errno;
+
+		g_set_error (
+			error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			_("Failed to create file “%s”: %s"),
+			filename, g_strerror (errsv));
+		return FALSE;
+	}
+
+	buffer = g_malloc (IO_BUFFER_SIZE);
+
+	while (success && reader->remaining > 0) {
+		gsize n_bytes = MIN (reader->remaining, IO_BUFFER_SIZE);
+
+		success = backup_reader_read_exact (reader, buffer, n_bytes, cancellable, error);
+
+		if (success && fwrite (buffer, 1, n_bytes, file) != n_bytes) {
+			gint errsv = errno;
+
+			g_set_error (
+				error, G_IO_ERROR, g_io_error_from_errno (errsv),
+				_("Failed to write file “%s”: %s"),
+				filename, g_strerror (errsv));
+			success = FALSE;
+		}
+
+		reader->remaining -= n_bytes;
+
+		if (success && reader->progress_func)
+			reader->progress_func (n_bytes, reader->progress_data);
+	}
+
+	g_free (buffer);
+
+	if (fclose (file) != 0 && success) {
+		gint errsv = errno;
+
+		g_set_error (
+			error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			_("Failed to write file “%s”: %s"),
+			filename, g_strerror (errsv));
+		success = FALSE;
+	}
+
+	if (success) {
+		g_chmod (filename, reader->entry.mode & 0777);
+
+		ut.actime = ut.modtime = (time_t) reader->entry.mtime;
+		g_utime (filename, &ut);
+	}
+
+	return success;
+}
+
+void
+backup_reader_free (BackupReader *reader)
+{
+	if (!reader)
+		return;
+
+	if (reader->subprocess) {
+		g_subprocess_force_exit (reader->subprocess);
+		g_subprocess_wait (reader->subprocess, NULL, NULL);
+	}
+
+	if (reader->input)
+		g_input_stream_close (reader->input, NULL, NULL);
+
+	backup_entry_clear (&reader->entry);
+
+	g_clear_object (&reader->input);
+	g_clear_object (&reader->subprocess);
+	g_clear_object (&reader->decompressor);
+	g_free (reader->in_buffer);
+
+	g_slice_free (BackupReader, reader);
+}
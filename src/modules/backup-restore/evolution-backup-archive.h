@@ -0,0 +1,98 @@
+/*
+ * evolution-backup-archive.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EVOLUTION_BACKUP_ARCHIVE_H
+#define EVOLUTION_BACKUP_ARCHIVE_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	BACKUP_ENTRY_FILE,
+	BACKUP_ENTRY_DIRECTORY,
+	BACKUP_ENTRY_HARDLINK,
+	BACKUP_ENTRY_OTHER
+} BackupEntryType;
+
+typedef struct _BackupEntry {
+	BackupEntryType type;
+	gchar *name;
+	gchar *link_name;
+	guint mode;
+	gint64 mtime;
+	goffset size;
+} BackupEntry;
+
+/* Called with the count of bytes of file content just processed. */
+typedef void	(*BackupProgressFunc)		(goffset n_bytes,
+						 gpointer user_data);
+
+typedef struct _BackupWriter BackupWriter;
+typedef struct _BackupReader BackupReader;
+
+gboolean	backup_archive_filename_is_xz	(const gchar *filename);
+
+BackupWriter *	backup_writer_new		(const gchar *filename,
+						 BackupProgressFunc progress_func,
+						 gpointer progress_data,
+						 GError **error);
+gboolean	backup_writer_add_directory	(BackupWriter *writer,
+						 const gchar *name,
+						 guint mode,
+						 gint64 mtime,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	backup_writer_add_file		(BackupWriter *writer,
+						 const gchar *name,
+						 const gchar *filename,
+						 guint mode,
+						 gint64 mtime,
+						 goffset size,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	backup_writer_add_data		(BackupWriter *writer,
+						 const gchar *name,
+						 gconstpointer data,
+						 gsize size,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	backup_writer_close		(BackupWriter *writer,
+						 GCancellable *cancellable,
+						 GError **error);
+void		backup_writer_free		(BackupWriter *writer);
+
+BackupReader *	backup_reader_new		(const gchar *filename,
+						 BackupProgressFunc progress_func,
+						 gpointer progress_data,
+						 GError **error);
+gboolean	backup_reader_next		(BackupReader *reader,
+						 const BackupEntry **out_entry,
+						 GCancellable *cancellable,
+						 GError **error);
+GBytes *	backup_reader_read_bytes	(BackupReader *reader,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	backup_reader_extract		(BackupReader *reader,
+						 const gchar *filename,
+						 GCancellable *cancellable,
+						 GError **error);
+void		backup_reader_free		(BackupReader *reader);
+
+G_END_DECLS
+
+#endif /* EVOLUTION_BACKUP_ARCHIVE_H */
@@ -37,6 +37,8 @@
 #include "e-util/e-util-private.h"
 #include "e-util/e-util.h"
 
+#include "evolution-backup-archive.h"
+
 #define EVOUSERDATADIR_MAGIC "#EVO_USERDATADIR#"
 
 #define EVOLUTION "evolution"
@@ -49,6 +51,8 @@
 #define DCONF_DUMP_FILE_EDS "backup-restore-dconf-eds.ini"
 #define DCONF_DUMP_FILE_EVO "backup-restore-dconf-evo.ini"
 
+#define BACKUP_MANIFEST_FILE ".evolution.manifest"
+
 #define DCONF_PATH_EDS "/org/gnome/evolution-data-server/"
 #define DCONF_PATH_EVO "/org/gnome/evolution/"
 
@@ -60,6 +64,7 @@ static gboolean restore_op = FALSE;
 static gchar *res_file = NULL;
 static gboolean check_op = FALSE;
 static gchar *chk_file = NULL;
+static gboolean incremental_arg = FALSE;
 static gboolean restart_arg = FALSE;
 static gboolean gui_arg = FALSE;
 static gchar **opt_remaining = NULL;
@@ -75,6 +80,8 @@ static GOptionEntry options[] = {
 	  N_("Restore Evolution directory"), NULL },
 	{ "check", '\0', 0, G_OPTION_ARG_NONE, &check_op,
 	  N_("Check Evolution Back up"), NULL },
+	{ "incremental", '\0', 0, G_OPTION_ARG_NONE, &incremental_arg,
+	  N_("Back up only files changed since the last back up"), NULL },
 	{ "restart", '\0', 0, G_OPTION_ARG_NONE, &restart_arg,
 	  N_("Restart Evolution"), NULL },
 	{ "gui", '\0', 0, G_OPTION_ARG_NONE, &gui_arg,
@@ -89,7 +96,7 @@ static GOptionEntry options[] = {
 #define print_and_run(x) \
 	G_STMT_START { g_message ("%s", x); if (system (x) == -1) g_warning ("%s: Failed to execute '%s'", G_STRFUNC, (x)); } G_STMT_END
 
-static gboolean check (const gchar *filename, gboolean *is_new_format);
+static gboolean check (const gchar *filename, gboolean *is_new_format, gchar **out_dir_content);
 
 static const gchar *
 strip_home_dir (const gchar *dir)
@@ -235,14 +242,284 @@ run_evolution_no_wait (void)
 	g_spawn_command_line_async (EVOLUTION, NULL);
 }
 
+static gchar *
+expand_path (const gchar *path)
+{
+	GString *str;
+
+	str = replace_variables (path, TRUE);
+	g_return_val_if_fail (str != NULL, NULL);
+
+	return g_string_free (str, FALSE);
+}
+
 static void
-write_dir_file (void)
+remove_recursive (const gchar *path)
 {
-	GString *content, *filename;
-	GError *error = NULL;
+	if (g_file_test (path, G_FILE_TEST_IS_DIR) &&
+	    !g_file_test (path, G_FILE_TEST_IS_SYMLINK)) {
+		GDir *dir;
 
-	filename = replace_variables ("$HOME/" EVOLUTION_DIR_FILE, TRUE);
-	g_return_if_fail (filename != NULL);
+		dir = g_dir_open (path, 0, NULL);
+		if (dir) {
+			const gchar *name;
+
+			while ((name = g_dir_read_name (dir)) != NULL) {
+				gchar *child;
+
+				child = g_build_filename (path, name, NULL);
+				remove_recursive (child);
+				g_free (child);
+			}
+
+			g_dir_close (dir);
+		}
+
+		g_rmdir (path);
+	} else {
+		g_unlink (path);
+	}
+}
+
+/* Removes the file or the directory tree at @path,
+ * which can contain the variables of replace_variables(). */
+static void
+remove_path (const gchar *path)
+{
+	gchar *filename;
+
+	filename = expand_path (path);
+	if (!filename)
+		return;
+
+	g_message ("Removing '%s'", filename);
+	remove_recursive (filename);
+
+	g_free (filename);
+}
+
+static gboolean
+rename_path (const gchar *from,
+             const gchar *to)
+{
+	gchar *from_filename, *to_filename;
+	gboolean success = FALSE;
+
+	from_filename = expand_path (from);
+	to_filename = expand_path (to);
+
+	if (from_filename && to_filename) {
+		g_message ("Moving '%s' to '%s'", from_filename, to_filename);
+
+		success = g_rename (from_filename, to_filename) == 0;
+
+		if (!success && errno != ENOENT)
+			g_warning (
+				"%s: Failed to move '%s' to '%s': %s", G_STRFUNC,
+				from_filename, to_filename, g_strerror (errno));
+	}
+
+	g_free (from_filename);
+	g_free (to_filename);
+
+	return success;
+}
+
+/* Progress of the archive reading and writing, in permilles of the
+ * file content, or -1 when unknown; read by the progress dialog. */
+static gint progress_permille = -1;
+static goffset progress_done = 0;
+static goffset progress_total = 0;
+
+static void
+set_progress_total (goffset total)
+{
+	progress_done = 0;
+	progress_total = total;
+
+	g_atomic_int_set (&progress_permille, total > 0 ? 0 : -1);
+}
+
+static void
+update_progress_cb (goffset n_bytes,
+                    gpointer user_data)
+{
+	progress_done += n_bytes;
+
+	if (progress_total > 0)
+		g_atomic_int_set (&progress_permille, (gint) (MIN (progress_done, progress_total) * 1000 / progress_total));
+}
+
+typedef struct _BackupFile {
+	gchar *name;		/* in the archive */
+	gchar *filename;	/* on the disk */
+	gboolean is_dir;
+	gboolean unchanged;
+	guint mode;
+	gint64 mtime;
+	goffset size;
+} BackupFile;
+
+static void
+backup_file_free (BackupFile *bf)
+{
+	if (bf) {
+		g_free (bf->name);
+		g_free (bf->filename);
+		g_slice_free (BackupFile, bf);
+	}
+}
+
+/* Collects what "tar ch" would archive when @follow_links is set, thus
+ * follows the symbolic links, but enters each directory only once, to
+ * not loop forever. */
+static void
+collect_files (const gchar *filename,
+               const gchar *name,
+               gboolean follow_links,
+               GHashTable *visited_dirs,
+               GPtrArray *files)
+{
+	BackupFile *bf;
+	GStatBuf st;
+
+	if ((follow_links ? g_stat (filename, &st) : g_lstat (filename, &st)) != 0) {
+		g_warning ("%s: Cannot stat '%s': %s", G_STRFUNC, filename, g_strerror (errno));
+		return;
+	}
+
+	if (!S_ISDIR (st.st_mode) && !S_ISREG (st.st_mode))
+		return;
+
+	if (S_ISDIR (st.st_mode) && st.st_ino != 0) {
+		gchar *key;
+
+		key = g_strdup_printf (
+			"%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+			(guint64) st.st_dev, (guint64) st.st_ino);
+
+		if (g_hash_table_contains (visited_dirs, key)) {
+			g_free (key);
+			return;
+		}
+
+		g_hash_table_add (visited_dirs, key);
+	}
+
+	bf = g_slice_new0 (BackupFile);
+	bf->name = g_strdup (name);
+	bf->filename = g_strdup (filename);
+	bf->is_dir = S_ISDIR (st.st_mode);
+	bf->mode = st.st_mode;
+	bf->mtime = st.st_mtime;
+	bf->size = bf->is_dir ? 0 : st.st_size;
+
+	g_ptr_array_add (files, bf);
+
+	if (bf->is_dir) {
+		GDir *dir;
+		const gchar *child;
+
+		dir = g_dir_open (filename, 0, NULL);
+		if (!dir)
+			return;
+
+		while ((child = g_dir_read_name (dir)) != NULL) {
+			gchar *child_filename, *child_name;
+
+			child_filename = g_build_filename (filename, child, NULL);
+			child_name = g_strconcat (name, "/", child, NULL);
+
+			collect_files (child_filename, child_name, follow_links, visited_dirs, files);
+
+			g_free (child_filename);
+			g_free (child_name);
+		}
+
+		g_dir_close (dir);
+	}
+}
+
+static gchar *
+get_manifest_filename (void)
+{
+	return g_build_filename (e_get_user_cache_dir (), BACKUP_MANIFEST_FILE, NULL);
+}
+
+/* The manifest has a line per regular file: "mtime size name",
+ * with the name escaped by g_strescape(). */
+static GString *
+manifest_build (GPtrArray *files)
+{
+	GString *manifest;
+	guint ii;
+
+	manifest = g_string_new ("");
+
+	for (ii = 0; ii < files->len; ii++) {
+		BackupFile *bf = g_ptr_array_index (files, ii);
+		gchar *escaped;
+
+		if (bf->is_dir)
+			continue;
+
+		escaped = g_strescape (bf->name, NULL);
+		g_string_append_printf (
+			manifest, "%" G_GINT64_FORMAT " %" G_GOFFSET_FORMAT " %s\n",
+			bf->mtime, bf->size, escaped);
+		g_free (escaped);
+	}
+
+	return manifest;
+}
+
+/* Returns a name ~> BackupFile table of the manifest entries. */
+static GHashTable *
+manifest_parse (const gchar *content)
+{
+	GHashTable *manifest;
+	gchar **lines;
+	guint ii;
+
+	manifest = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		NULL, (GDestroyNotify) backup_file_free);
+
+	lines = g_strsplit (content, "\n", -1);
+
+	for (ii = 0; lines[ii]; ii++) {
+		BackupFile *bf;
+		gchar *ptr = lines[ii], *endptr = NULL;
+		gint64 mtime;
+		goffset size;
+
+		mtime = g_ascii_strtoll (ptr, &endptr, 10);
+		if (!endptr || *endptr != ' ')
+			continue;
+
+		ptr = endptr + 1;
+		size = g_ascii_strtoll (ptr, &endptr, 10);
+		if (!endptr || *endptr != ' ' || !endptr[1])
+			continue;
+
+		bf = g_slice_new0 (BackupFile);
+		bf->name = g_strcompress (endptr + 1);
+		bf->mtime = mtime;
+		bf->size = size;
+
+		g_hash_table_replace (manifest, bf->name, bf);
+	}
+
+	g_strfreev (lines);
+
+	return manifest;
+}
+
+static GString *
+build_dir_file_content (gboolean incremental,
+                        goffset size)
+{
+	GString *content;
 
 	content = replace_variables (
 		"[" KEY_FILE_GROUP "]\n"
@@ -250,41 +527,112 @@ write_dir_file (void)
 		"UserDataDir=$STRIPDATADIR\n"
 		"UserConfigDir=$STRIPCONFIGDIR\n"
 		, TRUE);
-	g_return_if_fail (content != NULL);
+	g_return_val_if_fail (content != NULL, NULL);
 
-	g_file_set_contents (filename->str, content->str, content->len, &error);
+	g_string_append_printf (content, "\nSize=%" G_GOFFSET_FORMAT "\n", size);
 
-	if (error != NULL) {
-		g_warning ("Failed to write file '%s': %s\n", filename->str, error->message);
-		g_error_free (error);
-	}
+	if (incremental)
+		g_string_append (content, "Incremental=true\n");
 
-	g_string_free (filename, TRUE);
-	g_string_free (content, TRUE);
+	return content;
 }
 
 static gboolean
-get_filename_is_xz (const gchar *filename)
+write_archive (const gchar *filename,
+               GCancellable *cancellable,
+               GError **error)
 {
-	gint len;
+	BackupWriter *writer;
+	GHashTable *visited_dirs, *previous = NULL;
+	GPtrArray *files;
+	GString *dir_content, *manifest;
+	gchar *manifest_filename, *content = NULL;
+	goffset total = 0;
+	gboolean success;
+	guint ii;
+
+	manifest_filename = get_manifest_filename ();
+
+	if (incremental_arg && g_file_get_contents (manifest_filename, &content, NULL, NULL)) {
+		previous = manifest_parse (content);
+		g_free (content);
+	}
 
-	if (!filename)
-		return FALSE;
+	files = g_ptr_array_new_with_free_func ((GDestroyNotify) backup_file_free);
+	visited_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-	len = strlen (filename);
-	if (len < 3)
-		return FALSE;
+	collect_files (e_get_user_data_dir (), strip_home_dir (e_get_user_data_dir ()), TRUE, visited_dirs, files);
+	collect_files (e_get_user_config_dir (), strip_home_dir (e_get_user_config_dir ()), TRUE, visited_dirs, files);
+
+	g_hash_table_destroy (visited_dirs);
+
+	for (ii = 0; ii < files->len; ii++) {
+		BackupFile *bf = g_ptr_array_index (files, ii);
+
+		if (previous && !bf->is_dir) {
+			BackupFile *prev = g_hash_table_lookup (previous, bf->name);
+
+			bf->unchanged = prev && prev->mtime == bf->mtime && prev->size == bf->size;
+		}
 
-	return g_ascii_strcasecmp (filename + len - 3, ".xz") == 0;
+		if (!bf->unchanged)
+			total += bf->size;
+	}
+
+	dir_content = build_dir_file_content (previous != NULL, total);
+	manifest = manifest_build (files);
+
+	set_progress_total (total);
+
+	writer = backup_writer_new (filename, update_progress_cb, NULL, error);
+	success = writer != NULL;
+
+	/* The descriptive files go first, thus the restore can read
+	 * them before extracting anything. */
+	success = success &&
+		backup_writer_add_data (writer, EVOLUTION_DIR_FILE, dir_content->str, dir_content->len, cancellable, error) &&
+		backup_writer_add_data (writer, BACKUP_MANIFEST_FILE, manifest->str, manifest->len, cancellable, error);
+
+	for (ii = 0; success && ii < files->len; ii++) {
+		BackupFile *bf = g_ptr_array_index (files, ii);
+
+		if (bf->is_dir)
+			success = backup_writer_add_directory (writer, bf->name, bf->mode, bf->mtime, cancellable, error);
+		else if (!bf->unchanged)
+			success = backup_writer_add_file (writer, bf->name, bf->filename, bf->mode, bf->mtime, bf->size, cancellable, error);
+	}
+
+	success = success && backup_writer_close (writer, cancellable, error);
+
+	backup_writer_free (writer);
+
+	/* The next incremental back up is relative to this one */
+	if (success) {
+		gchar *dirname;
+
+		dirname = g_path_get_dirname (manifest_filename);
+		g_mkdir_with_parents (dirname, 0700);
+		g_free (dirname);
+
+		g_file_set_contents (manifest_filename, manifest->str, manifest->len, NULL);
+	}
+
+	g_string_free (dir_content, TRUE);
+	g_string_free (manifest, TRUE);
+	g_ptr_array_unref (files);
+	g_free (manifest_filename);
+
+	if (previous)
+		g_hash_table_destroy (previous);
+
+	return success;
 }
 
 static void
 backup (const gchar *filename,
         GCancellable *cancellable)
 {
-	gchar *command;
-	gchar *quotedfname;
-	gboolean use_xz;
+	GError *error = NULL;
 
 	g_return_if_fail (filename && *filename);
 
@@ -295,7 +643,7 @@ backup (const gchar *filename,
 	/* FIXME Will the versioned setting always work? */
 	run_cmd (EVOLUTION " --quit");
 
-	run_cmd ("rm $DATADIR/.running");
+	remove_path ("$DATADIR/.running");
 
 	if (g_cancellable_is_cancelled (cancellable))
 		return;
@@ -312,26 +660,23 @@ backup (const gchar *filename,
 		EVOLUTION_DIR DCONF_DUMP_FILE_EVO,
 		e_get_user_data_dir (), EVOUSERDATADIR_MAGIC);
 
-	write_dir_file ();
-
 	if (g_cancellable_is_cancelled (cancellable))
 		return;
 
 	txt = _("Backing Evolution data (Mails, Contacts, Calendar, Tasks, Memos)");
 
-	quotedfname = g_shell_quote (filename);
-	use_xz = get_filename_is_xz (filename);
+	if (!write_archive (filename, cancellable, &error)) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Failed to write back up file '%s': %s", filename, error ? error->message : "Unknown error");
 
-	command = g_strdup_printf (
-		"cd $HOME && tar chf - $STRIPDATADIR "
-		"$STRIPCONFIGDIR " EVOLUTION_DIR_FILE " | "
-		"%s > %s", use_xz ? "xz -z" : "gzip", quotedfname);
-	run_cmd (command);
+		g_clear_error (&error);
+		set_progress_total (0);
+		result = 1;
 
-	g_free (command);
-	g_free (quotedfname);
+		return;
+	}
 
-	run_cmd ("rm $HOME/" EVOLUTION_DIR_FILE);
+	set_progress_total (0);
 
 	txt = _("Back up complete");
 
@@ -347,23 +692,25 @@ backup (const gchar *filename,
 }
 
 static void
-extract_backup_data (const gchar *filename,
+extract_backup_data (const gchar *content,
                      gchar **restored_version,
                      gchar **data_dir,
-                     gchar **config_dir)
+                     gchar **config_dir,
+                     goffset *size,
+                     gboolean *incremental)
 {
 	GKeyFile *key_file;
 	GError *error = NULL;
 
-	g_return_if_fail (filename != NULL);
+	g_return_if_fail (content != NULL);
 	g_return_if_fail (data_dir != NULL);
 	g_return_if_fail (config_dir != NULL);
 
 	key_file = g_key_file_new ();
-	g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, &error);
+	g_key_file_load_from_data (key_file, content, -1, G_KEY_FILE_NONE, &error);
 
 	if (error != NULL) {
-		g_warning ("Failed to read '%s': %s", filename, error->message);
+		g_warning ("Failed to read '%s': %s", EVOLUTION_DIR_FILE, error->message);
 		g_error_free (error);
 
 	/* This is the current format as of Evolution 3.6. */
@@ -379,49 +726,238 @@ extract_backup_data (const gchar *filename,
 		tmp = g_key_file_get_value (
 			key_file, KEY_FILE_GROUP, "UserDataDir", NULL);
 		if (tmp != NULL)
-			*data_dir = g_shell_quote (tmp);
+			*data_dir = g_strdup (tmp);
 		g_free (tmp);
 
 		tmp = g_key_file_get_value (
 			key_file, KEY_FILE_GROUP, "UserConfigDir", NULL);
 		if (tmp != NULL)
-			*config_dir = g_shell_quote (tmp);
+			*config_dir = g_strdup (tmp);
 		g_free (tmp);
 
+		/* Written by the back up since 3.26 */
+		*size = g_key_file_get_int64 (key_file, KEY_FILE_GROUP, "Size", NULL);
+		*incremental = g_key_file_get_boolean (key_file, KEY_FILE_GROUP, "Incremental", NULL);
+
 	/* This is the legacy format with no version information. */
 	} else if (g_key_file_has_group (key_file, "dirs")) {
 		gchar *tmp;
 
 		tmp = g_key_file_get_value (key_file, "dirs", "data", NULL);
 		if (tmp)
-			*data_dir = g_shell_quote (tmp);
+			*data_dir = g_strdup (tmp);
 		g_free (tmp);
 
 		tmp = g_key_file_get_value (key_file, "dirs", "config", NULL);
 		if (tmp)
-			*config_dir = g_shell_quote (tmp);
+			*config_dir = g_strdup (tmp);
 		g_free (tmp);
 	}
 
 	g_key_file_free (key_file);
 }
 
-static gint
-get_dir_level (const gchar *dir)
+static const gchar *
+skip_archive_prefix (const gchar *name,
+                     const gchar *prefix)
 {
-	gint res = 0, i;
+	gsize len;
 
-	g_return_val_if_fail (dir != NULL, -1);
+	while (*prefix == G_DIR_SEPARATOR)
+		prefix++;
+
+	len = strlen (prefix);
+	while (len > 0 && prefix[len - 1] == G_DIR_SEPARATOR)
+		len--;
+
+	if (len == 0 || strncmp (name, prefix, len) != 0)
+		return NULL;
+
+	if (name[len] != '\0' && name[len] != '/')
+		return NULL;
+
+	name += len;
+	while (*name == '/')
+		name++;
+
+	return name;
+}
+
+/* Returns where the archive member @name belongs to, or %NULL when
+ * it is not part of the restored data.  The @data_dir and the
+ * @config_dir are as stored in the archive; when %NULL, it is
+ * the pre-3.0 archive with everything in ~/.evolution. */
+static gchar *
+map_archive_name (const gchar *name,
+                  const gchar *data_dir,
+                  const gchar *config_dir)
+{
+	const gchar *rest;
+	gchar **parts;
+	gboolean valid = TRUE;
+	guint ii;
 
-	for (i = 0; dir[i]; i++) {
-		if (dir[i] == '/' || dir[i] == '\\')
-			res++;
+	while (g_str_has_prefix (name, "./"))
+		name += 2;
+
+	if (!*name || g_path_is_absolute (name))
+		return NULL;
+
+	/* Never write outside of the target directories */
+	parts = g_strsplit (name, "/", -1);
+	for (ii = 0; valid && parts[ii]; ii++) {
+		valid = strcmp (parts[ii], "..") != 0;
 	}
+	g_strfreev (parts);
 
-	if (i > 0)
-		res++;
+	if (!valid)
+		return NULL;
 
-	return res;
+	if (!data_dir || !config_dir) {
+		if (!skip_archive_prefix (name, ".evolution"))
+			return NULL;
+
+		return g_build_filename (g_get_home_dir (), name, NULL);
+	}
+
+	rest = skip_archive_prefix (name, data_dir);
+	if (rest)
+		return g_build_filename (e_get_user_data_dir (), rest, NULL);
+
+	rest = skip_archive_prefix (name, config_dir);
+	if (rest)
+		return g_build_filename (e_get_user_config_dir (), rest, NULL);
+
+	return NULL;
+}
+
+/* Streams the archive content straight into the data and config
+ * directories.  For incremental archives, fills @out_manifest with
+ * the files there had been when the archive had been written. */
+static gboolean
+extract_archive (const gchar *filename,
+                 const gchar *data_dir,
+                 const gchar *config_dir,
+                 GHashTable **out_manifest,
+                 GCancellable *cancellable,
+                 GError **error)
+{
+	BackupReader *reader;
+	const BackupEntry *entry = NULL;
+	gboolean success;
+
+	reader = backup_reader_new (filename, update_progress_cb, NULL, error);
+	if (!reader)
+		return FALSE;
+
+	while ((success = backup_reader_next (reader, &entry, cancellable, error)) && entry) {
+		gchar *local_filename;
+
+		if (out_manifest && entry->type == BACKUP_ENTRY_FILE &&
+		    g_strcmp0 (entry->name, BACKUP_MANIFEST_FILE) == 0) {
+			GBytes *bytes;
+
+			bytes = backup_reader_read_bytes (reader, cancellable, error);
+			success = bytes != NULL;
+
+			if (success) {
+				*out_manifest = manifest_parse (g_bytes_get_data (bytes, NULL));
+				g_bytes_unref (bytes);
+			}
+
+			if (!success)
+				break;
+
+			continue;
+		}
+
+		local_filename = map_archive_name (entry->name, data_dir, config_dir);
+		if (!local_filename)
+			continue;
+
+		switch (entry->type) {
+		case BACKUP_ENTRY_DIRECTORY:
+			g_mkdir_with_parents (local_filename, 0700);
+			break;
+		case BACKUP_ENTRY_FILE:
+			success = backup_reader_extract (reader, local_filename, cancellable, error);
+			break;
+		case BACKUP_ENTRY_HARDLINK: {
+			gchar *target_filename;
+
+			/* The target had been extracted already */
+			target_filename = map_archive_name (entry->link_name, data_dir, config_dir);
+			if (target_filename) {
+				GFile *source, *destination;
+
+				source = g_file_new_for_path (target_filename);
+				destination = g_file_new_for_path (local_filename);
+
+				success = g_file_copy (
+					source, destination, G_FILE_COPY_OVERWRITE,
+					cancellable, NULL, NULL, error);
+
+				g_object_unref (source);
+				g_object_unref (destination);
+				g_free (target_filename);
+			}
+			} break;
+		case BACKUP_ENTRY_OTHER:
+			break;
+		}
+
+		g_free (local_filename);
+
+		if (!success)
+			break;
+	}
+
+	backup_reader_free (reader);
+
+	return success;
+}
+
+/* After an incremental restore, removes the files which had been
+ * removed before the incremental archive had been written. */
+static void
+remove_files_not_in_manifest (GHashTable *manifest,
+                              const gchar *data_dir,
+                              const gchar *config_dir)
+{
+	GHashTable *visited_dirs, *keep;
+	GHashTableIter iter;
+	GPtrArray *files;
+	gpointer key;
+	guint ii;
+
+	keep = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_hash_table_iter_init (&iter, manifest);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		gchar *local_filename;
+
+		local_filename = map_archive_name (key, data_dir, config_dir);
+		if (local_filename)
+			g_hash_table_add (keep, local_filename);
+	}
+
+	files = g_ptr_array_new_with_free_func ((GDestroyNotify) backup_file_free);
+	visited_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	/* Not through the symbolic links, these can lead anywhere */
+	collect_files (e_get_user_data_dir (), "", FALSE, visited_dirs, files);
+	collect_files (e_get_user_config_dir (), "", FALSE, visited_dirs, files);
+
+	for (ii = 0; ii < files->len; ii++) {
+		BackupFile *bf = g_ptr_array_index (files, ii);
+
+		if (!bf->is_dir && !g_hash_table_contains (keep, bf->filename))
+			g_unlink (bf->filename);
+	}
+
+	g_hash_table_destroy (visited_dirs);
+	g_hash_table_destroy (keep);
+	g_ptr_array_unref (files);
 }
 
 static gchar *
@@ -479,70 +1015,33 @@ restore (const gchar *filename,
          GCancellable *cancellable)
 {
 	gchar *command;
-	gchar *quotedfname;
+	gchar *dir_content = NULL;
 	gboolean is_new_format = FALSE;
+	gboolean incremental = FALSE;
+	GError *error = NULL;
 
 	g_return_if_fail (filename && *filename);
 
-	if (!check (filename, &is_new_format)) {
+	if (!check (filename, &is_new_format, &dir_content)) {
 		g_message ("Cannot restore from an incorrect archive '%s'.", filename);
 		goto end;
 	}
 
-	quotedfname = g_shell_quote (filename);
-
-	if (g_cancellable_is_cancelled (cancellable))
-		return;
-
-	/* FIXME Will the versioned setting always work? */
-	txt = _("Shutting down Evolution");
-	run_cmd (EVOLUTION " --quit");
-
-	if (g_cancellable_is_cancelled (cancellable))
+	if (g_cancellable_is_cancelled (cancellable)) {
+		g_free (dir_content);
 		return;
-
-	txt = _("Back up current Evolution data");
-	run_cmd ("mv $DATADIR $DATADIR_old");
-	run_cmd ("mv $CONFIGDIR $CONFIGDIR_old");
-
-	if (g_cancellable_is_cancelled (cancellable))
-		return;
-
-	txt = _("Extracting files from back up");
+	}
 
 	if (is_new_format) {
-		GString *dir_fn;
-		gchar *data_dir = NULL;
-		gchar *config_dir = NULL;
-		gchar *restored_version = NULL;
-		const gchar *tar_opts;
-
-		if (get_filename_is_xz (filename))
-			tar_opts = "-xJf";
-		else
-			tar_opts = "-xzf";
-
-		command = g_strdup_printf (
-			"cd $TMP && tar %s %s " EVOLUTION_DIR_FILE,
-			tar_opts, quotedfname);
-		run_cmd (command);
-		g_free (command);
+		/* Incremental archives apply on top of the current data */
+		gchar *data_dir = NULL, *config_dir = NULL, *restored_version = NULL;
+		goffset size = 0;
 
-		dir_fn = replace_variables ("$TMP" G_DIR_SEPARATOR_S EVOLUTION_DIR_FILE, TRUE);
-		if (!dir_fn) {
-			g_warning ("Failed to create evolution's dir filename");
-			goto end;
-		}
+		if (dir_content)
+			extract_backup_data (dir_content, &restored_version, &data_dir, &config_dir, &size, &incremental);
 
-		/* data_dir and config_dir are quoted inside extract_backup_data */
-		extract_backup_data (
-			dir_fn->str,
-			&restored_version,
-			&data_dir,
-			&config_dir);
-
-		g_unlink (dir_fn->str);
-		g_string_free (dir_fn, TRUE);
+		g_free (dir_content);
+		dir_content = NULL;
 
 		if (!data_dir || !config_dir) {
 			g_warning (
@@ -550,27 +1049,66 @@ restore (const gchar *filename,
 				"config_dir (%p)", data_dir, config_dir);
 			g_free (data_dir);
 			g_free (config_dir);
+			g_free (restored_version);
 			goto end;
 		}
 
+		/* FIXME Will the versioned setting always work? */
+		txt = _("Shutting down Evolution");
+		run_cmd (EVOLUTION " --quit");
+
+		if (g_cancellable_is_cancelled (cancellable)) {
+			g_free (data_dir);
+			g_free (config_dir);
+			g_free (restored_version);
+			return;
+		}
+
+		if (!incremental) {
+			txt = _("Back up current Evolution data");
+			rename_path ("$DATADIR", "$DATADIR_old");
+			rename_path ("$CONFIGDIR", "$CONFIGDIR_old");
+		}
+
+		txt = _("Extracting files from back up");
+
 		g_mkdir_with_parents (e_get_user_data_dir (), 0700);
 		g_mkdir_with_parents (e_get_user_config_dir (), 0700);
 
-		command = g_strdup_printf (
-			"cd $DATADIR && tar --strip-components %d %s %s %s",
-			 get_dir_level (data_dir), tar_opts, quotedfname, data_dir);
-		run_cmd (command);
-		g_free (command);
+		set_progress_total (size);
 
-		command = g_strdup_printf (
-			"cd $CONFIGDIR && tar --strip-components %d %s %s %s",
-			get_dir_level (config_dir), tar_opts, quotedfname, config_dir);
-		run_cmd (command);
-		g_free (command);
+		if (incremental) {
+			GHashTable *manifest = NULL;
+
+			if (extract_archive (filename, data_dir, config_dir, &manifest, cancellable, &error)) {
+				if (manifest)
+					remove_files_not_in_manifest (manifest, data_dir, config_dir);
+			} else {
+				g_warning ("Failed to restore from '%s': %s", filename, error ? error->message : "Unknown error");
+				g_clear_error (&error);
+				result = 1;
+			}
+
+			if (manifest)
+				g_hash_table_destroy (manifest);
+
+		} else if (!extract_archive (filename, data_dir, config_dir, NULL, cancellable, &error)) {
+			g_warning ("Failed to restore from '%s': %s", filename, error ? error->message : "Unknown error");
+			g_clear_error (&error);
+			result = 1;
+
+			/* Put back what there had been before */
+			remove_path ("$DATADIR");
+			remove_path ("$CONFIGDIR");
+			rename_path ("$DATADIR_old", "$DATADIR");
+			rename_path ("$CONFIGDIR_old", "$CONFIGDIR");
+		}
+
+		set_progress_total (0);
 
 		/* If the back file had version information, set the last
 		 * used version in GSettings before restarting Evolution. */
-		if (restored_version != NULL && *restored_version != '\0') {
+		if (result == 0 && restored_version != NULL && *restored_version != '\0') {
 			GSettings *settings;
 
 			settings = e_util_ref_settings ("org.gnome.evolution");
@@ -582,23 +1120,37 @@ restore (const gchar *filename,
 		g_free (data_dir);
 		g_free (config_dir);
 		g_free (restored_version);
+
+		if (result != 0)
+			goto end;
 	} else {
-		const gchar *decr_opts;
+		/* FIXME Will the versioned setting always work? */
+		txt = _("Shutting down Evolution");
+		run_cmd (EVOLUTION " --quit");
 
-		if (get_filename_is_xz (filename))
-			decr_opts = "xz -cd";
-		else
-			decr_opts = "gzip -cd";
+		if (g_cancellable_is_cancelled (cancellable))
+			return;
 
-		run_cmd ("mv $HOME/.evolution $HOME/.evolution_old");
+		txt = _("Back up current Evolution data");
+		rename_path ("$DATADIR", "$DATADIR_old");
+		rename_path ("$CONFIGDIR", "$CONFIGDIR_old");
+		rename_path ("$HOME/.evolution", "$HOME/.evolution_old");
 
-		command = g_strdup_printf (
-			"cd $HOME && %s %s | tar xf -", decr_opts, quotedfname);
-		run_cmd (command);
-		g_free (command);
-	}
+		txt = _("Extracting files from back up");
+
+		if (!extract_archive (filename, NULL, NULL, NULL, cancellable, &error)) {
+			g_warning ("Failed to restore from '%s': %s", filename, error ? error->message : "Unknown error");
+			g_clear_error (&error);
+			result = 1;
 
-	g_free (quotedfname);
+			remove_path ("$HOME/.evolution");
+			rename_path ("$HOME/.evolution_old", "$HOME/.evolution");
+			rename_path ("$DATADIR_old", "$DATADIR");
+			rename_path ("$CONFIGDIR_old", "$CONFIGDIR");
+
+			goto end;
+		}
+	}
 
 	if (g_cancellable_is_cancelled (cancellable))
 		return;
@@ -622,19 +1174,19 @@ restore (const gchar *filename,
 
 			/* do not forget to convert GConf keys into GSettings */
 			run_cmd ("gsettings-data-convert");
-			run_cmd ("rm " EVOLUTION_DIR ANCIENT_GCONF_DUMP_FILE);
+			remove_path (EVOLUTION_DIR ANCIENT_GCONF_DUMP_FILE);
 		} else {
 			replace_in_file (
 				EVOLUTION_DIR DCONF_DUMP_FILE_EDS,
 				EVOUSERDATADIR_MAGIC, e_get_user_data_dir ());
 			run_cmd ("cat " EVOLUTION_DIR DCONF_DUMP_FILE_EDS " | dconf load " DCONF_PATH_EDS);
-			run_cmd ("rm " EVOLUTION_DIR DCONF_DUMP_FILE_EDS);
+			remove_path (EVOLUTION_DIR DCONF_DUMP_FILE_EDS);
 
 			replace_in_file (
 				EVOLUTION_DIR DCONF_DUMP_FILE_EVO,
 				EVOUSERDATADIR_MAGIC, e_get_user_data_dir ());
 			run_cmd ("cat " EVOLUTION_DIR DCONF_DUMP_FILE_EVO " | dconf load " DCONF_PATH_EVO);
-			run_cmd ("rm " EVOLUTION_DIR DCONF_DUMP_FILE_EVO);
+			remove_path (EVOLUTION_DIR DCONF_DUMP_FILE_EVO);
 		}
 
 		g_string_free (file, TRUE);
@@ -663,9 +1215,7 @@ restore (const gchar *filename,
 		/* do not forget to convert GConf keys into GSettings */
 		run_cmd ("gsettings-data-convert");
 
-		command = g_strconcat ("rm ", gconf_dump_file, NULL);
-		run_cmd (command);
-		g_free (command);
+		remove_path (gconf_dump_file);
 
 		g_free (gconf_dump_file);
 	}
@@ -674,12 +1224,12 @@ restore (const gchar *filename,
 		return;
 
 	txt = _("Removing temporary back up files");
-	run_cmd ("rm -rf $DATADIR_old");
-	run_cmd ("rm -rf $CONFIGDIR_old");
-	run_cmd ("rm $DATADIR/.running");
+	remove_path ("$DATADIR_old");
+	remove_path ("$CONFIGDIR_old");
+	remove_path ("$DATADIR/.running");
 
 	if (!is_new_format)
-		run_cmd ("rm -rf $HOME/.evolution_old");
+		remove_path ("$HOME/.evolution_old");
 
 	if (g_cancellable_is_cancelled (cancellable))
 		return;
@@ -698,6 +1248,8 @@ restore (const gchar *filename,
 	g_free (command);
 
 end:
+	g_free (dir_content);
+
 	if (restart_arg) {
 		if (g_cancellable_is_cancelled (cancellable))
 			return;
@@ -712,93 +1264,83 @@ end:
 	}
 }
 
+/* Reads the whole archive, to verify it can be restored.  For the
+ * current format, returns the content of its EVOLUTION_DIR_FILE
+ * in @out_dir_content. */
 static gboolean
 check (const gchar *filename,
-       gboolean *is_new_format)
+       gboolean *is_new_format,
+       gchar **out_dir_content)
 {
-	gchar *command;
-	gchar *quotedfname;
-	const gchar *tar_opts;
-	gboolean is_new = TRUE;
+	BackupReader *reader;
+	const BackupEntry *entry = NULL;
+	gboolean has_dir_file = FALSE;
+	gboolean has_legacy_dir = FALSE;
+	gboolean has_gconf_dump = FALSE;
+	gboolean success;
+	GError *error = NULL;
 
 	g_return_val_if_fail (filename && *filename, FALSE);
 
-	if (get_filename_is_xz (filename))
-		tar_opts = "-tJf";
-	else
-		tar_opts = "-tzf";
-
-	quotedfname = g_shell_quote (filename);
-
 	if (is_new_format)
 		*is_new_format = FALSE;
 
-	command = g_strdup_printf ("tar %s %s 1>/dev/null", tar_opts, quotedfname);
-	result = system (command);
-	g_free (command);
+	reader = backup_reader_new (filename, NULL, NULL, &error);
+	success = reader != NULL;
 
-	g_message ("First result %d", result);
-	if (result) {
-		g_free (quotedfname);
-		return FALSE;
-	}
+	while (success && (success = backup_reader_next (reader, &entry, NULL, &error)) && entry) {
+		if (g_str_has_suffix (entry->name, EVOLUTION_DIR_FILE)) {
+			has_dir_file = TRUE;
 
-	command = g_strdup_printf (
-		"tar %s %s | grep -e \"%s$\"",
-		tar_opts, quotedfname, EVOLUTION_DIR_FILE);
-	result = system (command);
-	g_free (command);
+			if (out_dir_content && !*out_dir_content && entry->type == BACKUP_ENTRY_FILE) {
+				GBytes *bytes;
 
-	if (result) {
-		command = g_strdup_printf (
-			"tar %s %s | grep -e \"^\\.evolution/$\"",
-			tar_opts, quotedfname);
-		result = system (command);
-		g_free (command);
-		is_new = FALSE;
-	}
+				bytes = backup_reader_read_bytes (reader, NULL, &error);
+				success = bytes != NULL;
 
-	g_message ("Second result %d", result);
-	if (result) {
-		g_free (quotedfname);
-		return FALSE;
+				if (bytes) {
+					*out_dir_content = g_strdup (g_bytes_get_data (bytes, NULL));
+					g_bytes_unref (bytes);
+				}
+			}
+		} else if (g_strcmp0 (entry->name, ".evolution/") == 0) {
+			has_legacy_dir = TRUE;
+		} else if (g_strcmp0 (entry->name, ".evolution/" ANCIENT_GCONF_DUMP_FILE) == 0) {
+			has_gconf_dump = TRUE;
+		}
 	}
 
-	if (is_new) {
+	backup_reader_free (reader);
+
+	if (!success) {
+		g_message ("Failed to read '%s': %s", filename, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+	} else if (has_dir_file) {
 		if (is_new_format)
 			*is_new_format = TRUE;
-		g_free (quotedfname);
-		return TRUE;
-	}
-
-	command = g_strdup_printf (
-		"tar %s %s | grep -e \"^\\.evolution/%s$\"",
-		tar_opts, quotedfname, ANCIENT_GCONF_DUMP_FILE);
-	result = system (command);
-	g_free (command);
-
-	if (result != 0) {
-		/* maybe it's an ancient backup */
-		command = g_strdup_printf (
-			"tar %s %s | grep -e \"^\\.evolution/%s$\"",
-			tar_opts, quotedfname, ANCIENT_GCONF_DUMP_FILE);
-		result = system (command);
-		g_free (command);
+	} else {
+		success = has_legacy_dir && has_gconf_dump;
 	}
 
-	g_free (quotedfname);
+	g_message ("Check result %d", success ? 0 : 1);
 
-	g_message ("Third result %d", result);
+	result = success ? 0 : 1;
 
-	return result == 0;
+	return success;
 }
 
 static gboolean
 pbar_update (gpointer user_data)
 {
 	GCancellable *cancellable = G_CANCELLABLE (user_data);
+	gint permille;
 
-	gtk_progress_bar_pulse ((GtkProgressBar *) pbar);
+	permille = g_atomic_int_get (&progress_permille);
+
+	if (permille >= 0)
+		gtk_progress_bar_set_fraction ((GtkProgressBar *) pbar, permille / 1000.0);
+	else
+		gtk_progress_bar_pulse ((GtkProgressBar *) pbar);
 	gtk_progress_bar_set_text ((GtkProgressBar *) pbar, txt);
 
 	/* Return TRUE to reschedule the timeout. */
@@ -824,7 +1366,7 @@ start_job (GTask *task,
 	else if (restore_op)
 		restore (res_file, cancellable);
 	else if (check_op)
-		check (chk_file, NULL);  /* not cancellable */
+		check (chk_file, NULL, NULL);  /* not cancellable */
 
 	g_main_context_invoke (NULL, finish_job, NULL);
 }
@@ -842,24 +1384,12 @@ dlg_response (GtkWidget *dlg,
 	if (response != GTK_RESPONSE_NONE)
 		gtk_widget_destroy (dlg);
 
-	/* We will kill just the tar operation. Rest of
-	 * them will be just a second of microseconds.*/
-	run_cmd ("pkill tar");
-
 	if (bk_file && backup_op && response == GTK_RESPONSE_REJECT) {
 		/* Backup was cancelled, delete the
 		 * backup file as it is not needed now. */
-		gchar *cmd, *filename;
-
 		g_message ("Back up cancelled, removing partial back up file.");
 
-		filename = g_shell_quote (bk_file);
-		cmd = g_strconcat ("rm ", filename, NULL);
-
-		run_cmd (cmd);
-
-		g_free (cmd);
-		g_free (filename);
+		g_unlink (bk_file);
 	}
 
 	gtk_main_quit ();
@@ -1049,7 +1579,7 @@ main (gint argc,
 
 	} else if (check_op) {
 		/* For sanity we don't need gui */
-		check (chk_file, NULL);
+		check (chk_file, NULL, NULL);
 		exit (result == 0 ? 0 : 1);
 	}
 
@@ -17,8 +17,10 @@
 
 #include "evolution-config.h"
 
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
 
 #include <camel/camel.h>
@@ -451,6 +453,170 @@ retry:
 	return status;
 }
 
+/* Parses a line of the bulk mode output, "FILENAME X SPAMICITY",
+ * where X is 'S', 'H' or 'U', and returns the index of the message,
+ * as the name of its file in @directory, or -1 on failure. */
+static gint
+bogofilter_parse_bulk_line (const gchar *line,
+                            const gchar *directory,
+                            CamelJunkStatus *out_status)
+{
+	gsize directory_len = strlen (directory);
+	gchar *endptr = NULL;
+	gint64 index;
+
+	if (strncmp (line, directory, directory_len) != 0 ||
+	    line[directory_len] != G_DIR_SEPARATOR)
+		return -1;
+
+	line += directory_len + 1;
+
+	index = g_ascii_strtoll (line, &endptr, 10);
+	if (!endptr || endptr == line || !g_ascii_isspace (*endptr) || index < 0 || index > G_MAXINT)
+		return -1;
+
+	while (g_ascii_isspace (*endptr))
+		endptr++;
+
+	switch (*endptr) {
+		case 'S':
+			*out_status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+			break;
+		case 'H':
+			*out_status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+			break;
+		case 'U':
+			*out_status = CAMEL_JUNK_STATUS_INCONCLUSIVE;
+			break;
+		default:
+			return -1;
+	}
+
+	return (gint) index;
+}
+
+static gboolean
+bogofilter_write_message (CamelMimeMessage *message,
+                          const gchar *filename,
+                          GCancellable *cancellable,
+                          GError **error)
+{
+	CamelStream *stream;
+	gboolean success;
+
+	stream = camel_stream_fs_new_with_name (
+		filename, O_WRONLY | O_CREAT | O_TRUNC, 0600, error);
+	if (!stream)
+		return FALSE;
+
+	success = camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (message), stream, cancellable, error) >= 0 &&
+		camel_stream_close (stream, cancellable, error) == 0;
+
+	g_object_unref (stream);
+
+	return success;
+}
+
+/* Classifies all the messages with a single Bogofilter process in its
+ * bulk mode, thus the word list is opened only once.  Messages it does
+ * not report on are classified one by one, as a fallback. */
+static gboolean
+bogofilter_classify_messages_sync (EMailJunkFilter *junk_filter,
+                                   GPtrArray *messages,
+                                   CamelJunkStatus *statuses,
+                                   GCancellable *cancellable,
+                                   GError **error)
+{
+	EBogofilter *extension = E_BOGOFILTER (junk_filter);
+	GSubprocess *subprocess = NULL;
+	GPtrArray *argv;
+	gchar *directory;
+	gchar *output = NULL;
+	guint ii, n_written = 0;
+	gboolean success = TRUE;
+
+	directory = g_dir_make_tmp ("evolution-bogofilter-XXXXXX", NULL);
+
+	argv = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (argv, g_strdup (bogofilter_get_command_path (extension)));
+	g_ptr_array_add (argv, g_strdup ("-t"));
+	if (bogofilter_get_convert_to_unicode (extension))
+		g_ptr_array_add (argv, g_strdup ("--unicode=yes"));
+	g_ptr_array_add (argv, g_strdup ("-B"));
+
+	for (ii = 0; directory && ii < messages->len; ii++) {
+		gchar *filename, *basename;
+
+		basename = g_strdup_printf ("%u", ii);
+		filename = g_build_filename (directory, basename, NULL);
+		g_free (basename);
+
+		if (!bogofilter_write_message (messages->pdata[ii], filename, cancellable, NULL)) {
+			g_free (filename);
+			break;
+		}
+
+		g_ptr_array_add (argv, filename);
+		n_written++;
+	}
+
+	g_ptr_array_add (argv, NULL);
+
+	if (n_written > 0) {
+		subprocess = g_subprocess_newv (
+			(const gchar * const *) argv->pdata,
+			G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+			G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+			NULL);
+	}
+
+	if (subprocess && g_subprocess_communicate_utf8 (subprocess, NULL, cancellable, &output, NULL, NULL)) {
+		gchar **lines;
+
+		lines = g_strsplit (output ? output : "", "\n", -1);
+
+		for (ii = 0; lines[ii]; ii++) {
+			CamelJunkStatus status = CAMEL_JUNK_STATUS_ERROR;
+			gint index;
+
+			index = bogofilter_parse_bulk_line (lines[ii], directory, &status);
+			if (index >= 0 && index < (gint) messages->len)
+				statuses[index] = status;
+		}
+
+		g_strfreev (lines);
+	} else if (subprocess) {
+		g_subprocess_force_exit (subprocess);
+	}
+
+	g_clear_object (&subprocess);
+	g_free (output);
+
+	for (ii = 0; ii < n_written; ii++)
+		g_unlink (argv->pdata[argv->len - 1 - n_written + ii]);
+
+	if (directory)
+		g_rmdir (directory);
+
+	g_ptr_array_unref (argv);
+	g_free (directory);
+
+	/* Also initializes the word list, when it does not exist yet */
+	for (ii = 0; ii < messages->len && success; ii++) {
+		if (statuses[ii] != CAMEL_JUNK_STATUS_ERROR)
+			continue;
+
+		statuses[ii] = bogofilter_classify (
+			CAMEL_JUNK_FILTER (junk_filter),
+			messages->pdata[ii], cancellable, error);
+
+		success = statuses[ii] != CAMEL_JUNK_STATUS_ERROR;
+	}
+
+	return success;
+}
+
 static gboolean
 bogofilter_learn_junk (CamelJunkFilter *junk_filter,
                        CamelMimeMessage *message,
@@ -537,6 +703,7 @@ e_bogofilter_class_init (EBogofilterClass *class)
 	junk_filter_class->display_name = _("Bogofilter");
 	junk_filter_class->available = bogofilter_available;
 	junk_filter_class->new_config_widget = bogofilter_new_config_widget;
+	junk_filter_class->classify_messages_sync = bogofilter_classify_messages_sync;
 
 	g_object_class_install_property (
 		object_class,
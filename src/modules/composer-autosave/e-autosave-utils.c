@@ -29,8 +29,19 @@
 #define SNAPSHOT_FILE_PREFIX	".evolution-composer.autosave"
 #define SNAPSHOT_FILE_SEED	SNAPSHOT_FILE_PREFIX "-XXXXXX"
 
+/* Attachments are stored once per snapshot, as content-addressed blobs
+ * in the SNAPSHOT_BLOBS_DIR/<snapshot basename>/ directory. The snapshot
+ * file itself references them by SHA-256 checksum in the BLOB_HEADER. */
+#define SNAPSHOT_BLOBS_DIR	".evolution-composer-blobs"
+#define SNAPSHOT_BLOB_CACHE_KEY	"e-composer-snapshot-blob-cache"
+#define BLOB_HEADER		"X-Evolution-Autosave-Blob"
+#define BLOB_ENCODING_HEADER	"X-Evolution-Autosave-Encoding"
+#define BLOB_TMP_SEED		".blob-XXXXXX"
+
 typedef struct _LoadContext LoadContext;
 typedef struct _SaveContext SaveContext;
+typedef struct _BlobCache BlobCache;
+typedef struct _WriteData WriteData;
 
 struct _LoadContext {
 	EMsgComposer *composer;
@@ -41,6 +52,20 @@ struct _SaveContext {
 	GOutputStream *output_stream;
 };
 
+/* Remembers checksums of the attachments already stored, thus
+ * their content is not decoded again on the next snapshot. */
+struct _BlobCache {
+	volatile gint ref_count;
+	GMutex lock;
+	GHashTable *checksums; /* CamelDataWrapper * ~> gchar *checksum */
+};
+
+struct _WriteData {
+	GOutputStream *output_stream;
+	BlobCache *blob_cache;
+	gchar *blobs_dir;
+};
+
 static void
 load_context_free (LoadContext *context)
 {
@@ -62,9 +87,441 @@ save_context_free (SaveContext *context)
 	g_slice_free (SaveContext, context);
 }
 
+static BlobCache *
+blob_cache_ref (BlobCache *blob_cache)
+{
+	g_atomic_int_inc (&blob_cache->ref_count);
+
+	return blob_cache;
+}
+
+static void
+blob_cache_unref (BlobCache *blob_cache)
+{
+	if (g_atomic_int_dec_and_test (&blob_cache->ref_count)) {
+		g_hash_table_destroy (blob_cache->checksums);
+		g_mutex_clear (&blob_cache->lock);
+		g_slice_free (BlobCache, blob_cache);
+	}
+}
+
+static BlobCache *
+composer_ref_blob_cache (EMsgComposer *composer)
+{
+	BlobCache *blob_cache;
+
+	blob_cache = g_object_get_data (G_OBJECT (composer), SNAPSHOT_BLOB_CACHE_KEY);
+
+	if (!blob_cache) {
+		blob_cache = g_slice_new0 (BlobCache);
+		blob_cache->ref_count = 1;
+		blob_cache->checksums = g_hash_table_new_full (
+			g_direct_hash, g_direct_equal, g_object_unref, g_free);
+		g_mutex_init (&blob_cache->lock);
+
+		g_object_set_data_full (
+			G_OBJECT (composer),
+			SNAPSHOT_BLOB_CACHE_KEY, blob_cache,
+			(GDestroyNotify) blob_cache_unref);
+	}
+
+	return blob_cache_ref (blob_cache);
+}
+
+static void
+write_data_free (WriteData *wd)
+{
+	g_clear_object (&wd->output_stream);
+	blob_cache_unref (wd->blob_cache);
+	g_free (wd->blobs_dir);
+	g_slice_free (WriteData, wd);
+}
+
+static gchar *
+snapshot_dup_blobs_dir (GFile *snapshot_file)
+{
+	gchar *basename;
+	gchar *blobs_dir;
+
+	basename = g_file_get_basename (snapshot_file);
+	blobs_dir = g_build_filename (e_get_user_data_dir (), SNAPSHOT_BLOBS_DIR, basename, NULL);
+	g_free (basename);
+
+	return blobs_dir;
+}
+
+/* Deletes files not in the 'keep' set, or all of them
+ * together with the directory, when 'keep' is NULL. */
+static void
+remove_blobs (const gchar *blobs_dir,
+	      GHashTable *keep)
+{
+	GDir *dir;
+	const gchar *name;
+
+	dir = g_dir_open (blobs_dir, 0, NULL);
+	if (!dir)
+		return;
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		gchar *filename;
+
+		if (keep && g_hash_table_contains (keep, name))
+			continue;
+
+		filename = g_build_filename (blobs_dir, name, NULL);
+		g_unlink (filename);
+		g_free (filename);
+	}
+
+	g_dir_close (dir);
+
+	if (!keep)
+		g_rmdir (blobs_dir);
+}
+
+static gboolean
+is_blob_checksum (const gchar *checksum)
+{
+	gint ii;
+
+	if (!checksum)
+		return FALSE;
+
+	for (ii = 0; checksum[ii]; ii++) {
+		if (!g_ascii_isxdigit (checksum[ii]))
+			return FALSE;
+	}
+
+	return ii == 64;
+}
+
+static gboolean
+snapshot_part_is_blob (CamelMimePart *part)
+{
+	CamelDataWrapper *content;
+	CamelContentType *content_type;
+
+	content = camel_medium_get_content (CAMEL_MEDIUM (part));
+
+	if (!content || CAMEL_IS_MULTIPART (content) || CAMEL_IS_MIME_MESSAGE (content))
+		return FALSE;
+
+	content_type = camel_mime_part_get_content_type (part);
+
+	return !camel_content_type_is (content_type, "text", "*") ||
+		g_strcmp0 (camel_mime_part_get_disposition (part), "attachment") == 0;
+}
+
+/* Decodes the content into the blobs directory, unless it's there already,
+ * and returns its checksum. Called with the blob_cache locked. */
+static gchar *
+snapshot_store_blob (WriteData *wd,
+		     CamelDataWrapper *content,
+		     GCancellable *cancellable,
+		     GError **error)
+{
+	GChecksum *checksum;
+	GFile *tmp_file;
+	GInputStream *input_stream;
+	GFileOutputStream *output_stream;
+	gchar *tmp_filename;
+	gchar *filename;
+	gchar *hex;
+	gchar *buffer;
+	gssize n_read;
+	gint fd;
+
+	hex = g_hash_table_lookup (wd->blob_cache->checksums, content);
+	if (hex) {
+		filename = g_build_filename (wd->blobs_dir, hex, NULL);
+
+		if (g_file_test (filename, G_FILE_TEST_IS_REGULAR)) {
+			g_free (filename);
+			return g_strdup (hex);
+		}
+
+		g_free (filename);
+	}
+
+	tmp_filename = g_build_filename (wd->blobs_dir, BLOB_TMP_SEED, NULL);
+
+	errno = 0;
+	fd = g_mkstemp (tmp_filename);
+	if (fd == -1) {
+		g_set_error (
+			error, G_FILE_ERROR,
+			g_file_error_from_errno (errno),
+			"%s", g_strerror (errno));
+		g_free (tmp_filename);
+		return NULL;
+	}
+
+	close (fd);
+
+	tmp_file = g_file_new_for_path (tmp_filename);
+
+	output_stream = g_file_replace (tmp_file, NULL, FALSE, G_FILE_CREATE_PRIVATE, cancellable, error);
+	if (!output_stream ||
+	    camel_data_wrapper_decode_to_output_stream_sync (content, G_OUTPUT_STREAM (output_stream), cancellable, error) < 0 ||
+	    !g_output_stream_close (G_OUTPUT_STREAM (output_stream), cancellable, error)) {
+		g_clear_object (&output_stream);
+		g_object_unref (tmp_file);
+		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+		return NULL;
+	}
+
+	g_object_unref (output_stream);
+
+	input_stream = (GInputStream *) g_file_read (tmp_file, cancellable, error);
+	g_object_unref (tmp_file);
+
+	if (!input_stream) {
+		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+		return NULL;
+	}
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	buffer = g_malloc (65536);
+
+	do {
+		n_read = g_input_stream_read (input_stream, buffer, 65536, cancellable, error);
+		if (n_read > 0)
+			g_checksum_update (checksum, (const guchar *) buffer, n_read);
+	} while (n_read > 0);
+
+	g_free (buffer);
+	g_object_unref (input_stream);
+
+	if (n_read < 0) {
+		g_checksum_free (checksum);
+		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+		return NULL;
+	}
+
+	hex = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+
+	filename = g_build_filename (wd->blobs_dir, hex, NULL);
+
+	errno = 0;
+	if (g_rename (tmp_filename, filename) == -1) {
+		g_set_error (
+			error, G_FILE_ERROR,
+			g_file_error_from_errno (errno),
+			"%s", g_strerror (errno));
+		g_unlink (tmp_filename);
+		g_clear_pointer (&hex, g_free);
+	} else {
+		g_hash_table_insert (wd->blob_cache->checksums, g_object_ref (content), g_strdup (hex));
+	}
+
+	g_free (tmp_filename);
+	g_free (filename);
+
+	return hex;
+}
+
+static CamelDataWrapper *
+snapshot_build_content (WriteData *wd,
+			CamelDataWrapper *content,
+			GHashTable *used_checksums,
+			GCancellable *cancellable,
+			GError **error);
+
+/* Returns the part itself, or a copy of it, where the attachments
+ * are replaced with references to their blobs. The composer's
+ * attachments are shared with the message, thus cannot be changed. */
+static CamelMimePart *
+snapshot_build_part (WriteData *wd,
+		     CamelMimePart *part,
+		     GHashTable *used_checksums,
+		     GCancellable *cancellable,
+		     GError **error)
+{
+	CamelMimePart *stub;
+	CamelDataWrapper *content;
+	CamelDataWrapper *new_content;
+	const CamelNameValueArray *headers;
+	gboolean is_blob;
+
+	content = camel_medium_get_content (CAMEL_MEDIUM (part));
+	is_blob = snapshot_part_is_blob (part);
+
+	if (!is_blob && !(CAMEL_IS_MULTIPART (content) && !CAMEL_IS_MULTIPART_SIGNED (content)))
+		return g_object_ref (part);
+
+	stub = camel_mime_part_new ();
+
+	headers = camel_medium_get_headers (CAMEL_MEDIUM (part));
+	if (headers) {
+		gint ii, length;
+		length = camel_name_value_array_get_length (headers);
+
+		for (ii = 0; ii < length; ii++) {
+			const gchar *header_name = NULL;
+			const gchar *header_value = NULL;
+
+			if (camel_name_value_array_get (headers, ii, &header_name, &header_value))
+				camel_medium_add_header (CAMEL_MEDIUM (stub), header_name, header_value);
+		}
+	}
+
+	if (is_blob) {
+		gchar *checksum;
+
+		checksum = snapshot_store_blob (wd, content, cancellable, error);
+		if (!checksum) {
+			g_object_unref (stub);
+			return NULL;
+		}
+
+		g_hash_table_add (used_checksums, g_strdup (checksum));
+
+		new_content = camel_data_wrapper_new ();
+
+		camel_medium_remove_header (CAMEL_MEDIUM (stub), "Content-Transfer-Encoding");
+		camel_medium_set_header (CAMEL_MEDIUM (stub), BLOB_HEADER, checksum);
+		camel_medium_set_header (
+			CAMEL_MEDIUM (stub), BLOB_ENCODING_HEADER,
+			camel_transfer_encoding_to_string (camel_mime_part_get_encoding (part)));
+
+		g_free (checksum);
+	} else {
+		new_content = snapshot_build_content (wd, content, used_checksums, cancellable, error);
+		if (!new_content) {
+			g_object_unref (stub);
+			return NULL;
+		}
+	}
+
+	camel_data_wrapper_set_mime_type_field (new_content, camel_data_wrapper_get_mime_type_field (content));
+	camel_medium_set_content (CAMEL_MEDIUM (stub), new_content);
+	g_object_unref (new_content);
+
+	return stub;
+}
+
+static CamelDataWrapper *
+snapshot_build_content (WriteData *wd,
+			CamelDataWrapper *content,
+			GHashTable *used_checksums,
+			GCancellable *cancellable,
+			GError **error)
+{
+	CamelMultipart *multipart;
+	guint ii, n_parts;
+
+	if (!CAMEL_IS_MULTIPART (content) || CAMEL_IS_MULTIPART_SIGNED (content))
+		return g_object_ref (content);
+
+	multipart = camel_multipart_new ();
+	camel_data_wrapper_set_mime_type_field (
+		CAMEL_DATA_WRAPPER (multipart),
+		camel_data_wrapper_get_mime_type_field (content));
+
+	n_parts = camel_multipart_get_number (CAMEL_MULTIPART (content));
+
+	for (ii = 0; ii < n_parts; ii++) {
+		CamelMimePart *part;
+
+		part = snapshot_build_part (
+			wd, camel_multipart_get_part (CAMEL_MULTIPART (content), ii),
+			used_checksums, cancellable, error);
+
+		if (!part) {
+			g_object_unref (multipart);
+			return NULL;
+		}
+
+		camel_multipart_add_part (multipart, part);
+		g_object_unref (part);
+	}
+
+	return CAMEL_DATA_WRAPPER (multipart);
+}
+
+/* Puts the attachments, stored by snapshot_build_part(), back into the message. */
+static void
+snapshot_restore_blobs (CamelDataWrapper *content,
+			const gchar *blobs_dir)
+{
+	guint ii, n_parts;
+
+	if (!CAMEL_IS_MULTIPART (content))
+		return;
+
+	n_parts = camel_multipart_get_number (CAMEL_MULTIPART (content));
+
+	for (ii = 0; ii < n_parts; ii++) {
+		CamelMimePart *part;
+		CamelMedium *medium;
+		CamelDataWrapper *wrapper;
+		GInputStream *input_stream;
+		GFile *file;
+		const gchar *encoding;
+		gchar *filename;
+		GError *local_error = NULL;
+
+		part = camel_multipart_get_part (CAMEL_MULTIPART (content), ii);
+		medium = CAMEL_MEDIUM (part);
+
+		if (!camel_medium_get_header (medium, BLOB_HEADER)) {
+			snapshot_restore_blobs (camel_medium_get_content (medium), blobs_dir);
+			continue;
+		}
+
+		if (!is_blob_checksum (camel_medium_get_header (medium, BLOB_HEADER))) {
+			g_warning ("%s: Invalid attachment reference", G_STRFUNC);
+			camel_medium_remove_header (medium, BLOB_HEADER);
+			continue;
+		}
+
+		filename = g_build_filename (blobs_dir, camel_medium_get_header (medium, BLOB_HEADER), NULL);
+		file = g_file_new_for_path (filename);
+		input_stream = (GInputStream *) g_file_read (file, NULL, &local_error);
+		g_object_unref (file);
+
+		if (input_stream) {
+			wrapper = camel_data_wrapper_new ();
+
+			if (camel_data_wrapper_construct_from_input_stream_sync (wrapper, input_stream, NULL, &local_error)) {
+				camel_data_wrapper_set_mime_type_field (wrapper, camel_mime_part_get_content_type (part));
+				camel_medium_set_content (medium, wrapper);
+			}
+
+			g_object_unref (wrapper);
+			g_object_unref (input_stream);
+		}
+
+		if (local_error) {
+			g_warning ("%s: Failed to read attachment '%s': %s", G_STRFUNC, filename, local_error->message);
+			g_clear_error (&local_error);
+		}
+
+		encoding = camel_medium_get_header (medium, BLOB_ENCODING_HEADER);
+		if (encoding)
+			camel_mime_part_set_encoding (part, camel_transfer_encoding_from_string (encoding));
+
+		camel_medium_remove_header (medium, BLOB_HEADER);
+		camel_medium_remove_header (medium, BLOB_ENCODING_HEADER);
+
+		g_free (filename);
+	}
+}
+
 static void
 delete_snapshot_file (GFile *snapshot_file)
 {
+	gchar *blobs_dir;
+
+	blobs_dir = snapshot_dup_blobs_dir (snapshot_file);
+	remove_blobs (blobs_dir, NULL);
+	g_free (blobs_dir);
+
 	g_file_delete (snapshot_file, NULL, NULL);
 	g_object_unref (snapshot_file);
 }
@@ -162,6 +619,7 @@ load_snapshot_loaded_cb (GFile *snapshot_file,
 	CamelMimeMessage *message;
 	CamelStream *camel_stream;
 	gchar *contents = NULL;
+	gchar *blobs_dir;
 	gsize length;
 	CreateComposerData *ccd;
 	GError *local_error = NULL;
@@ -197,6 +655,10 @@ load_snapshot_loaded_cb (GFile *snapshot_file,
 		return;
 	}
 
+	blobs_dir = snapshot_dup_blobs_dir (snapshot_file);
+	snapshot_restore_blobs (camel_medium_get_content (CAMEL_MEDIUM (message)), blobs_dir);
+	g_free (blobs_dir);
+
 	/* g_async_result_get_source_object() returns a new reference. */
 	object = g_async_result_get_source_object (G_ASYNC_RESULT (simple));
 
@@ -241,17 +703,60 @@ write_message_to_stream_thread (GTask *task,
 				gpointer task_data,
 				GCancellable *cancellable)
 {
-	GOutputStream *output_stream;
-	gssize bytes_written;
+	WriteData *wd = task_data;
+	CamelMedium *message;
+	CamelDataWrapper *content;
+	GHashTable *used_checksums;
+	gssize bytes_written = -1;
 	GError *local_error = NULL;
 
-	output_stream = task_data;
+	message = CAMEL_MEDIUM (source_object);
+	used_checksums = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	/* Also serializes snapshots of the same composer. */
+	g_mutex_lock (&wd->blob_cache->lock);
+
+	if (g_mkdir_with_parents (wd->blobs_dir, 0700) == -1) {
+		g_set_error (
+			&local_error, G_FILE_ERROR,
+			g_file_error_from_errno (errno),
+			"%s", g_strerror (errno));
+		content = NULL;
+	} else {
+		content = snapshot_build_content (
+			wd, camel_medium_get_content (message),
+			used_checksums, cancellable, &local_error);
+	}
+
+	/* The message is our own copy, thus it can be changed. */
+	if (content) {
+		camel_medium_set_content (message, content);
+		g_object_unref (content);
+
+		bytes_written = camel_data_wrapper_decode_to_output_stream_sync (
+			CAMEL_DATA_WRAPPER (message),
+			wd->output_stream, cancellable, &local_error);
+	}
+
+	g_output_stream_close (wd->output_stream, cancellable, local_error ? NULL : &local_error);
+
+	/* Forget attachments removed from the composer. */
+	if (local_error == NULL) {
+		GHashTableIter iter;
+		gpointer value;
+
+		g_hash_table_iter_init (&iter, wd->blob_cache->checksums);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			if (!g_hash_table_contains (used_checksums, value))
+				g_hash_table_iter_remove (&iter);
+		}
+
+		remove_blobs (wd->blobs_dir, used_checksums);
+	}
 
-	bytes_written = camel_data_wrapper_decode_to_output_stream_sync (
-		CAMEL_DATA_WRAPPER (source_object),
-		output_stream, cancellable, &local_error);
+	g_mutex_unlock (&wd->blob_cache->lock);
 
-	g_output_stream_close (output_stream, cancellable, local_error ? NULL : &local_error);
+	g_hash_table_destroy (used_checksums);
 
 	if (local_error != NULL) {
 		g_task_return_error (task, local_error);
@@ -267,6 +772,7 @@ save_snapshot_get_message_cb (EMsgComposer *composer,
 {
 	SaveContext *context;
 	CamelMimeMessage *message;
+	WriteData *wd;
 	GTask *task;
 	GError *local_error = NULL;
 
@@ -287,7 +793,12 @@ save_snapshot_get_message_cb (EMsgComposer *composer,
 
 	task = g_task_new (message, context->cancellable, (GAsyncReadyCallback) save_snapshot_splice_cb, simple);
 
-	g_task_set_task_data (task, g_object_ref (context->output_stream), g_object_unref);
+	wd = g_slice_new0 (WriteData);
+	wd->output_stream = g_object_ref (context->output_stream);
+	wd->blob_cache = composer_ref_blob_cache (composer);
+	wd->blobs_dir = snapshot_dup_blobs_dir (e_composer_get_snapshot_file (composer));
+
+	g_task_set_task_data (task, wd, (GDestroyNotify) write_data_free);
 
 	g_task_run_in_thread (task, write_message_to_stream_thread);
 
@@ -371,6 +882,7 @@ e_composer_find_orphans (GQueue *registry,
 	GDir *dir;
 	const gchar *dirname;
 	const gchar *basename;
+	gchar *blobs_dirname;
 	GList *orphans = NULL;
 
 	g_return_val_if_fail (registry != NULL, NULL);
@@ -409,11 +921,18 @@ e_composer_find_orphans (GQueue *registry,
 		/* If the file is empty, delete it.  Failure here
 		 * is non-fatal; just emit a warning and move on. */
 		if (st.st_size == 0) {
+			gchar *blobs_dir;
+
 			errno = 0;
 			if (g_unlink (filename) < 0) {
 				errmsg = g_strerror (errno);
 				g_warning ("%s: %s", filename, errmsg);
 			}
+
+			blobs_dir = g_build_filename (dirname, SNAPSHOT_BLOBS_DIR, basename, NULL);
+			remove_blobs (blobs_dir, NULL);
+			g_free (blobs_dir);
+
 			g_free (filename);
 			continue;
 		}
@@ -426,6 +945,31 @@ e_composer_find_orphans (GQueue *registry,
 
 	g_dir_close (dir);
 
+	/* Remove attachments left behind by deleted snapshot files. */
+	blobs_dirname = g_build_filename (dirname, SNAPSHOT_BLOBS_DIR, NULL);
+	dir = g_dir_open (blobs_dirname, 0, NULL);
+
+	while (dir && (basename = g_dir_read_name (dir)) != NULL) {
+		gchar *filename;
+
+		filename = g_build_filename (dirname, basename, NULL);
+
+		if (!g_file_test (filename, G_FILE_TEST_EXISTS)) {
+			gchar *blobs_dir;
+
+			blobs_dir = g_build_filename (blobs_dirname, basename, NULL);
+			remove_blobs (blobs_dir, NULL);
+			g_free (blobs_dir);
+		}
+
+		g_free (filename);
+	}
+
+	if (dir)
+		g_dir_close (dir);
+
+	g_free (blobs_dirname);
+
 	return g_list_reverse (orphans);
 }
 
@@ -33,6 +33,12 @@ struct _EComposerAutosavePrivate {
 	GCancellable *cancellable;
 	guint timeout_id;
 
+	/* Incremented on each change; a snapshot is skipped
+	 * when nothing changed since the last saved one. */
+	guint dirty_generation;
+	guint saving_generation;
+	guint saved_generation;
+
 	/* Prevent error dialogs from piling up. */
 	gboolean error_shown;
 };
@@ -58,8 +64,11 @@ composer_autosave_finished_cb (GObject *source_object,
 	snapshot_file = e_composer_get_snapshot_file (composer);
 	e_composer_save_snapshot_finish (composer, result, &local_error);
 
+	if (local_error == NULL)
+		autosave->priv->saved_generation = autosave->priv->saving_generation;
+
 	/* Return silently if we were cancelled. */
-	if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	else if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
 		g_error_free (local_error);
 
 	else if (local_error != NULL) {
@@ -97,6 +106,13 @@ composer_autosave_timeout_cb (gpointer user_data)
 	autosave = E_COMPOSER_AUTOSAVE (user_data);
 	extensible = e_extension_get_extensible (E_EXTENSION (autosave));
 
+	autosave->priv->timeout_id = 0;
+
+	if (autosave->priv->dirty_generation == autosave->priv->saved_generation)
+		return FALSE;
+
+	autosave->priv->saving_generation = autosave->priv->dirty_generation;
+
 	/* Cancel the previous snapshot if it's still in
 	 * progress and start a new snapshot operation. */
 	g_cancellable_cancel (autosave->priv->cancellable);
@@ -109,8 +125,6 @@ composer_autosave_timeout_cb (gpointer user_data)
 		composer_autosave_finished_cb,
 		g_object_ref (autosave));
 
-	autosave->priv->timeout_id = 0;
-
 	return FALSE;
 }
 
@@ -126,7 +140,12 @@ composer_autosave_changed_cb (EComposerAutosave *autosave)
 	editor = e_msg_composer_get_editor (E_MSG_COMPOSER (extensible));
 	cnt_editor = e_html_editor_get_content_editor (editor);
 
-	if (autosave->priv->timeout_id == 0 && e_content_editor_get_changed (cnt_editor)) {
+	if (!e_content_editor_get_changed (cnt_editor))
+		return;
+
+	autosave->priv->dirty_generation++;
+
+	if (autosave->priv->timeout_id == 0) {
 		autosave->priv->timeout_id = e_named_timeout_add_seconds (
 			AUTOSAVE_INTERVAL,
 			composer_autosave_timeout_cb, autosave);
@@ -18,6 +18,7 @@
 #include "evolution-config.h"
 
 #include <errno.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <glib/gstdio.h>
@@ -38,6 +39,10 @@
 #define SPAM_ASSASSIN_EXIT_STATUS_SUCCESS	0
 #define SPAM_ASSASSIN_EXIT_STATUS_ERROR		-1
 
+/* The default port of spamd */
+#define SPAM_ASSASSIN_DAEMON_HOST	"localhost"
+#define SPAM_ASSASSIN_DAEMON_PORT	783
+
 typedef struct _ESpamAssassin ESpamAssassin;
 typedef struct _ESpamAssassinClass ESpamAssassinClass;
 
@@ -45,6 +50,7 @@ struct _ESpamAssassin {
 	EMailJunkFilter parent;
 
 	gboolean local_only;
+	gboolean use_daemon;
 	gchar *command;
 	gchar *learn_command;
 
@@ -59,6 +65,7 @@ struct _ESpamAssassinClass {
 enum {
 	PROP_0,
 	PROP_LOCAL_ONLY,
+	PROP_USE_DAEMON,
 	PROP_COMMAND,
 	PROP_LEARN_COMMAND
 };
@@ -345,6 +352,24 @@ spam_assassin_set_local_only (ESpamAssassin *extension,
 	g_object_notify (G_OBJECT (extension), "local-only");
 }
 
+static gboolean
+spam_assassin_get_use_daemon (ESpamAssassin *extension)
+{
+	return extension->use_daemon;
+}
+
+static void
+spam_assassin_set_use_daemon (ESpamAssassin *extension,
+                              gboolean use_daemon)
+{
+	if (extension->use_daemon == use_daemon)
+		return;
+
+	extension->use_daemon = use_daemon;
+
+	g_object_notify (G_OBJECT (extension), "use-daemon");
+}
+
 static const gchar *
 spam_assassin_get_command (ESpamAssassin *extension)
 {
@@ -396,6 +421,12 @@ spam_assassin_set_property (GObject *object,
 				g_value_get_boolean (value));
 			return;
 
+		case PROP_USE_DAEMON:
+			spam_assassin_set_use_daemon (
+				E_SPAM_ASSASSIN (object),
+				g_value_get_boolean (value));
+			return;
+
 		case PROP_COMMAND:
 			spam_assassin_set_command (
 				E_SPAM_ASSASSIN (object),
@@ -425,6 +456,12 @@ spam_assassin_get_property (GObject *object,
 				E_SPAM_ASSASSIN (object)));
 			return;
 
+		case PROP_USE_DAEMON:
+			g_value_set_boolean (
+				value, spam_assassin_get_use_daemon (
+				E_SPAM_ASSASSIN (object)));
+			return;
+
 		case PROP_COMMAND:
 			g_value_set_string (
 				value, spam_assassin_get_command (
@@ -571,16 +608,117 @@ spam_assassin_new_config_widget (EMailJunkFilter *junk_filter)
 	gtk_widget_show (widget);
 	g_free (markup);
 
+	widget = gtk_check_button_new_with_mnemonic (
+		_("Use the SpamAssassin _daemon (spamd)"));
+	gtk_widget_set_margin_left (widget, 12);
+	gtk_box_pack_start (GTK_BOX (container), widget, FALSE, FALSE, 0);
+	gtk_widget_show (widget);
+
+	e_binding_bind_property (
+		junk_filter, "use-daemon",
+		widget, "active",
+		G_BINDING_BIDIRECTIONAL |
+		G_BINDING_SYNC_CREATE);
+
 	return box;
 }
 
+/* Checks the message with a running spamd, which has the rules loaded
+ * already, thus it is much faster than the spamassassin command.  The
+ * tests it runs are given by the configuration of the daemon. */
 static CamelJunkStatus
-spam_assassin_classify (CamelJunkFilter *junk_filter,
-                        CamelMimeMessage *message,
-                        GCancellable *cancellable,
-                        GError **error)
+spam_assassin_classify_daemon (ESpamAssassin *extension,
+                               GSocketClient *client,
+                               CamelMimeMessage *message,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+	CamelJunkStatus status = CAMEL_JUNK_STATUS_ERROR;
+	GSocketConnection *connection;
+	GDataInputStream *input_stream;
+	GOutputStream *output_stream;
+	CamelStream *stream;
+	GByteArray *bytes;
+	gchar *request, *line;
+	gboolean success;
+
+	connection = g_socket_client_connect_to_host (
+		client, SPAM_ASSASSIN_DAEMON_HOST,
+		SPAM_ASSASSIN_DAEMON_PORT, cancellable, error);
+	if (!connection)
+		return CAMEL_JUNK_STATUS_ERROR;
+
+	stream = camel_stream_mem_new ();
+	success = camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (message), stream, cancellable, error) >= 0;
+	bytes = camel_stream_mem_get_byte_array (CAMEL_STREAM_MEM (stream));
+
+	output_stream = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+	request = g_strdup_printf (
+		"CHECK SPAMC/1.2\r\n"
+		"Content-length: %u\r\n"
+		"\r\n", bytes->len);
+
+	success = success &&
+		g_output_stream_write_all (output_stream, request, strlen (request), NULL, cancellable, error) &&
+		g_output_stream_write_all (output_stream, bytes->data, bytes->len, NULL, cancellable, error);
+
+	g_free (request);
+	g_object_unref (stream);
+
+	if (!success) {
+		g_object_unref (connection);
+		return CAMEL_JUNK_STATUS_ERROR;
+	}
+
+	input_stream = g_data_input_stream_new (
+		g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+	g_data_input_stream_set_newline_type (input_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	/* "SPAMD/1.1 0 EX_OK", then headers up to an empty line */
+	line = g_data_input_stream_read_line (input_stream, NULL, cancellable, error);
+	success = line && g_str_has_prefix (line, "SPAMD/") && strstr (line, " 0 ") != NULL;
+
+	while (success) {
+		g_free (line);
+		line = g_data_input_stream_read_line (input_stream, NULL, cancellable, error);
+
+		if (!line || !*line)
+			break;
+
+		/* "Spam: True ; 15.0 / 5.0" */
+		if (g_ascii_strncasecmp (line, "Spam:", 5) == 0) {
+			const gchar *value = line + 5;
+
+			while (g_ascii_isspace (*value))
+				value++;
+
+			if (g_ascii_strncasecmp (value, "True", 4) == 0 ||
+			    g_ascii_strncasecmp (value, "Yes", 3) == 0)
+				status = CAMEL_JUNK_STATUS_MESSAGE_IS_JUNK;
+			else
+				status = CAMEL_JUNK_STATUS_MESSAGE_IS_NOT_JUNK;
+		}
+	}
+
+	g_free (line);
+	g_object_unref (input_stream);
+	g_object_unref (connection);
+
+	if (status == CAMEL_JUNK_STATUS_ERROR && (!error || !*error))
+		g_set_error_literal (
+			error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+			_("Unexpected response from the SpamAssassin daemon"));
+
+	return status;
+}
+
+static CamelJunkStatus
+spam_assassin_classify_command (ESpamAssassin *extension,
+                                CamelMimeMessage *message,
+                                GCancellable *cancellable,
+                                GError **error)
 {
-	ESpamAssassin *extension = E_SPAM_ASSASSIN (junk_filter);
 	CamelJunkStatus status;
 	const gchar *argv[7];
 	gint exit_code;
@@ -621,6 +759,94 @@ spam_assassin_classify (CamelJunkFilter *junk_filter,
 	return status;
 }
 
+static CamelJunkStatus
+spam_assassin_classify (CamelJunkFilter *junk_filter,
+                        CamelMimeMessage *message,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	ESpamAssassin *extension = E_SPAM_ASSASSIN (junk_filter);
+	CamelJunkStatus status;
+
+	if (spam_assassin_get_use_daemon (extension)) {
+		GSocketClient *client;
+		GError *local_error = NULL;
+
+		client = g_socket_client_new ();
+		status = spam_assassin_classify_daemon (
+			extension, client, message, cancellable, &local_error);
+		g_object_unref (client);
+
+		if (status != CAMEL_JUNK_STATUS_ERROR)
+			return status;
+
+		if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_propagate_error (error, local_error);
+			return status;
+		}
+
+		g_debug ("%s: %s", G_STRFUNC, local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+	}
+
+	return spam_assassin_classify_command (extension, message, cancellable, error);
+}
+
+/* The spamd protocol checks one message per connection, but talking to
+ * the daemon saves starting the spamassassin command for each message;
+ * should the daemon not be running, the rest is checked with the command. */
+static gboolean
+spam_assassin_classify_messages_sync (EMailJunkFilter *junk_filter,
+                                      GPtrArray *messages,
+                                      CamelJunkStatus *statuses,
+                                      GCancellable *cancellable,
+                                      GError **error)
+{
+	ESpamAssassin *extension = E_SPAM_ASSASSIN (junk_filter);
+	GSocketClient *client;
+	guint ii;
+
+	if (!spam_assassin_get_use_daemon (extension)) {
+		/* Chain up to parent's method. */
+		return E_MAIL_JUNK_FILTER_CLASS (e_spam_assassin_parent_class)->
+			classify_messages_sync (junk_filter, messages, statuses, cancellable, error);
+	}
+
+	client = g_socket_client_new ();
+
+	for (ii = 0; ii < messages->len; ii++) {
+		GError *local_error = NULL;
+
+		statuses[ii] = spam_assassin_classify_daemon (
+			extension, client, messages->pdata[ii], cancellable, &local_error);
+
+		if (statuses[ii] != CAMEL_JUNK_STATUS_ERROR)
+			continue;
+
+		if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_propagate_error (error, local_error);
+			g_object_unref (client);
+			return FALSE;
+		}
+
+		g_debug ("%s: %s", G_STRFUNC, local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+		break;
+	}
+
+	g_object_unref (client);
+
+	for (; ii < messages->len; ii++) {
+		statuses[ii] = spam_assassin_classify_command (
+			extension, messages->pdata[ii], cancellable, error);
+
+		if (statuses[ii] == CAMEL_JUNK_STATUS_ERROR)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 static gboolean
 spam_assassin_learn_junk (CamelJunkFilter *junk_filter,
                           CamelMimeMessage *message,
@@ -740,6 +966,7 @@ e_spam_assassin_class_init (ESpamAssassinClass *class)
 	junk_filter_class->display_name = _("SpamAssassin");
 	junk_filter_class->available = spam_assassin_available;
 	junk_filter_class->new_config_widget = spam_assassin_new_config_widget;
+	junk_filter_class->classify_messages_sync = spam_assassin_classify_messages_sync;
 
 	g_object_class_install_property (
 		object_class,
@@ -751,6 +978,16 @@ e_spam_assassin_class_init (ESpamAssassinClass *class)
 			TRUE,
 			G_PARAM_READWRITE));
 
+	g_object_class_install_property (
+		object_class,
+		PROP_USE_DAEMON,
+		g_param_spec_boolean (
+			"use-daemon",
+			"Use Daemon",
+			"Check messages with a running spamd",
+			FALSE,
+			G_PARAM_READWRITE));
+
 	g_object_class_install_property (
 		object_class,
 		PROP_COMMAND,
@@ -797,6 +1034,10 @@ e_spam_assassin_init (ESpamAssassin *extension)
 		settings, "local-only",
 		extension, "local-only",
 		G_SETTINGS_BIND_DEFAULT);
+	g_settings_bind (
+		settings, "use-daemon",
+		extension, "use-daemon",
+		G_SETTINGS_BIND_DEFAULT);
 	g_settings_bind (
 		settings, "command",
 		G_OBJECT (extension), "command",
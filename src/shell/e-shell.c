@@ -47,6 +47,11 @@
 
 #define SET_ONLINE_TIMEOUT_SECONDS 5
 
+/* Which modules extend which extensible types, to load them on demand */
+#define MODULES_MANIFEST_FILE "modules.manifest"
+#define MODULES_MANIFEST_VERSION VERSION "/2"
+#define MODULES_MANIFEST_TYPE "(ssxa(sbas))"
+
 struct _EShellPrivate {
 	GQueue alerts;
 	ESourceRegistry *registry;
@@ -87,6 +92,30 @@ struct _EShellPrivate {
 	guint ready_to_quit : 1;
 	guint safe_mode : 1;
 	guint requires_shutdown : 1;
+	guint startup_profile : 1;
+};
+
+typedef struct _LazyModule {
+	gchar *filename;
+	gboolean loaded;
+} LazyModule;
+
+/* Modules not loaded yet, waiting for the class of an extensible type
+ * they extend to be initialized, which precedes its first instance. */
+static GRecMutex lazy_modules_lock;
+static GHashTable *lazy_modules; /* gchar *type_name ~> GSList { LazyModule * } */
+static guint lazy_modules_pending;
+static gboolean modules_profile;
+
+/* Types registered by a module, which are looked up at the time other
+ * classes are initialized, thus such module cannot wait for its
+ * extensible types. */
+static const gchar *eager_module_types[] = {
+	"EPlugin",
+	"EPluginHook",
+	"GalView",
+	"EMailParserExtension",
+	"EMailFormatterExtension"
 };
 
 enum {
@@ -2094,6 +2123,376 @@ e_shell_get_default (void)
 	return default_shell;
 }
 
+static gboolean
+shell_load_module_file (const gchar *filename,
+                        const gchar *reason)
+{
+	EModule *module;
+	gint64 start;
+
+	start = g_get_monotonic_time ();
+
+	module = e_module_load_file (filename);
+	if (module)
+		g_type_module_unuse (G_TYPE_MODULE (module));
+
+	if (modules_profile) {
+		gchar *basename = g_path_get_basename (filename);
+
+		g_print (
+			"%-40s %8.2f ms  (%s)\n", basename,
+			(g_get_monotonic_time () - start) / 1000.0, reason);
+
+		g_free (basename);
+	}
+
+	return module != NULL;
+}
+
+static void shell_extensible_check_cb (gpointer check_data, gpointer g_iface);
+
+/* The interface check is called only for the classes which add the
+ * EExtensible interface themselves, not for their subclasses, nor
+ * with an interface as the instance type. */
+static gboolean
+shell_type_adds_extensible (GType type)
+{
+	GType parent;
+
+	if (G_TYPE_IS_INTERFACE (type) || !g_type_is_a (type, E_TYPE_EXTENSIBLE))
+		return FALSE;
+
+	parent = g_type_parent (type);
+
+	return !parent || !g_type_is_a (parent, E_TYPE_EXTENSIBLE);
+}
+
+static gboolean
+shell_free_lazy_modules_idle_cb (gpointer user_data)
+{
+	g_rec_mutex_lock (&lazy_modules_lock);
+
+	if (lazy_modules && !lazy_modules_pending) {
+		GHashTable *lazy_set;
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_type_remove_interface_check (NULL, shell_extensible_check_cb);
+
+		lazy_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+		g_hash_table_iter_init (&iter, lazy_modules);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			GSList *link;
+
+			for (link = value; link; link = g_slist_next (link))
+				g_hash_table_add (lazy_set, link->data);
+
+			g_slist_free (value);
+		}
+
+		g_hash_table_iter_init (&iter, lazy_set);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			LazyModule *lazy_module = key;
+
+			g_free (lazy_module->filename);
+			g_slice_free (LazyModule, lazy_module);
+		}
+
+		g_hash_table_destroy (lazy_set);
+		g_hash_table_destroy (lazy_modules);
+		lazy_modules = NULL;
+	}
+
+	g_rec_mutex_unlock (&lazy_modules_lock);
+
+	return FALSE;
+}
+
+static void
+shell_extensible_check_cb (gpointer check_data,
+                           gpointer g_iface)
+{
+	GTypeInterface *iface = g_iface;
+	GSList *link;
+	const gchar *type_name;
+
+	if (iface->g_type != E_TYPE_EXTENSIBLE)
+		return;
+
+	g_rec_mutex_lock (&lazy_modules_lock);
+
+	type_name = g_type_name (iface->g_instance_type);
+	link = lazy_modules ? g_hash_table_lookup (lazy_modules, type_name) : NULL;
+
+	/* The module load can initialize other extensible classes,
+	 * which get here again, thus the lock is recursive.  The list
+	 * stays in the table, because its modules can be listed under
+	 * other types too; the loaded flag prevents loading them twice. */
+	if (link && lazy_modules_pending) {
+		for (; link; link = g_slist_next (link)) {
+			LazyModule *lazy_module = link->data;
+
+			if (!lazy_module->loaded) {
+				lazy_module->loaded = TRUE;
+				lazy_modules_pending--;
+				shell_load_module_file (lazy_module->filename, type_name);
+			}
+		}
+
+		/* Nothing more to wait for.  Not removing the check
+		 * from within itself, while GType iterates the checks. */
+		if (!lazy_modules_pending)
+			g_idle_add (shell_free_lazy_modules_idle_cb, NULL);
+	}
+
+	g_rec_mutex_unlock (&lazy_modules_lock);
+}
+
+static gchar *
+shell_get_modules_manifest_filename (void)
+{
+	return g_build_filename (e_get_user_cache_dir (), MODULES_MANIFEST_FILE, NULL);
+}
+
+static gint64
+shell_get_directory_mtime (const gchar *directory)
+{
+	GStatBuf st;
+
+	if (g_stat (directory, &st) != 0)
+		return -1;
+
+	return st.st_mtime;
+}
+
+/* Returns the manifest, if it describes the current content of
+ * the @module_directory, otherwise %NULL. */
+static GVariant *
+shell_read_modules_manifest (const gchar *module_directory)
+{
+	GVariant *manifest;
+	const gchar *version, *directory;
+	gchar *filename, *contents = NULL;
+	gsize length = 0;
+	gint64 mtime;
+
+	filename = shell_get_modules_manifest_filename ();
+
+	if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+		g_free (filename);
+		return NULL;
+	}
+
+	g_free (filename);
+
+	manifest = g_variant_new_from_data (
+		G_VARIANT_TYPE (MODULES_MANIFEST_TYPE),
+		contents, length, FALSE, g_free, contents);
+	g_variant_ref_sink (manifest);
+
+	g_variant_get (manifest, "(&s&sxa(sbas))", &version, &directory, &mtime, NULL);
+
+	if (g_strcmp0 (version, MODULES_MANIFEST_VERSION) != 0 ||
+	    g_strcmp0 (directory, module_directory) != 0 ||
+	    mtime != shell_get_directory_mtime (module_directory)) {
+		g_variant_unref (manifest);
+		return NULL;
+	}
+
+	return manifest;
+}
+
+static void
+shell_collect_type_cb (GType type,
+                       gpointer user_data)
+{
+	g_hash_table_add (user_data, GSIZE_TO_POINTER (type));
+}
+
+static GHashTable *
+shell_collect_module_types (void)
+{
+	GHashTable *types;
+	guint ii;
+
+	types = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	e_type_traverse (E_TYPE_EXTENSION, shell_collect_type_cb, types);
+
+	for (ii = 0; ii < G_N_ELEMENTS (eager_module_types); ii++) {
+		GType type = g_type_from_name (eager_module_types[ii]);
+
+		if (type)
+			e_type_traverse (type, shell_collect_type_cb, types);
+	}
+
+	return types;
+}
+
+/* Loads all the modules, like e_module_load_all_in_directory() does,
+ * and writes the manifest of what types each of them extends. */
+static void
+shell_load_all_modules (const gchar *module_directory)
+{
+	GVariantBuilder builder;
+	GVariant *manifest;
+	GDir *dir;
+	const gchar *basename;
+	gchar *filename, *dirname;
+	GError *error = NULL;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sbas)"));
+
+	dir = g_dir_open (module_directory, 0, NULL);
+
+	while (dir && (basename = g_dir_read_name (dir)) != NULL) {
+		GHashTable *known_types, *new_types, *extensible_types;
+		GHashTableIter iter;
+		GVariantBuilder types_builder;
+		gpointer key;
+		gboolean eager = FALSE;
+
+		if (!g_str_has_suffix (basename, "." G_MODULE_SUFFIX))
+			continue;
+
+		filename = g_build_filename (module_directory, basename, NULL);
+
+		known_types = shell_collect_module_types ();
+
+		if (!shell_load_module_file (filename, "startup")) {
+			g_hash_table_destroy (known_types);
+			g_free (filename);
+			continue;
+		}
+
+		g_free (filename);
+
+		extensible_types = g_hash_table_new (g_str_hash, g_str_equal);
+
+		/* What the module registered */
+		new_types = shell_collect_module_types ();
+
+		g_hash_table_iter_init (&iter, new_types);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			GType type = GPOINTER_TO_SIZE (key);
+			EExtensionClass *extension_class;
+
+			if (g_hash_table_contains (known_types, key))
+				continue;
+
+			if (!g_type_is_a (type, E_TYPE_EXTENSION)) {
+				eager = TRUE;
+				continue;
+			}
+
+			if (G_TYPE_IS_ABSTRACT (type))
+				continue;
+
+			extension_class = g_type_class_ref (type);
+			if (extension_class->extensible_type) {
+				g_hash_table_add (extensible_types, (gpointer) g_type_name (extension_class->extensible_type));
+
+				/* Nothing would tell when the type is initialized. */
+				if (!shell_type_adds_extensible (extension_class->extensible_type))
+					eager = TRUE;
+			}
+			g_type_class_unref (extension_class);
+		}
+
+		g_hash_table_destroy (new_types);
+		g_hash_table_destroy (known_types);
+
+		/* Nothing to wait for, the module does something else */
+		if (!g_hash_table_size (extensible_types))
+			eager = TRUE;
+
+		g_variant_builder_init (&types_builder, G_VARIANT_TYPE_STRING_ARRAY);
+
+		g_hash_table_iter_init (&iter, extensible_types);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_variant_builder_add (&types_builder, "s", key);
+		}
+
+		g_variant_builder_add (&builder, "(sbas)", basename, eager, &types_builder);
+
+		g_hash_table_destroy (extensible_types);
+	}
+
+	if (dir)
+		g_dir_close (dir);
+
+	manifest = g_variant_new (
+		"(ssxa(sbas))", MODULES_MANIFEST_VERSION, module_directory,
+		shell_get_directory_mtime (module_directory), &builder);
+	g_variant_ref_sink (manifest);
+
+	filename = shell_get_modules_manifest_filename ();
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	if (!g_file_set_contents (filename, g_variant_get_data (manifest), g_variant_get_size (manifest), &error)) {
+		g_warning ("%s: Failed to write '%s': %s", G_STRFUNC, filename, error->message);
+		g_clear_error (&error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (manifest);
+}
+
+/* Loads the modules which extend an already initialized extensible
+ * class, or which cannot wait; the rest is loaded on demand. */
+static void
+shell_load_modules_from_manifest (const gchar *module_directory,
+                                  GVariant *manifest)
+{
+	GVariantIter *iter;
+	const gchar *basename;
+	const gchar **types;
+	gboolean eager;
+
+	g_variant_get_child (manifest, 3, "a(sbas)", &iter);
+
+	while (g_variant_iter_next (iter, "(&sb^a&s)", &basename, &eager, &types)) {
+		LazyModule *lazy_module;
+		gchar *filename;
+		guint ii;
+
+		filename = g_build_filename (module_directory, basename, NULL);
+
+		for (ii = 0; !eager && types[ii]; ii++) {
+			GType type = g_type_from_name (types[ii]);
+
+			eager = type && (g_type_class_peek (type) || !shell_type_adds_extensible (type));
+		}
+
+		if (eager) {
+			shell_load_module_file (filename, "startup");
+			g_free (filename);
+			g_free (types);
+			continue;
+		}
+
+		lazy_module = g_slice_new0 (LazyModule);
+		lazy_module->filename = filename;
+		lazy_modules_pending++;
+
+		for (ii = 0; types[ii]; ii++) {
+			GSList *list;
+
+			list = g_hash_table_lookup (lazy_modules, types[ii]);
+			g_hash_table_insert (
+				lazy_modules, g_strdup (types[ii]),
+				g_slist_prepend (list, lazy_module));
+		}
+
+		g_free (types);
+	}
+
+	g_variant_iter_free (iter);
+}
+
 /**
  * e_shell_load_modules:
  * @shell: an #EShell
@@ -2101,13 +2500,20 @@ e_shell_get_default (void)
  * Loads all installed modules and performs some internal bookkeeping.
  * This function should be called after creating the #EShell instance
  * but before initiating migration or starting the main loop.
+ *
+ * The modules whose extensions are for classes not used yet are loaded
+ * only once such class is initialized.  What the modules extend is read
+ * from a manifest in the user cache directory, which is written when
+ * the content of the module directory changes.
  **/
 void
 e_shell_load_modules (EShell *shell)
 {
 	EClientCache *client_cache;
+	GVariant *manifest;
 	const gchar *module_directory;
 	GList *list;
+	gint64 start;
 
 	g_return_if_fail (E_IS_SHELL (shell));
 
@@ -2119,9 +2525,34 @@ e_shell_load_modules (EShell *shell)
 	module_directory = e_shell_get_module_directory (shell);
 	g_return_if_fail (module_directory != NULL);
 
-	list = e_module_load_all_in_directory (module_directory);
-	g_list_foreach (list, (GFunc) g_type_module_unuse, NULL);
-	g_list_free (list);
+	start = g_get_monotonic_time ();
+	modules_profile = shell->priv->startup_profile;
+
+	g_rec_mutex_lock (&lazy_modules_lock);
+
+	manifest = shell_read_modules_manifest (module_directory);
+
+	if (manifest) {
+		/* Before checking which classes are initialized already */
+		lazy_modules = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		g_type_add_interface_check (NULL, shell_extensible_check_cb);
+
+		shell_load_modules_from_manifest (module_directory, manifest);
+
+		if (!lazy_modules_pending)
+			g_idle_add (shell_free_lazy_modules_idle_cb, NULL);
+
+		g_variant_unref (manifest);
+	} else {
+		shell_load_all_modules (module_directory);
+	}
+
+	g_rec_mutex_unlock (&lazy_modules_lock);
+
+	if (modules_profile)
+		g_print (
+			"%-40s %8.2f ms\n", "Modules loaded at startup",
+			(g_get_monotonic_time () - start) / 1000.0);
 
 	/* Process shell backends. */
 
@@ -2549,6 +2980,43 @@ e_shell_get_express_mode (EShell *shell)
 	return shell->priv->express_mode;
 }
 
+/**
+ * e_shell_get_startup_profile:
+ * @shell: an #EShell
+ *
+ * Returns %TRUE if the time spent loading each module is printed.
+ *
+ * Returns: %TRUE if the module loading is profiled
+ *
+ * Since: 3.26
+ **/
+gboolean
+e_shell_get_startup_profile (EShell *shell)
+{
+	g_return_val_if_fail (E_IS_SHELL (shell), FALSE);
+
+	return shell->priv->startup_profile;
+}
+
+/**
+ * e_shell_set_startup_profile:
+ * @shell: an #EShell
+ * @startup_profile: whether to profile the module loading
+ *
+ * Sets whether e_shell_load_modules() prints the time spent loading
+ * each module, including those loaded on demand later on.
+ *
+ * Since: 3.26
+ **/
+void
+e_shell_set_startup_profile (EShell *shell,
+                             gboolean startup_profile)
+{
+	g_return_if_fail (E_IS_SHELL (shell));
+
+	shell->priv->startup_profile = startup_profile;
+}
+
 /**
  * e_shell_get_module_directory:
  * @shell: an #EShell
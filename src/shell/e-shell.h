@@ -131,6 +131,9 @@ void		e_shell_submit_alert		(EShell *shell,
 						 EAlert *alert);
 GtkWindow *     e_shell_get_active_window	(EShell *shell);
 gboolean	e_shell_get_express_mode	(EShell *shell);
+gboolean	e_shell_get_startup_profile	(EShell *shell);
+void		e_shell_set_startup_profile	(EShell *shell,
+						 gboolean startup_profile);
 const gchar *	e_shell_get_module_directory	(EShell *shell);
 gboolean	e_shell_get_network_available	(EShell *shell);
 void		e_shell_set_network_available	(EShell *shell,
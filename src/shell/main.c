@@ -97,6 +97,7 @@ static gboolean disable_eplugin = FALSE;
 static gboolean disable_preview = FALSE;
 static gboolean import_uris = FALSE;
 static gboolean quit = FALSE;
+static gboolean startup_profile = FALSE;
 
 static gchar *geometry = NULL;
 static gchar *requested_view = NULL;
@@ -336,6 +337,8 @@ static GOptionEntry entries[] = {
 	  N_("Import URIs or filenames given as rest of arguments."), NULL },
 	{ "quit", 'q', 0, G_OPTION_ARG_NONE, &quit,
 	  N_("Request a running Evolution process to quit"), NULL },
+	{ "startup-profile", '\0', 0, G_OPTION_ARG_NONE, &startup_profile,
+	  N_("Print the time spent loading each module and the plugins"), NULL },
 	{ "version", 'v', G_OPTION_FLAG_HIDDEN | G_OPTION_FLAG_NO_ARG,
 	  G_OPTION_ARG_CALLBACK, option_version_cb, NULL, NULL },
 	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY,
@@ -644,9 +647,12 @@ main (gint argc,
 	e_migrate_base_dirs (shell);
 	e_convert_local_mail (shell);
 
+	e_shell_set_startup_profile (shell, startup_profile);
 	e_shell_load_modules (shell);
 
 	if (!disable_eplugin) {
+		gint64 start = g_get_monotonic_time ();
+
 		/* Register built-in plugin hook types. */
 		g_type_ensure (E_TYPE_IMPORT_HOOK);
 		g_type_ensure (E_TYPE_PLUGIN_UI_HOOK);
@@ -654,6 +660,11 @@ main (gint argc,
 		/* All EPlugin and EPluginHook subclasses should be
 		 * registered in GType now, so load plugins now. */
 		e_plugin_load_plugins ();
+
+		if (startup_profile)
+			g_print (
+				"%-40s %8.2f ms\n", "Plugins loaded",
+				(g_get_monotonic_time () - start) / 1000.0);
 	}
 
 	/* Attempt migration -after- loading all modules and plugins,